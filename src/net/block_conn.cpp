@@ -17,6 +17,7 @@
  **********************************************/
 
 #include "block_conn.h"
+#include "unix_addr.h"
 #include "utils/log.h"
 
 #include <experimental/scope>
@@ -42,9 +43,17 @@ BlockListener::~BlockListener() {
     if (_fd >= 0) {
         close(_fd);
     }
+
+    if (_stats.ready && !_path.empty() && !isAbstractUnixPath(_path)) {
+        unlink(_path.c_str());
+    }
 }
 
 int BlockListener::init() {
+    if (!_path.empty()) {
+        return initUnix();
+    }
+
     _fd = socket(AF_INET, SOCK_STREAM, 0);
     if (_fd < 0) {
         LOG_ERROR << "Failed to create a listener socket: " << strerror(errno);
@@ -81,18 +90,59 @@ int BlockListener::init() {
     return 0;
 }
 
+int BlockListener::initUnix() {
+    sockaddr_un server_addr;
+    const socklen_t addr_len = makeUnixAddress(_path, server_addr);
+    if (addr_len == 0) {
+        return -1;
+    }
+
+    _fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_fd < 0) {
+        LOG_ERROR << "Failed to create a listener socket: " << strerror(errno);
+        return -1;
+    }
+
+    if (0 != removeStaleUnixSocket(_path)) {
+        return -1;
+    }
+
+    if (0 != bind(_fd, (struct sockaddr *)&server_addr, addr_len)) {
+        LOG_ERROR << "Failed to bind a socket: " << strerror(errno);
+        return -1;
+    }
+
+    if (0 != listen(_fd, _backlog)) {
+        LOG_ERROR << "Failed to listen on a socket: " << strerror(errno);
+        return -1;
+    }
+
+    strncpy(_stats.serverIp, _path.c_str(), sizeof(_stats.serverIp)-1);
+    _stats.ready = true;
+
+    return 0;
+}
+
 ConnectionInfoResult BlockListener::accept_connection() {
     struct sockaddr_in client_addr;
     socklen_t client_addr_len = sizeof(client_addr);
     char client_ip[INET_ADDRSTRLEN];
 
-    int client_fd = accept(_fd, (struct sockaddr *)&client_addr, &client_addr_len);
+    // UNIX peers are unnamed, the address is left alone.
+    const bool unix_socket = !_path.empty();
+    int client_fd = unix_socket ? accept(_fd, nullptr, nullptr)
+                                : accept(_fd, (struct sockaddr *)&client_addr, &client_addr_len);
     if (client_fd == -1) {
         LOG_ERROR << "Failed to accept connection: " << strerror(errno);
         _stats.failCount++;
         return {};
     }
 
+    if (unix_socket) {
+        _stats.connectCount++;
+        return ConnectionInfo { client_fd, _path, 0 };
+    }
+
     inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
     _stats.connectCount++;
 
@@ -108,6 +158,17 @@ BlockConnector::~BlockConnector() {
 }
 
 int BlockConnector::init() {
+    if (!_path.empty()) {
+        sockaddr_un addr;
+        if (makeUnixAddress(_path, addr) == 0) {
+            return -1;
+        }
+
+        strncpy(_stats.serverIp, _path.c_str(), sizeof(_stats.serverIp)-1);
+        _stats.ready = true;
+        return 0;
+    }
+
     char port_str[32];
     int n = snprintf(port_str, sizeof(port_str), "%d", _port);
     if (n < 1) {
@@ -146,6 +207,10 @@ void BlockConnector::print_resolve() const {
 }
 
 ConnectionInfoResult BlockConnector::make_connection() {
+    if (!_path.empty()) {
+        return makeUnixConnection();
+    }
+
     int fd = -1;
 
     if (-1 == (fd = socket(_addr->ai_family, _addr->ai_socktype, _addr->ai_protocol))) {
@@ -165,6 +230,32 @@ ConnectionInfoResult BlockConnector::make_connection() {
     return ConnectionInfo { fd, _stats.serverIp, _port };
 }
 
+ConnectionInfoResult BlockConnector::makeUnixConnection() {
+    sockaddr_un addr;
+    const socklen_t addr_len = makeUnixAddress(_path, addr);
+    if (addr_len == 0) {
+        _stats.failCount++;
+        return {};
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        LOG_ERROR << "Failed to create a socket: " << strerror(errno);
+        _stats.failCount++;
+        return {};
+    }
+
+    if (0 != connect(fd, (struct sockaddr *)&addr, addr_len)) {
+        LOG_ERROR << "Failed to connect: " << strerror(errno);
+        close(fd);
+        _stats.failCount++;
+        return {};
+    }
+
+    _stats.connectCount++;
+    return ConnectionInfo { fd, _path, 0 };
+}
+
 /**************************************************************
  */
 BlockConnection::~BlockConnection() {
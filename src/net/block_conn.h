@@ -39,6 +39,11 @@ struct ConnectionInfo {
 };
 using ConnectionInfoResult = std::optional<ConnectionInfo>;
 
+// A UNIX domain socket instead of host and port, '@' starts an abstract name.
+struct UnixPath {
+    std::string path;
+};
+
 /**************************************************************
  */
 class BlockConnection {
@@ -81,6 +86,9 @@ public:
     BlockConnector(const std::string& host, int port)
         : _host(host), _port(port)
     {}
+    BlockConnector(const UnixPath& path)
+        : _port(0), _path(path.path)
+    {}
     ~BlockConnector();
 
     int init();
@@ -90,8 +98,11 @@ public:
     void print_resolve() const;
 
 private:
+    ConnectionInfoResult makeUnixConnection();
+
     const std::string _host;
     const int _port;
+    const std::string _path;
     struct addrinfo *_addr_info = nullptr;
     struct addrinfo *_addr = nullptr;
     Stats _stats;
@@ -112,6 +123,9 @@ public:
     BlockListener(const std::string& iface, int port, int backlog = DefaultBacklog)
         : _iface(iface), _port(port), _backlog(backlog)
     {}
+    BlockListener(const UnixPath& path, int backlog = DefaultBacklog)
+        : _port(0), _path(path.path), _backlog(backlog)
+    {}
 
     ~BlockListener();
 
@@ -121,8 +135,11 @@ public:
     const Stats& stats() const { return _stats; }
 
 private:
+    int initUnix();
+
     const std::string _iface;
     const int _port;
+    const std::string _path;
     const int _backlog;
     int _fd = -1;
     Stats _stats;
@@ -0,0 +1,107 @@
+/**********************************************
+   File:   datagram.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "datagram.h"
+#include "proc/notification_base.h"
+#include "utils/log.h"
+#include "utils/pipe_queue.h"
+
+namespace bongo {
+
+size_t DatagramPeerHash::operator()(const DatagramPeer& peer) const {
+    // FNV-1a over the address bytes, port included.
+    const unsigned char* p = (const unsigned char*)&peer.addr;
+    uint64_t hash = 14695981039346656037ull;
+    for (socklen_t i = 0; i < peer.len; i++) {
+        hash = (hash ^ p[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/*******************************************************************************
+ *   DatagramSession
+ */
+DatagramSession::DatagramSession(NonBlockDatagram* socket, const DatagramPeer& peer)
+  : NetSession(nullptr), _socket(socket), _peer(peer) {
+}
+
+void DatagramSession::reply(const char* data, size_t size) {
+    countBytesOut(size);
+    _socket->queueReply(this, data, size);
+}
+
+void DatagramSession::onDatagram(const char* data, size_t size, uint64_t now) {
+    _lastSeen = now;
+    countBytesIn(size);
+
+    InputMessagePtr msg = new InputMessage;
+    msg->body.assign(data, data + size);
+    queueMessage(msg);
+}
+
+/*******************************************************************************
+ *   NonBlockDatagram
+ */
+NonBlockDatagram::NonBlockDatagram(NonBlockNet* parent, NonBlockName name, int fd, DatagramSessionFactoryPtr factory)
+  : NonBlockBase(std::move(name), fd, NonBlockFdType::Datagram),
+    NetSessionFactoryOwner(factory),
+    _parent(parent),
+    _factory(factory.get()) {
+}
+
+NonBlockDatagram::~NonBlockDatagram() {
+    for (auto& [peer, session]: _peers) {
+        releasePeer(session);
+    }
+}
+
+void NonBlockDatagram::releasePeer(DatagramSession* session) {
+    if (_factory->admission().maxConnections != 0) {
+        _factory->releaseConnection();
+    }
+    delete session;
+}
+
+void NonBlockDatagram::queueReply(DatagramSession* session, const char* data, size_t size) {
+    {
+        const std::lock_guard<std::mutex> lock(_mutex);
+        _replies.push_back(Reply{ .peer = session->peer(), .offset = _replyData.size(), .size = size });
+        _replyData.insert(_replyData.end(), data, data + size);
+        // The reactor flushes after every step anyway.
+        if (_flushPosted || _parent->onLoopThread()) {
+            return;
+        }
+        _flushPosted = true;
+    }
+
+    if (session->notify(NotificationType::MoreData) != 0) {
+        const std::lock_guard<std::mutex> lock(_mutex);
+        _flushPosted = false;
+    }
+}
+
+DatagramBuffers::DatagramBuffers(size_t batch, size_t datagramSize)
+  : batch(batch),
+    datagramSize(datagramSize),
+    data(batch * datagramSize),
+    msgs(batch),
+    iovs(batch),
+    addrs(batch) {
+}
+
+} // namespace bongo
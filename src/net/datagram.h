@@ -0,0 +1,145 @@
+/**********************************************
+   File:   datagram.h
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+#pragma once
+#include "nonblock_conn.h"
+#include "utils/timer_wheel.h"
+#include <mutex>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+#include <sys/socket.h>
+
+namespace bongo {
+
+class NonBlockDatagram;
+
+// The address a datagram came from, the key of its session.
+struct DatagramPeer {
+    sockaddr_storage addr;
+    socklen_t len = 0;
+
+    bool operator==(const DatagramPeer& other) const {
+        return len == other.len && memcmp(&addr, &other.addr, len) == 0;
+    }
+};
+
+struct DatagramPeerHash {
+    size_t operator()(const DatagramPeer& peer) const;
+};
+
+/*******************************************************************************
+ *   DatagramSession gets the datagrams of one peer of a UDP socket, each one
+ *   is an InputMessage with the datagram as its body. Requests of a peer are
+ *   processed in order, different peers in parallel. Responses go back with
+ *   reply(), the reactor sends the replies to all peers of the socket in
+ *   batches with sendmmsg.
+ */
+class DatagramSession : public NetSession {
+public:
+    DatagramSession(NonBlockDatagram* socket, const DatagramPeer& peer);
+
+    NonBlockDatagram* socket() const { return _socket; }
+    const DatagramPeer& peer() const { return _peer; }
+
+    // Queues a datagram to the peer. Called from sendResponse() on a worker,
+    // or from rejectRequest() on the reactor.
+    void reply(const char* data, size_t size);
+
+    // Reactor thread: a datagram arrived from the peer.
+    void onDatagram(const char* data, size_t size, uint64_t now);
+    uint64_t lastSeen() const { return _lastSeen; }
+
+protected:
+    // Datagrams come as whole messages, there is nothing to split.
+    void processReadBufferData() override {}
+
+private:
+    NonBlockDatagram* _socket;
+    DatagramPeer _peer;
+    uint64_t _lastSeen = 0;
+};
+
+/*******************************************************************************
+ *   The factory of a datagram socket makes a session for every new peer.
+ *   The settings of NetSessionFactory apply: timeouts().idleMs expires quiet
+ *   peers, admission().maxConnections caps the peers, datagrams of new peers
+ *   beyond it are dropped, admission().shedding and metrics work as for
+ *   connections.
+ */
+class DatagramSessionFactory : public NetSessionFactory {
+public:
+    NetSession* makeSession(NonBlockConnection*) final { return nullptr; }
+    virtual DatagramSession* makeDatagramSession(NonBlockDatagram* socket, const DatagramPeer& peer) = 0;
+};
+
+using DatagramSessionFactoryPtr = std::shared_ptr<DatagramSessionFactory>;
+
+/*******************************************************************************
+ *   NonBlockDatagram is a bound UDP socket of a reactor with the sessions of
+ *   its peers.
+ */
+class NonBlockDatagram : public NonBlockBase, public NetSessionFactoryOwner {
+    friend class NonBlockNet;
+public:
+    NonBlockDatagram(NonBlockNet* parent, NonBlockName name, int fd, DatagramSessionFactoryPtr factory);
+    ~NonBlockDatagram() override;
+
+    NonBlockNet* net() const { return _parent; }
+    size_t peersCount() const { return _peers.size(); }
+
+    // Any thread. The first reply a worker queues after a flush wakes the
+    // reactor up with a MoreData notification of the session.
+    void queueReply(DatagramSession* session, const char* data, size_t size);
+
+private:
+    NonBlockNet* _parent;
+    DatagramSessionFactory* _factory;
+    std::unordered_map<DatagramPeer, DatagramSession*, DatagramPeerHash> _peers;
+    Timer _idleTimer;
+
+    // Deletes the session and gives its place under the peers cap back.
+    void releasePeer(DatagramSession* session);
+
+    // Replies wait here for the reactor, their data packed in one buffer.
+    // The reactor swaps both out with the second pair, capacity is kept.
+    struct Reply {
+        DatagramPeer peer;
+        size_t offset;
+        size_t size;
+    };
+    std::mutex _mutex;
+    std::vector<Reply> _replies;
+    std::vector<char> _replyData;
+    bool _flushPosted = false;
+    std::vector<Reply> _sending;
+    std::vector<char> _sendingData;
+};
+
+// recvmmsg/sendmmsg arrays of a reactor, shared by its datagram sockets.
+struct DatagramBuffers {
+    DatagramBuffers(size_t batch, size_t datagramSize);
+
+    size_t batch;
+    size_t datagramSize;
+    std::vector<char> data;
+    std::vector<mmsghdr> msgs;
+    std::vector<iovec> iovs;
+    std::vector<sockaddr_storage> addrs;
+};
+
+} // namespace bongo
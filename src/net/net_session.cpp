@@ -19,12 +19,16 @@
 #include "net_session.h"
 #include "nonblock_conn.h"
 #include "utils/log.h"
+#include "utils/timer_wheel.h"
 #include <assert.h>
 #include <string.h>
 #include <iostream>
 
 namespace bongo {
 
+void NetSession::armTimer(Timer* timer, uint64_t delayMs) {
+    _conn->net()->timers().arm(timer, TimerWheel::clock() + delayMs);
+}
 
 } // namespace bongo
 
@@ -17,34 +17,143 @@
  **********************************************/
 
 #pragma once
-#include "utils/thread_queue.h"
 #include "utils/data_buffer.h"
 #include "proc/session_base.h"
+#include "tls.h"
 #include <memory>
 #include <queue>
 #include <mutex>
 #include <atomic>
 
+class Timer;
+
 namespace bongo {
 
 class NonBlockConnection;
+struct ProxyTarget;
 
 class NetSession;
-using SessionsQueue = ThreadQueue<SessionBase*>;
 
 class NetSession : public SessionBase {
 public:
     NetSession(NonBlockConnection* conn) : _conn(conn) {}
     virtual ~NetSession() = default;
     NonBlockConnection* connection() const { return _conn; }
+
+    // Runs the timer's callback on the reactor thread in delayMs. Call it on
+    // the reactor thread only, e.g. from onRead(). The session owns the timer.
+    void armTimer(Timer* timer, uint64_t delayMs);
+
+    // Called when the connection is closed. A session returning true has
+    // reset itself and is handed to a later connection instead of deleted.
+    virtual bool recycle() { return false; }
+    void setConnection(NonBlockConnection* conn) { _conn = conn; }
+
+    // Called on the reactor thread for a MoreData notification, before the
+    // output is written.
+    virtual void onMoreData() {}
+
+    // Called on the reactor thread before the session of a closed connection
+    // is deleted. A session returning false has a notification in flight and
+    // is deleted once it arrives.
+    virtual bool closing() { return true; }
+
 protected:
     NonBlockConnection* _conn;
 };
 
+// Connection timeouts in milliseconds. 0 turns a timeout off.
+struct NetTimeouts {
+    uint32_t idleMs = 0;       // no request in progress and nothing arrives
+    uint32_t headerMs = 0;     // a request started arriving, but isn't complete
+    uint32_t writeStallMs = 0; // output is pending, but the socket takes nothing
+};
+
+// Backpressure limits. Reading from the peer stops when more than the high
+// watermark of input messages wait for workers, or of output bytes for the
+// socket, and resumes once they are down to the low one. 0 turns a limit off.
+struct NetWatermarks {
+    size_t inputHigh = 0;
+    size_t inputLow = 0;
+    size_t outputHigh = 0;
+    size_t outputLow = 0;
+};
+
+// Admission control of a listener. Beyond maxConnections new connections
+// are reset right after accept, or, with deferAccepts, left in the listen
+// queue until one of the connections closes. The io_uring backend accepts
+// with a multishot request and always resets. shedding limits the sessions
+// queue for the requests of these connections. 0 turns a limit off.
+struct NetAdmission {
+    size_t maxConnections = 0;
+    bool deferAccepts = false;
+    LoadShedding shedding = {};
+};
+
 class NetSessionFactory {
 public:
     virtual ~NetSessionFactory() = default;
     virtual NetSession* makeSession(NonBlockConnection* conn) = 0;
+
+    // A connection started for this factory could not be established.
+    // Called on the reactor thread.
+    virtual void onConnectFailed() {}
+
+    // Connections of a factory with a target are relayed to it, see
+    // splice_proxy.h.
+    virtual const ProxyTarget* proxyTarget() const { return nullptr; }
+
+    // Defaults for every connection of the sessions made by this factory.
+    const NetTimeouts& timeouts() const { return _timeouts; }
+    void setTimeouts(const NetTimeouts& timeouts) { _timeouts = timeouts; }
+
+    // Per-session limits. NonBlockNet::setWatermarks() sets the reactor-wide ones.
+    const NetWatermarks& watermarks() const { return _watermarks; }
+    void setWatermarks(const NetWatermarks& watermarks) { _watermarks = watermarks; }
+
+    // Accounting is off until enabled, sessions made afterwards report into
+    // the returned metrics. Must be called before the listener starts.
+    SessionMetrics* enableMetrics() {
+        if (!_metrics) {
+            _metrics = std::make_unique<SessionMetrics>();
+        }
+        return _metrics.get();
+    }
+    SessionMetrics* metrics() const { return _metrics.get(); }
+
+    // Set it before listening. The connection count is shared by all reactors
+    // listening with this factory, and only kept while there is a cap.
+    const NetAdmission& admission() const { return _admission; }
+    void setAdmission(const NetAdmission& admission) { _admission = admission; }
+    size_t connectionsCount() const { return _connectionsCount.load(std::memory_order_relaxed); }
+    bool connectionsFull() const {
+        return _admission.maxConnections != 0 && connectionsCount() >= _admission.maxConnections;
+    }
+
+    // Counts a new connection in, false when the cap is reached.
+    bool admitConnection() {
+        size_t count = _connectionsCount.load(std::memory_order_relaxed);
+        while (count < _admission.maxConnections) {
+            if (_connectionsCount.compare_exchange_weak(count, count + 1, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    void releaseConnection() { _connectionsCount.fetch_sub(1, std::memory_order_relaxed); }
+
+    // Connections of this factory speak TLS. Epoll backend only. Set it
+    // before listening or connecting.
+    const TlsContextPtr& tls() const { return _tls; }
+    void setTls(TlsContextPtr tls) { _tls = std::move(tls); }
+
+private:
+    NetTimeouts _timeouts;
+    NetWatermarks _watermarks;
+    std::unique_ptr<SessionMetrics> _metrics;
+    NetAdmission _admission;
+    std::atomic<size_t> _connectionsCount = 0;
+    TlsContextPtr _tls;
 };
 
 using NetSessionFactoryPtr = std::shared_ptr<NetSessionFactory>;
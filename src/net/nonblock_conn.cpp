@@ -17,6 +17,10 @@
  **********************************************/
 
 #include "nonblock_conn.h"
+#include "datagram.h"
+#include "splice_proxy.h"
+#include "uring.h"
+#include "unix_addr.h"
 #include "proc/notification_base.h"
 #include "utils/log.h"
 
@@ -30,15 +34,65 @@
 #include <fcntl.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/errqueue.h>
+#include <sys/sendfile.h>
 #include <string.h>
 #include <netdb.h>
 #include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 
 namespace bongo {
 
 /**************************************************
  *    NonBlockNet
  */
+namespace {
+
+// sendfile() and splice() take no MSG_NOSIGNAL: writing to a socket the peer
+// reset raises SIGPIPE, and by default that kills the process. Let the call
+// fail with EPIPE instead. A handler the application set is left alone.
+void ignoreSigPipe() {
+    struct sigaction sa;
+    if (sigaction(SIGPIPE, nullptr, &sa) != 0 || sa.sa_handler != SIG_DFL) {
+        return;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_IGN;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPIPE, &sa, nullptr);
+}
+
+} // namespace
+
+socklen_t NonBlockNet::makeAddress(const NetOperation& op, sockaddr_storage& addr) {
+    memset(&addr, 0, sizeof(addr));
+    if (!op.path.empty()) {
+        return makeUnixAddress(op.path, (sockaddr_un&)addr);
+    }
+
+    sockaddr_in& in = (sockaddr_in&)addr;
+    in.sin_family = AF_INET;
+    in.sin_port = htons(op.port);
+    if (op.ip.empty() || op.ip[0] == '*') {
+        in.sin_addr.s_addr = htonl(INADDR_ANY);
+    } else {
+        in.sin_addr.s_addr = inet_addr(op.ip.c_str());
+        if (in.sin_addr.s_addr == INADDR_NONE) {
+            LOG_ERROR << "NonBlockNet::makeAddress: failed to convert IP address: " << op.ip;
+            return 0;
+        }
+    }
+
+    return sizeof(sockaddr_in);
+}
+
 NonBlockBase::~NonBlockBase() {
     if (_fd != -1) {
         LOG_TRACE << "NonBlockBase::~NonBlockBase: close fd=" << _fd;
@@ -58,24 +112,80 @@ void NonBlockBase::die() {
 /**************************************************
  *    NonBlockNet
  */
+NonBlockNet::NonBlockNet() = default;
+
 NonBlockNet::~NonBlockNet() {
     if (_fd != -1) {
         close(_fd);
     }
 
-    for (auto& nb: _sessions) {
+    // The ring releases its files asynchronously. Finish the requests first,
+    // so that sockets are really closed when the destructor returns.
+    if (_uring) {
+        uringShutdown();
+        _uring.reset();
+    }
+
+    for (auto nb: allSessions()) {
         clearSession(nb);
     }
-    _sessions.clear();
+    _table.clear();
+    _dying.clear();
+
+    for (auto conn: _freeConnections) {
+        delete conn;
+    }
+
+    for (auto& slab: _sessionSlabs) {
+        for (auto session: slab.sessions) {
+            delete session;
+        }
+    }
+}
+
+// TcpExt ListenOverflows from /proc/net/netstat, or -1 if it's not there.
+// The file has a line of names followed by a line of values per protocol.
+static long readListenOverflows() {
+    std::ifstream in("/proc/net/netstat");
+    std::string names;
+    std::string values;
+    while (std::getline(in, names) && std::getline(in, values)) {
+        if (!names.starts_with("TcpExt:")) {
+            continue;
+        }
+
+        std::istringstream namesStream(names);
+        std::istringstream valuesStream(values);
+        std::string name;
+        std::string value;
+        while (namesStream >> name && valuesStream >> value) {
+            if (name == "ListenOverflows") {
+                return strtol(value.c_str(), nullptr, 10);
+            }
+        }
+    }
+
+    return -1;
 }
 
-int NonBlockNet::init(size_t slotsCount) {
+int NonBlockNet::init(size_t slotsCount, NetBackend backend) {
     _evsvec.resize(slotsCount);
+    ignoreSigPipe();
 
-    _fd = epoll_create(slotsCount);
-    if (_fd < 0) {
-        LOG_CRITICAL << "NonBlockNet::init: failed to create epoll: " << strerror(errno);
-        return -1;
+    if (backend == NetBackend::Uring) {
+        _uring = std::make_unique<Uring>();
+        if (_uring->init(slotsCount, UringBuffersCount, UringBufferSize) != 0) {
+            LOG_WARN << "NonBlockNet::init: io_uring is not available, falling back to epoll";
+            _uring.reset();
+        }
+    }
+
+    if (!_uring) {
+        _fd = epoll_create(slotsCount);
+        if (_fd < 0) {
+            LOG_CRITICAL << "NonBlockNet::init: failed to create epoll: " << strerror(errno);
+            return -1;
+        }
     }
 
     auto [ret, err] = _notificationQueue.init();
@@ -83,40 +193,132 @@ int NonBlockNet::init(size_t slotsCount) {
         return -1;
     }
 
-    NonBlockBase* nb = new NonBlockBase("PipeQueue", _notificationQueue.getReadFd(), NonBlockFdType::PipeQueue);
+    NonBlockBase* nb = new NonBlockBase(std::make_shared<const std::string>("PipeQueue"), _notificationQueue.getReadFd(), NonBlockFdType::PipeQueue);
     ret = registerFd(_notificationQueue.getReadFd(), NetOpType::Read, nb);
     if (ret != 0) {
-        LOG_ERROR << "onBlockNet::init: failed register pipe fd";
+        LOG_ERROR << "onBlockNet::init: failed register notification fd";
         delete nb;
         return -1;
     }
 
+    _acceptStatsTime = std::chrono::steady_clock::now();
+    _listenOverflowsBase = readListenOverflows();
+
     _stats.ready = true;
     _keepRunning.store(true);
 
     return 0;
 }
 
+template<typename T>
+static void erasePaused(std::vector<T*>& paused, T* nb) {
+    auto it = std::find(paused.begin(), paused.end(), nb);
+    assert(it != paused.end());
+    *it = paused.back();
+    paused.pop_back();
+}
+
 void NonBlockNet::deleteSession(NonBlockBase* nb) {
-    assert(_sessions.find(nb) != _sessions.end());
+    assert(nb->dead() || findSession(nb->_slot) == nb);
     assert(_stats.count() == sessionsCount());
 
+    // io_uring requests hold the socket. Cancel them while the fd is still open.
+    if (_uring && nb->pending() > 0 && nb->fd() != -1) {
+        uringCancel(nb);
+    }
+
     if (nb->type() == NonBlockFdType::Connection) {
         NonBlockConnection* conn = static_cast<NonBlockConnection*>(nb);
+        forgetBackpressure(conn);
+
+        // A relayed pair goes down together.
+        if (NonBlockConnection* peer = conn->_splicePeer) {
+            conn->_splicePeer = nullptr;
+            peer->_splicePeer = nullptr;
+            deleteSession(peer);
+        }
+
+        // flushDeferred() may be walking the list, leave a hole.
+        if (conn->_writeDeferred) {
+            conn->_writeDeferred = false;
+            *std::find(_deferredWrites.begin(), _deferredWrites.end(), conn) = nullptr;
+        }
+
         NetSession* session = conn->session();
         switch (session->state()) {
             case SessionState::Released:
+                if (!session->closing()) {
+                    killSession(nb);
+                    return;
+                }
                 break; // keep going, let's remove this connection.
             default:
-                nb->die();
+                killSession(nb);
                 return; // we cannot delete connection when a session in this state.
         }
     }
 
-    _sessions.erase(nb);
+    if (nb->type() == NonBlockFdType::Listener) {
+        NonBlockListener* listener = static_cast<NonBlockListener*>(nb);
+        if (listener->_acceptDeferred) {
+            listener->_acceptDeferred = false;
+            erasePaused(_deferredListeners, listener);
+        }
+    }
+
+    // Deleted when the last io_uring completion for it arrives.
+    if (nb->pending() > 0) {
+        killSession(nb);
+        return;
+    }
+
+    removeSession(nb);
     clearSession(nb);
 }
 
+void NonBlockNet::killSession(NonBlockBase* nb) {
+    if (nb->dead()) {
+        return;
+    }
+
+    // The fd gets closed, the next accept may reuse its number.
+    _table[nb->_slot] = nullptr;
+    if (nb->type() == NonBlockFdType::Connection) {
+        static_cast<NonBlockConnection*>(nb)->abortZeroCopy();
+    }
+    nb->die();
+    _dying.push_back(nb);
+}
+
+void NonBlockNet::removeSession(NonBlockBase* nb) {
+    if (nb->dead()) {
+        auto it = std::find(_dying.begin(), _dying.end(), nb);
+        assert(it != _dying.end());
+        *it = _dying.back();
+        _dying.pop_back();
+    } else {
+        _table[nb->_slot] = nullptr;
+    }
+
+    nb->_slot = -1;
+    _sessionsCount--;
+}
+
+NonBlockBase* NonBlockNet::findSession(int fd) const {
+    return (fd >= 0 && (size_t)fd < _table.size()) ? _table[fd] : nullptr;
+}
+
+std::vector<NonBlockBase*> NonBlockNet::allSessions() const {
+    std::vector<NonBlockBase*> result(_dying);
+    for (auto nb: _table) {
+        if (nb != nullptr) {
+            result.push_back(nb);
+        }
+    }
+
+    return result;
+}
+
 void NonBlockNet::clearSession(NonBlockBase* nb) {
     if (nb == nullptr) {
         return;
@@ -127,6 +329,19 @@ void NonBlockNet::clearSession(NonBlockBase* nb) {
         case NonBlockFdType::Connector: _stats.connectorsCount--; break;
         case NonBlockFdType::Listener: _stats.listenersCount--; break;
         case NonBlockFdType::PipeQueue: _stats.pipesCount--; break;
+        case NonBlockFdType::Datagram: _stats.datagramsCount--; break;
+    }
+
+    if (nb->type() == NonBlockFdType::Datagram) {
+        auto it = std::find(_datagrams.begin(), _datagrams.end(), nb);
+        if (it != _datagrams.end()) {
+            _datagrams.erase(it);
+        }
+    }
+
+    if (nb->type() == NonBlockFdType::Connection) {
+        freeConnection(static_cast<NonBlockConnection*>(nb));
+        return;
     }
 
     delete nb;
@@ -140,12 +355,99 @@ void NonBlockNet::addSession(NonBlockBase* nb) {
         case NonBlockFdType::Connector: _stats.connectorsCount++; break;
         case NonBlockFdType::Listener: _stats.listenersCount++; break;
         case NonBlockFdType::PipeQueue: _stats.pipesCount++; break;
+        case NonBlockFdType::Datagram: _stats.datagramsCount++; break;
+    }
+
+    const size_t slot = nb->fd();
+    if (slot >= _table.size()) {
+        _table.resize(std::max(slot + 1, _table.size() * 2), nullptr);
     }
 
-    _sessions.insert(nb);
+    assert(_table[slot] == nullptr);
+    _table[slot] = nb;
+    nb->_slot = slot;
+    _sessionsCount++;
     assert(_stats.count() == sessionsCount());
 }
 
+NonBlockConnection* NonBlockNet::makeConnection(NonBlockName name, int fd, bool noDelay) {
+    NonBlockConnection* conn = nullptr;
+    if (_freeConnections.empty()) {
+        conn = new NonBlockConnection(this, std::move(name), fd);
+    } else {
+        conn = _freeConnections.back();
+        _freeConnections.pop_back();
+        conn->reuse(std::move(name), fd);
+    }
+
+    // Without it the connection still works, only with Nagle.
+    int one = 1;
+    if (noDelay && setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) != 0) {
+        LOG_WARN << "NonBlockNet::makeConnection: failed to set TCP_NODELAY for " << conn->name() << ": " << strerror(errno);
+    }
+
+    if (_busyPoll.socketUs != 0) {
+        setBusyPoll(conn);
+    }
+    return conn;
+}
+
+void NonBlockNet::freeConnection(NonBlockConnection* connection) {
+    if (connection->_admittedBy) {
+        connection->_admittedBy->releaseConnection();
+        connection->_admittedBy.reset();
+    }
+
+    if (!_recycling) {
+        delete connection;
+        return;
+    }
+
+    NetSession* session = connection->_session;
+    connection->_session = nullptr;
+    if (session != nullptr) {
+        freeSession(session, connection->_factory);
+    }
+
+    connection->reset();
+    _freeConnections.push_back(connection);
+}
+
+NetSession* NonBlockNet::makeSession(const NetSessionFactoryPtr& factory, NonBlockConnection* connection) {
+    // A few factories per reactor, a linear search is the fastest.
+    auto slab = std::find_if(_sessionSlabs.begin(), _sessionSlabs.end(), [&](const auto& s) { return s.factory == factory; });
+    if (slab == _sessionSlabs.end()) {
+        if (_recycling) {
+            _sessionSlabs.push_back(SessionSlab{ .factory = factory, .sessions = {} });
+        }
+    } else if (!slab->sessions.empty()) {
+        NetSession* session = slab->sessions.back();
+        slab->sessions.pop_back();
+        session->setConnection(connection);
+        return session;
+    }
+
+    return factory->makeSession(connection);
+}
+
+void NonBlockNet::freeSession(NetSession* session, NetSessionFactory* factory) {
+    if (!session->recycle()) {
+        delete session;
+        return;
+    }
+
+    // Slabs keep their factories alive, so a pointer is never reused by
+    // another factory while its sessions wait here.
+    for (auto& slab: _sessionSlabs) {
+        if (slab.factory.get() == factory) {
+            slab.sessions.push_back(session);
+            return;
+        }
+    }
+
+    delete session;
+}
+
 int NonBlockNet::setNonBlocking(int fd) {
     if (0 != fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK)) {
         LOG_ERROR << "NonBlockNet::setNonBlocking: failed to set non-blocking socket: " << strerror(errno);
@@ -156,20 +458,42 @@ int NonBlockNet::setNonBlocking(int fd) {
     return 0;
 }
 
+uint32_t NonBlockNet::epollEvents(NetOpType opType, NonBlockBase* nb) const {
+    // Connections are registered once for both directions. Reading and writing
+    // then progress independently, without epoll_ctl() on every response.
+    if (nb->type() == NonBlockFdType::Connection) {
+        const bool paused = static_cast<NonBlockConnection*>(nb)->_readPaused;
+        return (paused ? 0u : (uint32_t)EPOLLIN) | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+    }
+
+    return (opType == NetOpType::Read) ? EPOLLIN : (EPOLLOUT | EPOLLET);
+}
+
 int NonBlockNet::registerFd(int fd, NetOpType opType, NonBlockBase* nb) {
-    LOG_TRACE << "NonBlockNet::registerFd: fd=" << fd << "  " 
-              << ((opType == NetOpType::Read) ? "EPOLLIN" : "(EPOLLOUT | EPOLLET)");
+    LOG_TRACE << "NonBlockNet::registerFd: fd=" << fd << " events=" << epollEvents(opType, nb);
 
-    int ret = setNonBlocking(fd);
-    if (ret != 0) {
-        return -1;
+    // All fds come here non-blocking already: sockets are created and
+    // accepted with SOCK_NONBLOCK.
+    int ret = 0;
+    if (_uring) {
+        ret = uringArm(nb);
+        if (ret != 0) {
+            LOG_ERROR << "NonBlockNet::registerFd: failed to arm io_uring request";
+            return -1;
+        }
+
+        addSession(nb);
+        return 0;
     }
 
-    int flags = (opType == NetOpType::Read) ? EPOLLIN : (EPOLLOUT | EPOLLET);
+    // A killed object's fd may be reused before its events of this batch
+    // are handled, they carry the old generation.
+    nb->_generation = ++_generation;
 
     epoll_event ev;
-    ev.data.ptr = nb;
-    ev.events = /*EPOLLRDHUP |*/ flags;
+    ev.data.u64 = eventKey(nb);
+    ev.events = epollEvents(opType, nb);
+    _stats.epollCtlCount++;
     ret = epoll_ctl(_fd, EPOLL_CTL_ADD, fd, &ev);
     if (ret) {
         LOG_ERROR << "NonBlockNet::registerFd: failed to add epoll event: " << strerror(errno);
@@ -181,22 +505,25 @@ int NonBlockNet::registerFd(int fd, NetOpType opType, NonBlockBase* nb) {
 }
 
 int NonBlockNet::modifyFd(int fd, NetOpType opType, NonBlockBase* nb) {
-    LOG_TRACE << "NonBlockNet::modifyFd: fd=" << fd << "  " 
-              << ((opType == NetOpType::Read) ? "EPOLLIN" : "(EPOLLOUT | EPOLLET)");
+    LOG_TRACE << "NonBlockNet::modifyFd: fd=" << fd << " events=" << epollEvents(opType, nb);
     assert(nb->type() == NonBlockFdType::Connection);
 
-    int flags = (opType == NetOpType::Read) ? EPOLLIN : (EPOLLOUT | EPOLLET);
+    // Receiving is always armed with io_uring, writes are submitted explicitly.
+    if (_uring) {
+        NonBlockConnection* conn = static_cast<NonBlockConnection*>(nb);
+        return conn->_receiving ? 0 : uringArm(nb);
+    }
 
     epoll_event ev;
-    ev.data.ptr = nb; 
-    ev.events = /*EPOLLRDHUP |*/ flags;
+    ev.data.u64 = eventKey(nb);
+    ev.events = epollEvents(opType, nb);
+    _stats.epollCtlCount++;
     int ret = epoll_ctl(_fd, EPOLL_CTL_MOD, fd, &ev);
     if (ret) {
         LOG_ERROR << "NonBlockNet::modifyFd: failed to modify epoll event: " << strerror(errno);
         return -1;
     }   
 
-    LOG_TRACE << "NonBlockNet::modifyFd: type " << ((opType == NetOpType::Read) ? "EPOLLIN" : "EPOLLOUT");
     assert(_stats.count() == sessionsCount());
     return 0;
 }
@@ -204,6 +531,7 @@ int NonBlockNet::modifyFd(int fd, NetOpType opType, NonBlockBase* nb) {
 void NonBlockNet::unregisterFd(int fd) {
     epoll_event ev;
     bzero(&ev, sizeof(ev));
+    _stats.epollCtlCount++;
     int ret = epoll_ctl(_fd, EPOLL_CTL_DEL, fd, &ev);
     if (ret) {
         LOG_ERROR << "NonBlockNet::unregisterFd: failed to unregister epoll event: " << strerror(errno);
@@ -228,7 +556,13 @@ int NonBlockNet::startListen(const NetOperation& op) {
         }
     });
 
-    fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_storage bindaddr;
+    const socklen_t addrlen = makeAddress(op, bindaddr);
+    if (addrlen == 0) {
+        return result;
+    }
+
+    fd = socket(bindaddr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (fd < 0) {
         LOG_ERROR << "NonBlockNet::startListen: failed to create socket: " << strerror(errno);
         return result;
@@ -241,20 +575,20 @@ int NonBlockNet::startListen(const NetOperation& op) {
         return result;
     }
 
-    sockaddr_in bindaddr;
-    bindaddr.sin_family= AF_INET;
-    bindaddr.sin_port = htons(op.port);
-    if (op.ip.empty() || op.ip[0] == '*') {
-        bindaddr.sin_addr.s_addr = htonl(INADDR_ANY);
-    } else {
-        bindaddr.sin_addr.s_addr = inet_addr(op.ip.c_str()); 
-        if (bindaddr.sin_addr.s_addr == INADDR_NONE) {
-            LOG_ERROR << "NonBlockNet::startListen: failed to convert IP address: " << op.ip;
+    // A UNIX socket file outlives its listener, bind fails until it's removed.
+    if (!op.path.empty() && removeStaleUnixSocket(op.path) != 0) {
+        return result;
+    }
+
+    if (op.reusePort && op.path.empty()) {
+        ret = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        if (ret != 0) {
+            LOG_ERROR << "NonBlockNet::startListen: failed to set socket port reusable: " << strerror(errno);
             return result;
-        }   
+        }
     }
 
-    ret = bind(fd, (struct sockaddr *) &bindaddr, sizeof(struct sockaddr_in));
+    ret = bind(fd, (struct sockaddr *) &bindaddr, addrlen);
     if (ret != 0) {
         LOG_ERROR << "NonBlockNet::startListen: failed to bind: " << strerror(errno);
         return result;
@@ -266,7 +600,9 @@ int NonBlockNet::startListen(const NetOperation& op) {
         return result;
     }
 
-    nb = new NonBlockListener(op.name, fd, op.factory);
+    NonBlockListener* listener = new NonBlockListener(std::make_shared<const std::string>(op.name), fd, op.factory);
+    listener->_noDelay = op.noDelay && op.path.empty();
+    nb = listener;
     ret = registerFd(fd, NetOpType::Read, nb);
     if (ret != 0) {
         LOG_ERROR << "NonBlockNet::startListen: failed to register";
@@ -292,24 +628,21 @@ int NonBlockNet::startConnect(const NetOperation& op) {
         }
     });
 
-    fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (fd < 0) {
-        LOG_ERROR << "NonBlockNet::startConnect: failed create socket: " << strerror(errno);
+    sockaddr_storage sa;
+    const socklen_t addrlen = makeAddress(op, sa);
+    if (addrlen == 0) {
         return result;
     }
 
-    int ret = setNonBlocking(fd);
-    if (ret != 0) {
+    fd = socket(sa.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR << "NonBlockNet::startConnect: failed create socket: " << strerror(errno);
         return result;
     }
 
-    struct sockaddr_in sa;
-    memset(&sa, 0, sizeof(sa));
-    sa.sin_family = AF_INET;
-    sa.sin_port = htons(op.port);
-    sa.sin_addr.s_addr = inet_addr(op.ip.c_str()); 
-
-    ret = connect(fd, (struct sockaddr*)&sa, sizeof(sa));
+    // A UNIX socket either connects right away or fails with EAGAIN when the
+    // listener backlog is full.
+    int ret = connect(fd, (struct sockaddr*)&sa, addrlen);
     if (ret == 0) {
         LOG_TRACE << "NonBlockNet::startConnect: connection ready.";
         ret = on_connect(fd, op);
@@ -323,7 +656,9 @@ int NonBlockNet::startConnect(const NetOperation& op) {
         }
 
         LOG_TRACE << "NonBlockNet::startConnect: register fd.";
-        nb = new NonBlockConnector(op.name, fd, op.factory);
+        NonBlockConnector* connector = new NonBlockConnector(std::make_shared<const std::string>(op.name), fd, op.factory);
+        connector->_noDelay = op.noDelay && op.path.empty();
+        nb = connector;
         ret = registerFd(fd, NetOpType::Write, nb);
         if (ret != 0) {
             LOG_ERROR << "NonBlockNet::startConnect: failed to register";
@@ -336,44 +671,158 @@ int NonBlockNet::startConnect(const NetOperation& op) {
 }
 
 void NonBlockNet::on_accept(NonBlockListener* listener) {
+    const NetSessionFactoryPtr factory = listener->factory();
+
     while (_keepRunning.load()) {
-        struct sockaddr_in client_addr;
-        socklen_t client_addr_len = sizeof(client_addr);
-    
-        int fd = accept(listener->fd(), (struct sockaddr *)&client_addr, &client_addr_len);
+        // Listeners are level-triggered: what is left in the queue is reported
+        // again by the next epoll_wait(), after the other events get their turn.
+        if (_acceptBudget != 0 && _acceptsLeft == 0) {
+            _stats.acceptCapHitsCount++;
+            break;
+        }
+
+        // Or, over the connection cap, when a connection closes.
+        if (factory->admission().deferAccepts && factory->connectionsFull()) {
+            deferAccepting(listener);
+            break;
+        }
+
+        int fd = accept4(listener->fd(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (fd == -1 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
             break;
         }
 
+        if (fd == -1 && (errno == ECONNABORTED || errno == EINTR)) {
+            continue;
+        }
+
         if (fd == -1) {
             LOG_ERROR << "NonBlockNet::on_accept: failed to accept connection: " << strerror(errno);
             deleteSession(listener);
             return;
         }
 
-        NonBlockConnection* nb = new NonBlockConnection(this, listener->name(), fd);
-        int ret = nb->setSession(listener->factory());
-        if (ret != 0) {
-            LOG_ERROR << "NonBlockNet::on_accept: failed to set session for connection " << listener->name();
-            close(fd);
-            delete nb;
-            return;
+        if (_acceptsLeft > 0) {
+            _acceptsLeft--;
         }
 
-        ret = registerFd(fd, NetOpType::Read, nb);
-        if (ret != 0) {
-            LOG_ERROR << "NonBlockNet::on_accept: failed to register connection";
-            clearSession(nb);
+        if (!admitConnection(listener, fd)) {
+            continue;
+        }
+
+        // No read here. The new fd is added to epoll with its data already
+        // pending, so the first read comes with the next epoll_wait().
+        NonBlockConnection* nb = acceptConnection(listener, fd);
+        if (nb == nullptr) {
             return;
         }
+    }
+}
+
+bool NonBlockNet::admitConnection(NonBlockListener* listener, int fd) {
+    NetSessionFactory* factory = listener->factory().get();
+    if (factory->admission().maxConnections == 0 || factory->admitConnection()) {
+        return true;
+    }
+
+    // A reset tells the client at once, a connection nobody reads doesn't.
+    linger lg{ .l_onoff = 1, .l_linger = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    close(fd);
+    _stats.connectionsRejectedCount++;
+    LOG_TRACE << "NonBlockNet::admitConnection: over the cap of " << listener->name();
+    return false;
+}
+
+void NonBlockNet::deferAccepting(NonBlockListener* listener) {
+    epoll_event ev;
+    ev.data.u64 = eventKey(listener);
+    ev.events = 0;
+    _stats.epollCtlCount++;
+    int ret = epoll_ctl(_fd, EPOLL_CTL_MOD, listener->fd(), &ev);
+    if (ret) {
+        LOG_ERROR << "NonBlockNet::deferAccepting: failed to modify epoll event: " << strerror(errno);
+        return;
+    }
+
+    listener->_acceptDeferred = true;
+    _deferredListeners.push_back(listener);
+    _stats.acceptDeferredCount++;
+}
+
+void NonBlockNet::resumeAccepting() {
+    // The count is shared with other reactors, their closes are seen here too.
+    for (size_t i = 0; i < _deferredListeners.size();) {
+        NonBlockListener* listener = _deferredListeners[i];
+        if (listener->factory()->connectionsFull()) {
+            i++;
+            continue;
+        }
+
+        epoll_event ev;
+        ev.data.u64 = eventKey(listener);
+        ev.events = epollEvents(NetOpType::Read, listener);
+        _stats.epollCtlCount++;
+        int ret = epoll_ctl(_fd, EPOLL_CTL_MOD, listener->fd(), &ev);
+        if (ret) {
+            LOG_ERROR << "NonBlockNet::resumeAccepting: failed to modify epoll event: " << strerror(errno);
+        }
+
+        listener->_acceptDeferred = false;
+        _deferredListeners[i] = _deferredListeners.back();
+        _deferredListeners.pop_back();
+    }
+}
+
+void NonBlockNet::updateAcceptStats() {
+    const auto now = std::chrono::steady_clock::now();
+    const auto elapsed = now - _acceptStatsTime;
+    if (elapsed < AcceptStatsInterval) {
+        return;
+    }
+
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    _stats.acceptRate = (_stats.acceptedCount - _acceptStatsCount) / seconds;
+    _acceptStatsCount = _stats.acceptedCount;
+    _acceptStatsTime = now;
+
+    if (_stats.listenersCount > 0 && _listenOverflowsBase >= 0) {
+        const long overflows = readListenOverflows();
+        if (overflows >= _listenOverflowsBase) {
+            _stats.listenOverflowsCount = overflows - _listenOverflowsBase;
+        }
+    }
+}
+
+NonBlockConnection* NonBlockNet::acceptConnection(NonBlockListener* listener, int fd) {
+    NonBlockConnection* nb = makeConnection(listener->nameRef(), fd, listener->_noDelay);
+    if (listener->factory()->admission().maxConnections != 0) {
+        nb->_admittedBy = listener->factory();
+    }
 
-        // Pass a write side of the pipe to the session, so processors will be able
-        // to send messages back to this instance.
-        nb->session()->setPipe(_notificationQueue.getWriteFd());
+    int ret = nb->setSession(listener->factory());
+    if (ret != 0) {
+        LOG_ERROR << "NonBlockNet::on_accept: failed to set session for connection " << listener->name();
+        freeConnection(nb);
+        return nullptr;
+    }
 
-        LOG_TRACE << "NonBlockNet::on_accept: accepted new connection for " << nb->name();
-        onRead(nb);
+    ret = registerFd(fd, NetOpType::Read, nb);
+    if (ret != 0) {
+        LOG_ERROR << "NonBlockNet::on_accept: failed to register connection";
+        freeConnection(nb);
+        return nullptr;
     }
+
+    // Pass a write side of the pipe to the session, so processors will be able
+    // to send messages back to this instance.
+    nb->session()->setNotificationQueue(&_notificationQueue);
+    nb->session()->setReadyBatch(&_readySessions);
+
+    _stats.acceptedCount++;
+    armReadTimer(nb);
+    LOG_TRACE << "NonBlockNet::on_accept: accepted new connection for " << nb->name();
+    return nb;
 }
 
 void NonBlockNet::on_connect(NonBlockConnector* connector) {
@@ -384,6 +833,8 @@ void NonBlockNet::on_connect(NonBlockConnector* connector) {
         if (connector != nullptr) {
             if (result) {
                 connector->releaseFd();
+            } else {
+                connector->factory()->onConnectFailed();
             }
 
             deleteSession(connector);
@@ -393,44 +844,55 @@ void NonBlockNet::on_connect(NonBlockConnector* connector) {
 
     auto cleanup_on_exit = std::experimental::scope_exit(cleanup);
 
-    NonBlockConnection* nb = new NonBlockConnection(this, connector->name(), connector->fd());
+    // The fd stays with the connector until the connection takes over.
+    NonBlockConnection* nb = makeConnection(connector->nameRef(), connector->fd(), connector->_noDelay);
     int ret = nb->setSession(connector->factory());
     if (ret != 0) {
         LOG_ERROR << "NonBlockNet::on_accept: failed to set session for connection " << connector->name();
-        clearSession(nb);
+        nb->releaseFd();
+        freeConnection(nb);
         return;
     }
 
+    // The connector's events left in this batch are not for the connection.
+    nb->_generation = ++_generation;
     ret = modifyFd(nb->fd(), NetOpType::Write, nb);
     if (ret != 0) {
         LOG_ERROR << "NonBlockNet::on_connect: failed to modify fd";
-        clearSession(nb);
+        nb->releaseFd();
+        freeConnection(nb);
         return;
     }
 
     result = true;
     cleanup();
     addSession(nb);
+    _stats.connectedCount++;
+    armReadTimer(nb);
     onWrite(nb);
 }
 
 int NonBlockNet::on_connect(int fd, const NetOperation& op) {
-    NonBlockConnection* nb = new NonBlockConnection(this, op.name, fd);
+    // On failure the caller closes the fd.
+    NonBlockConnection* nb = makeConnection(std::make_shared<const std::string>(op.name), fd, op.noDelay && op.path.empty());
     int ret = nb->setSession(op.factory);
     if (ret != 0) {
         LOG_ERROR << "NonBlockNet::on_connect: failed to set session for connection " << op.name;
-        close(fd);
-        delete nb;
+        nb->releaseFd();
+        freeConnection(nb);
         return -1;
     }
 
     ret = registerFd(nb->fd(), NetOpType::Write, nb);
     if (ret != 0) {
         LOG_ERROR << "NonBlockNet::on_connect: failed to register fd";
-        clearSession(nb);
+        nb->releaseFd();
+        freeConnection(nb);
         return -1;
     }
 
+    _stats.connectedCount++;
+    armReadTimer(nb);
     onWrite(nb);
 
     return 0;
@@ -441,9 +903,15 @@ void NonBlockNet::onRead(NonBlockConnection* connection) {
 
     NetSession* session = connection->session();
     size_t size = 1024; //session->getSize();
+    bool received = false;
 
-    while (_keepRunning.load()) {
-        Buffer buf = session->getReadBuffer(size);
+    char records[TlsLayer::RecordSize];
+    size_t fullReads = 0;
+
+    while (_keepRunning.load() && !connection->_peerClosed) {
+        // TLS records are read aside, their plaintext goes to the session.
+        TlsLayer* tls = connection->tlsReading();
+        Buffer buf = tls ? Buffer{records, sizeof(records)} : session->getReadBuffer(size);
         int ret = read(connection->fd(), buf.ptr, buf.size);
     
         // Interrupted by signal. Try again.
@@ -459,51 +927,193 @@ void NonBlockNet::onRead(NonBlockConnection* connection) {
             return;
         }
 
-        if (ret <= 0) {
+        if (ret < 0) {
             LOG_TRACE << "NonBlockNet::onRead no more data " << connection->name();
+            connection->_readable = false;
+            break;
+        }
+
+        // The peer finished sending. The connection stays for writing.
+        if (ret == 0) {
+            LOG_TRACE << "NonBlockNet::onRead peer closed " << connection->name();
+            connection->_readable = false;
+            connection->_peerClosed = true;
             break;
         }
 
         size_t sz = (size_t)ret;
-        session->updateReadBuffer(sz);
+        if (tls != nullptr) {
+            if (!tlsDecrypt(connection, buf.ptr, sz)) {
+                return;
+            }
+        } else {
+            session->updateReadBuffer(sz);
+            session->countBytesIn(sz);
+        }
+        received = true;
         LOG_TRACE << "NonBlockNet::onRead received " << sz << " Bytes " << connection->name();
 
         // If operation found data to fill the whole buffer, it means
         // there may be more data. Keep reading.
         if (sz == buf.size) {
             LOG_TRACE << "NonBlockNet::onRead completed buffer " << connection->name();
+
+            // A fast peer keeps the buffer full. Every so many reads the
+            // input goes to the session and the watermarks are checked:
+            // reading stops once they pause it, the rest waits in the socket.
+            if (++fullReads % ReadsPerBackpressureCheck == 0) {
+                const int fd = connection->fd();
+                if (processInput(session) != 0) {
+                    LOG_TRACE << "NonBlockNet::onRead: finish connection: " << connection->name();
+                    finishSession(connection);
+                    return;
+                }
+
+                checkBackpressure(connection);
+                if (findSession(fd) != connection) {
+                    return;
+                }
+                if (connection->_readPaused) {
+                    break;
+                }
+            }
+            continue;
+        }
+
+        // A short read drains the socket, whatever arrives later raises a new
+        // edge. Not the FIN though: its edge may have come with these bytes,
+        // read on until the EOF.
+        if (connection->_peerClosing) {
             continue;
         }
 
         // Now we completed reading all data. Start processing.
+        connection->_readable = false;
         break;
     }
 
     LOG_TRACE << "NonBlockNet::onRead finished reading " << connection->name();
-    int ret = session->onRead(_queue);
+    int ret = processInput(session);
     if (ret != 0) {
         LOG_TRACE << "NonBlockNet::onRead: finish connection: " << connection->name();
-        deleteSession(connection);
+        finishSession(connection);
+        return;
+    }
+
+    if (!flushReleased(connection)) {
+        return;
+    }
+
+    if (closeIfDone(connection)) {
+        return;
+    }
+
+    if (received) {
+        armReadTimer(connection);
+    }
+
+    checkBackpressure(connection);
+}
+
+int NonBlockNet::processInput(NetSession* session) {
+    // Only the reactor queues messages, the session's count is ours to read.
+    const uint64_t requests = session->counters().requests.load(std::memory_order_relaxed);
+    const int ret = session->onRead(_queue);
+    _stats.requestsCount += session->counters().requests.load(std::memory_order_relaxed) - requests;
+    return ret;
+}
+
+bool NonBlockNet::flushReleased(NonBlockConnection* connection) {
+    // Output of a session no worker has, e.g. refusals of shed requests. No
+    // SessionReleased is coming to write it.
+    NetSession* session = connection->session();
+    if (session->state() != SessionState::Released || session->output().empty()) {
+        return true;
+    }
+
+    // A full socket gets written on EPOLLOUT.
+    if (!_uring && !connection->_writable) {
+        return true;
     }
+
+    const int fd = connection->fd();
+    onWrite(connection);
+    return findSession(fd) == connection;
 }
 
 void NonBlockNet::onWrite(NonBlockConnection* connection) {
     LOG_TRACE << "NonBlockNet::onWrite for " << connection->name();
 
+    if (_uring) {
+        uringWrite(connection);
+        return;
+    }
+
     NetSession* session = connection->session();
+    OutputChain& output = session->output();
+    iovec iov[IOV_MAX];
+    bool progress = false;
+    TlsLayer* tls = connection->tlsWriting();
 
     while (_keepRunning.load()) {
-        Buffer buf = session->getDataForWriting();
-        if (buf.size == 0) {
+        // The output is encrypted a few records at a time, as the socket
+        // takes the previous ones.
+        if (tls != nullptr && tls->pendingSize() == 0) {
+            ssize_t plain = tls->encrypt(session);
+            if (plain < 0) {
+                LOG_TRACE << "NonBlockNet::onWrite: TLS failed for " << connection->name();
+                deleteSession(connection);
+                return;
+            }
+            session->countBytesOut(plain);
+        }
+
+        if (tls != nullptr ? tls->pendingSize() == 0 : output.empty()) {
             LOG_TRACE << "NonBlockNet::onWrite no data " << connection->name();
             break;
         }
 
-        LOG_TRACE << "NonBlockNet::onWrite: buffer size " << buf.size;
-        int ret = send(connection->fd(), buf.ptr, buf.size, MSG_NOSIGNAL);
-        if (ret < 0 && errno == EINTR) {
-            LOG_TRACE << "NonBlockNet::onWrite: interrupt";
-            continue;
+        bool zeroCopy = false;
+        ssize_t ret = -1;
+
+        if (tls != nullptr) {
+            ret = send(connection->fd(), tls->pendingData(), tls->pendingSize(), MSG_NOSIGNAL);
+        } else if (auto file = output.frontFile()) {
+            LOG_TRACE << "NonBlockNet::onWrite: sending " << file->size << " Bytes of a file";
+            off_t offset = file->offset;
+            ret = sendfile(connection->fd(), file->fd, &offset, file->size);
+        } else {
+            msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = output.fill(iov, IOV_MAX);
+
+            size_t bytes = 0;
+            for (size_t i = 0; i < msg.msg_iovlen; i++) {
+                bytes += iov[i].iov_len;
+            }
+
+            // A file follows, let its first bytes share the packet with the header.
+            int flags = MSG_NOSIGNAL;
+            if (bytes < output.size()) {
+                flags |= MSG_MORE;
+            }
+
+            zeroCopy = useZeroCopy(connection, bytes);
+
+            LOG_TRACE << "NonBlockNet::onWrite: sending " << bytes << " Bytes in " << msg.msg_iovlen << " segments";
+            ret = sendmsg(connection->fd(), &msg, flags | (zeroCopy ? MSG_ZEROCOPY : 0));
+
+            // Out of option memory for zero-copy notifications. Send a copy instead.
+            if (ret < 0 && errno == ENOBUFS && zeroCopy) {
+                zeroCopy = false;
+                ret = sendmsg(connection->fd(), &msg, flags);
+            }
+        }
+
+        if (ret < 0 && errno == EINTR) {
+            LOG_TRACE << "NonBlockNet::onWrite: interrupt";
+            continue;
         }
 
         // Failed connection. Remove the connection.
@@ -513,33 +1123,43 @@ void NonBlockNet::onWrite(NonBlockConnection* connection) {
             return;
         }
 
-        // Switch to writing mode. If needed.
+        // The socket buffer is full. EPOLLOUT brings us back when it drains.
         if (ret < 0) {
-            LOG_TRACE << "NonBlockNet::onWrite modify fd to write " << connection->name();
-            ret = modifyFd(connection->fd(), NetOpType::Write, connection);
-            if (ret != 0) {
-                LOG_TRACE << "NonBlockNet::onWrite: failed to modify to write: " << connection->name();
-                deleteSession(connection);
-            }
-
+            LOG_TRACE << "NonBlockNet::onWrite wait for EPOLLOUT " << connection->name();
+            connection->_writable = false;
+            armWriteTimer(connection, progress);
             return;
         }
 
-        if (ret < 0) {
-            LOG_TRACE << "NonBlockNet::onWrite: ret=-1 " << strerror(errno);
-            return;
+        size_t sz = (size_t)ret;
+        progress = progress || sz > 0;
+        if (tls != nullptr) {
+            // Once the handshake is out, kTLS may take the rest.
+            tls->sent(sz);
+            tls = connection->tlsWriting();
+            continue;
         }
 
-        size_t sz = (size_t)ret;
-        session->completedWriting(sz);
+        session->countBytesOut(sz);
+        if (zeroCopy) {
+            // The kernel numbers successful zero-copy sends one by one.
+            auto& zc = connection->_zeroCopySends.emplace_back();
+            zc.id = connection->_zeroCopyNextId++;
+            output.used(sz, &zc.owners);
+            _stats.zeroCopySendsCount++;
+        } else {
+            session->completedWriting(sz);
+        }
 
         LOG_TRACE << "NonBlockNet::onWrite written " << sz << " Bytes for " << connection->name();
     }
 
+    armWriteTimer(connection, progress);
+
     /****************************************
      *   ret < 0 - something wrong happened on the session, close connection and delete it.
-     *   ret == 0 - all good, session finished writing, let's read
-     *   ret > 0. all good, but session will write more later, no reading yet.
+     *   ret >= 0 - all good. Reading goes on regardless, the connection
+     *              is registered for both directions.
      */
     int ret = session->onWrite();
     if (ret < 0) {
@@ -548,17 +1168,188 @@ void NonBlockNet::onWrite(NonBlockConnection* connection) {
         return;
     }
 
-    // Switch to reading mode. If needed.
-    if (ret == 0) {
-        LOG_TRACE << "NonBlockNet::onWrite modify fd to read " << connection->name();
-        // TODO: NOT GOOD. Session state and connection state is not the same!!!
-        int ret = modifyFd(connection->fd(), NetOpType::Read, connection);
-        if (ret != 0) {
-            LOG_TRACE << "NonBlockNet::onWrite: failed to modify to write: " << connection->name();
-            deleteSession(connection);
+    checkBackpressure(connection);
+}
+
+void NonBlockNet::deferWrite(NonBlockConnection* connection) {
+    _stats.writesDeferredCount++;
+    if (connection->_writeDeferred || connection->dead()) {
+        return;
+    }
+
+    connection->_writeDeferred = true;
+    _deferredWrites.push_back(connection);
+}
+
+void NonBlockNet::flushDeferred() {
+    // One write per connection for all the responses of the step. The list
+    // may grow meanwhile, deleted connections leave a null in it.
+    for (size_t i = 0; i < _deferredWrites.size(); i++) {
+        NonBlockConnection* connection = _deferredWrites[i];
+        if (connection == nullptr) {
+            continue;
+        }
+
+        connection->_writeDeferred = false;
+        _stats.deferredFlushesCount++;
+
+        const int fd = connection->fd();
+        onWrite(connection);
+        if (findSession(fd) == connection) {
+            closeIfDone(connection);
+        }
+    }
+
+    _deferredWrites.clear();
+}
+
+void NonBlockNet::dispatchReady() {
+    // One lock and one signal for all the sessions made ready by the step.
+    if (_readySessions.empty()) {
+        return;
+    }
+
+    if (_queue == nullptr) {
+        LOG_ERROR << "NonBlockNet::dispatchReady: no sessions queue for " << _readySessions.size() << " sessions";
+        _readySessions.clear();
+        return;
+    }
+
+    _stats.sessionsDispatchedCount += _readySessions.size();
+    _stats.dispatchBatchesCount++;
+    _queue->push_bulk(_readySessions);
+}
+
+bool NonBlockNet::tlsDecrypt(NonBlockConnection* connection, const char* data, size_t size) {
+    // Returns false when the connection is gone.
+    TlsLayer* tls = connection->_tls.get();
+    NetSession* session = connection->session();
+    const bool handshakeDone = tls->handshakeDone();
+
+    ssize_t plain = tls->decrypt(data, size, session);
+    if (plain < 0) {
+        LOG_TRACE << "NonBlockNet::tlsDecrypt: TLS failed for " << connection->name();
+        deleteSession(connection);
+        return false;
+    }
+    session->countBytesIn(plain);
+
+    const bool handshakeFinished = !handshakeDone && tls->handshakeDone();
+    if (handshakeFinished) {
+        _stats.tlsHandshakesCount++;
+        if (tls->offloading()) {
+            _stats.tlsOffloadedCount++;
+        }
+    }
+
+    // A close_notify ends the input like a FIN does.
+    if (tls->peerClosed()) {
+        connection->_peerClosed = true;
+    }
+
+    // Handshake flights and alerts, and output that waited for the handshake.
+    if (tls->pendingSize() > 0 || (handshakeFinished && !session->output().empty())) {
+        deferWrite(connection);
+    }
+
+    return true;
+}
+
+void NonBlockNet::finishSession(NonBlockConnection* connection) {
+    // The session is done with the connection. What it has written still
+    // goes out, as much as the socket takes.
+    if (connection->_writeDeferred) {
+        const int fd = connection->fd();
+        onWrite(connection);
+        if (findSession(fd) != connection) {
             return;
         }
     }
+
+    deleteSession(connection);
+}
+
+bool NonBlockNet::useZeroCopy(NonBlockConnection* connection, size_t size) {
+    // Completions are handled on the loop thread, so are zero-copy sends.
+    if (_zeroCopyThreshold == 0 || size < _zeroCopyThreshold || !onLoopThread() || connection->_tls) {
+        return false;
+    }
+
+    if (connection->_zeroCopyEnabled) {
+        return true;
+    }
+
+    if (connection->_zeroCopyUnsupported) {
+        return false;
+    }
+
+    int on = 1;
+    int ret = setsockopt(connection->fd(), SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on));
+    if (ret != 0) {
+        LOG_TRACE << "NonBlockNet::useZeroCopy: SO_ZEROCOPY is not supported: " << strerror(errno);
+        connection->_zeroCopyUnsupported = true;
+        return false;
+    }
+
+    connection->_zeroCopyEnabled = true;
+    return true;
+}
+
+int NonBlockNet::readErrorQueue(NonBlockConnection* connection) {
+    for (;;) {
+        char control[128];
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        int ret = recvmsg(connection->fd(), &msg, MSG_ERRQUEUE);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (ret < 0 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
+            break;
+        }
+
+        if (ret < 0) {
+            LOG_TRACE << "NonBlockNet::readErrorQueue: failed to read error queue: " << strerror(errno);
+            return -1;
+        }
+
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+            const bool ipError = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                                 (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!ipError) {
+                continue;
+            }
+
+            sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cm), sizeof(err));
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) {
+                LOG_TRACE << "NonBlockNet::readErrorQueue: socket error: " << strerror(err.ee_errno);
+                return -1;
+            }
+
+            // Sends [ee_info, ee_data] are done, their memory can go.
+            const uint32_t lo = err.ee_info;
+            const uint32_t hi = err.ee_data;
+            const size_t count = std::erase_if(connection->_zeroCopySends, [&](const auto& zc) {
+                return zc.id - lo <= hi - lo;
+            });
+
+            _stats.zeroCopyCompletedCount += count;
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                _stats.zeroCopyCopiedCount += count;
+            }
+        }
+    }
+
+    // The error queue held completions only. Make sure there is no real error.
+    int error = 0;
+    socklen_t len = sizeof(error);
+    int ret = getsockopt(connection->fd(), SOL_SOCKET, SO_ERROR, &error, &len);
+    return (ret == 0 && error == 0) ? 0 : -1;
 }
 
 void NonBlockNet::on_error(NonBlockBase* nb) {
@@ -574,12 +1365,286 @@ void NonBlockNet::on_error(NonBlockBase* nb) {
         LOG_TRACE << "NonBlockNet::on_error: socket error: " << strerror(error);
     }
 
+    if (nb->type() == NonBlockFdType::Connector) {
+        static_cast<NonBlockConnector*>(nb)->factory()->onConnectFailed();
+    }
+
     deleteSession(nb);
 }
 
+int NonBlockNet::waitTimeout(int time_ms) const {
+    const int64_t next = _timers.nextTimeout(TimerWheel::clock());
+    if (next < 0 || (time_ms >= 0 && next >= time_ms)) {
+        return time_ms;
+    }
+
+    return (int)next;
+}
+
+int NonBlockNet::spinTimeout(int time_ms) {
+    if (_busyPoll.spinUs == 0 || time_ms == 0 || std::chrono::steady_clock::now() >= _spinUntil) {
+        return waitTimeout(time_ms);
+    }
+
+    _stats.spinWaitsCount++;
+    return 0;
+}
+
+// Workers raise the eventfd only while the reactor is armed, the one going
+// to sleep must look at the queue after arming.
+int NonBlockNet::waitNotifications(int timeout) {
+    if (timeout != 0 && !_notificationQueue.arm()) {
+        return 0;
+    }
+    return timeout;
+}
+
+// The spin budget starts over with every step that had something to do.
+void NonBlockNet::spinAfter(size_t events) {
+    if (_busyPoll.spinUs != 0 && events > 0) {
+        _spinUntil = std::chrono::steady_clock::now() + std::chrono::microseconds(_busyPoll.spinUs);
+    }
+}
+
+void NonBlockNet::setBusyPoll(NonBlockConnection* connection) {
+    int value = _busyPoll.socketUs;
+    int ret = setsockopt(connection->fd(), SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value));
+#ifdef SO_PREFER_BUSY_POLL
+    if (ret == 0 && _busyPoll.preferBusyPoll) {
+        value = 1;
+        ret = setsockopt(connection->fd(), SOL_SOCKET, SO_PREFER_BUSY_POLL, &value, sizeof(value));
+    }
+#endif
+
+    if (ret != 0) {
+        LOG_TRACE << "NonBlockNet::setBusyPoll: failed for " << connection->name() << ": " << strerror(errno);
+        _stats.busyPollFailedCount++;
+    }
+}
+
+void NonBlockNet::armReadTimer(NonBlockConnection* connection) {
+    const NetTimeouts& timeouts = connection->_timeouts;
+    uint32_t timeout = timeouts.idleMs;
+
+    // The header timeout counts from the first bytes of a request, no matter
+    // how slowly the rest of it dribbles in.
+    if (connection->session()->hasPartialInput()) {
+        if (connection->_headerTimeout && connection->_readTimer.armed()) {
+            return;
+        }
+
+        connection->_headerTimeout = true;
+        timeout = timeouts.headerMs;
+    } else {
+        connection->_headerTimeout = false;
+    }
+
+    if (timeout == 0) {
+        connection->_readTimer.cancel();
+        return;
+    }
+
+    _timers.arm(&connection->_readTimer, TimerWheel::clock() + timeout);
+}
+
+void NonBlockNet::armWriteTimer(NonBlockConnection* connection, bool progress) {
+    const uint32_t timeout = connection->_timeouts.writeStallMs;
+    if (timeout == 0 || connection->session()->output().empty()) {
+        connection->_writeTimer.cancel();
+        return;
+    }
+
+    // Any progress restarts the stall timer.
+    if (progress || !connection->_writeTimer.armed()) {
+        _timers.arm(&connection->_writeTimer, TimerWheel::clock() + timeout);
+    }
+}
+
+bool NonBlockNet::closeIfDone(NonBlockConnection* connection) {
+    // The peer has finished sending, everything received is answered and
+    // written out: nothing can happen on this connection anymore. Called from
+    // the event handlers only, never under writeData(), which runs inside
+    // session callbacks.
+    if (!connection->_peerClosed || connection->dead() || !onLoopThread()) {
+        return false;
+    }
+
+    NetSession* session = connection->session();
+    if (session->state() != SessionState::Released || !session->output().empty() ||
+        connection->_sending || !connection->_zeroCopySends.empty() ||
+        (connection->_tls && connection->_tls->pendingSize() > 0)) {
+        return false;
+    }
+
+    LOG_TRACE << "NonBlockNet::closeIfDone: peer closed " << connection->name();
+    deleteSession(connection);
+    return true;
+}
+
+void NonBlockNet::setWatermarks(const NetWatermarks& watermarks) {
+    _watermarks = watermarks;
+    _inputGauge.low = watermarks.inputLow;
+}
+
+void NonBlockNet::checkBackpressure(NonBlockConnection* connection) {
+    if (connection->dead()) {
+        return;
+    }
+
+    // The output is the reactor's in any state, pushed responses included.
+    NetSession* session = connection->session();
+    const size_t output = session->output().size();
+    _outputQueued = _outputQueued - connection->_outputCounted + output;
+    connection->_outputCounted = output;
+
+    if (connection->_readPaused) {
+        return;
+    }
+
+    const NetWatermarks& marks = connection->_watermarks;
+    bool pause = false;
+    if (marks.inputHigh > 0 && session->inputSize() > marks.inputHigh) {
+        _stats.inputHighHitsCount++;
+        pause = true;
+    }
+
+    if (marks.outputHigh > 0 && connection->_outputCounted > marks.outputHigh) {
+        _stats.outputHighHitsCount++;
+        pause = true;
+    }
+
+    if (_watermarks.inputHigh > 0 && _inputGauge.queued.load() > _watermarks.inputHigh) {
+        _stats.globalInputHighHitsCount++;
+        _inputGauge.paused.store(true);
+        pause = true;
+    }
+
+    if (_watermarks.outputHigh > 0 && _outputQueued > _watermarks.outputHigh) {
+        _stats.globalOutputHighHitsCount++;
+        pause = true;
+    }
+
+    if (pause) {
+        pauseReading(connection);
+    }
+}
+
+bool NonBlockNet::canRead(NonBlockConnection* connection) const {
+    const NetWatermarks& marks = connection->_watermarks;
+    return (marks.inputHigh == 0 || connection->session()->inputSize() <= marks.inputLow) &&
+           (marks.outputHigh == 0 || connection->_outputCounted <= marks.outputLow) &&
+           (_watermarks.inputHigh == 0 || _inputGauge.queued.load() <= _watermarks.inputLow) &&
+           (_watermarks.outputHigh == 0 || _outputQueued <= _watermarks.outputLow);
+}
+
+void NonBlockNet::pauseReading(NonBlockConnection* connection) {
+    LOG_TRACE << "NonBlockNet::pauseReading: " << connection->name();
+    connection->_readPaused = true;
+    _pausedConnections.push_back(connection);
+    _stats.readPausedCount++;
+
+    if (connection->_watermarks.inputHigh > 0) {
+        connection->session()->pauseInput(connection->_watermarks.inputLow);
+    }
+
+    if (_uring) {
+        uringStopRecv(connection);
+    } else if (modifyFd(connection->fd(), NetOpType::Read, connection) != 0) {
+        deleteSession(connection);
+        return;
+    }
+
+    // Workers may have drained the input before they could see the pause.
+    if (canRead(connection)) {
+        resumeReading(connection);
+    }
+}
+
+void NonBlockNet::resumeReading(NonBlockConnection* connection) {
+    LOG_TRACE << "NonBlockNet::resumeReading: " << connection->name();
+    connection->_readPaused = false;
+    connection->session()->resumeInput();
+    erasePaused(_pausedConnections, connection);
+    _stats.readPausedCount--;
+    _stats.readResumesCount++;
+
+    // Data that arrived meanwhile raises an event right after the change.
+    int ret = 0;
+    if (_uring) {
+        if (!connection->_receiving && !connection->_peerClosed) {
+            ret = uringArm(connection);
+        }
+    } else {
+        ret = modifyFd(connection->fd(), NetOpType::Read, connection);
+    }
+
+    if (ret != 0) {
+        deleteSession(connection);
+    }
+}
+
+void NonBlockNet::resumePaused() {
+    // Resuming may close connections, which takes them off the list.
+    const std::vector<NonBlockConnection*> paused(_pausedConnections);
+    for (NonBlockConnection* connection: paused) {
+        if (connection->_readPaused && canRead(connection)) {
+            resumeReading(connection);
+        }
+    }
+}
+
+void NonBlockNet::forgetBackpressure(NonBlockConnection* connection) {
+    if (connection->dead() || connection->_slot < 0) {
+        return;
+    }
+
+    _outputQueued -= connection->_outputCounted;
+    connection->_outputCounted = 0;
+
+    if (connection->_readPaused) {
+        connection->_readPaused = false;
+        erasePaused(_pausedConnections, connection);
+        _stats.readPausedCount--;
+    }
+}
+
+void NonBlockNet::onTimeout(NonBlockConnection* connection, bool write) {
+    if (connection->dead()) {
+        return;
+    }
+
+    NetSession* session = connection->session();
+    if (write) {
+        LOG_TRACE << "NonBlockNet::onTimeout: write stalled " << connection->name();
+        _stats.writeTimeoutsCount++;
+    } else if (connection->_readPaused) {
+        // Reading is stopped by backpressure, the peer is not to blame.
+        armReadTimer(connection);
+        return;
+    } else if (connection->_headerTimeout) {
+        LOG_TRACE << "NonBlockNet::onTimeout: incomplete request " << connection->name();
+        _stats.headerTimeoutsCount++;
+    } else if (session->state() != SessionState::Released || !session->output().empty()) {
+        // Not idle: a request is in processing or a response is going out.
+        // Output the socket doesn't take is the stall timer's.
+        armReadTimer(connection);
+        if (session->state() == SessionState::Released) {
+            armWriteTimer(connection, false);
+        }
+        return;
+    } else {
+        LOG_TRACE << "NonBlockNet::onTimeout: idle " << connection->name();
+        _stats.idleTimeoutsCount++;
+    }
+
+    deleteSession(connection);
+}
+
 int  NonBlockNet::run(int time_ms) {
     _keepRunning.store(true);
+    _loopThread.store(std::this_thread::get_id());
     _stats.running = true;
+    _started.store(true);
 
     int ret = 0;
     while (_keepRunning.load()) {
@@ -598,11 +1663,43 @@ void NonBlockNet::stop() {
 }
 
 int  NonBlockNet::step(int time_ms) {
+    // Sessions made ready between the steps, e.g. by startConnect(), don't
+    // wait for the events of this one.
+    dispatchReady();
+
+    if (_uring) {
+        return stepUring(time_ms);
+    }
+
+    // Timers fire after the events: a timeout may delete connections which
+    // still have events in this batch.
+    auto afterStep = std::experimental::scope_exit([&]() {
+        // Notifications posted while the reactor was awake raise no event.
+        processPipe();
+        _timers.advance(TimerWheel::clock());
+        updateAcceptStats();
+        if (!_pausedConnections.empty()) {
+            resumePaused();
+        }
+        if (!_deferredWrites.empty()) {
+            flushDeferred();
+        }
+        for (NonBlockDatagram* socket: _datagrams) {
+            flushDatagram(socket);
+        }
+        if (!_deferredListeners.empty()) {
+            resumeAccepting();
+        }
+        dispatchReady();
+    });
+
     bool once = true;
     while (once) {
         once = false;
+        _acceptsLeft = _acceptBudget;
 
-        int count = epoll_wait(_fd, _evsvec.data(), _evsvec.size(), time_ms);
+        int count = epoll_wait(_fd, _evsvec.data(), _evsvec.size(), waitNotifications(spinTimeout(time_ms)));
+        _notificationQueue.disarm();
         if (count < 0 && errno == EINTR) {
             continue;
         }
@@ -611,84 +1708,138 @@ int  NonBlockNet::step(int time_ms) {
             LOG_ERROR << "NonBlockNet::step: failed epoll_wait: " << strerror(errno);
             return -1;
         }
+        spinAfter(count);
 
         for (int i = 0; i < count; i++) {
-            auto& ev = _evsvec[i];
-            NonBlockBase* nb = static_cast<NonBlockBase*>(ev.data.ptr);
-            int mask = ev.events;
-
-            if (mask & (EPOLLERR | EPOLLHUP)) {
-                on_error(nb);
+            const epoll_event& ev = _evsvec[i];
+            const int fd = (int)(uint32_t)ev.data.u64;
+            const NonBlockFdType type = (NonBlockFdType)(uint16_t)(ev.data.u64 >> 32);
+            const uint16_t generation = (uint16_t)(ev.data.u64 >> 48);
+
+            // A connection closed earlier in this batch is gone from the table,
+            // or its fd belongs to a new object already, registered under
+            // another generation. Either way the event is stale.
+            NonBlockBase* nb = findSession(fd);
+            if (nb == nullptr || nb->_generation != generation) {
                 continue;
             }
 
-            if (mask & EPOLLIN) {
-                switch (nb->type()) {
-                    case NonBlockFdType::Connection: {
-                        NonBlockConnection* conn = dynamic_cast<NonBlockConnection*>(nb);
-                        onRead(conn);
-                        break;
-                    }
+            const uint32_t mask = ev.events;
+            switch (type) {
+                case NonBlockFdType::Connection:
+                    onEvent(static_cast<NonBlockConnection*>(nb), mask);
+                    break;
 
-                    case NonBlockFdType::Listener: {
-                        NonBlockListener* listener = dynamic_cast<NonBlockListener*>(nb);
-                        on_accept(listener);
-                        break;
+                case NonBlockFdType::Listener:
+                    if (mask & (EPOLLERR | EPOLLHUP)) {
+                        on_error(nb);
+                    } else {
+                        on_accept(static_cast<NonBlockListener*>(nb));
                     }
+                    break;
 
-                    case NonBlockFdType::PipeQueue: {
-                        processPipe();
-                        break;
+                case NonBlockFdType::Connector:
+                    if (mask & (EPOLLERR | EPOLLHUP)) {
+                        on_error(nb);
+                    } else if (mask & EPOLLOUT) {
+                        on_connect(static_cast<NonBlockConnector*>(nb));
                     }
+                    break;
 
-                    default: {
-                        LOG_ERROR << "NonBlockNet::step: invalid socket type on read";
+                case NonBlockFdType::PipeQueue:
+                    if (mask & (EPOLLERR | EPOLLHUP)) {
                         on_error(nb);
-                        break;
+                    } else {
+                        _stats.notificationWakeupsCount++;
+                        _notificationQueue.clearWakeup();
+                        processPipe();
                     }
-                }
+                    break;
+
+                case NonBlockFdType::Datagram:
+                    onDatagramRead(static_cast<NonBlockDatagram*>(nb));
+                    break;
             }
+        }
+    }
 
-            if (mask & EPOLLOUT) {
-                switch (nb->type()) {
-                    case NonBlockFdType::Connection: {
-                        NonBlockConnection* conn = dynamic_cast<NonBlockConnection*>(nb);
-                        onWrite(conn);
-                        break;
-                    }
+    return 0;
+}
 
-                    case NonBlockFdType::Connector: {
-                        NonBlockConnector* connector = dynamic_cast<NonBlockConnector*>(nb);
-                        on_connect(connector);
-                        break;
-                    }
+void NonBlockNet::onEvent(NonBlockConnection* connection, uint32_t mask) {
+    if (connection->_splicing) {
+        onSplice(connection, mask);
+        return;
+    }
 
-                    default: {
-                        LOG_ERROR << "NonBlockNet::step: invalid socket type on write";
-                        on_error(nb);
-                        break;
-                    }
-                }
-            }            
+    const int fd = connection->fd();
+
+    // Zero-copy completions raise EPOLLERR as well.
+    if ((mask & EPOLLERR) && !(mask & EPOLLHUP)) {
+        if (connection->_zeroCopyEnabled && readErrorQueue(connection) == 0) {
+            mask &= ~EPOLLERR;
+            if (closeIfDone(connection)) {
+                return;
+            }
         }
     }
 
-    return 0;
+    if (mask & (EPOLLERR | EPOLLHUP)) {
+        on_error(connection);
+        return;
+    }
+
+    // Write first: a read may delete the connection. Output of a session in
+    // processing goes out as workers push it, the rest once it's released.
+    if (mask & EPOLLOUT) {
+        connection->_writable = true;
+    }
+
+    if ((mask & EPOLLOUT) && connection->session()->state() == SessionState::Released) {
+        onWrite(connection);
+        if (findSession(fd) != connection || closeIfDone(connection)) {
+            return;
+        }
+    }
+
+    if (mask & EPOLLRDHUP) {
+        connection->_peerClosing = true;
+    }
+
+    // Events queued before reading was paused.
+    if ((mask & (EPOLLIN | EPOLLRDHUP)) && !connection->_readPaused) {
+        connection->_readable = true;
+        onRead(connection);
+    }
 }
 
 void NonBlockNet::processPipe() {
+    _stats.notificationOverflowsCount = _notificationQueue.overflowsCount();
     for (;;) {
         NotificationBase* msg = _notificationQueue.next();
-        auto cleanup = std::experimental::scope_exit([&]() { delete msg; });
         if (msg == nullptr) {
             break;
         }
+        msg->taken();
 
         NetSession* session = static_cast<NetSession*>(msg->session());
         assert(session);
 
+        // Only datagram sessions have no connection.
         NonBlockConnection* conn = session->connection();
+        if (conn == nullptr) {
+            onDatagramNotification(static_cast<DatagramSession*>(session), msg->type());
+            continue;
+        }
+
+        const int fd = conn->fd();
         if (conn->dead()) {
+            // A released session of a dead connection can go away now.
+            if (msg->type() == NotificationType::SessionReleased) {
+                session->setState(SessionState::Released);
+            } else if (msg->type() == NotificationType::MoreData) {
+                session->onMoreData();
+            }
             deleteSession(conn);
             continue;
         }
@@ -697,13 +1848,41 @@ void NonBlockNet::processPipe() {
             case NotificationType::SessionReleased:
                 LOG_TRACE << "NonBlockNet::processPipe: session released";
                 session->setState(SessionState::Released);
-                session->onRead(_queue);
+                session->takePushed(true);
+                if (!session->output().empty()) {
+                    onWrite(conn);
+                    if (findSession(fd) != conn) {
+                        break;
+                    }
+                }
+
+                processInput(session);
+                if (findSession(fd) == conn && flushReleased(conn) && !closeIfDone(conn)) {
+                    checkBackpressure(conn);
+                }
+                break;
+
+            // Output of a session still in processing, written once the
+            // step is over with everything else pushed meanwhile.
+            case NotificationType::PushData:
+                LOG_TRACE << "NonBlockNet::processPipe: push data";
+                _stats.pushDataCount++;
+                session->takePushed(false);
+                deferWrite(conn);
+                break;
+
+            // Paused connections are looked at once the step is over.
+            case NotificationType::ResumeRead:
+                LOG_TRACE << "NonBlockNet::processPipe: resume reading";
                 break;
             
+            // Output handed over outside of processing, e.g. requests
+            // submitted to an upstream session. onMoreData() moves it into
+            // output() here, on the reactor; it's written once the step is over.
             case NotificationType::MoreData: {
                 LOG_TRACE << "NonBlockNet::processPipe: more data";
-                session->setState(SessionState::Released);
-                onWrite(conn);
+                session->onMoreData();
+                deferWrite(conn);
                 break;
             }
 
@@ -724,18 +1903,382 @@ void NonBlockNet::waitListenerReady(size_t listenersCount, size_t loopCount, int
     }
 }
 
+bool NonBlockNet::onLoopThread() const {
+    const std::thread::id id = _loopThread.load();
+    return id == std::thread::id() || id == std::this_thread::get_id();
+}
+
+void NonBlockNet::postMoreData(NetSession* session) {
+    session->notify(NotificationType::MoreData);
+}
+
+/**************************************************
+ *    NonBlockNet: splice proxy
+ *
+ *    A connection of a ProxySessionFactory is paired with an upstream one on
+ *    its first event. The bytes read from each connection wait in its pipe
+ *    for the peer: splice() moves them socket to pipe and pipe to socket
+ *    without entering user space. A full pipe stops reading, the sender is
+ *    then held back by TCP flow control. The edge flags remember what epoll
+ *    said, an event on either connection pumps both directions.
+ */
+void NonBlockNet::onSplice(NonBlockConnection* connection, uint32_t mask) {
+    if (mask & EPOLLERR) {
+        on_error(connection);
+        return;
+    }
+
+    // A hang-up still leaves bytes to read, and the EOF passes on after them.
+    if (mask & EPOLLOUT) {
+        connection->_writable = true;
+    }
+
+    if (mask & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+        connection->_readable = true;
+    }
+
+    // By the first event the accepted connection is in the table.
+    if (connection->_splicePeer == nullptr && startRelay(connection) != 0) {
+        deleteSession(connection);
+        return;
+    }
+
+    NonBlockConnection* peer = connection->_splicePeer;
+    if (!relay(connection, peer) || !relay(peer, connection)) {
+        return;
+    }
+
+    if (connection->_relayShut && peer->_relayShut) {
+        LOG_TRACE << "NonBlockNet::onSplice: relay finished " << connection->name();
+        deleteSession(connection);
+    }
+}
+
+int NonBlockNet::startRelay(NonBlockConnection* client) {
+    const ProxyTarget& target = *client->_factory->proxyTarget();
+    NetOperation op {
+        .name = target.name,
+        .ip = target.ip,
+        .port = target.port,
+        .factory = static_cast<ProxySessionFactory*>(client->_factory)->upstream(),
+        .path = target.path,
+    };
+
+    sockaddr_storage sa;
+    const socklen_t addrlen = makeAddress(op, sa);
+    if (addrlen == 0) {
+        return -1;
+    }
+
+    int fd = socket(sa.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR << "NonBlockNet::startRelay: failed create socket: " << strerror(errno);
+        return -1;
+    }
+
+    // What the client sends meanwhile fills its pipe, EPOLLOUT tells when
+    // the upstream can take it.
+    if (connect(fd, (sockaddr*)&sa, addrlen) != 0 && errno != EINPROGRESS) {
+        LOG_TRACE << "NonBlockNet::startRelay: failed to connect " << op.name << ": " << strerror(errno);
+        close(fd);
+        return -1;
+    }
+
+    NonBlockConnection* upstream = makeConnection(std::make_shared<const std::string>(op.name), fd);
+    if (upstream->setSession(op.factory) != 0 || openRelay(client, target) != 0 ||
+        openRelay(upstream, target) != 0) {
+        LOG_ERROR << "NonBlockNet::startRelay: failed to set up relay for " << client->name();
+        freeConnection(upstream);
+        return -1;
+    }
+
+    upstream->_timeouts = client->_timeouts;
+    upstream->_splicing = true;
+    upstream->_splicePeer = client;
+    client->_splicePeer = upstream;
+
+    if (registerFd(fd, NetOpType::Write, upstream) != 0) {
+        LOG_ERROR << "NonBlockNet::startRelay: failed to register upstream connection";
+        client->_splicePeer = nullptr;
+        freeConnection(upstream);
+        return -1;
+    }
+
+    _stats.connectedCount++;
+    _stats.relayPairsCount++;
+    armReadTimer(upstream);
+    return 0;
+}
+
+int NonBlockNet::openRelay(NonBlockConnection* connection, const ProxyTarget& target) {
+    if (target.copy) {
+        connection->_relayCopy = true;
+        connection->_relayCapacity = target.pipeSize ? target.pipeSize : DefaultRelaySize;
+        connection->_relayBuffer.resize(connection->_relayCapacity);
+        return 0;
+    }
+
+    if (pipe2(connection->_splicePipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+        LOG_ERROR << "NonBlockNet::openRelay: failed to create pipe: " << strerror(errno);
+        return -1;
+    }
+
+    // Past /proc/sys/fs/pipe-max-size it takes CAP_SYS_RESOURCE.
+    if (target.pipeSize != 0 && fcntl(connection->_splicePipe[1], F_SETPIPE_SZ, (int)target.pipeSize) < 0) {
+        LOG_WARN << "NonBlockNet::openRelay: failed to resize pipe: " << strerror(errno);
+    }
+
+    const int size = fcntl(connection->_splicePipe[1], F_GETPIPE_SZ);
+    connection->_relayCapacity = size > 0 ? size : DefaultRelaySize;
+    return 0;
+}
+
+bool NonBlockNet::relay(NonBlockConnection* src, NonBlockConnection* dst) {
+    // Returns false when the pair is gone, an error deletes it right away.
+    // splice() has no MSG_NOSIGNAL, a reset peer fails it with EPIPE since
+    // init() ignores SIGPIPE.
+    bool moved = false;
+    for (;;) {
+        bool progress = false;
+
+        if (src->_readable && !src->_peerClosed && src->_relayed < src->_relayCapacity) {
+            ssize_t ret = relayIn(src);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_TRACE << "NonBlockNet::relay: failed to read " << src->name() << ": " << strerror(errno);
+                deleteSession(src);
+                return false;
+            }
+
+            if (ret > 0) {
+                src->_relayed += ret;
+                src->session()->countBytesIn(ret);
+                progress = true;
+            } else if (ret == 0) {
+                src->_readable = false;
+                src->_peerClosed = true;
+            } else if (src->_relayed == 0) {
+                // A pipe may run out of slots before it runs out of bytes.
+                // Only an empty one tells the socket is drained.
+                src->_readable = false;
+            }
+        }
+
+        if (src->_relayed > 0 && dst->_writable) {
+            ssize_t ret = relayOut(src, dst);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_TRACE << "NonBlockNet::relay: failed to write " << dst->name() << ": " << strerror(errno);
+                deleteSession(dst);
+                return false;
+            }
+
+            if (ret > 0) {
+                src->_relayed -= ret;
+                dst->session()->countBytesOut(ret);
+                _stats.relayedBytesCount += ret;
+                progress = true;
+            } else if (ret < 0) {
+                dst->_writable = false;
+            }
+        }
+
+        if (!progress) {
+            break;
+        }
+        moved = true;
+    }
+
+    // Either side moving keeps both from the idle timeout.
+    if (moved) {
+        armReadTimer(src);
+        armReadTimer(dst);
+    }
+
+    // The EOF follows the last byte.
+    if (src->_peerClosed && src->_relayed == 0 && !dst->_relayShut) {
+        shutdown(dst->fd(), SHUT_WR);
+        dst->_relayShut = true;
+    }
+
+    return true;
+}
+
+ssize_t NonBlockNet::relayIn(NonBlockConnection* src) {
+    const size_t room = src->_relayCapacity - src->_relayed;
+    if (!src->_relayCopy) {
+        return splice(src->fd(), nullptr, src->_splicePipe[1], nullptr, room, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }
+
+    // Copying: the waiting bytes move to the front when the tail is full.
+    std::vector<char>& buffer = src->_relayBuffer;
+    if (src->_relayStart + src->_relayed == buffer.size()) {
+        memmove(buffer.data(), buffer.data() + src->_relayStart, src->_relayed);
+        src->_relayStart = 0;
+    }
+
+    const size_t offset = src->_relayStart + src->_relayed;
+    return read(src->fd(), buffer.data() + offset, buffer.size() - offset);
+}
+
+ssize_t NonBlockNet::relayOut(NonBlockConnection* src, NonBlockConnection* dst) {
+    if (!src->_relayCopy) {
+        return splice(src->_splicePipe[0], nullptr, dst->fd(), nullptr, src->_relayed, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }
+
+    ssize_t ret = send(dst->fd(), src->_relayBuffer.data() + src->_relayStart, src->_relayed, MSG_NOSIGNAL);
+    if (ret > 0) {
+        src->_relayStart = (size_t)ret == src->_relayed ? 0 : src->_relayStart + ret;
+    }
+    return ret;
+}
+
 /**************************************************
  *    NonBlockConnection
  */
 
-void NonBlockConnection::writeData() {
-    _parent->onWrite(this);
+int NonBlockConnection::writeData() {
+    // A worker appending to output() would race the reactor writing it.
+    if (!_parent->onLoopThread()) {
+        LOG_ERROR << "NonBlockConnection::writeData: not on the reactor thread, use pushData() for " << name();
+        return -1;
+    }
+
+    _parent->deferWrite(this);
+    return 0;
+}
+
+NonBlockConnection::~NonBlockConnection() {
+    // Without recycling a connection is deleted instead of reset. Its pipes,
+    // TLS state and relay peer must not outlive it either way.
+    if (_splicePeer != nullptr) {
+        _splicePeer->_splicePeer = nullptr;
+    }
+    reset();
+    delete _session;
 }
 
 int NonBlockConnection::setSession(NetSessionFactoryPtr factory) {
-    _session = factory->makeSession(this);
-    _session->setPipe(_parent->pipeFd());
+    _timeouts = factory->timeouts();
+    _watermarks = factory->watermarks();
+    _readTimer.setCallback([this]() { _parent->onTimeout(this, false); });
+    _writeTimer.setCallback([this]() { _parent->onTimeout(this, true); });
+
+    _factory = factory.get();
+    _session = _parent->makeSession(factory, this);
+    _session->setNotificationQueue(_parent->getNotificationQueue());
+    _session->setReadyBatch(&_parent->_readySessions);
+    _session->setInputGauge(&_parent->_inputGauge);
+    _session->setMetrics(factory->metrics());
+
+    const LoadShedding& shedding = factory->admission().shedding;
+    _session->setLoadShedding(shedding.maxQueued != 0 || shedding.maxWaitMs != 0 ? &shedding : nullptr);
+    if (shedding.maxWaitMs != 0 && _parent->_queue != nullptr) {
+        _parent->_queue->trackWait();
+    }
+
+    _splicing = factory->proxyTarget() != nullptr;
+    if (_splicing && _parent->_uring) {
+        LOG_ERROR << "NonBlockConnection::setSession: splicing needs the epoll backend";
+        return -1;
+    }
+
+    if (factory->tls()) {
+        if (_parent->_uring) {
+            LOG_ERROR << "NonBlockConnection::setSession: TLS needs the epoll backend";
+            return -1;
+        }
+
+        _tls = std::make_unique<TlsLayer>(factory->tls());
+        if (_tls->init(_fd) != 0) {
+            return -1;
+        }
+    }
+
     return _session->init();
 }
 
+void NonBlockConnection::abortZeroCopy() {
+    // The kernel may still be sending from pages the owners pin, and the
+    // owners go once the fd is closed. An abortive close drops the unsent
+    // data, nothing reads the pages after that.
+    if (_fd == -1 || _zeroCopySends.empty()) {
+        return;
+    }
+
+    linger lg{ .l_onoff = 1, .l_linger = 0 };
+    setsockopt(_fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+}
+
+void NonBlockConnection::reset() {
+    if (_fd != -1) {
+        abortZeroCopy();
+        close(_fd);
+        _fd = -1;
+    }
+
+    _dead = false;
+    _pending = 0;
+    _slot = -1;
+
+    _readable = false;
+    _writable = false;
+    _peerClosed = false;
+    _peerClosing = false;
+
+    _readTimer.cancel();
+    _writeTimer.cancel();
+    _headerTimeout = false;
+
+    _readPaused = false;
+    _outputCounted = 0;
+    _writeDeferred = false;
+    _tls.reset();
+
+    for (int& fd: _splicePipe) {
+        if (fd != -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    _splicing = false;
+    _splicePeer = nullptr;
+    _relayCopy = false;
+    _relayStart = 0;
+    _relayed = 0;
+    _relayCapacity = 0;
+    _relayShut = false;
+
+    _zeroCopySends.clear();
+    _zeroCopyNextId = 0;
+    _zeroCopyEnabled = false;
+    _zeroCopyUnsupported = false;
+
+    for (int& fd: _sendPipe) {
+        if (fd != -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    _sendPipeSize = 0;
+    _sendPiped = 0;
+    _sendsInFlight = 0;
+    _sendProgress = false;
+    _sendBlocked = false;
+    _sendFailed = false;
+    _sending = false;
+    _receiving = false;
+}
+
+void NonBlockConnection::reuse(NonBlockName name, int fd) {
+    _name = std::move(name);
+    _fd = fd;
+}
+
 } // namespace bongo
@@ -18,30 +18,56 @@
 
 #pragma once
 #include "net_session.h"
+#include "tls.h"
 #include "proc/notification_base.h"
-#include "utils/thread_queue.h"
+#include "utils/timer_wheel.h"
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <atomic>
-#include <unordered_set>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <thread>
 #include <sys/epoll.h>
+#include <sys/socket.h>
+
+struct io_uring_cqe;
 
 namespace bongo {
 
-enum class NonBlockFdType {
+class Uring;
+enum class UringOp : uint64_t;
+class NonBlockDatagram;
+class DatagramSession;
+struct DatagramPeer;
+struct DatagramBuffers;
+
+enum class NetBackend {
+    Epoll,
+    Uring,
+};
+
+enum class NonBlockFdType : uint32_t {
     Listener,
     Connector,
     Connection,
     PipeQueue,
+    Datagram,
 };
 
+// Names are only for logs. Connections share the name of their listener.
+using NonBlockName = std::shared_ptr<const std::string>;
+
 class NonBlockBase {
+    friend class NonBlockNet;
 public:
-    NonBlockBase(const std::string& name, int fd, NonBlockFdType type)
-        : _name(name), _type(type), _fd(fd) {}
+    NonBlockBase(NonBlockName name, int fd, NonBlockFdType type)
+        : _type(type), _fd(fd), _name(std::move(name)) {}
     virtual ~NonBlockBase();
 
-    const std::string& name() const { return _name; }
+    const std::string& name() const { return *_name; }
+    const NonBlockName& nameRef() const { return _name; }
     NonBlockFdType type() const { return _type; }
 
     int fd() const { return _fd; }
@@ -50,73 +76,197 @@ public:
     bool dead() const { return _dead; }
     void die();
 
+    // io_uring operations in flight for this fd. The object must outlive them.
+    unsigned pending() const { return _pending; }
+    void incPending() { _pending++; }
+    void decPending() { _pending--; }
+
 protected:
-    const std::string _name;
+    // Hot fields first, what step() touches for every event.
     const NonBlockFdType _type;
     int _fd = -1;
     bool _dead = false;
+    unsigned _pending = 0;
+    int _slot = -1; // index in the reactor's fd table
+    uint16_t _generation = 0; // tells its epoll events from those of an earlier owner of the fd
+    NonBlockName _name;
 };
 
 class NonBlockListener : public NonBlockBase, public NetSessionFactoryOwner {
 public:
-    NonBlockListener(const std::string& name, int fd, NetSessionFactoryPtr factory)
-      : NonBlockBase(name, fd, NonBlockFdType::Listener),
+    NonBlockListener(NonBlockName name, int fd, NetSessionFactoryPtr factory)
+      : NonBlockBase(std::move(name), fd, NonBlockFdType::Listener),
         NetSessionFactoryOwner(factory) { }
+
+private:
+    friend class NonBlockNet;
+    bool _acceptDeferred = false; // out of the epoll set while the connection cap is reached
+    bool _noDelay = false;        // NetOperation::noDelay, for the accepted connections
 };
 
 class NonBlockConnector : public NonBlockBase, public NetSessionFactoryOwner {
 public:
-    NonBlockConnector(const std::string& name, int fd, NetSessionFactoryPtr factory)
-      : NonBlockBase(name, fd, NonBlockFdType::Connector),
+    NonBlockConnector(NonBlockName name, int fd, NetSessionFactoryPtr factory)
+      : NonBlockBase(std::move(name), fd, NonBlockFdType::Connector),
         NetSessionFactoryOwner(factory) { }
+
+private:
+    friend class NonBlockNet;
+    bool _noDelay = false;
 };
 
 class NonBlockNet;
 
 class NonBlockConnection : public NonBlockBase {
+    friend class NonBlockNet;
 public:
-    NonBlockConnection(NonBlockNet* parent, const std::string& name, int fd)
-      : NonBlockBase(name, fd, NonBlockFdType::Connection), _parent(parent) {}
+    NonBlockConnection(NonBlockNet* parent, NonBlockName name, int fd)
+      : NonBlockBase(std::move(name), fd, NonBlockFdType::Connection), _parent(parent) {}
 
     // Assuming this object can be deleted on the network thread and the session
     // in the right state, which might be not quite right. Keep thinking...
-    virtual ~NonBlockConnection() { delete _session; }
+    virtual ~NonBlockConnection();
 
     NetSession* session() const { return _session; }
     int setSession(NetSessionFactoryPtr factory);
 
-    void writeData();
+    NonBlockNet* net() const { return _parent; }
+
+    // Writes the session output. The write waits for the end of the step, so
+    // everything the step produced goes out together. Reactor thread only,
+    // -1 elsewhere: output() is the reactor's, workers hand theirs over with
+    // SessionBase::pushData().
+    int writeData();
 
 private:
     NonBlockNet* _parent;
     NetSession* _session = nullptr;
+    NetSessionFactory* _factory = nullptr;
+    NetSessionFactoryPtr _admittedBy; // the listener's factory counting this connection against its cap
+
+    // Slab recycling: reset() closes and clears a connection, reuse() gives
+    // it the next fd. Buffers keep their capacity.
+    void reset();
+    void reuse(NonBlockName name, int fd);
+
+    // Epoll readiness. The connection is registered once, edge-triggered, so
+    // these remember what the last edge and the last syscall said.
+    bool _readable = false;
+    bool _writable = false;
+    bool _peerClosed = false;
+    bool _peerClosing = false;  // EPOLLRDHUP came, the EOF may follow a short read
+
+    // Timeouts of the session factory. The read timer runs the idle or, while
+    // a request is arriving, the header timeout.
+    NetTimeouts _timeouts;
+    Timer _readTimer;
+    Timer _writeTimer;
+    bool _headerTimeout = false;
+
+    // Backpressure: the session's watermarks, whether reading is stopped,
+    // and the output size the reactor-wide count last took into account.
+    NetWatermarks _watermarks;
+    bool _readPaused = false;
+    size_t _outputCounted = 0;
+
+    // Waits in NonBlockNet::_deferredWrites for the end of the step.
+    bool _writeDeferred = false;
+
+    // TLS of the session factory. A direction kTLS has taken is plain to the
+    // reactor, these return nullptr for it.
+    std::unique_ptr<TlsLayer> _tls;
+    TlsLayer* tlsReading() const { return _tls && !_tls->rxOffloaded() ? _tls.get() : nullptr; }
+    TlsLayer* tlsWriting() const { return _tls && !_tls->txOffloaded() ? _tls.get() : nullptr; }
+
+    // Splice proxy: bytes read from this connection wait in the pipe, or
+    // when copying in _relayBuffer, until _splicePeer's socket takes them.
+    bool _splicing = false;
+    NonBlockConnection* _splicePeer = nullptr;
+    int _splicePipe[2] = {-1, -1};
+    bool _relayCopy = false;
+    std::vector<char> _relayBuffer;
+    size_t _relayStart = 0;
+    size_t _relayed = 0;          // bytes waiting for the peer
+    size_t _relayCapacity = 0;
+    bool _relayShut = false;      // the write side is shut, the peer's EOF went through
+
+    // MSG_ZEROCOPY: sent segments stay referenced until the kernel reports
+    // the completion on the socket error queue.
+    struct ZeroCopySend {
+        uint32_t id;
+        std::vector<OutputChain::Owner> owners;
+    };
+    std::deque<ZeroCopySend> _zeroCopySends;
+    uint32_t _zeroCopyNextId = 0;
+    bool _zeroCopyEnabled = false;
+    bool _zeroCopyUnsupported = false;
+    void abortZeroCopy();
+
+    // io_uring backend: the chain of linked sends in flight, one per flush.
+    // It describes the leading segments of the session output, those stay
+    // in place until it completes. File segments go through _sendPipe.
+    std::vector<msghdr> _sendMsgs;
+    std::vector<iovec> _sendIov;
+    int _sendPipe[2] = {-1, -1};
+    size_t _sendPipeSize = 0;
+    size_t _sendPiped = 0;        // file bytes in the pipe, not on the socket yet
+    size_t _sendsInFlight = 0;
+    bool _sendProgress = false;
+    bool _sendBlocked = false;    // the socket was full, wait for POLLOUT
+    bool _sendFailed = false;
+    bool _sending = false;
+    bool _receiving = false;
 };
 
 struct NetOperation {
     const std::string name;
-    const std::string ip;
-    int port;
+    const std::string ip = {};
+    int port = 0;
     NetSessionFactoryPtr factory;
+    bool reusePort = false; // SO_REUSEPORT, lets several reactors listen on the same port
+    const std::string path = {}; // a UNIX domain socket used instead of ip/port, '@' starts an abstract name
+    // TCP_NODELAY on the connections, ignored with path. The reactor gathers
+    // what a step produced into one write by itself, Nagle only holds back
+    // output that workers push in pieces until the peer's delayed ACK.
+    bool noDelay = false;
+};
+
+// Busy polling trades a core for latency. After a step with events the
+// reactor keeps waiting with a zero timeout for spinUs, then it blocks again.
+// Worker notifications are picked up by the same waits, so a handoff doesn't
+// have to wake a sleeping reactor. socketUs sets SO_BUSY_POLL on connections:
+// an empty receive polls the device queue for that long. Raising it above
+// net.core.busy_read takes CAP_NET_ADMIN.
+struct NetBusyPoll {
+    uint32_t spinUs = 0;
+    uint32_t socketUs = 0;
+    bool preferBusyPoll = false; // SO_PREFER_BUSY_POLL, along with socketUs
 };
 
 enum class NetOpType { Read, Write };
 
 class NonBlockNet {
     friend class NonBlockConnection;
+    friend class NonBlockDatagram;
 public:
+    NonBlockNet();
     virtual ~NonBlockNet();
 
-    int init(size_t slotsCount = 1024);
+    // Uring falls back to Epoll when io_uring is not available.
+    int init(size_t slotsCount = 1024, NetBackend backend = NetBackend::Epoll);
+    NetBackend backend() const { return _uring ? NetBackend::Uring : NetBackend::Epoll; }
 
     int startListen(const NetOperation& op);
     int startConnect(const NetOperation& op);
 
+    // A UDP socket bound to op.ip/op.port. op.factory must be a
+    // DatagramSessionFactory, see datagram.h.
+    int startDatagram(const NetOperation& op);
+
     int  run(int time_ms);
     void stop();
     int  step(int time_ms);
 
-    int pipeFd() const { return _notificationQueue.getWriteFd(); }
-
     void waitListenerReady(size_t listenersCount = 1, size_t loopCount = 10, int sleepLenMs = 50);
 
 public:
@@ -129,43 +279,249 @@ public:
         size_t listenersCount = 0;
         size_t connectorsCount = 0;
         size_t pipesCount = 0;
-        size_t count() const { return connectionsCount + listenersCount + connectorsCount + pipesCount; }
+        size_t datagramsCount = 0; // UDP sockets
+        size_t epollCtlCount = 0;  // epoll_ctl() calls
+        size_t requestsCount = 0;  // input messages parsed off stream connections
+        size_t zeroCopySendsCount = 0;
+        size_t zeroCopyCompletedCount = 0;
+        size_t zeroCopyCopiedCount = 0; // completed, but the kernel copied the data anyway
+        size_t acceptCapHitsCount = 0;   // accepting stopped by the per-step budget
+        size_t listenOverflowsCount = 0; // TcpExt ListenOverflows since init(), for the whole netns
+        double acceptRate = 0.0;         // accepted connections per second, over the last interval
+        size_t idleTimeoutsCount = 0;
+        size_t headerTimeoutsCount = 0;
+        size_t writeTimeoutsCount = 0;
+        size_t inputHighHitsCount = 0;        // a session's input messages above its high watermark
+        size_t outputHighHitsCount = 0;       // a session's output bytes above its high watermark
+        size_t globalInputHighHitsCount = 0;  // the reactor's input messages above its high watermark
+        size_t globalOutputHighHitsCount = 0; // the reactor's output bytes above its high watermark
+        size_t readResumesCount = 0;
+        size_t readPausedCount = 0;           // connections not being read right now
+        size_t spinWaitsCount = 0;            // zero-timeout waits of busy polling
+        size_t busyPollFailedCount = 0;       // connections left without SO_BUSY_POLL
+        size_t connectionsRejectedCount = 0;  // reset right after accept, over a listener's cap
+        size_t acceptDeferredCount = 0;       // listeners taken out of epoll by their connection cap
+        size_t datagramsReceivedCount = 0;
+        size_t datagramsSentCount = 0;
+        size_t datagramsDroppedCount = 0;     // truncated, from peers over the cap, or not sent
+        size_t recvmmsgCount = 0;
+        size_t sendmmsgCount = 0;
+        size_t writesDeferredCount = 0;       // writeData() calls left for the end of the step
+        size_t deferredFlushesCount = 0;      // connections written at the end of a step
+        size_t tlsHandshakesCount = 0;
+        size_t tlsOffloadedCount = 0;         // handshakes followed by kTLS in at least one direction
+        size_t relayPairsCount = 0;           // proxied connections paired with an upstream one
+        size_t relayedBytesCount = 0;         // bytes moved from one connection of a pair to the other
+        size_t notificationWakeupsCount = 0;  // times the notification eventfd woke the reactor
+        size_t notificationOverflowsCount = 0; // notifications spilled past the full ring
+        size_t pushDataCount = 0;             // output handed over by workers with PushData
+        size_t sessionsDispatchedCount = 0;   // sessions handed to the workers
+        size_t dispatchBatchesCount = 0;      // push_bulk() calls carrying them
+        size_t count() const { return connectionsCount + listenersCount + connectorsCount + pipesCount + datagramsCount; }
+        double ctlPerRequest() const { return requestsCount ? (double)epollCtlCount / requestsCount : 0.0; }
     };
 
     Stats stats() const { return _stats; }
-    size_t sessionsCount() const { return _sessions.size(); }
+    // Set once run() is entered and never cleared, even when run() fails
+    // right away, so a thread starting the reactor can wait for it.
+    bool started() const { return _started.load(); }
+    size_t sessionsCount() const { return _sessionsCount; }
+
+    // Sends of at least this many bytes go with MSG_ZEROCOPY. 0 turns it off.
+    // Only the epoll backend uses it.
+    void setZeroCopyThreshold(size_t bytes) { _zeroCopyThreshold = bytes; }
+
+    // At most this many connections are accepted per step(), the rest wait in
+    // the listen queue for the next one. 0 means no limit. The io_uring
+    // backend accepts with a multishot request and ignores it.
+    void setAcceptBudget(size_t count) { _acceptBudget = count; }
+
+    // Closed connections, and sessions whose recycle() agrees, are kept in
+    // per-reactor slabs and reused instead of being deleted. On by default.
+    void setRecycling(bool enabled) { _recycling = enabled; }
+
+    // Off by default. Set it before run().
+    void setBusyPoll(const NetBusyPoll& busyPoll) { _busyPoll = busyPoll; }
+
+    // Datagrams received with one recvmmsg and replies sent with one
+    // sendmmsg. Set it before startDatagram().
+    void setDatagramBatch(size_t batch) { _datagramBatch = std::max<size_t>(batch, 1); }
+    size_t freeConnectionsCount() const { return _freeConnections.size(); }
+
+    // Reactor-wide backpressure limits: input messages waiting for workers and
+    // output bytes waiting for sockets, summed over all sessions. Set it
+    // before run().
+    void setWatermarks(const NetWatermarks& watermarks);
+
+    // Connection timeouts and session timers. Reactor thread only.
+    TimerWheel& timers() { return _timers; }
 
     void setSessionsQueue(SessionsQueue* queue) { _queue = queue; }
+    SessionsQueue* sessionsQueue() const { return _queue; }
     NotificationQueue* getNotificationQueue() { return &_notificationQueue; }
 
 private:
     int _fd = -1;
     std::vector<epoll_event> _evsvec;
-    std::unordered_set<NonBlockBase*> _sessions;
+
+    // Live objects indexed by fd. Dead ones have their fd closed, it may be
+    // taken already, and wait in _dying for their session or io_uring.
+    std::vector<NonBlockBase*> _table;
+    std::vector<NonBlockBase*> _dying;
+    size_t _sessionsCount = 0;
+    uint16_t _generation = 0;
+
+    struct SessionSlab {
+        NetSessionFactoryPtr factory;
+        std::vector<NetSession*> sessions;
+    };
+    std::vector<NonBlockConnection*> _freeConnections;
+    std::vector<SessionSlab> _sessionSlabs;
+    bool _recycling = true;
     Stats _stats;
+
+    // Backpressure. Output bytes are counted when the reactor looks at a
+    // session on its own thread.
+    NetWatermarks _watermarks;
+    InputGauge _inputGauge;
+    size_t _outputQueued = 0;
+    std::vector<NonBlockConnection*> _pausedConnections;
+    std::vector<NonBlockListener*> _deferredListeners;
+    std::vector<NonBlockConnection*> _deferredWrites;
+    std::vector<SessionBase*> _readySessions;  // for the workers at the end of the step
+    std::vector<NonBlockDatagram*> _datagrams;
+    std::unique_ptr<DatagramBuffers> _datagramBuffers;
+    size_t _datagramBatch = DefaultDatagramBatch;
+
     std::atomic<bool> _keepRunning = false;
+    std::atomic<bool> _started = false;
     NotificationQueue _notificationQueue;
     SessionsQueue* _queue = nullptr;
+    size_t _zeroCopyThreshold = 0;
+    size_t _acceptBudget = DefaultAcceptBudget;
+    size_t _acceptsLeft = 0;
+    NetBusyPoll _busyPoll;
+    std::chrono::steady_clock::time_point _spinUntil;
+
+    // Accept rate and listen overflows are refreshed once per interval.
+    std::chrono::steady_clock::time_point _acceptStatsTime;
+    size_t _acceptStatsCount = 0;
+    long _listenOverflowsBase = -1;
+    std::unique_ptr<Uring> _uring;
+    std::vector<OutputChain::Slice> _sendSlices;
+    std::atomic<std::thread::id> _loopThread;
+    TimerWheel _timers{TimerWheel::clock()};
+
+    static constexpr unsigned UringBuffersCount = 512;
+    static constexpr unsigned UringBufferSize = 4096;
+    static constexpr size_t UringChainLength = 16;    // linked requests per flush
+    static constexpr size_t UringChainSegments = 1024; // output segments per flush
+    static constexpr size_t DefaultAcceptBudget = 64;
+    static constexpr size_t DefaultDatagramBatch = 64;
+    static constexpr size_t DatagramMaxSize = 2048; // longer ones are dropped
+    static constexpr size_t DatagramReadRounds = 4; // recvmmsg calls per event
+    static constexpr size_t ReadsPerBackpressureCheck = 16; // full reads in onRead() between watermark checks
+    static constexpr size_t DefaultRelaySize = 64 * 1024;
+    static constexpr std::chrono::seconds AcceptStatsInterval{1};
 
 private:
     void on_accept(NonBlockListener* listener);
+    NonBlockConnection* acceptConnection(NonBlockListener* listener, int fd);
+    bool admitConnection(NonBlockListener* listener, int fd);
+    bool flushReleased(NonBlockConnection* connection);
+    int  processInput(NetSession* session);
+    void onDatagramRead(NonBlockDatagram* socket);
+    void onDatagramNotification(DatagramSession* session, NotificationType type);
+    DatagramSession* findPeer(NonBlockDatagram* socket, const DatagramPeer& peer);
+    void flushDatagram(NonBlockDatagram* socket);
+    void dispatchReady();
+    void sweepPeers(NonBlockDatagram* socket);
+    void deferAccepting(NonBlockListener* listener);
+    void resumeAccepting();
     void on_connect(NonBlockConnector* connector);
     int  on_connect(int fd, const NetOperation& op);
+    void updateAcceptStats();
+    int  waitTimeout(int time_ms) const;
+    int  spinTimeout(int time_ms);
+    int  waitNotifications(int timeout);
+    void spinAfter(size_t events);
+    void setBusyPoll(NonBlockConnection* connection);
+    void armReadTimer(NonBlockConnection* connection);
+    void armWriteTimer(NonBlockConnection* connection, bool progress);
+    void onTimeout(NonBlockConnection* connection, bool write);
+    bool closeIfDone(NonBlockConnection* connection);
+    void checkBackpressure(NonBlockConnection* connection);
+    bool canRead(NonBlockConnection* connection) const;
+    void pauseReading(NonBlockConnection* connection);
+    void resumeReading(NonBlockConnection* connection);
+    void resumePaused();
+    void forgetBackpressure(NonBlockConnection* connection);
+    void onEvent(NonBlockConnection* connection, uint32_t mask);
     void onRead(NonBlockConnection* connection);
     void onWrite(NonBlockConnection* connection);
+    void deferWrite(NonBlockConnection* connection);
+    void flushDeferred();
+    void finishSession(NonBlockConnection* connection);
+    bool tlsDecrypt(NonBlockConnection* connection, const char* data, size_t size);
+    void onSplice(NonBlockConnection* connection, uint32_t mask);
+    int  startRelay(NonBlockConnection* client);
+    int  openRelay(NonBlockConnection* connection, const ProxyTarget& target);
+    bool relay(NonBlockConnection* src, NonBlockConnection* dst);
+    ssize_t relayIn(NonBlockConnection* src);
+    ssize_t relayOut(NonBlockConnection* src, NonBlockConnection* dst);
     void on_error(NonBlockBase* nb);
 
+    bool useZeroCopy(NonBlockConnection* connection, size_t size);
+    int  readErrorQueue(NonBlockConnection* connection);
+
     int  registerFd(int fd, NetOpType opType, NonBlockBase* nb);
     int  modifyFd(int fd, NetOpType opType, NonBlockBase* nb);
     void unregisterFd(int fd);
+    uint32_t epollEvents(NetOpType opType, NonBlockBase* nb) const;
+
+    // Epoll event data: the generation and the type tag in the high half,
+    // the fd, which is the index in _table, in the low half. step()
+    // dispatches on the tag.
+    static uint64_t eventKey(const NonBlockBase* nb) {
+        return (uint64_t)nb->_generation << 48 | (uint64_t)nb->type() << 32 | (uint32_t)nb->fd();
+    }
 
     int setNonBlocking(int fd);
 
+    // The socket address of the operation, a UNIX path or ip/port. Returns its
+    // length, 0 if it's invalid.
+    static socklen_t makeAddress(const NetOperation& op, sockaddr_storage& addr);
+
     void deleteSession(NonBlockBase* nb);
     void clearSession(NonBlockBase* nb);
     void addSession(NonBlockBase* nb);
+    void killSession(NonBlockBase* nb);
+    void removeSession(NonBlockBase* nb);
+    NonBlockBase* findSession(int fd) const;
+    std::vector<NonBlockBase*> allSessions() const;
+
+    NonBlockConnection* makeConnection(NonBlockName name, int fd, bool noDelay = false);
+    void freeConnection(NonBlockConnection* connection);
+    NetSession* makeSession(const NetSessionFactoryPtr& factory, NonBlockConnection* connection);
+    void freeSession(NetSession* session, NetSessionFactory* factory);
 
     void processPipe();
+
+    bool onLoopThread() const;
+    void postMoreData(NetSession* session);
+
+    int  stepUring(int time_ms);
+    int  uringArm(NonBlockBase* nb);
+    void uringCancel(NonBlockBase* nb);
+    void uringShutdown();
+    void uringWrite(NonBlockConnection* connection);
+    void uringSubmit(NonBlockConnection* connection, UringOp op);
+    void uringSend(NonBlockConnection* connection);
+    bool uringOpenPipe(NonBlockConnection* connection);
+    void uringOnSend(NonBlockConnection* connection, UringOp op, int res);
+    void uringStopRecv(NonBlockConnection* connection);
+    void uringOnCompletion(const io_uring_cqe& cqe);
+    void uringOnRecv(NonBlockConnection* connection, const io_uring_cqe& cqe);
 };
 
 } // namespace bongo
@@ -0,0 +1,326 @@
+/**********************************************
+   File:   nonblock_datagram.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+#include "nonblock_conn.h"
+#include "datagram.h"
+#include "utils/log.h"
+
+#include <experimental/scope>
+
+#include <assert.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+
+namespace bongo {
+
+/**************************************************
+ *    NonBlockNet: datagrams
+ *
+ *    Datagram sockets are read with recvmmsg, each datagram is queued to the
+ *    session of its peer. Replies wait on the socket until the step is over or
+ *    a MoreData notification comes from a worker, then go out with sendmmsg.
+ */
+int NonBlockNet::startDatagram(const NetOperation& op) {
+    int fd = -1;
+    NonBlockDatagram* nb = nullptr;
+    int result = -1;
+
+    auto cleanup = std::experimental::scope_exit([&]() {
+        if (result != 0) {
+            if (nb == nullptr && fd != -1) {
+                close(fd);
+            }
+
+            delete nb;
+        }
+    });
+
+    auto factory = std::dynamic_pointer_cast<DatagramSessionFactory>(op.factory);
+    if (!factory) {
+        LOG_ERROR << "NonBlockNet::startDatagram: " << op.name << " needs a DatagramSessionFactory";
+        return result;
+    }
+
+    if (!op.path.empty()) {
+        LOG_ERROR << "NonBlockNet::startDatagram: UNIX datagram sockets are not supported";
+        return result;
+    }
+
+    sockaddr_storage bindaddr;
+    const socklen_t addrlen = makeAddress(op, bindaddr);
+    if (addrlen == 0) {
+        return result;
+    }
+
+    fd = socket(bindaddr.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR << "NonBlockNet::startDatagram: failed to create socket: " << strerror(errno);
+        return result;
+    }
+
+    int on = 1;
+    int ret = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (ret != 0) {
+        LOG_ERROR << "NonBlockNet::startDatagram: failed to set socket resuable: " << strerror(errno);
+        return result;
+    }
+
+    if (op.reusePort) {
+        ret = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        if (ret != 0) {
+            LOG_ERROR << "NonBlockNet::startDatagram: failed to set socket port reusable: " << strerror(errno);
+            return result;
+        }
+    }
+
+    ret = bind(fd, (struct sockaddr *) &bindaddr, addrlen);
+    if (ret != 0) {
+        LOG_ERROR << "NonBlockNet::startDatagram: failed to bind: " << strerror(errno);
+        return result;
+    }
+
+    if (!_datagramBuffers) {
+        _datagramBuffers = std::make_unique<DatagramBuffers>(_datagramBatch, DatagramMaxSize);
+    }
+
+    nb = new NonBlockDatagram(this, std::make_shared<const std::string>(op.name), fd, factory);
+    ret = registerFd(fd, NetOpType::Read, nb);
+    if (ret != 0) {
+        LOG_ERROR << "NonBlockNet::startDatagram: failed to register";
+        return result;
+    }
+
+    _datagrams.push_back(nb);
+    const uint32_t idleMs = factory->timeouts().idleMs;
+    if (idleMs != 0) {
+        nb->_idleTimer.setCallback([this, nb]() { sweepPeers(nb); });
+        _timers.arm(&nb->_idleTimer, TimerWheel::clock() + idleMs);
+    }
+
+    result = 0;
+    return result;
+}
+
+void NonBlockNet::onDatagramRead(NonBlockDatagram* socket) {
+    DatagramBuffers& buffers = *_datagramBuffers;
+    const uint64_t now = TimerWheel::clock();
+
+    for (size_t round = 0; round < DatagramReadRounds; round++) {
+        for (size_t i = 0; i < buffers.batch; i++) {
+            buffers.iovs[i] = iovec{ .iov_base = &buffers.data[i * buffers.datagramSize], .iov_len = buffers.datagramSize };
+            msghdr& hdr = buffers.msgs[i].msg_hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_name = &buffers.addrs[i];
+            hdr.msg_namelen = sizeof(sockaddr_storage);
+            hdr.msg_iov = &buffers.iovs[i];
+            hdr.msg_iovlen = 1;
+        }
+
+        const int count = recvmmsg(socket->fd(), buffers.msgs.data(), buffers.batch, 0, nullptr);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+
+        // Errors of a UDP socket are for one datagram sent earlier, the
+        // socket itself keeps working.
+        if (count < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_TRACE << "NonBlockNet::onDatagramRead: " << socket->name() << ": " << strerror(errno);
+            }
+            break;
+        }
+        _stats.recvmmsgCount++;
+
+        for (int i = 0; i < count; i++) {
+            const mmsghdr& msg = buffers.msgs[i];
+            if (msg.msg_hdr.msg_flags & MSG_TRUNC) {
+                _stats.datagramsDroppedCount++;
+                continue;
+            }
+
+            DatagramPeer peer;
+            memcpy(&peer.addr, &buffers.addrs[i], msg.msg_hdr.msg_namelen);
+            peer.len = msg.msg_hdr.msg_namelen;
+
+            DatagramSession* session = findPeer(socket, peer);
+            if (session == nullptr) {
+                _stats.datagramsDroppedCount++;
+                continue;
+            }
+
+            _stats.datagramsReceivedCount++;
+            session->onDatagram(&buffers.data[i * buffers.datagramSize], msg.msg_len, now);
+            session->onRead(_queue);
+        }
+
+        if ((size_t)count < buffers.batch) {
+            break;
+        }
+    }
+}
+
+DatagramSession* NonBlockNet::findPeer(NonBlockDatagram* socket, const DatagramPeer& peer) {
+    auto it = socket->_peers.find(peer);
+    if (it != socket->_peers.end()) {
+        return it->second;
+    }
+
+    DatagramSessionFactory* factory = socket->_factory;
+    const NetAdmission& admission = factory->admission();
+    if (admission.maxConnections != 0 && !factory->admitConnection()) {
+        return nullptr;
+    }
+
+    DatagramSession* session = factory->makeDatagramSession(socket, peer);
+    session->setNotificationQueue(&_notificationQueue);
+    session->setReadyBatch(&_readySessions);
+    session->setMetrics(factory->metrics());
+
+    const LoadShedding& shedding = admission.shedding;
+    session->setLoadShedding(shedding.maxQueued != 0 || shedding.maxWaitMs != 0 ? &shedding : nullptr);
+    if (shedding.maxWaitMs != 0 && _queue != nullptr) {
+        _queue->trackWait();
+    }
+    if (session->init() != 0) {
+        LOG_ERROR << "NonBlockNet::findPeer: failed to init session for " << socket->name();
+        socket->releasePeer(session);
+        return nullptr;
+    }
+
+    socket->_peers.emplace(peer, session);
+    return session;
+}
+
+void NonBlockNet::onDatagramNotification(DatagramSession* session, NotificationType type) {
+    NonBlockDatagram* socket = session->socket();
+
+    switch (type) {
+        case NotificationType::SessionReleased:
+            LOG_TRACE << "NonBlockNet::onDatagramNotification: session released";
+            session->setState(SessionState::Released);
+            session->onRead(_queue);
+            break;
+
+        case NotificationType::ResumeRead:
+            break;
+
+        // A worker queued the first reply since the last flush.
+        case NotificationType::MoreData: {
+            {
+                const std::lock_guard<std::mutex> lock(socket->_mutex);
+                socket->_flushPosted = false;
+            }
+            flushDatagram(socket);
+            break;
+        }
+
+        default:
+            assert(false);
+            break;
+    }
+}
+
+void NonBlockNet::flushDatagram(NonBlockDatagram* socket) {
+    {
+        const std::lock_guard<std::mutex> lock(socket->_mutex);
+        if (socket->_replies.empty()) {
+            return;
+        }
+
+        socket->_replies.swap(socket->_sending);
+        socket->_replyData.swap(socket->_sendingData);
+    }
+
+    auto cleanup = std::experimental::scope_exit([&]() {
+        socket->_sending.clear();
+        socket->_sendingData.clear();
+    });
+
+    DatagramBuffers& buffers = *_datagramBuffers;
+    auto& sending = socket->_sending;
+    size_t next = 0;
+    while (next < sending.size()) {
+        const size_t count = std::min(buffers.batch, sending.size() - next);
+        for (size_t i = 0; i < count; i++) {
+            NonBlockDatagram::Reply& reply = sending[next + i];
+            buffers.iovs[i] = iovec{ .iov_base = &socket->_sendingData[reply.offset], .iov_len = reply.size };
+            msghdr& hdr = buffers.msgs[i].msg_hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_name = &reply.peer.addr;
+            hdr.msg_namelen = reply.peer.len;
+            hdr.msg_iov = &buffers.iovs[i];
+            hdr.msg_iovlen = 1;
+        }
+
+        const int sent = sendmmsg(socket->fd(), buffers.msgs.data(), count, 0);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+
+        // UDP has no backpressure, a full socket buffer drops the rest the
+        // same way the network would.
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+            _stats.datagramsDroppedCount += sending.size() - next;
+            break;
+        }
+
+        // Any other error is about the first datagram, e.g. its peer is
+        // unreachable.
+        if (sent < 0) {
+            LOG_TRACE << "NonBlockNet::flushDatagram: " << socket->name() << ": " << strerror(errno);
+            _stats.datagramsDroppedCount++;
+            next++;
+            continue;
+        }
+
+        _stats.sendmmsgCount++;
+        _stats.datagramsSentCount += sent;
+        next += sent;
+    }
+}
+
+void NonBlockNet::sweepPeers(NonBlockDatagram* socket) {
+    const uint32_t idleMs = socket->_factory->timeouts().idleMs;
+    const uint64_t now = TimerWheel::clock();
+
+    // A posted flush notification points to one of the sessions, they all
+    // wait for the next sweep then.
+    bool flushPosted = false;
+    {
+        const std::lock_guard<std::mutex> lock(socket->_mutex);
+        flushPosted = socket->_flushPosted;
+    }
+
+    for (auto it = socket->_peers.begin(); !flushPosted && it != socket->_peers.end();) {
+        DatagramSession* session = it->second;
+        if (session->state() != SessionState::Released || now - session->lastSeen() < idleMs) {
+            ++it;
+            continue;
+        }
+
+        _stats.idleTimeoutsCount++;
+        socket->releasePeer(session);
+        it = socket->_peers.erase(it);
+    }
+
+    _timers.arm(&socket->_idleTimer, now + idleMs);
+}
+
+} // namespace bongo
@@ -0,0 +1,234 @@
+/**********************************************
+   File:   nonblock_group.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "nonblock_group.h"
+#include "utils/log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <pthread.h>
+#include <sched.h>
+
+namespace bongo {
+
+NonBlockNetGroup::NonBlockNetGroup(size_t size) {
+    if (size == 0) {
+        size = std::thread::hardware_concurrency();
+    }
+
+    if (size == 0) {
+        size = 1;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        _reactors.emplace_back(std::make_unique<NonBlockNet>());
+    }
+}
+
+NonBlockNetGroup::~NonBlockNetGroup() {
+    stop();
+}
+
+int NonBlockNetGroup::init(size_t slotsCount, NetBackend backend) {
+    for (auto& reactor: _reactors) {
+        int ret = reactor->init(slotsCount, backend);
+        if (ret != 0) {
+            LOG_ERROR << "NonBlockNetGroup::init: failed to init reactor";
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int NonBlockNetGroup::startListen(const NetOperation& op) {
+    // UNIX sockets have no SO_REUSEPORT balancing, one reactor accepts all.
+    if (!op.path.empty()) {
+        return _reactors.front()->startListen(op);
+    }
+
+    NetOperation reactorOp = op;
+    reactorOp.reusePort = true;
+
+    for (auto& reactor: _reactors) {
+        int ret = reactor->startListen(reactorOp);
+        if (ret != 0) {
+            LOG_ERROR << "NonBlockNetGroup::startListen: failed to listen on " << op.name;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int NonBlockNetGroup::startConnect(const NetOperation& op) {
+    NonBlockNet& reactor = *_reactors[_nextConnect];
+    _nextConnect = (_nextConnect + 1) % _reactors.size();
+    return reactor.startConnect(op);
+}
+
+int NonBlockNetGroup::startDatagram(const NetOperation& op) {
+    NetOperation reactorOp = op;
+    reactorOp.reusePort = true;
+
+    for (auto& reactor: _reactors) {
+        int ret = reactor->startDatagram(reactorOp);
+        if (ret != 0) {
+            LOG_ERROR << "NonBlockNetGroup::startDatagram: failed to bind " << op.name;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int NonBlockNetGroup::start(int time_ms) {
+    if (!_threads.empty()) {
+        LOG_ERROR << "NonBlockNetGroup::start: already started";
+        return -1;
+    }
+
+    const size_t cores = std::thread::hardware_concurrency();
+
+    for (size_t i = 0; i < _reactors.size(); i++) {
+        NonBlockNet* reactor = _reactors[i].get();
+        _threads.emplace_back(std::thread([reactor, time_ms]() { reactor->run(time_ms); }));
+
+        if (cores > 1) {
+            cpu_set_t cpuset;
+            CPU_ZERO(&cpuset);
+            CPU_SET(i % cores, &cpuset);
+            int ret = pthread_setaffinity_np(_threads.back().native_handle(), sizeof(cpuset), &cpuset);
+            if (ret != 0) {
+                LOG_WARN << "NonBlockNetGroup::start: failed to pin reactor " << i << ": " << strerror(ret);
+            }
+        }
+    }
+
+    // Don't let stop() race with the reactors entering run(). A reactor
+    // whose run() already failed counts as started.
+    for (auto& reactor: _reactors) {
+        while (!reactor->started()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    return 0;
+}
+
+void NonBlockNetGroup::stop() {
+    for (auto& reactor: _reactors) {
+        reactor->stop();
+    }
+
+    for (auto& t: _threads) {
+        t.join();
+    }
+    _threads.clear();
+}
+
+void NonBlockNetGroup::waitListenerReady(size_t listenersCount, size_t loopCount, int sleepLenMs) {
+    for (auto& reactor: _reactors) {
+        reactor->waitListenerReady(listenersCount, loopCount, sleepLenMs);
+    }
+}
+
+NonBlockNet::Stats NonBlockNetGroup::stats() const {
+    NonBlockNet::Stats result;
+    result.ready = true;
+    result.running = true;
+
+    for (const auto& reactor: _reactors) {
+        const NonBlockNet::Stats s = reactor->stats();
+        result.ready = result.ready && s.ready;
+        result.running = result.running && s.running;
+        result.acceptedCount += s.acceptedCount;
+        result.connectedCount += s.connectedCount;
+        result.connectionsCount += s.connectionsCount;
+        result.listenersCount += s.listenersCount;
+        result.connectorsCount += s.connectorsCount;
+        result.pipesCount += s.pipesCount;
+        result.epollCtlCount += s.epollCtlCount;
+        result.requestsCount += s.requestsCount;
+        result.zeroCopySendsCount += s.zeroCopySendsCount;
+        result.zeroCopyCompletedCount += s.zeroCopyCompletedCount;
+        result.zeroCopyCopiedCount += s.zeroCopyCopiedCount;
+        result.acceptCapHitsCount += s.acceptCapHitsCount;
+        result.acceptRate += s.acceptRate;
+        result.idleTimeoutsCount += s.idleTimeoutsCount;
+        result.headerTimeoutsCount += s.headerTimeoutsCount;
+        result.writeTimeoutsCount += s.writeTimeoutsCount;
+        result.inputHighHitsCount += s.inputHighHitsCount;
+        result.outputHighHitsCount += s.outputHighHitsCount;
+        result.globalInputHighHitsCount += s.globalInputHighHitsCount;
+        result.globalOutputHighHitsCount += s.globalOutputHighHitsCount;
+        result.readResumesCount += s.readResumesCount;
+        result.readPausedCount += s.readPausedCount;
+        result.spinWaitsCount += s.spinWaitsCount;
+        result.busyPollFailedCount += s.busyPollFailedCount;
+        result.connectionsRejectedCount += s.connectionsRejectedCount;
+        result.acceptDeferredCount += s.acceptDeferredCount;
+        result.datagramsCount += s.datagramsCount;
+        result.datagramsReceivedCount += s.datagramsReceivedCount;
+        result.datagramsSentCount += s.datagramsSentCount;
+        result.datagramsDroppedCount += s.datagramsDroppedCount;
+        result.recvmmsgCount += s.recvmmsgCount;
+        result.sendmmsgCount += s.sendmmsgCount;
+        result.writesDeferredCount += s.writesDeferredCount;
+        result.deferredFlushesCount += s.deferredFlushesCount;
+        result.tlsHandshakesCount += s.tlsHandshakesCount;
+        result.tlsOffloadedCount += s.tlsOffloadedCount;
+        result.relayPairsCount += s.relayPairsCount;
+        result.relayedBytesCount += s.relayedBytesCount;
+        result.notificationWakeupsCount += s.notificationWakeupsCount;
+        result.notificationOverflowsCount += s.notificationOverflowsCount;
+        result.pushDataCount += s.pushDataCount;
+        result.sessionsDispatchedCount += s.sessionsDispatchedCount;
+        result.dispatchBatchesCount += s.dispatchBatchesCount;
+        // The kernel counter is shared by the whole network namespace.
+        result.listenOverflowsCount = std::max(result.listenOverflowsCount, s.listenOverflowsCount);
+    }
+
+    return result;
+}
+
+void NonBlockNetGroup::setSessionsQueue(SessionsQueue* queue) {
+    for (auto& reactor: _reactors) {
+        reactor->setSessionsQueue(queue);
+    }
+}
+
+void NonBlockNetGroup::setWatermarks(const NetWatermarks& watermarks) {
+    for (auto& reactor: _reactors) {
+        reactor->setWatermarks(watermarks);
+    }
+}
+
+void NonBlockNetGroup::setBusyPoll(const NetBusyPoll& busyPoll) {
+    for (auto& reactor: _reactors) {
+        reactor->setBusyPoll(busyPoll);
+    }
+}
+
+void NonBlockNetGroup::setDatagramBatch(size_t batch) {
+    for (auto& reactor: _reactors) {
+        reactor->setDatagramBatch(batch);
+    }
+}
+
+} // namespace bongo
@@ -0,0 +1,77 @@
+/**********************************************
+   File:   nonblock_group.h
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#pragma once
+#include "nonblock_conn.h"
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace bongo {
+
+/*******************************************************************************
+ *   NonBlockNetGroup runs several NonBlockNet reactors, one thread each.
+ *   Every reactor has its own epoll fd, notification queue and stats.
+ *   Listeners are opened on every reactor with SO_REUSEPORT, so the kernel
+ *   spreads accepted connections between them. UNIX socket listeners are
+ *   opened on the first reactor only. Connectors are assigned round-robin.
+ *   Datagram sockets are bound on every reactor with SO_REUSEPORT too, the
+ *   kernel keeps a peer on one of them by its address hash.
+ *
+ *   startListen(), startConnect() and startDatagram() must be called before
+ *   start().
+ */
+class NonBlockNetGroup {
+public:
+    NonBlockNetGroup(size_t size = 0);
+    ~NonBlockNetGroup();
+
+    int init(size_t slotsCount = 1024, NetBackend backend = NetBackend::Epoll);
+
+    int startListen(const NetOperation& op);
+    int startConnect(const NetOperation& op);
+    int startDatagram(const NetOperation& op);
+
+    int  start(int time_ms);
+    void stop();
+
+    void waitListenerReady(size_t listenersCount = 1, size_t loopCount = 10, int sleepLenMs = 50);
+
+    size_t size() const { return _reactors.size(); }
+    NonBlockNet& reactor(size_t index) { return *_reactors[index]; }
+
+    // Sum of the reactors' stats. ready/running are set when all reactors are.
+    NonBlockNet::Stats stats() const;
+
+    void setSessionsQueue(SessionsQueue* queue);
+
+    // The reactor-wide watermarks apply to each reactor separately.
+    void setWatermarks(const NetWatermarks& watermarks);
+
+    // Every reactor spins on a core of its own.
+    void setBusyPoll(const NetBusyPoll& busyPoll);
+
+    void setDatagramBatch(size_t batch);
+
+private:
+    std::vector<std::unique_ptr<NonBlockNet>> _reactors;
+    std::vector<std::thread> _threads;
+    size_t _nextConnect = 0;
+};
+
+} // namespace bongo
@@ -0,0 +1,605 @@
+/**********************************************
+   File:   nonblock_uring.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+#include "nonblock_conn.h"
+#include "datagram.h"
+#include "uring.h"
+#include "proc/notification_base.h"
+#include "utils/log.h"
+
+#include <experimental/scope>
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <algorithm>
+
+namespace bongo {
+
+/**************************************************
+ *    NonBlockNet: io_uring backend
+ *
+ *    Listeners run a multishot accept, connections a multishot recv over the
+ *    provided buffer ring, the notification pipe a multishot poll. A flush
+ *    of the output is one chain of linked sends, one chain in flight per
+ *    connection: sendmsg for memory segments, splice through a pipe for file
+ *    segments. A POLLOUT poll waits for room when a splice finds the socket
+ *    full.
+ *    Everything queued during a step goes to the kernel with the
+ *    io_uring_enter() that waits for the next completions.
+ */
+enum class UringOp : uint64_t {
+    Accept = 1,
+    Recv = 2,
+    Send = 3,
+    Poll = 4,
+    WritePoll = 5,
+    FileToPipe = 6,
+    PipeToSocket = 7,
+};
+
+static constexpr uint64_t UringOpMask = 7;
+
+static uint64_t uringData(NonBlockBase* nb, UringOp op) {
+    return reinterpret_cast<uint64_t>(nb) | static_cast<uint64_t>(op);
+}
+
+int NonBlockNet::stepUring(int time_ms) {
+    auto afterStep = std::experimental::scope_exit([&]() {
+        processPipe();
+        _timers.advance(TimerWheel::clock());
+        updateAcceptStats();
+        if (!_pausedConnections.empty()) {
+            resumePaused();
+        }
+        if (!_deferredWrites.empty()) {
+            flushDeferred();
+        }
+        for (NonBlockDatagram* socket: _datagrams) {
+            flushDatagram(socket);
+        }
+        dispatchReady();
+    });
+
+    int ret = _uring->submit(waitNotifications(spinTimeout(time_ms)));
+    _notificationQueue.disarm();
+    if (ret != 0) {
+        LOG_ERROR << "NonBlockNet::stepUring: failed to submit";
+        return -1;
+    }
+
+    size_t count = 0;
+    for (;; count++) {
+        io_uring_cqe* cqe = _uring->peek();
+        if (cqe == nullptr) {
+            break;
+        }
+
+        const io_uring_cqe completion = *cqe;
+        _uring->seen();
+        uringOnCompletion(completion);
+    }
+    spinAfter(count);
+
+    return 0;
+}
+
+int NonBlockNet::uringArm(NonBlockBase* nb) {
+    io_uring_sqe* sqe = _uring->getSqe();
+    if (sqe == nullptr) {
+        LOG_ERROR << "NonBlockNet::uringArm: submission queue is full";
+        return -1;
+    }
+
+    sqe->fd = nb->fd();
+
+    switch (nb->type()) {
+        case NonBlockFdType::Listener:
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            sqe->user_data = uringData(nb, UringOp::Accept);
+            break;
+
+        case NonBlockFdType::Connector:
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->poll32_events = POLLOUT;
+            sqe->user_data = uringData(nb, UringOp::Poll);
+            break;
+
+        case NonBlockFdType::PipeQueue:
+        case NonBlockFdType::Datagram:
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->poll32_events = POLLIN;
+            sqe->len = IORING_POLL_ADD_MULTI;
+            sqe->user_data = uringData(nb, UringOp::Poll);
+            break;
+
+        case NonBlockFdType::Connection:
+            sqe->opcode = IORING_OP_RECV;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = Uring::BufferGroup;
+            sqe->user_data = uringData(nb, UringOp::Recv);
+            static_cast<NonBlockConnection*>(nb)->_receiving = true;
+            break;
+    }
+
+    nb->incPending();
+    return 0;
+}
+
+void NonBlockNet::uringCancel(NonBlockBase* nb) {
+    io_uring_sqe* sqe = _uring->getSqe();
+    if (sqe == nullptr) {
+        LOG_ERROR << "NonBlockNet::uringCancel: submission queue is full";
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = nb->fd();
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = 0;
+
+    // The cancel matches requests by file, so it has to reach the kernel
+    // before the caller closes the fd.
+    _uring->submit();
+}
+
+void NonBlockNet::uringShutdown() {
+    io_uring_sqe* sqe = _uring->getSqe();
+    if (sqe == nullptr) {
+        LOG_ERROR << "NonBlockNet::uringShutdown: submission queue is full";
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = 0;
+
+    auto pendingCount = [this]() {
+        size_t count = 0;
+        for (auto nb: allSessions()) {
+            count += nb->pending();
+        }
+        return count;
+    };
+
+    // Cancelled requests complete quickly. Don't hang on a broken kernel though.
+    for (int i = 0; i < 100 && pendingCount() > 0; i++) {
+        if (_uring->submit(10) != 0) {
+            break;
+        }
+
+        for (io_uring_cqe* cqe = _uring->peek(); cqe != nullptr; cqe = _uring->peek()) {
+            const uint64_t data = cqe->user_data;
+            const bool more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+            _uring->seen();
+
+            if (data != 0 && !more) {
+                reinterpret_cast<NonBlockBase*>(data & ~UringOpMask)->decPending();
+            }
+        }
+    }
+}
+
+void NonBlockNet::uringWrite(NonBlockConnection* connection) {
+    // Workers must not touch the ring. Let the reactor do the writing.
+    if (!onLoopThread()) {
+        postMoreData(connection->session());
+        return;
+    }
+
+    if (connection->_sending || connection->dead()) {
+        return;
+    }
+
+    NetSession* session = connection->session();
+    armWriteTimer(connection, false);
+
+    if (session->output().empty()) {
+        int ret = session->onWrite();
+        if (ret < 0) {
+            LOG_TRACE << "NonBlockNet::uringWrite: finish connection: " << connection->name();
+            deleteSession(connection);
+        }
+        return;
+    }
+
+    uringSend(connection);
+}
+
+void NonBlockNet::uringStopRecv(NonBlockConnection* connection) {
+    if (!connection->_receiving) {
+        return;
+    }
+
+    // The recv completes with ECANCELED and is not re-armed while paused.
+    io_uring_sqe* sqe = _uring->getSqe();
+    if (sqe == nullptr) {
+        LOG_ERROR << "NonBlockNet::uringStopRecv: submission queue is full";
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = uringData(connection, UringOp::Recv);
+    sqe->user_data = 0;
+}
+
+void NonBlockNet::uringSubmit(NonBlockConnection* connection, UringOp op) {
+    io_uring_sqe* sqe = _uring->getSqe();
+    if (sqe == nullptr) {
+        LOG_ERROR << "NonBlockNet::uringSubmit: submission queue is full";
+        deleteSession(connection);
+        return;
+    }
+
+    sqe->fd = connection->fd();
+    sqe->user_data = uringData(connection, op);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->poll32_events = POLLOUT;
+
+    connection->_sending = true;
+    connection->incPending();
+}
+
+void NonBlockNet::uringSend(NonBlockConnection* connection) {
+    // One flush is one chain of linked requests: a sendmsg per run of memory
+    // segments, and per file segment a splice into the pipe followed by a
+    // splice from it to the socket. The kernel runs them in order, one that
+    // fails or comes up short cancels the rest.
+    if (!_uring->reserve(UringChainLength)) {
+        LOG_ERROR << "NonBlockNet::uringSend: submission queue is full";
+        deleteSession(connection);
+        return;
+    }
+
+    OutputChain& output = connection->session()->output();
+    _sendSlices.resize(std::min(output.segmentsCount(), UringChainSegments));
+    const size_t count = output.describe(_sendSlices.data(), _sendSlices.size());
+
+    // The kernel reads them when it runs the request, they must not move.
+    connection->_sendMsgs.resize(UringChainLength);
+    connection->_sendIov.resize(count);
+    size_t msgs = 0;
+    size_t iovs = 0;
+
+    size_t requests = 0;
+    size_t queued = 0;
+    io_uring_sqe* last = nullptr;
+    auto next = [&](UringOp op) {
+        io_uring_sqe* sqe = _uring->getSqe();
+        if (last != nullptr) {
+            last->flags |= IOSQE_IO_LINK;
+        }
+        last = sqe;
+        requests++;
+        sqe->user_data = uringData(connection, op);
+        connection->incPending();
+        return sqe;
+    };
+
+    // Bytes already in the pipe are the first ones of the leading segment.
+    size_t piped = connection->_sendPiped;
+    for (size_t i = 0; i < count && requests < UringChainLength; i++) {
+        const OutputChain::Slice& slice = _sendSlices[i];
+        if (slice.fd == -1) {
+            iovec& iov = connection->_sendIov[iovs++];
+            iov.iov_base = const_cast<char*>(slice.ptr);
+            iov.iov_len = slice.size;
+            queued += slice.size;
+
+            if (last != nullptr && last->opcode == IORING_OP_SENDMSG) {
+                connection->_sendMsgs[msgs - 1].msg_iovlen++;
+                continue;
+            }
+
+            msghdr& msg = connection->_sendMsgs[msgs++];
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+
+            io_uring_sqe* sqe = next(UringOp::Send);
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = connection->fd();
+            sqe->addr = reinterpret_cast<uint64_t>(&msg);
+            sqe->len = 1;
+            sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL | MSG_MORE;
+            continue;
+        }
+
+        if (!uringOpenPipe(connection)) {
+            if (requests == 0) {
+                deleteSession(connection);
+                return;
+            }
+            break;
+        }
+
+        off_t offset = slice.offset + piped;
+        size_t left = slice.size - piped;
+        while ((left > 0 || piped > 0) && requests + 2 <= UringChainLength) {
+            // Drain what a short request left in the pipe before refilling it,
+            // a partly filled pipe may have no room for another page.
+            const size_t size = piped > 0 ? 0 : std::min(left, connection->_sendPipeSize);
+            if (size > 0) {
+                io_uring_sqe* sqe = next(UringOp::FileToPipe);
+                sqe->opcode = IORING_OP_SPLICE;
+                sqe->splice_fd_in = slice.fd;
+                sqe->splice_off_in = offset;
+                sqe->fd = connection->_sendPipe[1];
+                sqe->off = (uint64_t)-1;
+                sqe->len = size;
+                sqe->splice_flags = SPLICE_F_MOVE;
+                offset += size;
+                left -= size;
+            }
+
+            io_uring_sqe* sqe = next(UringOp::PipeToSocket);
+            sqe->opcode = IORING_OP_SPLICE;
+            sqe->splice_fd_in = connection->_sendPipe[0];
+            sqe->splice_off_in = (uint64_t)-1;
+            sqe->fd = connection->fd();
+            sqe->off = (uint64_t)-1;
+            sqe->len = piped + size;
+            sqe->splice_flags = SPLICE_F_MOVE | SPLICE_F_MORE;
+            queued += piped + size;
+            piped = 0;
+        }
+
+        if (left > 0) {
+            break;
+        }
+    }
+
+    // Nothing follows the chain: let the last bytes go out.
+    if (queued == output.size()) {
+        if (last->opcode == IORING_OP_SENDMSG) {
+            last->msg_flags &= ~MSG_MORE;
+        } else {
+            last->splice_flags &= ~SPLICE_F_MORE;
+        }
+    }
+
+    LOG_TRACE << "NonBlockNet::uringSend: " << queued << " Bytes in " << requests << " requests for "
+              << connection->name();
+    connection->_sendsInFlight = requests;
+    connection->_sendProgress = false;
+    connection->_sendBlocked = false;
+    connection->_sendFailed = false;
+    connection->_sending = true;
+}
+
+bool NonBlockNet::uringOpenPipe(NonBlockConnection* connection) {
+    if (connection->_sendPipe[0] != -1) {
+        return true;
+    }
+
+    if (pipe2(connection->_sendPipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+        LOG_ERROR << "NonBlockNet::uringOpenPipe: failed to create pipe: " << strerror(errno);
+        return false;
+    }
+
+    const int size = fcntl(connection->_sendPipe[1], F_GETPIPE_SZ);
+    connection->_sendPipeSize = size > 0 ? size : 64 * 1024;
+    return true;
+}
+
+void NonBlockNet::uringOnSend(NonBlockConnection* connection, UringOp op, int res) {
+    NetSession* session = connection->session();
+    if (res > 0 && op == UringOp::FileToPipe) {
+        connection->_sendPiped += res;
+    } else if (res > 0) {
+        if (op == UringOp::PipeToSocket) {
+            connection->_sendPiped -= res;
+        }
+        session->countBytesOut(res);
+        session->completedWriting(res);
+        connection->_sendProgress = true;
+    } else if (res == -EAGAIN) {
+        connection->_sendBlocked = true;
+    } else if (res == 0 && op == UringOp::FileToPipe) {
+        LOG_TRACE << "NonBlockNet::uringOnSend: file is shorter than its segment for " << connection->name();
+        connection->_sendFailed = true;
+    } else if (res < 0 && res != -ECANCELED) {
+        LOG_TRACE << "NonBlockNet::uringOnSend: failed to write to socket: " << strerror(-res);
+        connection->_sendFailed = true;
+    }
+
+    if (--connection->_sendsInFlight > 0) {
+        return;
+    }
+
+    // The chain is over. A short request cancelled the rest, the next flush
+    // picks up where it stopped.
+    connection->_sending = false;
+    if (connection->_sendFailed) {
+        deleteSession(connection);
+        return;
+    }
+
+    armWriteTimer(connection, connection->_sendProgress);
+    if (connection->_sendBlocked) {
+        uringSubmit(connection, UringOp::WritePoll);
+        return;
+    }
+
+    const int fd = connection->fd();
+    uringWrite(connection);
+    if (findSession(fd) == connection && !closeIfDone(connection)) {
+        checkBackpressure(connection);
+    }
+}
+
+void NonBlockNet::uringOnCompletion(const io_uring_cqe& cqe) {
+    if (cqe.user_data == 0) {
+        return; // cancel request
+    }
+
+    NonBlockBase* nb = reinterpret_cast<NonBlockBase*>(cqe.user_data & ~UringOpMask);
+    UringOp op = static_cast<UringOp>(cqe.user_data & UringOpMask);
+
+    const bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+    if (!more) {
+        nb->decPending();
+    }
+
+    if (op == UringOp::Recv && (cqe.flags & IORING_CQE_F_BUFFER) != 0 && nb->dead()) {
+        _uring->recycleBuffer(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+
+    if (nb->dead()) {
+        if (nb->pending() == 0) {
+            deleteSession(nb);
+        }
+        return;
+    }
+
+    switch (op) {
+        case UringOp::Accept: {
+            NonBlockListener* listener = static_cast<NonBlockListener*>(nb);
+            if (cqe.res < 0) {
+                LOG_ERROR << "NonBlockNet::uringOnCompletion: failed to accept connection: " << strerror(-cqe.res);
+                deleteSession(listener);
+                return;
+            }
+
+            // A session may have output ready right away, e.g. a greeting.
+            // The accept is multishot, over the cap connections are reset.
+            if (admitConnection(listener, cqe.res)) {
+                NonBlockConnection* conn = acceptConnection(listener, cqe.res);
+                if (conn != nullptr) {
+                    uringWrite(conn);
+                }
+            }
+
+            if (!more && uringArm(listener) != 0) {
+                deleteSession(listener);
+            }
+            break;
+        }
+
+        case UringOp::Recv:
+            uringOnRecv(static_cast<NonBlockConnection*>(nb), cqe);
+            break;
+
+        case UringOp::Send:
+        case UringOp::FileToPipe:
+        case UringOp::PipeToSocket:
+            uringOnSend(static_cast<NonBlockConnection*>(nb), op, cqe.res);
+            break;
+
+        case UringOp::WritePoll: {
+            NonBlockConnection* conn = static_cast<NonBlockConnection*>(nb);
+            conn->_sending = false;
+            if (cqe.res < 0 || (cqe.res & (POLLERR | POLLHUP)) != 0) {
+                on_error(conn);
+                break;
+            }
+
+            uringWrite(conn);
+            break;
+        }
+
+        case UringOp::Poll:
+            if (nb->type() == NonBlockFdType::PipeQueue) {
+                _stats.notificationWakeupsCount++;
+                _notificationQueue.clearWakeup();
+                processPipe();
+                if (!more && uringArm(nb) != 0) {
+                    LOG_ERROR << "NonBlockNet::uringOnCompletion: failed to re-arm pipe";
+                }
+                break;
+            }
+
+            if (nb->type() == NonBlockFdType::Datagram) {
+                onDatagramRead(static_cast<NonBlockDatagram*>(nb));
+                if (!more && uringArm(nb) != 0) {
+                    LOG_ERROR << "NonBlockNet::uringOnCompletion: failed to re-arm datagram socket";
+                }
+                break;
+            }
+
+            if (cqe.res < 0 || (cqe.res & (POLLERR | POLLHUP)) != 0) {
+                on_error(nb);
+                break;
+            }
+
+            on_connect(static_cast<NonBlockConnector*>(nb));
+            break;
+    }
+}
+
+void NonBlockNet::uringOnRecv(NonBlockConnection* connection, const io_uring_cqe& cqe) {
+    const bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+    if (!more) {
+        connection->_receiving = false;
+    }
+
+    if (cqe.res == -ENOBUFS) {
+        LOG_TRACE << "NonBlockNet::uringOnRecv: out of buffers " << connection->name();
+    } else if (cqe.res == 0) {
+        // Same as epoll onRead: the peer finished sending, the connection stays
+        // for writing. Just don't re-arm the receive.
+        LOG_TRACE << "NonBlockNet::uringOnRecv: no more data " << connection->name();
+        connection->_peerClosed = true;
+        closeIfDone(connection);
+        return;
+    } else if (cqe.res == -ECANCELED && connection->_readPaused) {
+        LOG_TRACE << "NonBlockNet::uringOnRecv: paused " << connection->name();
+    } else if (cqe.res < 0) {
+        LOG_TRACE << "NonBlockNet::uringOnRecv: failed to read from socket: " << strerror(-cqe.res);
+        deleteSession(connection);
+        return;
+    } else {
+        uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        size_t sz = (size_t)cqe.res;
+
+        NetSession* session = connection->session();
+        Buffer buf = session->getReadBuffer(sz);
+        memcpy(buf.ptr, _uring->buffer(bid), sz);
+        session->updateReadBuffer(sz);
+        session->countBytesIn(sz);
+        _uring->recycleBuffer(bid);
+
+        LOG_TRACE << "NonBlockNet::uringOnRecv received " << sz << " Bytes " << connection->name();
+        int ret = processInput(session);
+        if (ret != 0) {
+            LOG_TRACE << "NonBlockNet::uringOnRecv: finish connection: " << connection->name();
+            finishSession(connection);
+            return;
+        }
+
+        if (!flushReleased(connection)) {
+            return;
+        }
+
+        armReadTimer(connection);
+        checkBackpressure(connection);
+    }
+
+    if (!connection->_receiving && !connection->dead() && !connection->_readPaused) {
+        if (uringArm(connection) != 0) {
+            deleteSession(connection);
+        }
+    }
+}
+
+} // namespace bongo
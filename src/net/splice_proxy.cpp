@@ -0,0 +1,36 @@
+/**********************************************
+   File:   splice_proxy.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "splice_proxy.h"
+
+namespace bongo {
+
+namespace {
+
+class ProxyUpstreamFactory : public NetSessionFactory {
+public:
+    NetSession* makeSession(NonBlockConnection* conn) override { return new ProxySession(conn); }
+};
+
+} // namespace
+
+ProxySessionFactory::ProxySessionFactory(const ProxyTarget& target)
+  : _target(target), _upstream(std::make_shared<ProxyUpstreamFactory>()) {
+}
+
+} // namespace bongo
@@ -0,0 +1,66 @@
+/**********************************************
+   File:   splice_proxy.h
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#pragma once
+#include "net_session.h"
+#include <string>
+
+namespace bongo {
+
+struct ProxyTarget {
+    std::string name = {};  // of the upstream connections, for logs
+    std::string ip = {};
+    int port = 0;
+    std::string path = {};  // a UNIX domain socket used instead of ip/port
+    size_t pipeSize = 0;    // bytes buffered per direction, 0 - the pipe default
+    bool copy = false;      // relay through user space with read()/send() instead of splice()
+};
+
+/*******************************************************************************
+ *   ProxySession stands for either side of a relayed connection pair. It
+ *   never sees the bytes: the reactor moves them between the sockets with
+ *   splice() through a pipe per direction. Nothing to process, so nothing
+ *   goes to the workers.
+ */
+class ProxySession : public NetSession {
+public:
+    ProxySession(NonBlockConnection* conn) : NetSession(conn) {}
+    bool recycle() override { return true; }
+};
+
+/*******************************************************************************
+ *   ProxySessionFactory relays every accepted connection to the target. The
+ *   upstream connection is opened by the reactor on the first event of the
+ *   accepted one and closed along with it. Epoll backend only.
+ */
+class ProxySessionFactory : public NetSessionFactory {
+public:
+    ProxySessionFactory(const ProxyTarget& target);
+
+    NetSession* makeSession(NonBlockConnection* conn) override { return new ProxySession(conn); }
+    const ProxyTarget* proxyTarget() const override { return &_target; }
+
+    // Makes the sessions of the upstream connections.
+    const NetSessionFactoryPtr& upstream() const { return _upstream; }
+
+private:
+    const ProxyTarget _target;
+    NetSessionFactoryPtr _upstream;
+};
+
+} // namespace bongo
@@ -0,0 +1,549 @@
+/**********************************************
+   File:   tls.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "tls.h"
+#include "proc/session_base.h"
+#include "utils/log.h"
+#include "utils/output_chain.h"
+
+#include <experimental/scope>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <sstream>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+namespace bongo {
+
+namespace {
+
+std::string tlsError() {
+    char buf[256];
+    ERR_error_string_n(ERR_get_error(), buf, sizeof(buf));
+    return buf;
+}
+
+// RFC 8446 7.1 with an empty context.
+int expandLabel(const EVP_MD* md, const std::vector<unsigned char>& secret, const std::string& label,
+                unsigned char* out, size_t size) {
+    const std::string fullLabel = "tls13 " + label;
+    std::vector<unsigned char> info;
+    info.push_back(size >> 8);
+    info.push_back(size & 0xff);
+    info.push_back(fullLabel.size());
+    info.insert(info.end(), fullLabel.begin(), fullLabel.end());
+    info.push_back(0);
+
+    EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+    if (pctx == nullptr) {
+        return -1;
+    }
+    auto cleanup = std::experimental::scope_exit([&]() { EVP_PKEY_CTX_free(pctx); });
+
+    size_t len = size;
+    if (EVP_PKEY_derive_init(pctx) <= 0 ||
+        EVP_PKEY_CTX_set_hkdf_mode(pctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) <= 0 ||
+        EVP_PKEY_CTX_set_hkdf_md(pctx, md) <= 0 ||
+        EVP_PKEY_CTX_set1_hkdf_key(pctx, secret.data(), secret.size()) <= 0 ||
+        EVP_PKEY_CTX_add1_hkdf_info(pctx, info.data(), info.size()) <= 0 ||
+        EVP_PKEY_derive(pctx, out, &len) <= 0 || len != size) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int hexValue(char ch) {
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    }
+    if (ch >= 'A' && ch <= 'F') {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+} // namespace
+
+/*******************************************************************************
+ *   TlsContext
+ */
+TlsContext::TlsContext(TlsMode mode, const TlsConfig& config) : _mode(mode), _config(config) {
+}
+
+TlsContext::~TlsContext() {
+    SSL_CTX_free(_ctx);
+}
+
+int TlsContext::init() {
+    _ctx = SSL_CTX_new(_mode == TlsMode::Server ? TLS_server_method() : TLS_client_method());
+    if (_ctx == nullptr) {
+        LOG_ERROR << "TlsContext::init: failed to create context: " << tlsError();
+        return -1;
+    }
+
+    SSL_CTX_set_min_proto_version(_ctx, TLS1_2_VERSION);
+    if (_config.kernelOffload) {
+        SSL_CTX_set_keylog_callback(_ctx, TlsLayer::keyLog);
+    }
+
+    // A client verifies the server unless told not to.
+    if (_mode == TlsMode::Client) {
+        if (_config.insecure) {
+            return 0;
+        }
+
+        if (_config.caPem.empty() || _config.serverName.empty()) {
+            LOG_ERROR << "TlsContext::init: a client needs caPem and serverName, or insecure";
+            return -1;
+        }
+
+        BIO* bio = BIO_new_mem_buf(_config.caPem.data(), _config.caPem.size());
+        auto cleanup = std::experimental::scope_exit([&]() { BIO_free(bio); });
+        X509_STORE* store = SSL_CTX_get_cert_store(_ctx);
+        size_t count = 0;
+        while (X509* ca = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr)) {
+            X509_STORE_add_cert(store, ca);
+            X509_free(ca);
+            count++;
+        }
+        ERR_clear_error();
+
+        if (count == 0) {
+            LOG_ERROR << "TlsContext::init: no CA certificates";
+            return -1;
+        }
+
+        SSL_CTX_set_verify(_ctx, SSL_VERIFY_PEER, nullptr);
+        return 0;
+    }
+
+    SSL_CTX_set_num_tickets(_ctx, 0);
+    SSL_CTX_set_options(_ctx, SSL_OP_NO_TICKET);
+
+    BIO* bio = BIO_new_mem_buf(_config.certPem.data(), _config.certPem.size());
+    auto cleanupCert = std::experimental::scope_exit([&]() { BIO_free(bio); });
+    X509* cert = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr);
+    if (cert == nullptr || SSL_CTX_use_certificate(_ctx, cert) != 1) {
+        LOG_ERROR << "TlsContext::init: bad certificate: " << tlsError();
+        X509_free(cert);
+        return -1;
+    }
+    X509_free(cert);
+
+    // The rest of the chain, if any.
+    while (X509* chain = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr)) {
+        SSL_CTX_add_extra_chain_cert(_ctx, chain);
+    }
+    ERR_clear_error();
+
+    BIO* keyBio = BIO_new_mem_buf(_config.keyPem.data(), _config.keyPem.size());
+    auto cleanupKey = std::experimental::scope_exit([&]() { BIO_free(keyBio); });
+    EVP_PKEY* key = PEM_read_bio_PrivateKey(keyBio, nullptr, nullptr, nullptr);
+    if (key == nullptr || SSL_CTX_use_PrivateKey(_ctx, key) != 1 || SSL_CTX_check_private_key(_ctx) != 1) {
+        LOG_ERROR << "TlsContext::init: bad private key: " << tlsError();
+        EVP_PKEY_free(key);
+        return -1;
+    }
+    EVP_PKEY_free(key);
+
+    return 0;
+}
+
+int TlsContext::makeSelfSigned(const std::string& commonName, std::string& certPem, std::string& keyPem) {
+    EVP_PKEY* key = EVP_EC_gen("P-256");
+    X509* cert = X509_new();
+    BIO* bio = BIO_new(BIO_s_mem());
+    auto cleanup = std::experimental::scope_exit([&]() {
+        BIO_free(bio);
+        X509_free(cert);
+        EVP_PKEY_free(key);
+    });
+
+    if (key == nullptr || cert == nullptr || bio == nullptr) {
+        LOG_ERROR << "TlsContext::makeSelfSigned: out of memory";
+        return -1;
+    }
+
+    X509_set_version(cert, X509_VERSION_3);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), -60);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 7 * 24 * 3600);
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)commonName.c_str(), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    X509_set_pubkey(cert, key);
+
+    if (X509_sign(cert, key, EVP_sha256()) == 0) {
+        LOG_ERROR << "TlsContext::makeSelfSigned: failed to sign: " << tlsError();
+        return -1;
+    }
+
+    auto take = [&](std::string& pem) {
+        char* data = nullptr;
+        const long size = BIO_get_mem_data(bio, &data);
+        pem.assign(data, size);
+        BIO_reset(bio);
+    };
+
+    if (PEM_write_bio_X509(bio, cert) != 1) {
+        return -1;
+    }
+    take(certPem);
+
+    if (PEM_write_bio_PrivateKey(bio, key, nullptr, nullptr, 0, nullptr, nullptr) != 1) {
+        return -1;
+    }
+    take(keyPem);
+
+    return 0;
+}
+
+bool TlsContext::kernelTlsAvailable() {
+    // Without the module the upper layer protocol is unknown. With it, an
+    // unconnected socket is refused for not being connected.
+    static const bool available = []() {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return false;
+        }
+
+        int ret = setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls"));
+        const bool result = ret == 0 || errno == ENOTCONN;
+        close(fd);
+        return result;
+    }();
+
+    return available;
+}
+
+/*******************************************************************************
+ *   TlsLayer
+ */
+TlsLayer::TlsLayer(TlsContextPtr context) : _context(std::move(context)) {
+}
+
+TlsLayer::~TlsLayer() {
+    SSL_free(_ssl);
+    OPENSSL_cleanse(_clientSecret.data(), _clientSecret.size());
+    OPENSSL_cleanse(_serverSecret.data(), _serverSecret.size());
+}
+
+int TlsLayer::init(int fd) {
+    _fd = fd;
+    _ssl = SSL_new(_context->ctx());
+    _rbio = BIO_new(BIO_s_mem());
+    _wbio = BIO_new(BIO_s_mem());
+    if (_ssl == nullptr || _rbio == nullptr || _wbio == nullptr) {
+        LOG_ERROR << "TlsLayer::init: failed to create TLS state: " << tlsError();
+        BIO_free(_rbio);
+        BIO_free(_wbio);
+        return -1;
+    }
+
+    // An empty read BIO means "come back later", not the end of the stream.
+    BIO_set_mem_eof_return(_rbio, -1);
+    SSL_set_bio(_ssl, _rbio, _wbio);
+    SSL_set_app_data(_ssl, this);
+
+    if (_context->mode() == TlsMode::Server) {
+        SSL_set_accept_state(_ssl);
+        return 0;
+    }
+
+    // The handshake fails unless the certificate is for the server name.
+    const std::string& host = _context->serverName();
+    if (!host.empty() && (SSL_set_tlsext_host_name(_ssl, host.c_str()) != 1 ||
+                          SSL_set1_host(_ssl, host.c_str()) != 1)) {
+        LOG_ERROR << "TlsLayer::init: failed to set server name: " << tlsError();
+        return -1;
+    }
+
+    SSL_set_connect_state(_ssl);
+    return 0;
+}
+
+ssize_t TlsLayer::decrypt(const char* data, size_t size, SessionBase* session) {
+    if (BIO_write(_rbio, data, size) != (int)size) {
+        LOG_ERROR << "TlsLayer::decrypt: failed to buffer records";
+        return -1;
+    }
+
+    if (!_handshakeDone) {
+        if (handshake() != 0) {
+            return -1;
+        }
+
+        if (!_handshakeDone) {
+            return 0;
+        }
+    }
+
+    ssize_t plain = 0;
+    for (;;) {
+        Buffer buf = session->getReadBuffer(RecordSize);
+        int ret = SSL_read(_ssl, buf.ptr, buf.size);
+        if (ret > 0) {
+            session->updateReadBuffer(ret);
+            plain += ret;
+            continue;
+        }
+
+        const int err = SSL_get_error(_ssl, ret);
+        if (err == SSL_ERROR_WANT_READ) {
+            break;
+        }
+
+        if (err == SSL_ERROR_ZERO_RETURN) {
+            _peerClosed = true;
+            break;
+        }
+
+        LOG_TRACE << "TlsLayer::decrypt: " << tlsError();
+        return -1;
+    }
+
+    // Alerts, key updates.
+    collect();
+    return plain;
+}
+
+ssize_t TlsLayer::encrypt(SessionBase* session) {
+    if (!_handshakeDone) {
+        return handshake();
+    }
+
+    // The kernel encrypts from the first record of application data on.
+    if (_txOffloadWanted) {
+        return 0;
+    }
+
+    OutputChain& output = session->output();
+    ssize_t plain = 0;
+    iovec iov[64];
+
+    while (!output.empty() && pendingSize() < MaxPendingSize) {
+        // Small segments share a record, a file is read in.
+        _record.resize(RecordSize);
+        size_t size = 0;
+        if (auto file = output.frontFile()) {
+            ssize_t ret = pread(file->fd, _record.data(), std::min(file->size, RecordSize), file->offset);
+            if (ret <= 0) {
+                LOG_ERROR << "TlsLayer::encrypt: failed to read file: " << strerror(errno);
+                return -1;
+            }
+            size = ret;
+        } else {
+            const size_t count = output.fill(iov, 64);
+            for (size_t i = 0; i < count && size < RecordSize; i++) {
+                const size_t len = std::min(iov[i].iov_len, RecordSize - size);
+                memcpy(_record.data() + size, iov[i].iov_base, len);
+                size += len;
+            }
+        }
+
+        const int ret = SSL_write(_ssl, _record.data(), size);
+        if (ret <= 0) {
+            LOG_TRACE << "TlsLayer::encrypt: " << tlsError();
+            return -1;
+        }
+
+        session->completedWriting(ret);
+        plain += ret;
+        collect();
+    }
+
+    return plain;
+}
+
+void TlsLayer::sent(size_t size) {
+    _pendingSent += size;
+    if (_pendingSent < _pending.size()) {
+        return;
+    }
+
+    _pending.clear();
+    _pendingSent = 0;
+
+    if (_txOffloadWanted) {
+        _txOffloadWanted = false;
+        _txOffloaded = offload(TLS_TX, _context->mode() == TlsMode::Server ? _serverSecret : _clientSecret) == 0;
+    }
+}
+
+int TlsLayer::handshake() {
+    const int ret = SSL_do_handshake(_ssl);
+    collect();
+
+    if (ret == 1) {
+        _handshakeDone = true;
+        if (_context->kernelOffload()) {
+            offload();
+        }
+        return 0;
+    }
+
+    const int err = SSL_get_error(_ssl, ret);
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+        return 0;
+    }
+
+    LOG_TRACE << "TlsLayer::handshake: " << tlsError();
+    return -1;
+}
+
+void TlsLayer::collect() {
+    const size_t size = BIO_ctrl_pending(_wbio);
+    if (size == 0) {
+        return;
+    }
+
+    const size_t offset = _pending.size();
+    _pending.resize(offset + size);
+    BIO_read(_wbio, _pending.data() + offset, size);
+}
+
+void TlsLayer::offload() {
+    if (SSL_version(_ssl) != TLS1_3_VERSION || !TlsContext::kernelTlsAvailable()) {
+        return;
+    }
+
+    if (setsockopt(_fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0) {
+        LOG_TRACE << "TlsLayer::offload: no kTLS: " << strerror(errno);
+        return;
+    }
+
+    const bool server = _context->mode() == TlsMode::Server;
+
+    // The last flight of the handshake goes out before the kernel takes over.
+    if (pendingSize() == 0) {
+        _txOffloaded = offload(TLS_TX, server ? _serverSecret : _clientSecret) == 0;
+    } else {
+        _txOffloadWanted = true;
+    }
+
+    // A client may still get session tickets. A server with records read
+    // ahead keeps decrypting them itself.
+    if (server && BIO_ctrl_pending(_rbio) == 0 && SSL_pending(_ssl) == 0) {
+        _rxOffloaded = offload(TLS_RX, _clientSecret) == 0;
+    }
+}
+
+int TlsLayer::offload(int direction, const std::vector<unsigned char>& secret) {
+    const SSL_CIPHER* cipher = SSL_get_current_cipher(_ssl);
+    const uint32_t id = SSL_CIPHER_get_id(cipher);
+    if (secret.empty() || (id != TLS1_3_CK_AES_128_GCM_SHA256 && id != TLS1_3_CK_AES_256_GCM_SHA384)) {
+        return -1;
+    }
+
+    const EVP_MD* md = SSL_CIPHER_get_handshake_digest(cipher);
+    const size_t keySize = id == TLS1_3_CK_AES_128_GCM_SHA256 ? 16 : 32;
+    unsigned char key[32];
+    unsigned char iv[12];
+    auto cleanup = std::experimental::scope_exit([&]() {
+        OPENSSL_cleanse(key, sizeof(key));
+        OPENSSL_cleanse(iv, sizeof(iv));
+    });
+
+    if (expandLabel(md, secret, "key", key, keySize) != 0 || expandLabel(md, secret, "iv", iv, sizeof(iv)) != 0) {
+        LOG_ERROR << "TlsLayer::offload: failed to derive keys";
+        return -1;
+    }
+
+    // The record sequence starts at zero, nothing was sent or received with
+    // these keys yet.
+    int ret = -1;
+    if (keySize == 16) {
+        tls12_crypto_info_aes_gcm_128 info;
+        memset(&info, 0, sizeof(info));
+        info.info.version = TLS_1_3_VERSION;
+        info.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+        memcpy(info.key, key, sizeof(info.key));
+        memcpy(info.salt, iv, sizeof(info.salt));
+        memcpy(info.iv, iv + sizeof(info.salt), sizeof(info.iv));
+        ret = setsockopt(_fd, SOL_TLS, direction, &info, sizeof(info));
+        OPENSSL_cleanse(&info, sizeof(info));
+    } else {
+        tls12_crypto_info_aes_gcm_256 info;
+        memset(&info, 0, sizeof(info));
+        info.info.version = TLS_1_3_VERSION;
+        info.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+        memcpy(info.key, key, sizeof(info.key));
+        memcpy(info.salt, iv, sizeof(info.salt));
+        memcpy(info.iv, iv + sizeof(info.salt), sizeof(info.iv));
+        ret = setsockopt(_fd, SOL_TLS, direction, &info, sizeof(info));
+        OPENSSL_cleanse(&info, sizeof(info));
+    }
+
+    if (ret != 0) {
+        LOG_TRACE << "TlsLayer::offload: kTLS refused the keys: " << strerror(errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+void TlsLayer::keyLog(const ssl_st* ssl, const char* line) {
+    // "<label> <client random> <secret>", kept for kTLS only.
+    TlsLayer* layer = static_cast<TlsLayer*>(SSL_get_app_data(ssl));
+    if (layer == nullptr) {
+        return;
+    }
+
+    std::istringstream in(line);
+    std::string label;
+    std::string random;
+    std::string secret;
+    in >> label >> random >> secret;
+
+    std::vector<unsigned char>* target = nullptr;
+    if (label == "CLIENT_TRAFFIC_SECRET_0") {
+        target = &layer->_clientSecret;
+    } else if (label == "SERVER_TRAFFIC_SECRET_0") {
+        target = &layer->_serverSecret;
+    } else {
+        return;
+    }
+
+    target->clear();
+    for (size_t i = 0; i + 1 < secret.size(); i += 2) {
+        target->push_back(hexValue(secret[i]) << 4 | hexValue(secret[i + 1]));
+    }
+    OPENSSL_cleanse(secret.data(), secret.size());
+}
+
+} // namespace bongo
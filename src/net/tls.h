@@ -0,0 +1,154 @@
+/**********************************************
+   File:   tls.h
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+struct ssl_st;
+struct ssl_ctx_st;
+struct bio_st;
+class OutputChain;
+
+namespace bongo {
+
+class SessionBase;
+
+enum class TlsMode { Server, Client };
+
+struct TlsConfig {
+    std::string certPem = {};      // the server's certificate chain, PEM
+    std::string keyPem = {};       // its private key, PEM
+    std::string caPem = {};        // a client verifies the server against it
+    std::string serverName = {};   // and checks the certificate is for this host, sent as SNI too
+    bool insecure = false;         // a client skips verifying the server, for tests only
+    bool kernelOffload = false;    // hand the record layer to kTLS after the handshake
+};
+
+/*******************************************************************************
+ *   TlsContext is the OpenSSL context shared by the connections of a session
+ *   factory. Only TLS 1.2 and 1.3 are allowed. A server sends no session
+ *   tickets, so nothing follows the handshake and the kernel can take over
+ *   the record layer from the first record of application data.
+ */
+class TlsContext {
+public:
+    TlsContext(TlsMode mode, const TlsConfig& config);
+    ~TlsContext();
+
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    int init();
+
+    TlsMode mode() const { return _mode; }
+    bool kernelOffload() const { return _config.kernelOffload; }
+    const std::string& serverName() const { return _config.serverName; }
+    ssl_ctx_st* ctx() const { return _ctx; }
+
+    // A self-signed certificate and its key for testing, PEM encoded.
+    static int makeSelfSigned(const std::string& commonName, std::string& certPem, std::string& keyPem);
+
+    // Whether the kernel has the "tls" upper layer protocol.
+    static bool kernelTlsAvailable();
+
+private:
+    const TlsMode _mode;
+    const TlsConfig _config;
+    ssl_ctx_st* _ctx = nullptr;
+};
+
+using TlsContextPtr = std::shared_ptr<TlsContext>;
+
+/*******************************************************************************
+ *   TlsLayer is the TLS state of one connection. Records from the socket are
+ *   fed to OpenSSL through a memory BIO, the plaintext goes to the session's
+ *   read buffer. The session's output is encrypted into a ciphertext buffer
+ *   the reactor writes to the socket. Reactor thread only.
+ *
+ *   Once the handshake is done and the context asks for it, the keys are
+ *   passed to kTLS. A direction the kernel has taken bypasses this layer, the
+ *   reactor reads, sends and sendfile()s plaintext. Offload needs TLS 1.3
+ *   with an AES-GCM suite, and for receiving no records read ahead past the
+ *   handshake. Otherwise that direction stays in user space.
+ */
+class TlsLayer {
+public:
+    TlsLayer(TlsContextPtr context);
+    ~TlsLayer();
+
+    TlsLayer(const TlsLayer&) = delete;
+    TlsLayer& operator=(const TlsLayer&) = delete;
+
+    int init(int fd);
+
+    bool handshakeDone() const { return _handshakeDone; }
+    bool rxOffloaded() const { return _rxOffloaded; }
+    bool txOffloaded() const { return _txOffloaded; }
+    bool peerClosed() const { return _peerClosed; }
+    bool offloading() const { return _rxOffloaded || _txOffloaded || _txOffloadWanted; }
+
+    // Ciphertext read from the socket. Returns the plaintext bytes appended
+    // to the session's read buffer, -1 when the connection must be closed.
+    ssize_t decrypt(const char* data, size_t size, SessionBase* session);
+
+    // Encrypts the front of the session's output while less than
+    // MaxPendingSize ciphertext waits, or drives the handshake until it is
+    // done. Returns the plaintext bytes taken, -1 on failure.
+    ssize_t encrypt(SessionBase* session);
+
+    // Ciphertext waiting for the socket.
+    const char* pendingData() const { return _pending.data() + _pendingSent; }
+    size_t pendingSize() const { return _pending.size() - _pendingSent; }
+    void sent(size_t size);
+
+    static constexpr size_t MaxPendingSize = 64 * 1024;
+    static constexpr size_t RecordSize = 16 * 1024;
+
+private:
+    TlsContextPtr _context;
+    ssl_st* _ssl = nullptr;
+    bio_st* _rbio = nullptr; // owned by _ssl
+    bio_st* _wbio = nullptr;
+    int _fd = -1;
+    bool _handshakeDone = false;
+    bool _rxOffloaded = false;
+    bool _txOffloaded = false;
+    bool _peerClosed = false;
+    bool _txOffloadWanted = false; // once the handshake's last flight is sent
+
+    std::vector<char> _pending;
+    size_t _pendingSent = 0;
+    std::vector<char> _record; // plaintext of the next record
+
+    // Traffic secrets from the key log, for kTLS.
+    std::vector<unsigned char> _clientSecret;
+    std::vector<unsigned char> _serverSecret;
+
+    int handshake();
+    void collect();
+    void offload();
+    int offload(int direction, const std::vector<unsigned char>& secret);
+
+    static void keyLog(const ssl_st* ssl, const char* line);
+    friend class TlsContext;
+};
+
+} // namespace bongo
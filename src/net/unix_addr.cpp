@@ -0,0 +1,72 @@
+/**********************************************
+   File:   unix_addr.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "unix_addr.h"
+#include "utils/log.h"
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace bongo {
+
+socklen_t makeUnixAddress(const std::string& path, sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    // Abstract names are not NUL-terminated, the length tells where they end.
+    const bool abstract = isAbstractUnixPath(path);
+    const size_t size = abstract ? path.size() : path.size() + 1;
+    if (path.empty() || size > sizeof(addr.sun_path)) {
+        LOG_ERROR << "makeUnixAddress: invalid path: " << path;
+        return 0;
+    }
+
+    memcpy(addr.sun_path, path.data(), path.size());
+    if (abstract) {
+        addr.sun_path[0] = '\0';
+    }
+
+    return offsetof(sockaddr_un, sun_path) + size;
+}
+
+int removeStaleUnixSocket(const std::string& path) {
+    if (isAbstractUnixPath(path)) {
+        return 0;
+    }
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    if (!S_ISSOCK(st.st_mode)) {
+        LOG_ERROR << "removeStaleUnixSocket: not a socket: " << path;
+        return -1;
+    }
+
+    if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+        LOG_ERROR << "removeStaleUnixSocket: failed to remove " << path << ": " << strerror(errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+} // namespace bongo
@@ -0,0 +1,38 @@
+/**********************************************
+   File:   unix_addr.h
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#pragma once
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace bongo {
+
+// UNIX domain socket paths. A path starting with '@' names a socket in the
+// abstract namespace, the rest of it is the name. Other paths are files.
+inline bool isAbstractUnixPath(const std::string& path) { return !path.empty() && path[0] == '@'; }
+
+// Fills the address for the path. Returns its length, 0 when the path is
+// empty or too long.
+socklen_t makeUnixAddress(const std::string& path, sockaddr_un& addr);
+
+// Removes a socket file left by an earlier listener. Abstract names and
+// files that aren't sockets are kept. Returns 0 when nothing is in the way.
+int removeStaleUnixSocket(const std::string& path);
+
+} // namespace bongo
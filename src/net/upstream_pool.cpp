@@ -0,0 +1,289 @@
+/**********************************************
+   File:   upstream_pool.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "upstream_pool.h"
+#include "proc/notification_base.h"
+#include "utils/log.h"
+#include "utils/pipe_queue.h"
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+namespace bongo {
+
+namespace {
+
+constexpr size_t MAX_REPLY_SIZE = 1 << 20;
+
+} // namespace
+
+class UpstreamPool::Factory : public NetSessionFactory {
+public:
+    Factory(UpstreamPool* pool) : _pool(pool) {}
+
+    NetSession* makeSession(NonBlockConnection* conn) override { return new UpstreamSession(conn, _pool); }
+    void onConnectFailed() override { _pool->onConnectFailed(); }
+
+private:
+    UpstreamPool* _pool;
+};
+
+/*******************************************************************************
+ *   UpstreamSession
+ */
+UpstreamSession::UpstreamSession(NonBlockConnection* conn, UpstreamPool* pool)
+ : NetSession(conn)
+ , _pool(pool)
+{
+    _headerSize = sizeof(uint32_t);
+    _maxBodySize = MAX_REPLY_SIZE;
+}
+
+UpstreamSession::~UpstreamSession() {
+    if (_pool) {
+        _pool->onClosed(this);
+    }
+
+    std::deque<UpstreamCallback> calls;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        calls.swap(_calls);
+    }
+
+    for (auto& callback: calls) {
+        callback(-1, {});
+        if (_pool) {
+            _pool->_failed++;
+        }
+    }
+}
+
+int UpstreamSession::init() {
+    if (_pool) {
+        _pool->onConnected(this);
+    }
+    return 0;
+}
+
+void UpstreamSession::submit(const std::string& request, UpstreamCallback&& callback) {
+    uint32_t size = request.size();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _submitted.append((const char*)&size, sizeof(size));
+        _submitted.append(request);
+        _calls.push_back(std::move(callback));
+    }
+    _outstanding++;
+
+    // One notification flushes everything submitted until the reactor gets it.
+    if (_flushPosted.exchange(true)) {
+        return;
+    }
+
+    if (notify(NotificationType::MoreData) != 0) {
+        _flushPosted.store(false);
+    }
+}
+
+void UpstreamSession::onMoreData() {
+    _flushPosted.store(false);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_submitted.empty()) {
+        _output.append(_submitted.data(), _submitted.size());
+        _submitted.clear();
+    }
+}
+
+bool UpstreamSession::closing() {
+    if (_pool) {
+        _pool->onClosed(this);
+    }
+
+    // The pool doesn't hand out this session anymore, but a flush it posted
+    // may still be in the pipe.
+    return !_flushPosted.load();
+}
+
+// Replies are completed right here, the processor never sees them.
+std::optional<RequestBase*> UpstreamSession::getRequest() {
+    while (inputSize() > 0) {
+        SessionBase::getRequest();
+    }
+    return {};
+}
+
+size_t UpstreamSession::parseMessageSize(Buffer header) {
+    assert(header.size >= sizeof(uint32_t));
+    uint32_t size;
+    memcpy(&size, header.ptr, sizeof(uint32_t));
+    return size;
+}
+
+std::optional<RequestBase*> UpstreamSession::parseMessage(const InputMessagePtr& msg) {
+    UpstreamCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_calls.empty()) {
+            LOG_ERROR << "UpstreamSession::parseMessage: a reply without a call";
+            return {};
+        }
+        callback = std::move(_calls.front());
+        _calls.pop_front();
+    }
+    _outstanding--;
+
+    callback(0, std::string(msg->body.data(), msg->body.size()));
+    if (_pool) {
+        _pool->_completed++;
+    }
+    return {};
+}
+
+/*******************************************************************************
+ *   UpstreamPool
+ */
+UpstreamPool::UpstreamPool(NonBlockNet& net, const UpstreamTarget& target)
+ : _net(net)
+ , _target(target)
+{
+    _factory = std::make_shared<Factory>(this);
+
+    _reconnectTimer.setCallback([this]() {
+        _reconnects++;
+        connect();
+    });
+}
+
+UpstreamPool::~UpstreamPool() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _started = false;
+    _reconnectTimer.cancel();
+    for (auto session: _sessions) {
+        session->detach();
+    }
+    _sessions.clear();
+}
+
+int UpstreamPool::start() {
+    if (_net.sessionsQueue() == nullptr) {
+        LOG_ERROR << "UpstreamPool::start: the reactor has no sessions queue";
+        return -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _started = true;
+    }
+
+    connect();
+    return 0;
+}
+
+int UpstreamPool::submit(const std::string& request, UpstreamCallback callback) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    UpstreamSession* best = nullptr;
+    for (auto session: _sessions) {
+        if (best == nullptr || session->outstanding() < best->outstanding()) {
+            best = session;
+        }
+    }
+
+    if (best == nullptr || (_target.pipeline != 0 && best->outstanding() >= _target.pipeline)) {
+        return -1;
+    }
+
+    best->submit(request, std::move(callback));
+    _submitted++;
+    return 0;
+}
+
+UpstreamPool::Stats UpstreamPool::stats() const {
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        stats.connections = _sessions.size();
+    }
+    stats.submitted = _submitted.load();
+    stats.completed = _completed.load();
+    stats.failed = _failed.load();
+    stats.reconnects = _reconnects.load();
+    return stats;
+}
+
+// Connections complete on the reactor and call back into the pool, so the
+// lock is not held while they start.
+void UpstreamPool::connect() {
+    size_t missing = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_started) {
+            return;
+        }
+
+        const size_t open = _sessions.size() + _connecting;
+        missing = open < _target.connections ? _target.connections - open : 0;
+        _connecting += missing;
+    }
+
+    NetOperation op { .name = _target.name, .ip = _target.ip, .port = _target.port, .factory = _factory };
+    for (size_t i = 0; i < missing; i++) {
+        if (_net.startConnect(op) != 0) {
+            LOG_WARN << "UpstreamPool::connect: failed to connect to " << _target.name;
+            onConnectFailed();
+        }
+    }
+}
+
+void UpstreamPool::onConnected(UpstreamSession* session) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_connecting > 0) {
+        _connecting--;
+    }
+    _sessions.push_back(session);
+}
+
+void UpstreamPool::onClosed(UpstreamSession* session) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = std::find(_sessions.begin(), _sessions.end(), session);
+    if (it == _sessions.end()) {
+        return;
+    }
+
+    *it = _sessions.back();
+    _sessions.pop_back();
+    scheduleConnect();
+}
+
+void UpstreamPool::onConnectFailed() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_connecting > 0) {
+        _connecting--;
+    }
+    scheduleConnect();
+}
+
+// Called under the lock.
+void UpstreamPool::scheduleConnect() {
+    if (_started && !_reconnectTimer.armed()) {
+        _net.timers().arm(&_reconnectTimer, TimerWheel::clock() + _target.reconnectMs);
+    }
+}
+
+} // namespace bongo
@@ -0,0 +1,141 @@
+/**********************************************
+   File:   upstream_pool.h
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#pragma once
+#include "nonblock_conn.h"
+#include "utils/timer_wheel.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace bongo {
+
+class UpstreamPool;
+
+// Completion of an upstream call. status is 0 with the reply, -1 when the
+// connection went away first. Runs on a worker thread, or on the reactor
+// thread for failed calls.
+using UpstreamCallback = std::function<void(int status, std::string&& reply)>;
+
+struct UpstreamTarget {
+    std::string name;
+    std::string ip;
+    int port = 0;
+    size_t connections = 2;  // kept open all the time
+    size_t pipeline = 0;     // calls in flight per connection, 0 - no limit
+    uint32_t reconnectMs = 100;
+};
+
+/*******************************************************************************
+ *   UpstreamSession is one pooled connection to an upstream. Requests and
+ *   replies are framed with a 4-byte length, replies come in request order.
+ *   Calls are submitted from any thread and written by the reactor. Replies
+ *   take the usual way to the workers, which run the callbacks instead of
+ *   handing requests to the processor.
+ */
+class UpstreamSession : public NetSession {
+public:
+    UpstreamSession(NonBlockConnection* conn, UpstreamPool* pool);
+    ~UpstreamSession() override;
+
+    int init() override;
+    std::optional<RequestBase*> getRequest() override;
+    void onMoreData() override;
+    bool closing() override;
+
+    // Called under the pool lock.
+    void submit(const std::string& request, UpstreamCallback&& callback);
+    size_t outstanding() const { return _outstanding.load(); }
+    void detach() { _pool = nullptr; }
+
+protected:
+    size_t parseMessageSize(Buffer header) override;
+    std::optional<RequestBase*> parseMessage(const InputMessagePtr& msg) override;
+
+private:
+    UpstreamPool* _pool;
+
+    std::mutex _mutex;
+    std::string _submitted;              // framed, not handed to the reactor yet
+    std::deque<UpstreamCallback> _calls; // waiting for replies, in order
+    std::atomic<size_t> _outstanding = 0;
+    std::atomic<bool> _flushPosted = false;
+};
+
+/*******************************************************************************
+ *   UpstreamPool keeps a fixed number of connections to one upstream on a
+ *   reactor and spreads calls between them, each call goes to the connection
+ *   with the fewest in flight. Closed connections are reopened after
+ *   reconnectMs.
+ *
+ *   The reactor needs a sessions queue, the replies are completed there.
+ *   start() is called before the reactor runs, the pool is destroyed after it
+ *   stops.
+ */
+class UpstreamPool {
+    friend class UpstreamSession;
+public:
+    UpstreamPool(NonBlockNet& net, const UpstreamTarget& target);
+    ~UpstreamPool();
+
+    int start();
+
+    // Thread-safe. Returns -1 when no connection is up or all of them have
+    // the pipeline full.
+    int submit(const std::string& request, UpstreamCallback callback);
+
+    struct Stats {
+        size_t connections = 0;
+        size_t submitted = 0;
+        size_t completed = 0;
+        size_t failed = 0;
+        size_t reconnects = 0;
+    };
+
+    Stats stats() const;
+
+private:
+    class Factory;
+
+    NonBlockNet& _net;
+    const UpstreamTarget _target;
+    NetSessionFactoryPtr _factory;
+
+    mutable std::mutex _mutex;
+    std::vector<UpstreamSession*> _sessions;
+    size_t _connecting = 0;
+    bool _started = false;
+    Timer _reconnectTimer;
+
+    std::atomic<size_t> _submitted = 0;
+    std::atomic<size_t> _completed = 0;
+    std::atomic<size_t> _failed = 0;
+    std::atomic<size_t> _reconnects = 0;
+
+    // Reactor thread.
+    void connect();
+    void onConnected(UpstreamSession* session);
+    void onClosed(UpstreamSession* session);
+    void onConnectFailed();
+    void scheduleConnect();
+};
+
+} // namespace bongo
@@ -0,0 +1,261 @@
+/**********************************************
+   File:   uring.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "uring.h"
+#include "utils/log.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace bongo {
+
+static int uringSetup(unsigned entries, io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize) {
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+static int uringRegister(int fd, unsigned opcode, void* arg, unsigned argsCount) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, argsCount);
+}
+
+Uring::~Uring() {
+    if (_fd != -1) {
+        close(_fd);
+    }
+
+    if (_ringPtr != nullptr) {
+        munmap(_ringPtr, _ringSize);
+    }
+
+    if (_sqes != nullptr) {
+        munmap(_sqes, _sqesSize);
+    }
+
+    if (_bufRing != nullptr) {
+        munmap(_bufRing, _bufRingSize);
+    }
+
+    delete[] _buffers;
+}
+
+int Uring::init(unsigned entries, unsigned buffersCount, unsigned bufferSize) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    _fd = uringSetup(entries, &params);
+    if (_fd < 0) {
+        _fd = -1;
+        LOG_ERROR << "Uring::init: failed io_uring_setup(): " << strerror(errno);
+        return -1;
+    }
+
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0 || (params.features & IORING_FEAT_NODROP) == 0) {
+        LOG_ERROR << "Uring::init: kernel io_uring is too old";
+        return -1;
+    }
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    _ringSize = sqSize > cqSize ? sqSize : cqSize;
+
+    _ringPtr = mmap(nullptr, _ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_ringPtr == MAP_FAILED) {
+        _ringPtr = nullptr;
+        LOG_ERROR << "Uring::init: failed to map rings: " << strerror(errno);
+        return -1;
+    }
+
+    _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        LOG_ERROR << "Uring::init: failed to map SQEs: " << strerror(errno);
+        return -1;
+    }
+    _sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* ring = static_cast<char*>(_ringPtr);
+    _sqHead = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+    _sqTail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+    _sqArray = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+    _sqMask = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+    _sqEntries = params.sq_entries;
+    _sqLocalTail = *_sqTail;
+    _sqSubmitted = _sqLocalTail;
+
+    _cqHead = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+    _cqTail = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+    _cqes = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+    _cqMask = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+
+    return registerBuffers(buffersCount, bufferSize);
+}
+
+int Uring::registerBuffers(unsigned buffersCount, unsigned bufferSize) {
+    // The kernel wants a power of two ring, up to 32K entries.
+    unsigned count = 1;
+    while (count < buffersCount && count < 32768) {
+        count <<= 1;
+    }
+
+    _buffersCount = count;
+    _bufferSize = bufferSize;
+    _bufRingSize = count * sizeof(io_uring_buf);
+
+    void* bufRing = mmap(nullptr, _bufRingSize, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (bufRing == MAP_FAILED) {
+        LOG_ERROR << "Uring::registerBuffers: failed to map buffer ring: " << strerror(errno);
+        return -1;
+    }
+    _bufRing = bufRing;
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)_bufRing;
+    reg.ring_entries = count;
+    reg.bgid = BufferGroup;
+
+    int ret = uringRegister(_fd, IORING_REGISTER_PBUF_RING, &reg, 1);
+    if (ret != 0) {
+        LOG_ERROR << "Uring::registerBuffers: failed to register buffer ring: " << strerror(errno);
+        return -1;
+    }
+
+    _buffers = new char[(size_t)count * bufferSize];
+    for (unsigned bid = 0; bid < count; bid++) {
+        recycleBuffer(bid);
+    }
+
+    return 0;
+}
+
+void Uring::recycleBuffer(uint16_t bid) {
+    // The ring tail overlays resv of the first entry. Index the entries by hand:
+    // the header's flex array gets an extra offset when compiled as C++.
+    io_uring_buf* bufs = reinterpret_cast<io_uring_buf*>(_bufRing);
+    uint16_t* tailPtr = &bufs[0].resv;
+
+    // Only this thread moves the tail, so a plain read is fine.
+    uint16_t tail = *tailPtr;
+    io_uring_buf* buf = &bufs[tail & (_buffersCount - 1)];
+    buf->addr = (uint64_t)buffer(bid);
+    buf->len = _bufferSize;
+    buf->bid = bid;
+    __atomic_store_n(tailPtr, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+io_uring_sqe* Uring::getSqe() {
+    unsigned head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    if (_sqLocalTail - head >= _sqEntries) {
+        submit();
+        head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+        if (_sqLocalTail - head >= _sqEntries) {
+            return nullptr;
+        }
+    }
+
+    unsigned index = _sqLocalTail & _sqMask;
+    io_uring_sqe* sqe = &_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    _sqArray[index] = index;
+    _sqLocalTail++;
+    return sqe;
+}
+
+bool Uring::reserve(unsigned count) {
+    if (count > _sqEntries) {
+        return false;
+    }
+
+    unsigned head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    if (_sqEntries - (_sqLocalTail - head) >= count) {
+        return true;
+    }
+
+    submit();
+    head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    return _sqEntries - (_sqLocalTail - head) >= count;
+}
+
+int Uring::submit(int time_ms) {
+    unsigned toSubmit = _sqLocalTail - _sqSubmitted;
+    __atomic_store_n(_sqTail, _sqLocalTail, __ATOMIC_RELEASE);
+
+    unsigned flags = 0;
+    unsigned minComplete = 0;
+    __kernel_timespec ts;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+
+    if (time_ms != 0) {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        minComplete = 1;
+        if (time_ms > 0) {
+            ts.tv_sec = time_ms / 1000;
+            ts.tv_nsec = (long long)(time_ms % 1000) * 1000000;
+            arg.ts = (uint64_t)&ts;
+        }
+    }
+
+    if (toSubmit == 0 && minComplete == 0) {
+        return 0;
+    }
+
+    // Don't go to sleep when completions are already waiting.
+    if (minComplete > 0 && __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE) != *_cqHead) {
+        minComplete = 0;
+        flags &= ~IORING_ENTER_GETEVENTS;
+        if (toSubmit == 0) {
+            return 0;
+        }
+    }
+
+    const bool extArg = (flags & IORING_ENTER_EXT_ARG) != 0;
+    int ret = uringEnter(_fd, toSubmit, minComplete, flags, extArg ? &arg : nullptr, extArg ? sizeof(arg) : 0);
+    if (ret < 0) {
+        if (errno == ETIME || errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+            return 0;
+        }
+
+        LOG_ERROR << "Uring::submit: failed io_uring_enter(): " << strerror(errno);
+        return -1;
+    }
+
+    _sqSubmitted += ret;
+    return 0;
+}
+
+io_uring_cqe* Uring::peek() {
+    unsigned head = *_cqHead;
+    if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)) {
+        return nullptr;
+    }
+
+    return &_cqes[head & _cqMask];
+}
+
+void Uring::seen() {
+    __atomic_store_n(_cqHead, *_cqHead + 1, __ATOMIC_RELEASE);
+}
+
+} // namespace bongo
@@ -0,0 +1,91 @@
+/**********************************************
+   File:   uring.h
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#pragma once
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace bongo {
+
+/*******************************************************************************
+ *   Uring is a thin wrapper over the raw io_uring syscalls: SQ/CQ rings mapped
+ *   into the process and one provided buffer ring used by multishot recv.
+ *   It is used by the reactor thread only.
+ */
+class Uring {
+public:
+    Uring() = default;
+    ~Uring();
+
+    int init(unsigned entries, unsigned buffersCount, unsigned bufferSize);
+
+    // Returns a zeroed SQE, or nullptr if the submission queue is full even
+    // after flushing it to the kernel.
+    io_uring_sqe* getSqe();
+
+    // Makes room for count SQEs, flushing the queue to the kernel when it's
+    // short of them, so a linked chain isn't split between two submissions.
+    // false when the queue is smaller than count.
+    bool reserve(unsigned count);
+
+    // Submits queued SQEs. When time_ms is not zero, also waits for at least
+    // one completion or the timeout (time_ms < 0 waits forever).
+    int submit(int time_ms = 0);
+
+    // Returns the next completion or nullptr. Each returned CQE must be
+    // retired with seen() before the next call.
+    io_uring_cqe* peek();
+    void seen();
+
+    char* buffer(uint16_t bid) const { return _buffers + (size_t)bid * _bufferSize; }
+    void recycleBuffer(uint16_t bid);
+
+    static constexpr uint16_t BufferGroup = 0;
+
+private:
+    int _fd = -1;
+    void* _ringPtr = nullptr;
+    size_t _ringSize = 0;
+    io_uring_sqe* _sqes = nullptr;
+    size_t _sqesSize = 0;
+
+    unsigned* _sqHead = nullptr;
+    unsigned* _sqTail = nullptr;
+    unsigned* _sqArray = nullptr;
+    unsigned _sqMask = 0;
+    unsigned _sqEntries = 0;
+    unsigned _sqLocalTail = 0;
+    unsigned _sqSubmitted = 0;
+
+    unsigned* _cqHead = nullptr;
+    unsigned* _cqTail = nullptr;
+    io_uring_cqe* _cqes = nullptr;
+    unsigned _cqMask = 0;
+
+    void* _bufRing = nullptr;
+    size_t _bufRingSize = 0;
+    char* _buffers = nullptr;
+    unsigned _buffersCount = 0;
+    unsigned _bufferSize = 0;
+
+private:
+    int registerBuffers(unsigned buffersCount, unsigned bufferSize);
+};
+
+} // namespace bongo
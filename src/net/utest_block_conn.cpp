@@ -57,11 +57,10 @@ TEST(BLOCK_CONN, ListenerConnector) {
 
     auto conn = listener.accept_connection();
     ASSERT_TRUE(conn);
+    t.join();
 
     ASSERT_EQ(1, listener.stats().connectCount);
     ASSERT_EQ(1, connector.stats().connectCount);
-
-    t.join();
 }
 
 TEST(BLOCK_CONN, Connection) {
@@ -97,9 +96,6 @@ TEST(BLOCK_CONN, Connection) {
     auto conn_info = listener.accept_connection();
     ASSERT_TRUE(conn_info);
 
-    ASSERT_EQ(1, listener.stats().connectCount);
-    ASSERT_EQ(1, connector.stats().connectCount);
-
     BlockConnection reader(conn_info->fd);
     for (const auto val: data) {
         uint32_t num;
@@ -109,6 +105,9 @@ TEST(BLOCK_CONN, Connection) {
     }
 
     t.join();
+
+    ASSERT_EQ(1, listener.stats().connectCount);
+    ASSERT_EQ(1, connector.stats().connectCount);
 }
 
 
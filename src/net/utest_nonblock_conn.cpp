@@ -16,6 +16,7 @@
    limitations under the License.
  **********************************************/
 #include "nonblock_conn.h"
+#include "nonblock_group.h"
 #include "block_conn.h"
 #include "utils/log.h"
 #include "gtest/gtest.h"
@@ -45,6 +46,29 @@ TEST(NONBLOCK_CONN, NetInit) {
     ASSERT_EQ(1, s.pipesCount);
 }
 
+TEST(NONBLOCK_CONN, NetInitUring) {
+    NonBlockNet net;
+    int ret = net.init(1024, NetBackend::Uring);
+    ASSERT_EQ(0, ret);
+    if (net.backend() != NetBackend::Uring) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+
+    auto s = net.stats();
+    ASSERT_TRUE(s.ready);
+    ASSERT_EQ(1, s.pipesCount);
+
+    NetOperation op {
+        .name = "ListenerTest",
+        .ip = "127.0.0.1",
+        .port = 8888,
+        .factory = nullptr,
+    };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+    ASSERT_EQ(2, net.stats().count());
+}
+
 TEST(NONBLOCK_CONN, ListenerBasic) {
     NonBlockNet net;
     int ret = net.init();
@@ -60,3 +84,26 @@ TEST(NONBLOCK_CONN, ListenerBasic) {
     auto s = net.stats();
     ASSERT_EQ(2, s.count());
 }
+
+TEST(NONBLOCK_CONN, GroupListenerBasic) {
+    NonBlockNetGroup group(2);
+    int ret = group.init();
+    ASSERT_EQ(0, ret);
+    ASSERT_EQ(2, group.size());
+
+    NetOperation op {
+        .name = "GroupListenerTest",
+        .ip = "127.0.0.1",
+        .port = 8888,
+        .factory = nullptr,
+    };
+    ret = group.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    auto s = group.stats();
+    ASSERT_TRUE(s.ready);
+    ASSERT_EQ(2, s.listenersCount);
+    ASSERT_EQ(2, s.pipesCount);
+    ASSERT_EQ(1, group.reactor(0).stats().listenersCount);
+    ASSERT_EQ(1, group.reactor(1).stats().listenersCount);
+}
@@ -0,0 +1,58 @@
+/**********************************************
+   File:   bench.h
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace bongo {
+
+/*******************************************************************************
+ *   Benchmarks run by bongo_bench. Each one takes the command line remaining
+ *   after its name and prints a small report to stdout.
+ */
+using BenchFunction = int (*)(int argc, const char** argv);
+
+struct BenchInfo {
+    const char* name;
+    const char* description;
+    BenchFunction run;
+};
+
+int benchZeroCopy(int argc, const char** argv);
+int benchChurn(int argc, const char** argv);
+int benchDispatch(int argc, const char** argv);
+int benchPingPong(int argc, const char** argv);
+int benchHistogram(int argc, const char** argv);
+int benchUdp(int argc, const char** argv);
+int benchTls(int argc, const char** argv);
+int benchProxy(int argc, const char** argv);
+int benchNotify(int argc, const char** argv);
+int benchPush(int argc, const char** argv);
+int benchQueue(int argc, const char** argv);
+
+// CPU time of the calling thread and of the whole process, in seconds.
+double threadCpuTime();
+double processCpuTime();
+double wallTime();
+
+// Value of "--name <value>" on the command line, or the default.
+size_t benchOption(int argc, const char** argv, const std::string& name, size_t defaultValue);
+
+} // namespace bongo
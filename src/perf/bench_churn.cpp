@@ -0,0 +1,181 @@
+/**********************************************
+   File:   bench_churn.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "bench.h"
+#include "net/nonblock_conn.h"
+#include "net/block_conn.h"
+#include "utils/log.h"
+#include <iostream>
+#include <memory>
+#include <pthread.h>
+#include <stdio.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+namespace bongo {
+
+/*******************************************************************************
+ *   A client thread opens a connection, makes one echo round trip and closes
+ *   it, over and over, while a set of idle connections keeps the connection
+ *   table populated. The reactor thread's CPU time per connection shows what
+ *   accept and close cost with and without object recycling.
+ */
+namespace {
+
+class ChurnSession : public NetSession {
+public:
+    ChurnSession(NonBlockConnection* conn) : NetSession(conn) {}
+
+    int onRead(SessionsQueue*) override {
+        Buffer src = _readBuf.getData();
+        _output.append(src.ptr, src.size);
+        _readBuf.used(src.size);
+        _conn->writeData();
+        return 0;
+    }
+
+    bool recycle() override { reset(); return true; }
+};
+
+class ChurnSessionFactory : public NetSessionFactory {
+public:
+    NetSession* makeSession(NonBlockConnection* conn) override { return new ChurnSession(conn); }
+};
+
+struct ChurnResult {
+    double wall = 0;
+    double reactorCpu = 0;
+    size_t connections = 0;
+    size_t freeConnections = 0;
+};
+
+int runChurn(bool recycling, size_t count, size_t idle, int port, ChurnResult& result) {
+    const std::string IP = "127.0.0.1";
+
+    NonBlockNet net;
+    if (net.init() != 0) {
+        return -1;
+    }
+    net.setRecycling(recycling);
+
+    NetOperation op { .name = "Churn", .ip = IP, .port = port, .factory = std::make_shared<ChurnSessionFactory>() };
+    if (net.startListen(op) != 0) {
+        return -1;
+    }
+
+    std::thread t([&]() { net.run(100); });
+
+    auto connect = [&]() -> std::unique_ptr<BlockConnection> {
+        BlockConnector connector(IP, port);
+        if (connector.init() != 0) {
+            return nullptr;
+        }
+
+        auto conn_info = connector.make_connection();
+        if (!conn_info) {
+            return nullptr;
+        }
+
+        return std::make_unique<BlockConnection>(conn_info->fd);
+    };
+
+    auto roundTrip = [](BlockConnection& conn, uint64_t val) {
+        uint64_t num = 0;
+        return conn.writeAll((char*)&val, sizeof(val)) == sizeof(val) &&
+               conn.readAll((char*)&num, sizeof(num)) == sizeof(num) && num == val;
+    };
+
+    // CPU clock of the reactor thread, so the idle set setup is not counted.
+    clockid_t reactorClock;
+    pthread_getcpuclockid(t.native_handle(), &reactorClock);
+    auto reactorCpu = [reactorClock]() {
+        timespec ts;
+        clock_gettime(reactorClock, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    };
+
+    auto churn = [&]() {
+        std::vector<std::unique_ptr<BlockConnection>> idleConns;
+        for (size_t i = 0; i < idle; i++) {
+            auto conn = connect();
+            if (!conn || !roundTrip(*conn, i)) {
+                return -1;
+            }
+            idleConns.emplace_back(std::move(conn));
+        }
+
+        const double wallStart = wallTime();
+        const double cpuStart = reactorCpu();
+
+        for (size_t i = 0; i < count; i++) {
+            auto conn = connect();
+            if (!conn || !roundTrip(*conn, i)) {
+                return -1;
+            }
+            result.connections++;
+        }
+
+        // The last close is handled by the reactor asynchronously.
+        while (net.stats().connectionsCount > idle) {
+            std::this_thread::yield();
+        }
+
+        result.wall = wallTime() - wallStart;
+        result.reactorCpu = reactorCpu() - cpuStart;
+        return 0;
+    };
+
+    int ret = churn();
+
+    net.stop();
+    t.join();
+
+    result.freeConnections = net.freeConnectionsCount();
+    return ret;
+}
+
+} // namespace
+
+int benchChurn(int argc, const char** argv) {
+    const size_t count = benchOption(argc, argv, "count", 10000);
+    const size_t idle = benchOption(argc, argv, "idle", 1000);
+    const size_t port = benchOption(argc, argv, "port", 8891);
+
+    printf("%-8s %8s %8s %10s %12s %20s %8s\n", "mode", "conns", "idle", "wall, s", "conns/s", "reactor CPU us/conn", "free");
+
+    const std::pair<const char*, bool> modes[] = {
+        { "alloc", false },
+        { "slab", true },
+    };
+
+    for (const auto& [name, recycling]: modes) {
+        ChurnResult r;
+        if (runChurn(recycling, count, idle, (int)port, r) != 0) {
+            std::cerr << "benchChurn: " << name << " run failed after " << r.connections << " connections" << std::endl;
+            return 1;
+        }
+
+        printf("%-8s %8zu %8zu %10.2f %12.0f %20.2f %8zu\n", name, r.connections, idle, r.wall,
+               r.connections / r.wall, r.reactorCpu * 1e6 / r.connections, r.freeConnections);
+    }
+
+    return 0;
+}
+
+} // namespace bongo
@@ -0,0 +1,280 @@
+/**********************************************
+   File:   bench_dispatch.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "bench.h"
+#include "net/nonblock_conn.h"
+#include "net/block_conn.h"
+#include "utils/log.h"
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdio.h>
+#include <unistd.h>
+#include <vector>
+#include <sys/epoll.h>
+
+namespace bongo {
+
+/*******************************************************************************
+ *   Many connections become readable at once and step() is driven directly
+ *   from the benchmark thread. Each event is one short read handed to a
+ *   session that drops the data. The same round over a bare epoll set, with
+ *   nothing but epoll_wait() and read(), gives the syscall floor; the
+ *   difference is what the reactor adds per event.
+ */
+namespace {
+
+// Drops what it reads, counting the bytes. Every client writes one per round.
+class SinkSession : public NetSession {
+public:
+    SinkSession(NonBlockConnection* conn, size_t& received) : NetSession(conn), _received(received) {}
+
+    int onRead(SessionsQueue*) override {
+        const size_t size = _readBuf.getData().size;
+        _readBuf.used(size);
+        _received += size;
+        return 0;
+    }
+
+private:
+    size_t& _received;
+};
+
+class SinkSessionFactory : public NetSessionFactory {
+public:
+    SinkSessionFactory(size_t& received) : _received(received) {}
+    NetSession* makeSession(NonBlockConnection* conn) override { return new SinkSession(conn, _received); }
+
+private:
+    size_t& _received;
+};
+
+struct DispatchResult {
+    size_t events = 0;
+    size_t waits = 0;
+    double cpu = 0;
+};
+
+using Connections = std::vector<std::unique_ptr<BlockConnection>>;
+
+int connectAll(const std::string& ip, int port, size_t count, Connections& conns, std::function<int()> onConnected) {
+    while (conns.size() < count) {
+        BlockConnector connector(ip, port);
+        if (connector.init() != 0) {
+            return -1;
+        }
+
+        auto conn_info = connector.make_connection();
+        if (!conn_info) {
+            return -1;
+        }
+        conns.emplace_back(std::make_unique<BlockConnection>(conn_info->fd));
+
+        if (onConnected() != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int writeAll(Connections& conns) {
+    char byte = 'x';
+    for (auto& conn: conns) {
+        if (conn->writeAll(&byte, 1) != 1) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// The syscall floor: accepted sockets in a plain edge-triggered epoll set.
+class BareSet {
+public:
+    ~BareSet() {
+        if (_epfd >= 0) {
+            close(_epfd);
+        }
+    }
+
+    int init(const std::string& ip, int port, size_t count) {
+        _listener = std::make_unique<BlockListener>(ip, port);
+        if (_listener->init() != 0) {
+            return -1;
+        }
+
+        _epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (_epfd < 0) {
+            return -1;
+        }
+
+        _events.resize(count);
+        return connectAll(ip, port, count, _clients, [this]() { return accept(); });
+    }
+
+    int round(DispatchResult& result) {
+        if (writeAll(_clients) != 0) {
+            return -1;
+        }
+
+        char buf[1024];
+        size_t left = _clients.size();
+        const double start = threadCpuTime();
+        while (left > 0) {
+            int count = epoll_wait(_epfd, _events.data(), _events.size(), 0);
+            if (count < 0) {
+                return -1;
+            }
+
+            for (int i = 0; i < count; i++) {
+                if (read(_events[i].data.fd, buf, sizeof(buf)) > 0) {
+                    left--;
+                }
+            }
+            result.waits++;
+        }
+        result.cpu += threadCpuTime() - start;
+        result.events += _clients.size();
+        return 0;
+    }
+
+private:
+    std::unique_ptr<BlockListener> _listener;
+    int _epfd = -1;
+    std::vector<epoll_event> _events;
+    Connections _clients;
+    Connections _servers;
+
+    int accept() {
+        auto conn_info = _listener->accept_connection();
+        if (!conn_info) {
+            return -1;
+        }
+        _servers.emplace_back(std::make_unique<BlockConnection>(conn_info->fd));
+
+        const int fd = conn_info->fd;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = fd;
+        return epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+};
+
+// The same sockets served by a NonBlockNet, stepped from this thread.
+class ReactorSet {
+public:
+    int init(const std::string& ip, int port, size_t count) {
+        if (_net.init(count) != 0) {
+            return -1;
+        }
+
+        NetOperation op { .name = "Dispatch", .ip = ip, .port = port, .factory = std::make_shared<SinkSessionFactory>(_received) };
+        if (_net.startListen(op) != 0) {
+            return -1;
+        }
+
+        // Accept as we go, the listen backlog is shorter than the set.
+        int ret = connectAll(ip, port, count, _clients, [this]() { return _net.step(0) < 0 ? -1 : 0; });
+        if (ret != 0) {
+            return -1;
+        }
+
+        while (_net.stats().connectionsCount < count) {
+            if (_net.step(0) < 0) {
+                return -1;
+            }
+        }
+
+        return 0;
+    }
+
+    int round(DispatchResult& result) {
+        if (writeAll(_clients) != 0) {
+            return -1;
+        }
+
+        const size_t target = _received + _clients.size();
+        const double start = threadCpuTime();
+        while (_received < target) {
+            if (_net.step(0) < 0) {
+                return -1;
+            }
+            result.waits++;
+        }
+        result.cpu += threadCpuTime() - start;
+        result.events += _clients.size();
+        return 0;
+    }
+
+private:
+    NonBlockNet _net;
+    Connections _clients;
+    size_t _received = 0;
+};
+
+} // namespace
+
+int benchDispatch(int argc, const char** argv) {
+    const size_t fds = benchOption(argc, argv, "fds", 1000);
+    const size_t rounds = benchOption(argc, argv, "rounds", 200);
+    const size_t port = benchOption(argc, argv, "port", 8892);
+    const std::string IP = "127.0.0.1";
+
+    BareSet bareSet;
+    if (bareSet.init(IP, (int)port + 1, fds) != 0) {
+        std::cerr << "benchDispatch: failed to set up bare epoll" << std::endl;
+        return 1;
+    }
+
+    ReactorSet reactorSet;
+    if (reactorSet.init(IP, (int)port, fds) != 0) {
+        std::cerr << "benchDispatch: failed to set up the reactor" << std::endl;
+        return 1;
+    }
+
+    // Rounds alternate, so both sides see the same machine noise.
+    DispatchResult bare;
+    DispatchResult step;
+    for (size_t round = 0; round < rounds; round++) {
+        if (bareSet.round(bare) != 0 || reactorSet.round(step) != 0) {
+            std::cerr << "benchDispatch: round " << round << " failed" << std::endl;
+            return 1;
+        }
+    }
+
+    printf("%-8s %8s %8s %10s %12s %10s %12s %10s\n", "mode", "fds", "rounds", "events", "events/wait", "CPU, s",
+           "events/s", "ns/event");
+
+    const std::pair<const char*, const DispatchResult&> modes[] = {
+        { "bare", bare },
+        { "step", step },
+    };
+
+    for (const auto& [name, m]: modes) {
+        printf("%-8s %8zu %8zu %10zu %12.1f %10.3f %12.0f %10.0f\n", name, fds, rounds, m.events,
+               (double)m.events / m.waits, m.cpu, m.events / m.cpu, m.cpu * 1e9 / m.events);
+    }
+
+    printf("reactor overhead per event: %.0f ns\n", (step.cpu / step.events - bare.cpu / bare.events) * 1e9);
+    return 0;
+}
+
+} // namespace bongo
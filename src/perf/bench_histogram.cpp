@@ -0,0 +1,77 @@
+/**********************************************
+   File:   bench_histogram.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+#include "bench.h"
+#include "utils/latency_histogram.h"
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+namespace bongo {
+
+/*******************************************************************************
+ *   The cost of session accounting on the hot path: a clock read and a
+ *   histogram record, alone and with several threads recording into the
+ *   same histogram the way workers share a listener's metrics.
+ */
+namespace {
+
+double recordNs(LatencyHistogram& histogram, size_t threads, size_t count) {
+    std::vector<std::thread> workers;
+    const double start = wallTime();
+
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&histogram, count, t]() {
+            for (size_t i = 0; i < count; i++) {
+                histogram.record((i * 7919 + t) & 0xfffff);
+            }
+        });
+    }
+
+    for (auto& w: workers) {
+        w.join();
+    }
+
+    return (wallTime() - start) * 1e9 / count;
+}
+
+} // namespace
+
+int benchHistogram(int argc, const char** argv) {
+    const size_t count = benchOption(argc, argv, "count", 10000000);
+    const size_t maxThreads = benchOption(argc, argv, "threads", 4);
+
+    volatile uint64_t sink = 0;
+    const double start = wallTime();
+    for (size_t i = 0; i < count; i++) {
+        sink = monotonicNs();
+    }
+    (void)sink;
+
+    printf("%-12s %8s %16s\n", "operation", "threads", "ns/op");
+    printf("%-12s %8d %16.2f\n", "clock", 1, (wallTime() - start) * 1e9 / count);
+
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        LatencyHistogram histogram;
+        const double ns = recordNs(histogram, threads, count);
+        printf("%-12s %8zu %16.2f\n", "record", threads, ns / threads);
+    }
+
+    return 0;
+}
+
+} // namespace bongo
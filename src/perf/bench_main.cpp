@@ -0,0 +1,100 @@
+/**********************************************
+   File:   bench_main.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "bench.h"
+#include "utils/log.h"
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+namespace bongo {
+
+static const BenchInfo benchmarks[] = {
+    { "zerocopy", "CPU per GB sent on loopback, copying send() vs MSG_ZEROCOPY", benchZeroCopy },
+    { "churn", "Connections opened and closed per second, fresh objects vs recycled ones", benchChurn },
+    { "dispatch", "Events per second through NonBlockNet::step() with many ready fds", benchDispatch },
+    { "pingpong", "Round-trip latency of small messages: TCP loopback vs a UNIX socket, blocking vs spinning reactor", benchPingPong },
+    { "histogram", "Cost of recording a latency: clock read and histogram update, one and many threads", benchHistogram },
+    { "udp", "Datagrams echoed per second, one per syscall vs recvmmsg/sendmmsg batches", benchUdp },
+    { "tls", "TLS handshakes per second and bulk echo throughput, user-space records vs kTLS", benchTls },
+    { "proxy", "CPU per GB relayed by a TCP proxy, splice() through pipes vs copying through user space", benchProxy },
+    { "notify", "Notifications per second and syscalls per notification, pipe vs eventfd with a lock-free ring", benchNotify },
+    { "push", "Requests per second with workers pushing responses to one reactor, by number of workers", benchPush },
+    { "queue", "Values per second through the sessions queue, mutex vs lock-free with futex parking, by producers and consumers", benchQueue },
+};
+
+double threadCpuTime() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double processCpuTime() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+double wallTime() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double>(now).count();
+}
+
+size_t benchOption(int argc, const char** argv, const std::string& name, size_t defaultValue) {
+    const std::string option = "--" + name;
+    for (int i = 0; i + 1 < argc; i++) {
+        if (option == argv[i]) {
+            return strtoull(argv[i + 1], nullptr, 10);
+        }
+    }
+
+    return defaultValue;
+}
+
+} // namespace bongo
+
+using namespace bongo;
+
+static void usage() {
+    std::cout << "Usage:\n    bongo_bench <name> [--option value ...]\n\nBenchmarks:\n";
+    for (const auto& bench: benchmarks) {
+        std::cout << "    " << bench.name << "\t" << bench.description << "\n";
+    }
+}
+
+int main(int argc, const char** argv) {
+    set_log_level(LL_ERROR);
+
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+
+    for (const auto& bench: benchmarks) {
+        if (strcmp(bench.name, argv[1]) == 0) {
+            return bench.run(argc - 2, argv + 2);
+        }
+    }
+
+    usage();
+    return 1;
+}
@@ -0,0 +1,190 @@
+/**********************************************
+   File:   bench_notify.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+#include "bench.h"
+#include "utils/mpsc_ring.h"
+#include "utils/pipe_queue.h"
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+namespace bongo {
+
+/*******************************************************************************
+ *   Worker threads post notifications to one consumer, which sleeps whenever
+ *   there is nothing to take, like a reactor does. The pipe costs a write()
+ *   per notification and a read() per batch; the ring costs an eventfd write
+ *   only when the consumer is asleep. Syscalls are counted on both sides.
+ */
+namespace {
+
+struct Notification {
+    size_t producer = 0;
+};
+
+struct NotifyResult {
+    size_t notifications = 0;
+    size_t syscalls = 0;
+    size_t wakeups = 0;
+    size_t overflows = 0;
+    double wall = 0;
+    double cpu = 0;
+};
+
+int waitReadable(int fd, size_t& syscalls) {
+    pollfd pfd { .fd = fd, .events = POLLIN, .revents = 0 };
+    syscalls++;
+    return poll(&pfd, 1, 1000) > 0 ? 0 : -1;
+}
+
+int runPipe(size_t producers, size_t count, NotifyResult& result) {
+    int fds[2] = { -1, -1 };
+    if (initPipeFds(fds).first != 0) {
+        return -1;
+    }
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    std::vector<Notification> items(producers);
+    std::vector<std::thread> threads;
+    const double wall = wallTime();
+    const double cpu = processCpuTime();
+    for (size_t p = 0; p < producers; p++) {
+        threads.emplace_back([&, p]() {
+            Notification* item = &items[p];
+            for (size_t i = 0; i < count; i++) {
+                writePipeFd(fds[1], &item);
+            }
+        });
+    }
+
+    void* batch[128];
+    const size_t total = producers * count;
+    size_t received = 0;
+    int ret = 0;
+    while (received < total && ret == 0) {
+        result.syscalls++;
+        const size_t n = readPipeData(fds[0], batch, 128);
+        if (n == 0) {
+            ret = waitReadable(fds[0], result.syscalls);
+            continue;
+        }
+        received += n;
+    }
+
+    for (auto& t: threads) {
+        t.join();
+    }
+
+    result.wall += wallTime() - wall;
+    result.cpu += processCpuTime() - cpu;
+    result.notifications += received;
+    // One write() per notification.
+    result.syscalls += total;
+    result.wakeups += total;
+    closePipeFds(fds);
+    return ret;
+}
+
+int runRing(size_t producers, size_t count, NotifyResult& result) {
+    MpscRing<Notification> ring;
+    if (ring.init().first != 0) {
+        return -1;
+    }
+
+    std::vector<Notification> items(producers);
+    std::vector<std::thread> threads;
+    const double wall = wallTime();
+    const double cpu = processCpuTime();
+    for (size_t p = 0; p < producers; p++) {
+        threads.emplace_back([&, p]() {
+            for (size_t i = 0; i < count; i++) {
+                ring.push(&items[p]);
+            }
+        });
+    }
+
+    const size_t total = producers * count;
+    size_t received = 0;
+    int ret = 0;
+    while (received < total && ret == 0) {
+        if (ring.next() != nullptr) {
+            received++;
+            continue;
+        }
+
+        if (!ring.arm()) {
+            continue;
+        }
+
+        ret = waitReadable(ring.getReadFd(), result.syscalls);
+        ring.disarm();
+        ring.clearWakeup();
+        result.syscalls++;
+    }
+
+    for (auto& t: threads) {
+        t.join();
+    }
+
+    result.wall += wallTime() - wall;
+    result.cpu += processCpuTime() - cpu;
+    result.notifications += received;
+    result.syscalls += ring.wakeupsCount();
+    result.wakeups += ring.wakeupsCount();
+    result.overflows += ring.overflowsCount();
+    return ret;
+}
+
+} // namespace
+
+int benchNotify(int argc, const char** argv) {
+    const size_t producers = benchOption(argc, argv, "producers", 4);
+    const size_t count = benchOption(argc, argv, "count", 1000000);
+    const size_t rounds = benchOption(argc, argv, "rounds", 3);
+
+    // Rounds alternate, so both sides see the same machine noise.
+    NotifyResult pipe;
+    NotifyResult ring;
+    for (size_t round = 0; round < rounds; round++) {
+        if (runPipe(producers, count, pipe) != 0 || runRing(producers, count, ring) != 0) {
+            std::cerr << "benchNotify: round " << round << " failed" << std::endl;
+            return 1;
+        }
+    }
+
+    printf("%-6s %10s %12s %10s %14s %10s %16s\n", "mode", "producers", "notify", "wall, s", "notify/s",
+           "CPU, s", "syscalls/notify");
+
+    const std::pair<const char*, const NotifyResult&> modes[] = {
+        { "pipe", pipe },
+        { "ring", ring },
+    };
+
+    for (const auto& [name, m]: modes) {
+        printf("%-6s %10zu %12zu %10.3f %14.0f %10.3f %16.4f\n", name, producers, m.notifications, m.wall,
+               m.notifications / m.wall, m.cpu, (double)m.syscalls / m.notifications);
+    }
+
+    printf("eventfd wakeups per notification: %.4f, spilled past the full ring: %.1f%%\n",
+           (double)ring.wakeups / ring.notifications, 100.0 * ring.overflows / ring.notifications);
+    return 0;
+}
+
+} // namespace bongo
@@ -0,0 +1,243 @@
+/**********************************************
+   File:   bench_pingpong.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "bench.h"
+#include "net/nonblock_conn.h"
+#include "net/block_conn.h"
+#include "proc/processor_base.h"
+#include "proc/thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace bongo {
+
+/*******************************************************************************
+ *   One client does blocking round trips of a small length-prefixed message,
+ *   over TCP loopback and over a UNIX domain socket, with the reactor
+ *   blocking in its waits and with it spinning. The echo comes from the
+ *   reactor thread, or with --workers from a worker, and then the reply and
+ *   the release travel back through the notification queue. Each round trip
+ *   is timed on its own.
+ */
+namespace {
+
+struct PingRequest : public RequestBase {
+    std::string data;
+};
+
+struct PingResponse : public ResponseBase {
+    const std::string* data = nullptr;
+};
+
+class PingSession : public NetSession {
+public:
+    PingSession(NonBlockConnection* conn, bool workers) : NetSession(conn), _workers(workers) {
+        _headerSize = sizeof(uint32_t);
+        _maxBodySize = 1 << 20;
+    }
+
+    int onRead(SessionsQueue* queue) override {
+        if (_workers) {
+            return NetSession::onRead(queue);
+        }
+
+        Buffer src = _readBuf.getData();
+        _output.append(src.ptr, src.size);
+        _readBuf.used(src.size);
+        _conn->writeData();
+        return 0;
+    }
+
+    ProcessingStatus sendResponse(const ResponseBase& response) override {
+        const std::string& data = *static_cast<const PingResponse&>(response).data;
+        const uint32_t size = data.size();
+        pushBuffer().append((const char*)&size, sizeof(size));
+        pushBuffer().append(data.data(), size);
+        return ProcessingStatus::Ok;
+    }
+
+protected:
+    size_t parseMessageSize(Buffer header) override {
+        uint32_t size;
+        memcpy(&size, header.ptr, sizeof(size));
+        return size;
+    }
+
+    std::optional<RequestBase*> parseMessage(const InputMessagePtr& msg) override {
+        PingRequest* req = new PingRequest;
+        req->data.assign(msg->body.data(), msg->body.size());
+        return req;
+    }
+
+private:
+    const bool _workers;
+};
+
+class PingSessionFactory : public NetSessionFactory {
+public:
+    PingSessionFactory(bool workers) : _workers(workers) {}
+    NetSession* makeSession(NonBlockConnection* conn) override { return new PingSession(conn, _workers); }
+
+private:
+    const bool _workers;
+};
+
+class PingProcessor : public ProcessorBase {
+public:
+    PingProcessor(SessionsQueue* queue, ProcessorStats* stats) : ProcessorBase(queue, stats) {}
+
+protected:
+    ProcessingStatus processRequest(SessionBase* session, RequestBase* request) override {
+        PingResponse resp;
+        resp.data = &static_cast<PingRequest*>(request)->data;
+        return session->sendResponse(resp);
+    }
+};
+
+struct PingConfig {
+    size_t count = 0;
+    size_t size = 0;
+    size_t workers = 0;
+    NetBusyPoll busyPoll;
+};
+
+struct PingResult {
+    std::vector<double> rtt; // microseconds, sorted
+    double wall = 0;
+    size_t spinWaits = 0;
+};
+
+template<typename Connector>
+int runPings(const NetOperation& op, Connector& connector, const PingConfig& config, PingResult& result) {
+    ThreadPool<PingProcessor> pool(std::max<size_t>(config.workers, 1));
+    NonBlockNet net;
+    if (net.init() != 0 || net.startListen(op) != 0) {
+        return -1;
+    }
+    net.setSessionsQueue(pool.sessionsQueue());
+    net.setBusyPoll(config.busyPoll);
+
+    std::thread t([&]() { net.run(100); });
+    if (config.workers > 0) {
+        pool.start();
+    }
+
+    auto cleanup = [&]() {
+        pool.stop();
+        net.stop();
+        t.join();
+        result.spinWaits = net.stats().spinWaitsCount;
+    };
+
+    auto conn_info = connector.init() == 0 ? connector.make_connection() : ConnectionInfoResult{};
+    if (!conn_info) {
+        cleanup();
+        return -1;
+    }
+
+    BlockConnection conn(conn_info->fd);
+    const uint32_t size = config.size;
+    const int frameSize = sizeof(size) + size;
+    std::vector<char> buf(frameSize, 'p');
+    memcpy(buf.data(), &size, sizeof(size));
+    result.rtt.reserve(config.count);
+
+    const double wallStart = wallTime();
+    for (size_t i = 0; i < config.count; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        if (conn.writeAll(buf.data(), frameSize) != frameSize || conn.readAll(buf.data(), frameSize) != frameSize) {
+            cleanup();
+            return -1;
+        }
+        result.rtt.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    result.wall = wallTime() - wallStart;
+
+    cleanup();
+    std::sort(result.rtt.begin(), result.rtt.end());
+    return 0;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+} // namespace
+
+int benchPingPong(int argc, const char** argv) {
+    PingConfig config;
+    config.count = benchOption(argc, argv, "count", 100000);
+    config.size = benchOption(argc, argv, "size", 64);
+    config.workers = benchOption(argc, argv, "workers", 0);
+    const size_t spinUs = benchOption(argc, argv, "spin", 1000);
+    const size_t socketUs = benchOption(argc, argv, "busy-poll", 0);
+    const size_t port = benchOption(argc, argv, "port", 8893);
+    const std::string IP = "127.0.0.1";
+    const std::string PATH = "@bongo_bench_pingpong_" + std::to_string(getpid());
+
+    if (config.count == 0 || config.size == 0) {
+        std::cerr << "benchPingPong: --count and --size must be positive" << std::endl;
+        return 1;
+    }
+
+    printf("%-8s %-6s %8s %6s %8s %12s %10s %10s %10s %12s\n", "socket", "wait", "count", "size", "workers",
+           "trips/s", "p50, us", "p99, us", "p999, us", "spin waits");
+
+    for (bool spin: { false, true }) {
+        config.busyPoll = spin ? NetBusyPoll{ .spinUs = (uint32_t)spinUs, .socketUs = (uint32_t)socketUs } : NetBusyPoll{};
+        const auto factory = std::make_shared<PingSessionFactory>(config.workers > 0);
+
+        PingResult tcp;
+        NetOperation tcpOp { .name = "PingTcp", .ip = IP, .port = (int)port, .factory = factory };
+        BlockConnector tcpConnector(IP, (int)port);
+        if (runPings(tcpOp, tcpConnector, config, tcp) != 0) {
+            std::cerr << "benchPingPong: TCP loopback run failed" << std::endl;
+            return 1;
+        }
+
+        PingResult uds;
+        NetOperation udsOp { .name = "PingUnix", .factory = factory, .path = PATH };
+        BlockConnector udsConnector(UnixPath{PATH});
+        if (runPings(udsOp, udsConnector, config, uds) != 0) {
+            std::cerr << "benchPingPong: UNIX socket run failed" << std::endl;
+            return 1;
+        }
+
+        const std::pair<const char*, const PingResult&> sockets[] = {
+            { "tcp", tcp },
+            { "unix", uds },
+        };
+
+        for (const auto& [name, m]: sockets) {
+            printf("%-8s %-6s %8zu %6zu %8zu %12.0f %10.1f %10.1f %10.1f %12zu\n", name, spin ? "spin" : "block",
+                   config.count, config.size, config.workers, config.count / m.wall, percentile(m.rtt, 0.5),
+                   percentile(m.rtt, 0.99), percentile(m.rtt, 0.999), m.spinWaits);
+        }
+    }
+
+    return 0;
+}
+
+} // namespace bongo
@@ -0,0 +1,183 @@
+/**********************************************
+   File:   bench_proxy.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "bench.h"
+#include "net/block_conn.h"
+#include "net/nonblock_conn.h"
+#include "net/splice_proxy.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+
+namespace bongo {
+
+/*******************************************************************************
+ *   A client streams data through a proxy reactor to an echo server and
+ *   reads the echo back. The proxy splices the bytes through pipes, then
+ *   copies them through a user-space buffer. The CPU time is the proxy
+ *   reactor's thread alone, per GB relayed in both directions.
+ */
+namespace {
+
+class ProxyEchoSession : public NetSession {
+public:
+    ProxyEchoSession(NonBlockConnection* conn) : NetSession(conn) {}
+
+    int onRead(SessionsQueue*) override {
+        Buffer src = _readBuf.getData();
+        _output.append(src.ptr, src.size);
+        _readBuf.used(src.size);
+        _conn->writeData();
+        return 0;
+    }
+};
+
+class ProxyEchoSessionFactory : public NetSessionFactory {
+public:
+    NetSession* makeSession(NonBlockConnection* conn) override { return new ProxyEchoSession(conn); }
+};
+
+struct ProxyConfig {
+    size_t bytes = 0;
+    size_t chunk = 0;
+    size_t pipeSize = 0;
+    int port = 0;
+    bool copy = false;
+};
+
+struct ProxyResult {
+    double wall = 0;
+    double proxyCpu = 0;
+    NonBlockNet::Stats stats;
+};
+
+int runProxy(const ProxyConfig& config, ProxyResult& result) {
+    NonBlockNet echo;
+    NetOperation echoOp { .name = "BenchEcho", .ip = "127.0.0.1", .port = config.port,
+                          .factory = std::make_shared<ProxyEchoSessionFactory>() };
+    if (echo.init() != 0 || echo.startListen(echoOp) != 0) {
+        return -1;
+    }
+
+    NonBlockNet proxy;
+    ProxyTarget target { .name = "BenchUpstream", .ip = "127.0.0.1", .port = config.port,
+                         .pipeSize = config.pipeSize, .copy = config.copy };
+    NetOperation proxyOp { .name = "BenchProxy", .ip = "127.0.0.1", .port = config.port + 1,
+                           .factory = std::make_shared<ProxySessionFactory>(target) };
+    if (proxy.init() != 0 || proxy.startListen(proxyOp) != 0) {
+        return -1;
+    }
+
+    std::thread echoThread([&]() { echo.run(100); });
+    std::thread proxyThread([&]() {
+        const double start = threadCpuTime();
+        proxy.run(100);
+        result.proxyCpu = threadCpuTime() - start;
+    });
+    echo.waitListenerReady();
+    proxy.waitListenerReady();
+
+    int ret = -1;
+    auto cleanup = [&]() {
+        proxy.stop();
+        proxyThread.join();
+        echo.stop();
+        echoThread.join();
+        result.stats = proxy.stats();
+        return ret;
+    };
+
+    BlockConnector connector("127.0.0.1", config.port + 1);
+    if (connector.init() != 0) {
+        return cleanup();
+    }
+
+    auto info = connector.make_connection();
+    if (!info) {
+        return cleanup();
+    }
+    BlockConnection conn(info->fd);
+
+    std::vector<char> data(config.chunk, 'p');
+    const double start = wallTime();
+    std::thread writer([&]() {
+        for (size_t sent = 0; sent < config.bytes; ) {
+            const int n = conn.writeAll(data.data(), std::min(data.size(), config.bytes - sent));
+            if (n <= 0) {
+                break;
+            }
+            sent += n;
+        }
+        shutdown(info->fd, SHUT_WR);
+    });
+
+    std::vector<char> buffer(config.chunk);
+    size_t received = 0;
+    while (received < config.bytes) {
+        const int n = conn.readSome(buffer.data(), buffer.size());
+        if (n <= 0) {
+            break;
+        }
+        received += n;
+    }
+    writer.join();
+    result.wall = wallTime() - start;
+
+    ret = received == config.bytes ? 0 : -1;
+    return cleanup();
+}
+
+} // namespace
+
+int benchProxy(int argc, const char** argv) {
+    ProxyConfig config;
+    config.bytes = benchOption(argc, argv, "mb", 2048) * 1024 * 1024;
+    config.chunk = benchOption(argc, argv, "chunk", 256 * 1024);
+    config.pipeSize = benchOption(argc, argv, "pipe", 0);
+    config.port = benchOption(argc, argv, "port", 8896);
+
+    if (config.bytes == 0 || config.chunk == 0) {
+        std::cerr << "benchProxy: --mb and --chunk must be positive" << std::endl;
+        return 1;
+    }
+
+    printf("%8s %10s %10s %16s %14s\n", "relay", "MB", "MB/s", "proxy CPU s/GB", "relayed MB");
+
+    for (bool copy: { false, true }) {
+        config.copy = copy;
+        ProxyResult result;
+        if (runProxy(config, result) != 0) {
+            std::cerr << "benchProxy: run failed" << std::endl;
+            return 1;
+        }
+
+        // Every byte crosses the proxy twice, there and back.
+        const double relayedGb = result.stats.relayedBytesCount / (1024.0 * 1024 * 1024);
+        printf("%8s %10zu %10.1f %16.3f %14.0f\n", copy ? "copy" : "splice", config.bytes >> 20,
+               2.0 * config.bytes / (1024 * 1024) / result.wall, result.proxyCpu / std::max(relayedGb, 1e-9),
+               result.stats.relayedBytesCount / (1024.0 * 1024));
+    }
+
+    return 0;
+}
+
+} // namespace bongo
@@ -0,0 +1,239 @@
+/**********************************************
+   File:   bench_push.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+#include "bench.h"
+#include "net/nonblock_conn.h"
+#include "net/block_conn.h"
+#include "proc/processor_base.h"
+#include "proc/thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+namespace bongo {
+
+/*******************************************************************************
+ *   Clients pipeline requests over many connections to one reactor, workers
+ *   burn some CPU on each and push the response frame to the reactor on its
+ *   own, or with --push 0 leave all of them for the release of the session. Nothing but the notification queue is shared between workers and
+ *   the reactor, so throughput should follow the number of workers up to the
+ *   number of cores.
+ */
+namespace {
+
+struct PushRequest : public RequestBase {
+    uint32_t size = 0;
+};
+
+struct PushResponse : public ResponseBase {
+    uint32_t size = 0;
+};
+
+class PushSession : public NetSession {
+public:
+    PushSession(NonBlockConnection* conn) : NetSession(conn) {
+        _headerSize = sizeof(uint32_t);
+        _maxBodySize = 1 << 20;
+    }
+
+    ProcessingStatus sendResponse(const ResponseBase& response) override {
+        static const std::string body(1 << 20, 'r');
+        const uint32_t size = static_cast<const PushResponse&>(response).size;
+        pushBuffer().append((const char*)&size, sizeof(size));
+        pushBuffer().append(body.data(), size);
+        return ProcessingStatus::Ok;
+    }
+
+    bool recycle() override { reset(); return true; }
+
+protected:
+    size_t parseMessageSize(Buffer header) override {
+        uint32_t size;
+        memcpy(&size, header.ptr, sizeof(size));
+        return size;
+    }
+
+    std::optional<RequestBase*> parseMessage(const InputMessagePtr& msg) override {
+        PushRequest* req = new PushRequest;
+        req->size = msg->body.size();
+        return req;
+    }
+};
+
+class PushSessionFactory : public NetSessionFactory {
+public:
+    NetSession* makeSession(NonBlockConnection* conn) override { return new PushSession(conn); }
+};
+
+std::atomic<size_t> workNs = 0;
+std::atomic<bool> pushEach = true;
+
+class PushProcessor : public ProcessorBase {
+public:
+    PushProcessor(SessionsQueue* queue, ProcessorStats* stats) : ProcessorBase(queue, stats) {}
+
+protected:
+    ProcessingStatus processRequest(SessionBase* session, RequestBase* request) override {
+        const uint64_t until = monotonicNs() + workNs.load(std::memory_order_relaxed);
+        while (monotonicNs() < until) {
+        }
+
+        PushResponse resp;
+        resp.size = static_cast<PushRequest*>(request)->size;
+        ProcessingStatus status = session->sendResponse(resp);
+        if (pushEach.load(std::memory_order_relaxed)) {
+            session->pushData();
+        }
+        return status;
+    }
+};
+
+struct PushConfig {
+    size_t connections = 0;
+    size_t requests = 0; // per connection
+    size_t batch = 0;
+    size_t size = 0;
+    size_t workers = 0;
+};
+
+struct PushResult {
+    double wall = 0;
+    size_t pushes = 0;
+    size_t wakeups = 0;
+    size_t handoffs = 0;
+    size_t dispatched = 0;
+};
+
+int runClient(const std::string& ip, int port, const PushConfig& config) {
+    BlockConnector connector(ip, port);
+    auto conn_info = connector.init() == 0 ? connector.make_connection() : ConnectionInfoResult{};
+    if (!conn_info) {
+        return -1;
+    }
+    BlockConnection conn(conn_info->fd);
+
+    const uint32_t size = config.size;
+    const int frameSize = sizeof(size) + size;
+    std::vector<char> frames(frameSize * config.batch, 'q');
+    for (size_t i = 0; i < config.batch; i++) {
+        memcpy(frames.data() + i * frameSize, &size, sizeof(size));
+    }
+
+    for (size_t done = 0; done < config.requests; done += config.batch) {
+        const int bytes = frameSize * std::min(config.batch, config.requests - done);
+        if (conn.writeAll(frames.data(), bytes) != bytes || conn.readAll(frames.data(), bytes) != bytes) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int runPush(const std::string& ip, int port, const PushConfig& config, PushResult& result) {
+    ThreadPool<PushProcessor> pool(config.workers);
+    NonBlockNet net;
+    // Pushed pieces would otherwise wait for the client's delayed ACK.
+    NetOperation op { .name = "Push", .ip = ip, .port = port, .factory = std::make_shared<PushSessionFactory>(), .noDelay = true };
+    if (net.init() != 0 || net.startListen(op) != 0) {
+        return -1;
+    }
+    net.setSessionsQueue(pool.sessionsQueue());
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+    pool.start();
+
+    std::atomic<int> failed = 0;
+    std::vector<std::thread> clients;
+    const double start = wallTime();
+    for (size_t i = 0; i < config.connections; i++) {
+        clients.emplace_back([&]() {
+            if (runClient(ip, port, config) != 0) {
+                failed++;
+            }
+        });
+    }
+
+    for (auto& client: clients) {
+        client.join();
+    }
+    result.wall = wallTime() - start;
+
+    pool.stop();
+    net.stop();
+    t.join();
+
+    const NonBlockNet::Stats s = net.stats();
+    result.pushes = s.pushDataCount;
+    result.wakeups = s.notificationWakeupsCount;
+    result.handoffs = s.dispatchBatchesCount;
+    result.dispatched = s.sessionsDispatchedCount;
+    return failed.load() == 0 ? 0 : -1;
+}
+
+} // namespace
+
+int benchPush(int argc, const char** argv) {
+    PushConfig config;
+    config.connections = benchOption(argc, argv, "connections", 16);
+    config.requests = benchOption(argc, argv, "requests", 20000);
+    config.batch = benchOption(argc, argv, "batch", 16);
+    config.size = benchOption(argc, argv, "size", 64);
+    const size_t maxWorkers = benchOption(argc, argv, "workers", std::max(1u, std::thread::hardware_concurrency()));
+    const size_t port = benchOption(argc, argv, "port", 8898);
+    workNs.store(benchOption(argc, argv, "work-ns", 2000));
+    // 0: the responses go with the release of the session only.
+    pushEach.store(benchOption(argc, argv, "push", 1) != 0);
+    const std::string IP = "127.0.0.1";
+
+    if (config.connections == 0 || config.requests == 0 || config.batch == 0) {
+        std::cerr << "benchPush: --connections, --requests and --batch must be positive" << std::endl;
+        return 1;
+    }
+
+    std::vector<size_t> counts;
+    for (size_t workers = 1; workers < maxWorkers; workers *= 2) {
+        counts.push_back(workers);
+    }
+    counts.push_back(maxWorkers);
+
+    printf("%8s %12s %10s %12s %12s %14s %16s\n", "workers", "requests", "wall, s", "requests/s", "pushes/s",
+           "wakeups/push", "sessions/handoff");
+
+    for (size_t workers: counts) {
+        config.workers = workers;
+        PushResult result;
+        if (runPush(IP, (int)port, config, result) != 0) {
+            std::cerr << "benchPush: run with " << workers << " workers failed" << std::endl;
+            return 1;
+        }
+
+        const size_t requests = config.connections * config.requests;
+        printf("%8zu %12zu %10.3f %12.0f %12.0f %14.4f %16.2f\n", workers, requests, result.wall, requests / result.wall,
+               result.pushes / result.wall, result.pushes ? (double)result.wakeups / result.pushes : 0.0,
+               result.handoffs ? (double)result.dispatched / result.handoffs : 0.0);
+    }
+
+    return 0;
+}
+
+} // namespace bongo
@@ -0,0 +1,182 @@
+/**********************************************
+   File:   bench_queue.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "bench.h"
+#include "utils/mpmc_queue.h"
+#include "utils/thread_queue.h"
+#include <atomic>
+#include <iostream>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+namespace bongo {
+
+/*******************************************************************************
+ *   Producers, like reactors, push values that consumers, like workers, pop
+ *   and drop. Every pair of producer and consumer counts is run over
+ *   ThreadQueue, one mutex and condition variable, and over MpmcQueue, a
+ *   lock-free ring with futex parking. --batch above 1 uses push_bulk() and
+ *   pop_bulk() on both.
+ */
+namespace {
+
+struct QueueConfig {
+    size_t producers = 0;
+    size_t consumers = 0;
+    size_t count = 0;
+    size_t batch = 0;
+};
+
+struct QueueResult {
+    size_t values = 0;
+    double wall = 0;
+    double cpu = 0;
+    size_t parks = 0;
+};
+
+template <typename Queue>
+void produce(Queue& queue, const QueueConfig& config) {
+    if (config.batch <= 1) {
+        for (size_t i = 0; i < config.count; i++) {
+            queue.push(i + 1);
+        }
+        return;
+    }
+
+    std::vector<size_t> values;
+    values.reserve(config.batch);
+    for (size_t i = 0; i < config.count; i++) {
+        values.push_back(i + 1);
+        if (values.size() == config.batch) {
+            queue.push_bulk(values);
+        }
+    }
+    queue.push_bulk(values);
+}
+
+template <typename Queue>
+void consume(Queue& queue, const QueueConfig& config, std::atomic<size_t>& taken) {
+    if (config.batch <= 1) {
+        while (queue.pop()) {
+            taken.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    std::vector<size_t> values;
+    values.reserve(config.batch);
+    while (queue.pop_bulk(values, config.batch)) {
+        taken.fetch_add(values.size(), std::memory_order_relaxed);
+    }
+}
+
+template <typename Queue>
+void runQueue(Queue& queue, const QueueConfig& config, QueueResult& result) {
+    std::atomic<size_t> taken = 0;
+    std::vector<std::thread> consumers;
+    for (size_t c = 0; c < config.consumers; c++) {
+        consumers.emplace_back([&]() { consume(queue, config, taken); });
+    }
+
+    const double wall = wallTime();
+    const double cpu = processCpuTime();
+    std::vector<std::thread> producers;
+    for (size_t p = 0; p < config.producers; p++) {
+        producers.emplace_back([&]() { produce(queue, config); });
+    }
+
+    const size_t total = config.producers * config.count;
+    for (auto& t: producers) {
+        t.join();
+    }
+    while (taken.load(std::memory_order_relaxed) < total) {
+        std::this_thread::yield();
+    }
+    result.wall = wallTime() - wall;
+    result.cpu = processCpuTime() - cpu;
+    result.values = total;
+
+    queue.shutdown();
+    for (auto& t: consumers) {
+        t.join();
+    }
+}
+
+std::vector<size_t> sweep(size_t max) {
+    std::vector<size_t> counts;
+    for (size_t n = 1; n < max; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(max);
+    return counts;
+}
+
+} // namespace
+
+int benchQueue(int argc, const char** argv) {
+    const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    const size_t maxProducers = benchOption(argc, argv, "producers", 4);
+    const size_t maxConsumers = benchOption(argc, argv, "consumers", std::max<size_t>(4, cores));
+    QueueConfig config;
+    config.count = benchOption(argc, argv, "count", 200000);
+    config.batch = benchOption(argc, argv, "batch", 1);
+
+    if (maxProducers == 0 || maxConsumers == 0 || config.count == 0) {
+        std::cerr << "benchQueue: --producers, --consumers and --count must be positive" << std::endl;
+        return 1;
+    }
+
+    printf("%-8s %10s %10s %12s %10s %14s %10s %12s\n", "queue", "producers", "consumers", "values", "wall, s",
+           "values/s", "CPU, s", "parks/value");
+
+    for (size_t producers: sweep(maxProducers)) {
+        for (size_t consumers: sweep(maxConsumers)) {
+            config.producers = producers;
+            config.consumers = consumers;
+
+            QueueResult locked;
+            ThreadQueue<size_t> threadQueue;
+            runQueue(threadQueue, config, locked);
+
+            QueueResult lockFree;
+            MpmcQueue<size_t> mpmcQueue;
+            runQueue(mpmcQueue, config, lockFree);
+            lockFree.parks = mpmcQueue.parksCount();
+
+            const std::pair<const char*, const QueueResult&> modes[] = {
+                { "mutex", locked },
+                { "mpmc", lockFree },
+            };
+
+            // ThreadQueue doesn't count its condition variable waits.
+            for (const auto& [name, m]: modes) {
+                char parks[32] = "-";
+                if (&m == &lockFree) {
+                    snprintf(parks, sizeof(parks), "%.4f", (double)m.parks / m.values);
+                }
+                printf("%-8s %10zu %10zu %12zu %10.3f %14.0f %10.3f %12s\n", name, producers, consumers,
+                       m.values, m.wall, m.values / m.wall, m.cpu, parks);
+            }
+        }
+    }
+
+    return 0;
+}
+
+} // namespace bongo
@@ -0,0 +1,240 @@
+/**********************************************
+   File:   bench_tls.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "bench.h"
+#include "net/block_conn.h"
+#include "net/nonblock_conn.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+
+namespace bongo {
+
+/*******************************************************************************
+ *   TLS termination on the reactor. Clients connect, handshake and close one
+ *   after another, then one client streams data through an echo session. Both
+ *   run with the record layer in user space and, when the kernel has it, with
+ *   kTLS. The CPU time is the whole process, the clients included.
+ */
+namespace {
+
+class TlsEchoSession : public NetSession {
+public:
+    TlsEchoSession(NonBlockConnection* conn) : NetSession(conn) {}
+
+    int onRead(SessionsQueue*) override {
+        Buffer src = _readBuf.getData();
+        _output.append(src.ptr, src.size);
+        _readBuf.used(src.size);
+        _conn->writeData();
+        return 0;
+    }
+};
+
+class TlsEchoSessionFactory : public NetSessionFactory {
+public:
+    NetSession* makeSession(NonBlockConnection* conn) override { return new TlsEchoSession(conn); }
+};
+
+struct TlsBenchConfig {
+    size_t handshakes = 0;
+    size_t bulkBytes = 0;
+    size_t chunk = 0;
+    int port = 0;
+    bool kernelOffload = false;
+};
+
+struct TlsBenchResult {
+    double handshakeWall = 0;
+    double handshakeCpu = 0;
+    double bulkWall = 0;
+    double bulkCpu = 0;
+    NonBlockNet::Stats stats;
+};
+
+// A client verifying the server against its self-signed certificate.
+SSL_CTX* makeClientContext(const std::string& caPem) {
+    SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+    BIO* bio = BIO_new_mem_buf(caPem.data(), caPem.size());
+    X509* ca = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr);
+    X509_STORE_add_cert(SSL_CTX_get_cert_store(ctx), ca);
+    X509_free(ca);
+    BIO_free(bio);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+    return ctx;
+}
+
+SSL* connectClient(SSL_CTX* ctx, int port) {
+    BlockConnector connector("127.0.0.1", port);
+    if (connector.init() != 0) {
+        return nullptr;
+    }
+
+    auto info = connector.make_connection();
+    if (!info) {
+        return nullptr;
+    }
+
+    SSL* ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, info->fd);
+    if (SSL_connect(ssl) != 1) {
+        close(info->fd);
+        SSL_free(ssl);
+        return nullptr;
+    }
+
+    return ssl;
+}
+
+void closeClient(SSL* ssl) {
+    const int fd = SSL_get_fd(ssl);
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    close(fd);
+}
+
+int runTls(const TlsBenchConfig& config, TlsBenchResult& result) {
+    TlsConfig tlsConfig;
+    if (TlsContext::makeSelfSigned("localhost", tlsConfig.certPem, tlsConfig.keyPem) != 0) {
+        return -1;
+    }
+    tlsConfig.kernelOffload = config.kernelOffload;
+
+    auto tls = std::make_shared<TlsContext>(TlsMode::Server, tlsConfig);
+    if (tls->init() != 0) {
+        return -1;
+    }
+
+    auto factory = std::make_shared<TlsEchoSessionFactory>();
+    factory->setTls(tls);
+
+    NonBlockNet net;
+    NetOperation op { .name = "BenchTls", .ip = "127.0.0.1", .port = config.port, .factory = factory };
+    if (net.init() != 0 || net.startListen(op) != 0) {
+        return -1;
+    }
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+
+    SSL_CTX* ctx = makeClientContext(tlsConfig.certPem);
+    int ret = -1;
+    auto cleanup = [&]() {
+        SSL_CTX_free(ctx);
+        net.stop();
+        t.join();
+        result.stats = net.stats();
+        return ret;
+    };
+
+    double wallStart = wallTime();
+    double cpuStart = processCpuTime();
+    for (size_t i = 0; i < config.handshakes; i++) {
+        SSL* ssl = connectClient(ctx, config.port);
+        if (ssl == nullptr) {
+            return cleanup();
+        }
+        closeClient(ssl);
+    }
+    result.handshakeWall = wallTime() - wallStart;
+    result.handshakeCpu = processCpuTime() - cpuStart;
+
+    SSL* ssl = connectClient(ctx, config.port);
+    if (ssl == nullptr) {
+        return cleanup();
+    }
+
+    // The echo comes back while the client is still sending.
+    std::vector<char> data(config.chunk, 't');
+    wallStart = wallTime();
+    cpuStart = processCpuTime();
+    std::thread writer([&]() {
+        for (size_t sent = 0; sent < config.bulkBytes; ) {
+            const int n = SSL_write(ssl, data.data(), std::min(data.size(), config.bulkBytes - sent));
+            if (n <= 0) {
+                break;
+            }
+            sent += n;
+        }
+    });
+
+    std::vector<char> buffer(config.chunk);
+    size_t received = 0;
+    while (received < config.bulkBytes) {
+        const int n = SSL_read(ssl, buffer.data(), buffer.size());
+        if (n <= 0) {
+            break;
+        }
+        received += n;
+    }
+    writer.join();
+    result.bulkWall = wallTime() - wallStart;
+    result.bulkCpu = processCpuTime() - cpuStart;
+
+    closeClient(ssl);
+    ret = received == config.bulkBytes ? 0 : -1;
+    return cleanup();
+}
+
+} // namespace
+
+int benchTls(int argc, const char** argv) {
+    TlsBenchConfig config;
+    config.handshakes = benchOption(argc, argv, "handshakes", 2000);
+    config.bulkBytes = benchOption(argc, argv, "mb", 1024) * 1024 * 1024;
+    config.chunk = benchOption(argc, argv, "chunk", 64 * 1024);
+    config.port = benchOption(argc, argv, "port", 8895);
+
+    if (config.handshakes == 0 || config.bulkBytes == 0 || config.chunk == 0) {
+        std::cerr << "benchTls: --handshakes, --mb and --chunk must be positive" << std::endl;
+        return 1;
+    }
+
+    if (!TlsContext::kernelTlsAvailable()) {
+        printf("kTLS is not available, the second run falls back to user space\n");
+    }
+
+    printf("%8s %12s %14s %12s %12s %12s\n", "kTLS", "handshakes/s", "CPU us/hshake", "MB/s", "CPU s/GB",
+           "offloaded");
+
+    for (bool kernelOffload: { false, true }) {
+        config.kernelOffload = kernelOffload;
+        TlsBenchResult result;
+        if (runTls(config, result) != 0) {
+            std::cerr << "benchTls: run failed" << std::endl;
+            return 1;
+        }
+
+        // Bulk bytes go both ways through the reactor.
+        const double gb = 2.0 * config.bulkBytes / (1024.0 * 1024 * 1024);
+        printf("%8s %12.0f %14.1f %12.1f %12.2f %12zu\n", kernelOffload ? "on" : "off",
+               config.handshakes / result.handshakeWall, result.handshakeCpu * 1e6 / config.handshakes,
+               2.0 * config.bulkBytes / (1024 * 1024) / result.bulkWall, result.bulkCpu / gb,
+               result.stats.tlsOffloadedCount);
+    }
+
+    return 0;
+}
+
+} // namespace bongo
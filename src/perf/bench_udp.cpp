@@ -0,0 +1,265 @@
+/**********************************************
+   File:   bench_udp.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "bench.h"
+#include "net/datagram.h"
+#include "proc/processor_base.h"
+#include "proc/thread_pool.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace bongo {
+
+/*******************************************************************************
+ *   Several peers send small datagrams to a datagram socket and get them
+ *   echoed back, every peer keeps a window of them in flight. The reactor
+ *   reads and replies one datagram per syscall, then a batch per syscall.
+ *   The echo comes from the reactor, or with --workers from a worker. Lost
+ *   datagrams are counted when a window times out.
+ */
+namespace {
+
+struct UdpRequest : public RequestBase {
+    std::vector<char> data;
+};
+
+struct UdpResponse : public ResponseBase {
+    const std::vector<char>* data = nullptr;
+};
+
+class UdpEchoSession : public DatagramSession {
+public:
+    UdpEchoSession(NonBlockDatagram* socket, const DatagramPeer& peer, bool workers)
+      : DatagramSession(socket, peer), _workers(workers) {}
+
+    int onRead(SessionsQueue* queue) override {
+        if (_workers) {
+            return DatagramSession::onRead(queue);
+        }
+
+        while (auto request = getRequest()) {
+            UdpRequest* req = static_cast<UdpRequest*>(request.value());
+            reply(req->data.data(), req->data.size());
+            delete req;
+        }
+        return 0;
+    }
+
+    ProcessingStatus sendResponse(const ResponseBase& response) override {
+        const std::vector<char>& data = *static_cast<const UdpResponse&>(response).data;
+        reply(data.data(), data.size());
+        return ProcessingStatus::Ok;
+    }
+
+protected:
+    std::optional<RequestBase*> parseMessage(const InputMessagePtr& msg) override {
+        UdpRequest* req = new UdpRequest;
+        req->data.swap(msg->body);
+        return req;
+    }
+
+private:
+    const bool _workers;
+};
+
+class UdpEchoSessionFactory : public DatagramSessionFactory {
+public:
+    UdpEchoSessionFactory(bool workers) : _workers(workers) {}
+    DatagramSession* makeDatagramSession(NonBlockDatagram* socket, const DatagramPeer& peer) override {
+        return new UdpEchoSession(socket, peer, _workers);
+    }
+
+private:
+    const bool _workers;
+};
+
+class UdpProcessor : public ProcessorBase {
+public:
+    UdpProcessor(SessionsQueue* queue, ProcessorStats* stats) : ProcessorBase(queue, stats) {}
+
+protected:
+    ProcessingStatus processRequest(SessionBase* session, RequestBase* request) override {
+        UdpResponse resp;
+        resp.data = &static_cast<UdpRequest*>(request)->data;
+        return session->sendResponse(resp);
+    }
+};
+
+struct UdpConfig {
+    size_t count = 0;
+    size_t size = 0;
+    size_t peers = 0;
+    size_t window = 0;
+    size_t workers = 0;
+    size_t batch = 0;
+    int port = 0;
+};
+
+struct UdpResult {
+    double wall = 0;
+    double cpu = 0; // the whole process, the peers included
+    size_t echoed = 0;
+    size_t lost = 0;
+    NonBlockNet::Stats stats;
+};
+
+int runUdp(const UdpConfig& config, UdpResult& result) {
+    ThreadPool<UdpProcessor> pool(std::max<size_t>(config.workers, 1));
+    NonBlockNet net;
+    net.setDatagramBatch(config.batch);
+    NetOperation op {
+        .name = "BenchUdp",
+        .ip = "127.0.0.1",
+        .port = config.port,
+        .factory = std::make_shared<UdpEchoSessionFactory>(config.workers > 0),
+    };
+    if (net.init() != 0 || net.startDatagram(op) != 0) {
+        return -1;
+    }
+    net.setSessionsQueue(pool.sessionsQueue());
+
+    std::thread t([&]() { net.run(100); });
+    if (config.workers > 0) {
+        pool.start();
+    }
+
+    std::vector<int> peers;
+    auto cleanup = [&]() {
+        for (int fd: peers) {
+            close(fd);
+        }
+        pool.stop();
+        net.stop();
+        t.join();
+        result.stats = net.stats();
+    };
+
+    sockaddr_in server = {};
+    server.sin_family = AF_INET;
+    server.sin_port = htons(config.port);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (size_t i = 0; i < config.peers; i++) {
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            cleanup();
+            return -1;
+        }
+        peers.push_back(fd);
+
+        timeval tv { .tv_sec = 0, .tv_usec = 200000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        if (connect(fd, (sockaddr*)&server, sizeof(server)) != 0) {
+            cleanup();
+            return -1;
+        }
+    }
+
+    // The peers batch too, so that the reactor is what's measured.
+    std::vector<char> data(config.window * config.size, 'u');
+    std::vector<mmsghdr> msgs(config.window);
+    std::vector<iovec> iovs(config.window);
+    auto prepare = [&]() {
+        for (size_t i = 0; i < config.window; i++) {
+            iovs[i] = iovec{ .iov_base = &data[i * config.size], .iov_len = config.size };
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    };
+
+    const double wallStart = wallTime();
+    const double cpuStart = processCpuTime();
+    size_t sent = 0;
+    while (sent < config.count) {
+        for (int fd: peers) {
+            prepare();
+            const int ret = sendmmsg(fd, msgs.data(), config.window, 0);
+            sent += std::max(ret, 0);
+        }
+
+        for (int fd: peers) {
+            size_t left = config.window;
+            while (left > 0) {
+                prepare();
+                const int ret = recvmmsg(fd, msgs.data(), left, MSG_WAITFORONE, nullptr);
+                if (ret <= 0) {
+                    result.lost += left;
+                    break;
+                }
+                result.echoed += ret;
+                left -= ret;
+            }
+        }
+    }
+    result.wall = wallTime() - wallStart;
+    result.cpu = processCpuTime() - cpuStart;
+
+    cleanup();
+    return 0;
+}
+
+} // namespace
+
+int benchUdp(int argc, const char** argv) {
+    UdpConfig config;
+    config.count = benchOption(argc, argv, "count", 1000000);
+    config.size = benchOption(argc, argv, "size", 64);
+    config.peers = benchOption(argc, argv, "peers", 4);
+    config.window = benchOption(argc, argv, "window", 32);
+    config.workers = benchOption(argc, argv, "workers", 0);
+    config.port = benchOption(argc, argv, "port", 8894);
+    const size_t batch = benchOption(argc, argv, "batch", 64);
+
+    if (config.count == 0 || config.size == 0 || config.peers == 0 || config.window == 0) {
+        std::cerr << "benchUdp: --count, --size, --peers and --window must be positive" << std::endl;
+        return 1;
+    }
+
+    printf("%6s %8s %6s %6s %8s %12s %10s %12s %12s %10s\n", "batch", "count", "size", "peers", "workers",
+           "echoes/s", "lost", "syscalls/dg", "CPU us/dg", "sendmmsg");
+
+    for (size_t b: { (size_t)1, batch }) {
+        config.batch = b;
+        UdpResult result;
+        if (runUdp(config, result) != 0) {
+            std::cerr << "benchUdp: run failed" << std::endl;
+            return 1;
+        }
+
+        const NonBlockNet::Stats& s = result.stats;
+        const double received = std::max<size_t>(s.datagramsReceivedCount, 1);
+        printf("%6zu %8zu %6zu %6zu %8zu %12.0f %10zu %12.3f %12.2f %10zu\n", b, config.count, config.size,
+               config.peers, config.workers, result.echoed / result.wall, result.lost,
+               (s.recvmmsgCount + s.sendmmsgCount) / received, result.cpu * 1e6 / std::max<size_t>(result.echoed, 1),
+               s.sendmmsgCount);
+    }
+
+    return 0;
+}
+
+} // namespace bongo
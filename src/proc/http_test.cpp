@@ -21,6 +21,8 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <dirent.h>
+#include <sys/mman.h>
 #include <experimental/scope>
 
 namespace bongo {
@@ -28,6 +30,8 @@ namespace bongo {
 const std::string HeaderDelimiter = "\r\n\r\n";
 const std::string ContentLengthHeader = "Content-Length: ";
 const std::string SimpleHttpResponse = "HTTP/1.1 200 OK\r\nContent-Length: 13\r\nContent-Type: text/html\r\n\r\nHello World!";
+const std::string NotFoundHttpResponse = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+const std::string OverloadedHttpResponse = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nRetry-After: 1\r\n\r\n";
 
 /***********************************************************
  *   Session
@@ -37,12 +41,15 @@ HttpSession::HttpSession() {
 }
 
 ProcessingStatus HttpSession::sendResponse(const ResponseBase&) {
-    Buffer dest = _writeBuf.getAvailable(SimpleHttpResponse.length());
-    memcpy(dest.ptr, SimpleHttpResponse.data(), SimpleHttpResponse.length());
-    _writeBuf.update(SimpleHttpResponse.length());
+    pushBuffer().appendStatic(SimpleHttpResponse.data(), SimpleHttpResponse.length());
     return ProcessingStatus::Ok;
 }
 
+bool HttpSession::rejectRequest() {
+    _output.appendStatic(OverloadedHttpResponse.data(), OverloadedHttpResponse.length());
+    return true;
+}
+
 size_t HttpSession::parseMessageSize(Buffer header) {
     const std::string_view haystack(header.ptr, header.size);
     size_t headerStart = haystack.find(ContentLengthHeader);
@@ -70,6 +77,10 @@ const std::string& HttpSession::getSimpleHttpResponse() {
     return SimpleHttpResponse;
 }
 
+const std::string& HttpSession::getOverloadedResponse() {
+    return OverloadedHttpResponse;
+}
+
 /***********************************************************
  *   Processor
  */
@@ -81,4 +92,147 @@ ProcessingStatus HttpProcessor::processRequest(SessionBase* session, RequestBase
     return session->sendResponse(resp);
 }
 
+/***********************************************************
+ *   File cache
+ */
+static const char* contentType(const std::string& name) {
+    static const std::pair<const char*, const char*> types[] = {
+        { ".html", "text/html" },
+        { ".txt",  "text/plain" },
+        { ".css",  "text/css" },
+        { ".js",   "application/javascript" },
+        { ".json", "application/json" },
+        { ".png",  "image/png" },
+        { ".jpg",  "image/jpeg" },
+    };
+
+    const std::string_view sv(name);
+    for (const auto& [ext, type]: types) {
+        if (sv.ends_with(ext)) {
+            return type;
+        }
+    }
+
+    return "application/octet-stream";
+}
+
+HttpFileCache::~HttpFileCache() {
+    if (_headers != nullptr) {
+        munmap(_headers, _headersSize);
+    }
+}
+
+int HttpFileCache::init(const std::string& directory) {
+    DIR* dir = opendir(directory.c_str());
+    if (dir == nullptr) {
+        LOG_ERROR << "HttpFileCache::init: failed to open directory " << directory << ": " << strerror(errno);
+        return -1;
+    }
+    auto closeDir = std::experimental::scope_exit([&]() { closedir(dir); });
+
+    std::vector<std::pair<std::string, std::string>> headers;
+    while (dirent* ent = readdir(dir)) {
+        const std::string name = ent->d_name;
+        auto file = OutputFile::open(directory + "/" + name);
+        if (!file) {
+            continue; // directories and the like
+        }
+
+        char header[256];
+        snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\nContent-Type: %s\r\n\r\n",
+                 file->size(), contentType(name));
+
+        headers.emplace_back(name, header);
+        _entries[name] = Entry{ .header = nullptr, .headerSize = 0, .file = file };
+    }
+
+    if (headers.empty()) {
+        return 0;
+    }
+
+    for (const auto& h: headers) {
+        _headersSize += h.second.length();
+    }
+
+    void* ptr = mmap(nullptr, _headersSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        LOG_ERROR << "HttpFileCache::init: failed to map headers: " << strerror(errno);
+        return -1;
+    }
+    _headers = ptr;
+
+    char* dest = static_cast<char*>(_headers);
+    for (const auto& [name, header]: headers) {
+        memcpy(dest, header.data(), header.length());
+        Entry& entry = _entries[name];
+        entry.header = dest;
+        entry.headerSize = header.length();
+        dest += header.length();
+    }
+
+    if (mprotect(_headers, _headersSize, PROT_READ) != 0) {
+        LOG_ERROR << "HttpFileCache::init: failed to protect headers: " << strerror(errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+const HttpFileCache::Entry* HttpFileCache::find(std::string_view path) const {
+    if (path.starts_with('/')) {
+        path.remove_prefix(1);
+    }
+
+    auto it = _entries.find(std::string(path));
+    return it != _entries.end() ? &it->second : nullptr;
+}
+
+/***********************************************************
+ *   File session
+ */
+const std::string& HttpFileSession::getNotFoundResponse() {
+    return NotFoundHttpResponse;
+}
+
+std::optional<RequestBase*> HttpFileSession::parseMessage(const InputMessagePtr& msg) {
+    // GET /path HTTP/1.1
+    const std::string_view header(msg->header.data(), msg->header.size());
+    HttpFileRequest* req = new HttpFileRequest;
+
+    if (header.starts_with("GET ")) {
+        const size_t start = 4;
+        const size_t end = header.find(' ', start);
+        if (end != std::string_view::npos) {
+            req->path = header.substr(start, end - start);
+        }
+    }
+
+    return req;
+}
+
+ProcessingStatus HttpFileSession::sendResponse(const ResponseBase& response) {
+    const HttpFileResponse& resp = dynamic_cast<const HttpFileResponse&>(response);
+
+    OutputChain& output = pushBuffer();
+    const HttpFileCache::Entry* entry = _cache->find(resp.path);
+    if (entry == nullptr) {
+        output.appendStatic(NotFoundHttpResponse.data(), NotFoundHttpResponse.length());
+        return ProcessingStatus::Ok;
+    }
+
+    output.append(_cache, entry->header, entry->headerSize);
+    output.appendFile(entry->file, 0, entry->file->size());
+    return ProcessingStatus::Ok;
+}
+
+ProcessingStatus HttpFileProcessor::processRequest(SessionBase* session, RequestBase* request) {
+    HttpFileRequest* req = dynamic_cast<HttpFileRequest*>(request);
+    assert(session);
+    assert(req);
+
+    HttpFileResponse resp;
+    resp.path = std::move(req->path);
+    return session->sendResponse(resp);
+}
+
 } // namespace bongo
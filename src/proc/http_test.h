@@ -20,7 +20,10 @@
 #include "notification_base.h"
 #include "utils/pipe_queue.h"
 #include "thread_pool.h"
+#include "utils/output_chain.h"
+#include <memory>
 #include <string_view>
+#include <unordered_map>
 
 namespace bongo {
 
@@ -31,9 +34,11 @@ class HttpSession : public SessionBase {
 public:
     HttpSession();
     static const std::string& getSimpleHttpResponse();
+    static const std::string& getOverloadedResponse();
 
 protected:
     ProcessingStatus sendResponse(const ResponseBase& response) override;
+    bool rejectRequest() override;
     size_t parseMessageSize(Buffer header) override;
     std::optional<RequestBase*> parseMessage(const InputMessagePtr& msg) override;
 };
@@ -55,4 +60,76 @@ protected:
  */
 using HttpSingleThreadPool = ThreadPool<HttpProcessor, 1>;
 
+/***************************
+ * File cache
+ *
+ * Opens every regular file of a directory once. Response headers of all
+ * files are precomputed into one read-only mmap'd region.
+ */
+class HttpFileCache {
+public:
+    struct Entry {
+        const char* header;
+        size_t headerSize;
+        std::shared_ptr<const OutputFile> file;
+    };
+
+    HttpFileCache() = default;
+    ~HttpFileCache();
+
+    HttpFileCache(const HttpFileCache&) = delete;
+    HttpFileCache& operator=(const HttpFileCache&) = delete;
+
+    int init(const std::string& directory);
+
+    // The path is a file name, with or without the leading '/'.
+    const Entry* find(std::string_view path) const;
+    size_t size() const { return _entries.size(); }
+
+private:
+    std::unordered_map<std::string, Entry> _entries;
+    void* _headers = nullptr;
+    size_t _headersSize = 0;
+};
+
+using HttpFileCachePtr = std::shared_ptr<const HttpFileCache>;
+
+/***************************
+ * File session
+ *
+ * Serves GET requests from an HttpFileCache. The header goes from the cache,
+ * the body is a file segment sent with sendfile().
+ */
+struct HttpFileRequest : public RequestBase {
+    std::string path;
+};
+
+struct HttpFileResponse : public ResponseBase {
+    std::string path;
+};
+
+class HttpFileSession : public HttpSession {
+public:
+    HttpFileSession(HttpFileCachePtr cache) : _cache(cache) {}
+    static const std::string& getNotFoundResponse();
+
+protected:
+    ProcessingStatus sendResponse(const ResponseBase& response) override;
+    std::optional<RequestBase*> parseMessage(const InputMessagePtr& msg) override;
+
+private:
+    HttpFileCachePtr _cache;
+};
+
+class HttpFileProcessor : public ProcessorBase {
+public:
+    HttpFileProcessor(SessionsQueue* sessionsQueue, ProcessorStats* stats = nullptr)
+      : ProcessorBase(sessionsQueue, stats) {}
+
+protected:
+    ProcessingStatus processRequest(SessionBase* session, RequestBase* request) override;
+};
+
+using HttpFileSingleThreadPool = ThreadPool<HttpFileProcessor, 1>;
+
 } // namespace bongo
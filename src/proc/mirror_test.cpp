@@ -46,22 +46,18 @@ ProcessingStatus MirrorSession::sendResponse(const ResponseBase& response) {
 }
 
 ProcessingStatus MirrorSession::sendResponseFixedHeader(const MirrorResponse& resp) {
-    uint32_t len = resp.output.length();
-    size_t serializedSize = sizeof(len) + resp.output.length();
-    Buffer dest = _writeBuf.getAvailable(serializedSize);
-
-    memcpy(dest.ptr, &len, sizeof(len));
-    memcpy(dest.ptr + sizeof(len), resp.output.data(), len);
-
-    _writeBuf.update(serializedSize);
+    OutputChain& output = pushBuffer();
+    uint32_t len = resp.output->length();
+    output.append((const char*)&len, sizeof(len));
+    output.append(resp.output);
     return ProcessingStatus::Ok;
 }
 
 ProcessingStatus MirrorSession::sendResponseVariableHeader(const MirrorResponse& resp) {
-    const std::string output = makeMirrorPacketWithVarHeader(resp.output);
-    Buffer dest = _writeBuf.getAvailable(output.length());
-    memcpy(dest.ptr, output.data(), output.length());
-    _writeBuf.update(output.length());
+    OutputChain& output = pushBuffer();
+    const std::string header = makeMirrorVarHeader(resp.output->length());
+    output.append(header.data(), header.length());
+    output.append(resp.output);
     return ProcessingStatus::Ok;
 }
 
@@ -106,21 +102,39 @@ size_t MirrorSession::parseMessageSizeVariableHeader(Buffer header, size_t& head
     return val;
 }
 
+bool MirrorSession::rejectRequest() {
+    const std::string frame = makeErrorFrame();
+    _output.append(frame.data(), frame.length());
+    return true;
+}
+
+std::string MirrorSession::makeErrorFrame() const {
+    if (_headerSize == 0) {
+        return "-1" + HeaderDelimiter;
+    }
+
+    const uint32_t size = ErrorFrameSize;
+    return std::string((const char*)&size, sizeof(size));
+}
+
 std::optional<RequestBase*> MirrorSession::parseMessage(const InputMessagePtr& msg) {
     MirrorRequest* req = new MirrorRequest;
     req->input.assign(msg->body.data(), msg->body.size());
     return req;
 }
 
-std::string MirrorSession::makeMirrorPacketWithVarHeader(const std::string& str) {
-    const uint32_t len = str.length();
+std::string MirrorSession::makeMirrorVarHeader(uint32_t len) {
     char buffer[64];
     snprintf(buffer, sizeof(buffer)-1, "%u", len);
 
     std::string result = buffer;
     result += HeaderDelimiter;
-    result += str;
+    return result;
+}
 
+std::string MirrorSession::makeMirrorPacketWithVarHeader(const std::string& str) {
+    std::string result = makeMirrorVarHeader(str.length());
+    result += str;
     return result;
 }
 
@@ -141,8 +155,9 @@ ProcessingStatus MirrorProcessor::processRequest(SessionBase* session, RequestBa
     MirrorRequest* req = dynamic_cast<MirrorRequest*>(request);
     assert(req);
 
+    // The request is done with its input. Hand it over to the output chain.
     MirrorResponse resp;
-    resp.output = req->input;
+    resp.output = std::make_shared<const std::string>(std::move(req->input));
 
     assert(session);
     return session->sendResponse(resp);
@@ -20,6 +20,8 @@
 #include "notification_base.h"
 #include "utils/pipe_queue.h"
 #include "thread_pool.h"
+#include <cstdint>
+#include <memory>
 #include <string_view>
 
 namespace bongo {
@@ -32,7 +34,7 @@ struct MirrorRequest : public RequestBase {
 };
 
 struct MirrorResponse : public ResponseBase {
-    std::string output;
+    std::shared_ptr<const std::string> output;
 };
 
 /***************************
@@ -44,11 +46,18 @@ public:
     ProcessingStatus sendResponse(const ResponseBase& response) override;
     void setHeaderDelimiter();
 
+    static std::string makeMirrorVarHeader(uint32_t len);
     static std::string makeMirrorPacketWithVarHeader(const std::string& str);
     static std::string parseOutput(Buffer buf, size_t& size);
 
+    // The refusal of a request under load: a frame of ErrorFrameSize in the
+    // fixed header, "-1" in the variable one, with no body.
+    static constexpr uint32_t ErrorFrameSize = UINT32_MAX;
+    std::string makeErrorFrame() const;
+
 protected:
     size_t parseMessageSize(Buffer header) override;
+    bool rejectRequest() override;
     std::optional<RequestBase*> parseMessage(const InputMessagePtr& msg) override;
 private:
     static const std::string HeaderDelimiter;
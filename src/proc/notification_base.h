@@ -17,7 +17,10 @@
  **********************************************/
 
 #pragma once
-#include "utils/pipe_queue.h"
+#include "utils/mpsc_ring.h"
+#include "utils/output_chain.h"
+#include <atomic>
+#include <thread>
 
 namespace bongo {
 
@@ -27,37 +30,115 @@ enum class NotificationType {
     SessionReleased,
     MoreData,
     PushData,
+    ResumeRead, // input backpressure is released, the reactor may read again
 };
 
+/*******************************************************************************
+ *   Every session owns one node per type, notifications are never allocated.
+ *   A node sits in the queue at most once: posting one that is queued already
+ *   does nothing, the pending notification covers the new one too.
+ */
 class NotificationBase {
 public:
     NotificationBase(NotificationType type, SessionBase* session) : _type(type), _session(session) {}
     virtual ~NotificationBase() = default;
 
+    NotificationBase(const NotificationBase&) = delete;
+    NotificationBase& operator=(const NotificationBase&) = delete;
+
     NotificationType type() const { return _type; }
     SessionBase* session() const { return _session; }
 
+    // Any thread. False when the node is queued already.
+    bool post() { return !_queued.exchange(true); }
+    // The consumer, once it took the node and before it acts on it. What
+    // the posters did before a post() that found the node queued is seen
+    // after this.
+    void taken() { _queued.exchange(false); }
+    bool queued() const { return _queued.load(); }
+
 private:
     NotificationType _type;
     SessionBase* _session;
+    std::atomic<bool> _queued = false;
 };
 
 /*******************************************************************************
- * DON'T BOTHER WITH THIS YET!!!
+ *   MessagePushData hands output over from workers to the reactor. A worker
+ *   serializes into buffer(), which only it touches, and push() swaps the
+ *   buffer into the node: the reactor takes it from there with takeInto().
+ *   Two chains go back and forth through atomic slots, neither side ever
+ *   waits for a lock of the other.
+ *
+ *   One worker at a time, like the processing of a session.
+ */
 class MessagePushData : public NotificationBase {
 public:
-    MessagePushData(SessionBase* session, DataBuffer& buffer)
-      : NotificationBase(NotificationType::PushData, session) {
-        _buffer.swap(buffer);
+    MessagePushData(SessionBase* session) : NotificationBase(NotificationType::PushData, session) {}
+
+    // Worker.
+    OutputChain& buffer() { return *_buffer; }
+
+    // Worker. False when there was nothing to push, otherwise the node has
+    // to be posted.
+    bool push() {
+        if (_buffer->empty()) {
+            return false;
+        }
+
+        // Not taken yet: the new output goes after it.
+        OutputChain* pushed = _pushed.exchange(nullptr);
+        if (pushed != nullptr) {
+            pushed->splice(*_buffer);
+            _pushed.store(pushed);
+            return true;
+        }
+
+        _pushed.store(_buffer);
+
+        // The other chain is on its way back, if the reactor is still
+        // moving it.
+        while ((_buffer = _free.exchange(nullptr)) == nullptr) {
+            std::this_thread::yield();
+        }
+        return true;
     }
 
-    DataBuffer& buffer() { return _buffer; }
+    // Reactor. Appends the pushed output to output.
+    void takeInto(OutputChain& output) {
+        OutputChain* pushed = _pushed.exchange(nullptr);
+        if (pushed == nullptr) {
+            return;
+        }
+
+        output.splice(*pushed);
+        _free.store(pushed);
+    }
+
+    // Reactor, when no worker has the session: everything the worker left in
+    // its buffer too.
+    void takeAllInto(OutputChain& output) {
+        takeInto(output);
+        output.splice(*_buffer);
+    }
+
+    // No worker has the session.
+    void clear() {
+        _chains[0].clear();
+        _chains[1].clear();
+        _buffer = &_chains[0];
+        _pushed.store(nullptr);
+        _free.store(&_chains[1]);
+    }
 
 private:
-    DataBuffer _buffer;
+    OutputChain _chains[2];
+    OutputChain* _buffer = &_chains[0];
+    std::atomic<OutputChain*> _pushed = nullptr;
+    std::atomic<OutputChain*> _free = &_chains[1];
 };
- *********************************************************************************/
 
-using NotificationQueue = PipeQueue<NotificationBase>;
+// Workers post to their reactor without a syscall unless it's asleep.
+using NotificationQueue = MpscRing<NotificationBase>;
 
 } // namespace bongo
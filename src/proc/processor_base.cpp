@@ -18,25 +18,28 @@
 #include "processor_base.h"
 #include "notification_base.h"
 #include "utils/log.h"
-#include "utils/pipe_queue.h"
 #include <experimental/scope>
 #include <assert.h>
 
 namespace bongo {
 
 void ProcessorBase::run() {
-    while (auto optionalSession = _sessionsQueue->pop()) {
-        if (!optionalSession) {
-            break;
-        }
+    std::vector<SessionBase*> sessions;
+    sessions.reserve(_batch);
 
-        auto session = optionalSession.value();
-        if (session == nullptr) {
-            LOG_ERROR << "ProcessorBase::run: BAD Session";
-            break;
+    bool bad = false;
+    while (!bad && _sessionsQueue->pop_bulk(sessions, _batch)) {
+        // The rest of the batch is InProcessing already, leaving it would
+        // strand those sessions. Stop once it is done.
+        for (SessionBase* session: sessions) {
+            if (session == nullptr) {
+                LOG_ERROR << "ProcessorBase::run: BAD Session";
+                bad = true;
+                continue;
+            }
+
+            processSession(session);
         }
-    
-        processSession(session);
     }
 }
 
@@ -58,7 +61,9 @@ void ProcessorBase::processSession(SessionBase* session) {
             _stats->processedCount++;
         }
 
+        const uint64_t start = session->metrics() ? monotonicNs() : 0;
         status = processRequest(session, optionalRequest.value());
+        session->countResponse(start ? monotonicNs() - start : 0);
         if (status != ProcessingStatus::Ok) {
             break;
         }
@@ -66,8 +71,7 @@ void ProcessorBase::processSession(SessionBase* session) {
 
     if (session->failed() || !session->hasRequest() || status != ProcessingStatus::Ok) {
         // Notify the network thread that session is released.
-        NotificationBase* msg = new NotificationBase(resultType, session);
-        writePipeFd(session->getPipe(), &msg);
+        session->notify(resultType);
     } else {
         // Return the session to the queue for further processing.
         _sessionsQueue->push(session);
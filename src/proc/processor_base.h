@@ -32,14 +32,22 @@ public:
 
     void run();
 
+    // Sessions taken from the queue per wakeup.
+    static constexpr size_t DefaultBatch = 8;
+
 protected:
     virtual ProcessingStatus processRequest(SessionBase* /*session*/, RequestBase* /*request*/) {
         return ProcessingStatus::Failed;
     }
 
+    // Before run(). A larger batch takes the lock less often, but the last
+    // session of the batch waits for the others.
+    void setBatch(size_t batch) { _batch = batch; }
+
 private:
     SessionsQueue* _sessionsQueue;
     ProcessorStats* _stats;
+    size_t _batch = DefaultBatch;
 
 private:
     void processSession(SessionBase* session);
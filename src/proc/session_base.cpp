@@ -36,12 +36,14 @@ InputMessagePtr InputMessagesQueue::pop() {
 
     auto result = _queue.front();
     _queue.pop();
+    _size--;
     return result;
 }
 
 void InputMessagesQueue::push(InputMessagePtr& imsg) {
     const std::unique_lock<std::mutex> lock(_mutex);
     _queue.push(imsg);
+    _size++;
 }
 
 bool InputMessagesQueue::empty() const {
@@ -52,6 +54,90 @@ bool InputMessagesQueue::empty() const {
 /*******************************************************************************
  *   SessionBase
  */
+SessionBase::SessionBase()
+  : _releasedNode(NotificationType::SessionReleased, this),
+    _moreDataNode(NotificationType::MoreData, this),
+    _resumeReadNode(NotificationType::ResumeRead, this),
+    _pushData(this) {
+}
+
+SessionBase::~SessionBase() {
+    dropInput();
+}
+
+void SessionBase::queueMessage(InputMessagePtr msg) {
+    if (_inputGauge) {
+        _inputGauge->queued++;
+    }
+
+    SessionCounters::add(_counters.requests, 1);
+    if (_metrics) {
+        _metrics->requests.fetch_add(1, std::memory_order_relaxed);
+        msg->queuedNs = monotonicNs();
+    }
+    _inputQueue.push(msg);
+}
+
+void SessionBase::takenMessage() {
+    bool resume = false;
+    if (_inputGauge) {
+        const size_t queued = --_inputGauge->queued;
+        if (queued <= _inputGauge->low && _inputGauge->paused.load()) {
+            resume = _inputGauge->paused.exchange(false);
+        }
+    }
+
+    if (_inputPaused.load() && _inputQueue.size() <= _inputLow) {
+        resume = _inputPaused.exchange(false) || resume;
+    }
+
+    if (!resume || _notifications == nullptr) {
+        return;
+    }
+
+    notify(NotificationType::ResumeRead);
+}
+
+int SessionBase::notify(NotificationType type) {
+    if (_notifications == nullptr) {
+        LOG_ERROR << "SessionBase::notify: no notification queue";
+        return -1;
+    }
+
+    NotificationBase* node = nullptr;
+    switch (type) {
+        case NotificationType::SessionReleased: node = &_releasedNode; break;
+        case NotificationType::MoreData: node = &_moreDataNode; break;
+        case NotificationType::PushData: node = &_pushData; break;
+        case NotificationType::ResumeRead: node = &_resumeReadNode; break;
+    }
+
+    if (node->post()) {
+        _notifications->push(node);
+    }
+    return 0;
+}
+
+int SessionBase::pushData() {
+    return _pushData.push() ? notify(NotificationType::PushData) : 0;
+}
+
+void SessionBase::takePushed(bool released) {
+    if (released) {
+        _pushData.takeAllInto(_output);
+    } else {
+        _pushData.takeInto(_output);
+    }
+}
+
+void SessionBase::dropInput() {
+    while (InputMessagePtr msg = _inputQueue.pop()) {
+        if (_inputGauge) {
+            _inputGauge->queued--;
+        }
+        delete msg;
+    }
+}
 void SessionBase::processReadBufferData() {
     if (_headerSize > 0) {
         processReadBufferDataFixedHeader();
@@ -85,7 +171,7 @@ void SessionBase::processReadBufferDataFixedHeader() {
         memcpy(msg->header.data(), src.ptr, _headerSize);
         msg->body.resize(size);
         memcpy(msg->body.data(), src.ptr + _headerSize, size);
-        _inputQueue.push(msg);
+        queueMessage(msg);
 
         // After getting a whole request release space in the buffer
         _readBuf.used(_headerSize + size);        
@@ -124,7 +210,7 @@ void SessionBase::processReadBufferDataVariableHeader() {
         memcpy(msg->header.data(), src.ptr, bodyStartPos);
         msg->body.resize(size);
         memcpy(msg->body.data(), src.ptr + bodyStartPos, size);
-        _inputQueue.push(msg);
+        queueMessage(msg);
 
         // After getting a whole request release space in the buffer
         _readBuf.used(bodyStartPos + size);        
@@ -136,6 +222,11 @@ std::optional<RequestBase*> SessionBase::getRequest() {
     if (msg == nullptr) {
         return {};
     }
+    takenMessage();
+
+    if (_metrics && msg->queuedNs != 0) {
+        _metrics->queueTime.record(monotonicNs() - msg->queuedNs);
+    }
 
     auto cleanup = std::experimental::scope_exit([&]() {
         if (msg != nullptr) {
@@ -146,6 +237,44 @@ std::optional<RequestBase*> SessionBase::getRequest() {
     return parseMessage(msg);
 }
 
+void SessionBase::reset() {
+    _state = SessionState::Released;
+    _readBuf.clear();
+    _output.clear();
+    _pushData.clear();
+    _inputPaused.store(false);
+    _counters.clear();
+    dropInput();
+}
+
+bool SessionBase::overloaded(const SessionsQueue* queue) const {
+    if (_shedding->maxQueued != 0 && queue->size() >= _shedding->maxQueued) {
+        return true;
+    }
+
+    return _shedding->maxWaitMs != 0 && queue->headWait() >= std::chrono::milliseconds(_shedding->maxWaitMs);
+}
+
+bool SessionBase::shedInput() {
+    while (!_inputQueue.empty()) {
+        if (!rejectRequest()) {
+            return false;
+        }
+
+        delete _inputQueue.pop();
+        if (_inputGauge) {
+            _inputGauge->queued--;
+        }
+
+        SessionCounters::add(_counters.rejected, 1);
+        if (_metrics) {
+            _metrics->rejected.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    return true;
+}
+
 int SessionBase::onRead(SessionsQueue* queue) {
     processReadBufferData();
 
@@ -155,9 +284,18 @@ int SessionBase::onRead(SessionsQueue* queue) {
     }
 
     // If the session is in the Released state, let's pass it to processing.
+    // Unless workers are behind and the session can refuse the requests.
     if (!_inputQueue.empty()) {
+        if (_shedding && overloaded(queue) && shedInput()) {
+            return 0;
+        }
+
         _state = SessionState::InProcessing;
-        queue->push(this);
+        if (_readyBatch) {
+            _readyBatch->push_back(this);
+        } else {
+            queue->push(this);
+        }
     }
 
     return 0;
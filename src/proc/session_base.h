@@ -16,8 +16,12 @@
    limitations under the License.
  **********************************************/
 #pragma once
+#include "session_metrics.h"
+#include "notification_base.h"
+#include "sessions_queue.h"
 #include "utils/data_buffer.h"
-#include "utils/thread_queue.h"
+#include "utils/output_chain.h"
+#include <atomic>
 #include <optional>
 #include <mutex>
 #include <vector>
@@ -25,12 +29,10 @@
 
 namespace bongo {
 
-class SessionBase;
-using SessionsQueue = ThreadQueue<SessionBase*>;
-
 struct InputMessage {
     std::vector<char> header;
     std::vector<char> body;
+    uint64_t queuedNs = 0; // set when the session has metrics
 };
 
 using InputMessagePtr = InputMessage*;
@@ -40,6 +42,7 @@ public:
     InputMessagePtr pop();
     void push(InputMessagePtr& imsg);
     bool empty() const;
+    size_t size() const { return _size.load(); }
 
 private:
     using Queue = std::queue<InputMessagePtr>; // TODO: make it lock-less list
@@ -47,6 +50,25 @@ private:
 private:
     mutable std::mutex _mutex;    
     Queue _queue;
+    std::atomic<size_t> _size = 0;
+};
+
+// Input messages waiting for workers across a group of sessions, e.g. all
+// sessions of one reactor. The reactor sets paused when the count crosses its
+// high watermark, the worker which brings it down to low clears it.
+struct InputGauge {
+    std::atomic<size_t> queued = 0;
+    std::atomic<bool> paused = false;
+    size_t low = 0;
+};
+
+// Load shedding. While the sessions queue holds maxQueued sessions, or its
+// oldest one has waited maxWaitMs, a released session answers new requests
+// with rejectRequest() on the reactor instead of queueing itself for workers.
+// 0 turns a limit off.
+struct LoadShedding {
+    size_t maxQueued = 0;
+    uint32_t maxWaitMs = 0;
 };
 
 enum class SessionState {
@@ -70,7 +92,8 @@ enum class ProcessingStatus {
 
 class SessionBase {
 public:
-    virtual ~SessionBase() = default;
+    SessionBase();
+    virtual ~SessionBase();
 
     SessionState state() const { return _state; }
     virtual void setState(SessionState state) { _state = state; }
@@ -79,25 +102,83 @@ public:
 
     Buffer getReadBuffer(size_t size) { return _readBuf.getAvailable(size); }
     void updateReadBuffer(size_t size) { _readBuf.update(size); }
+    // Received bytes which don't make a complete message yet.
+    bool hasPartialInput() const { return _readBuf.size() > 0; }
 
-    Buffer getDataForWriting() { return _writeBuf.getData(); }
-    void completedWriting(size_t size) { _writeBuf.used(size); }
+    OutputChain& output() { return _output; }
+    void completedWriting(size_t size) { _output.used(size); }
 
     virtual int onRead(SessionsQueue* session);
     virtual int onWrite() { return 0; }
 
+    // Set by the reactor owning the session: onRead() collects the session
+    // there instead of pushing it to the queue, and the reactor hands the
+    // whole step over with one push_bulk(). Without it, onRead() pushes.
+    void setReadyBatch(std::vector<SessionBase*>* batch) { _readyBatch = batch; }
+
     virtual std::optional<RequestBase*> getRequest();
     virtual bool hasRequest() const { return _inputQueue.empty(); }
     virtual ProcessingStatus sendResponse(const ResponseBase& /*response*/) { return ProcessingStatus::Failed; }
     virtual bool failed() const { return true; }
 
-    int  getPipe() const { return _pipeFd; }
-    void setPipe(int fd) { _pipeFd = fd; }
+    // The queue of the reactor owning the session. notify() posts to it from
+    // any thread, without allocating; a notification of a type still queued
+    // isn't posted twice.
+    NotificationQueue* notificationQueue() const { return _notifications; }
+    void setNotificationQueue(NotificationQueue* queue) { _notifications = queue; }
+    int  notify(NotificationType type);
+
+    // Workers serialize responses into pushBuffer() and hand them over with
+    // pushData(); the reactor appends them to output() and writes them.
+    // Workers never touch output() or the socket, nor share a lock with the
+    // reactor.
+    OutputChain& pushBuffer() { return _pushData.buffer(); }
+    int  pushData();
+    // Reactor, on PushData. Once the session is released, the rest of the
+    // buffer goes too: no PushData is needed for the last responses.
+    void takePushed(bool released);
+
+    // Backpressure. While input is paused, the worker taking the message that
+    // brings the queue down to low posts NotificationType::ResumeRead. The
+    // same goes for the gauge shared with other sessions.
+    size_t inputSize() const { return _inputQueue.size(); }
+    void pauseInput(size_t low) { _inputLow = low; _inputPaused.store(true); }
+    void resumeInput() { _inputPaused.store(false); }
+    void setInputGauge(InputGauge* gauge) { _inputGauge = gauge; }
+    void setLoadShedding(const LoadShedding* shedding) { _shedding = shedding; }
+
+    // Accounting. The metrics are shared by the sessions of a listener, no
+    // metrics means no clock reads.
+    void setMetrics(SessionMetrics* metrics) { _metrics = metrics; }
+    SessionMetrics* metrics() const { return _metrics; }
+    const SessionCounters& counters() const { return _counters; }
+
+    void countBytesIn(size_t size) {
+        SessionCounters::add(_counters.bytesIn, size);
+        if (_metrics) {
+            _metrics->bytesIn.fetch_add(size, std::memory_order_relaxed);
+        }
+    }
+
+    void countBytesOut(size_t size) {
+        SessionCounters::add(_counters.bytesOut, size);
+        if (_metrics) {
+            _metrics->bytesOut.fetch_add(size, std::memory_order_relaxed);
+        }
+    }
+
+    void countResponse(uint64_t processNs) {
+        SessionCounters::add(_counters.responses, 1);
+        if (_metrics) {
+            _metrics->responses.fetch_add(1, std::memory_order_relaxed);
+            _metrics->processTime.record(processNs);
+        }
+    }
 
 protected:
     SessionState _state = SessionState::Released;
     DataBuffer _readBuf{1024};
-    DataBuffer _writeBuf{1024 * 16};
+    OutputChain _output;
     InputMessagesQueue _inputQueue;
 
 protected: // Support for the fixed-size header protocol
@@ -115,9 +196,37 @@ protected:
     virtual size_t parseMessageSize(Buffer header) { (void)header; return 0; }
     virtual void processReadBufferDataFixedHeader();
     virtual void processReadBufferDataVariableHeader();
+    void queueMessage(InputMessagePtr msg);
+
+    // Appends a cheap refusal of one request to the output, e.g. an HTTP 503.
+    // Called on the reactor thread while no worker has the session, so the
+    // refusals keep the order of responses. false: the session can't refuse,
+    // its requests go to workers regardless of the load.
+    virtual bool rejectRequest() { return false; }
+
+    // Drops buffered input and output, keeping the memory, for the next
+    // connection of a recycled session.
+    void reset();
+
+private:
+    NotificationQueue* _notifications = nullptr;
+    std::vector<SessionBase*>* _readyBatch = nullptr;
+    NotificationBase _releasedNode;
+    NotificationBase _moreDataNode;
+    NotificationBase _resumeReadNode;
+    MessagePushData _pushData;
+    std::atomic<bool> _inputPaused = false;
+    size_t _inputLow = 0;
+    InputGauge* _inputGauge = nullptr;
+    SessionMetrics* _metrics = nullptr;
+    SessionCounters _counters;
+    const LoadShedding* _shedding = nullptr;
 
 private:
-    int _pipeFd = -1;
+    void takenMessage();
+    void dropInput();
+    bool overloaded(const SessionsQueue* queue) const;
+    bool shedInput();
 };
 
 } // namespace bongo
@@ -0,0 +1,52 @@
+/**********************************************
+   File:   session_metrics.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "session_metrics.h"
+#include <sstream>
+
+namespace bongo {
+
+void SessionCounters::clear() {
+    bytesIn.store(0, std::memory_order_relaxed);
+    bytesOut.store(0, std::memory_order_relaxed);
+    requests.store(0, std::memory_order_relaxed);
+    responses.store(0, std::memory_order_relaxed);
+    rejected.store(0, std::memory_order_relaxed);
+}
+
+std::string SessionMetrics::report() const {
+    std::ostringstream out;
+    out << "bytes_in=" << bytesIn.load() << " bytes_out=" << bytesOut.load()
+        << " requests=" << requests.load() << " responses=" << responses.load()
+        << " rejected=" << rejected.load();
+
+    const std::pair<const char*, const LatencyHistogram&> histograms[] = {
+        { "queue", queueTime },
+        { "process", processTime },
+    };
+
+    for (const auto& [name, histogram]: histograms) {
+        const auto s = histogram.snapshot();
+        out << " " << name << "_us=" << s.percentile(0.5) / 1000.0 << "/" << s.percentile(0.99) / 1000.0
+            << "/" << s.percentile(0.999) / 1000.0;
+    }
+
+    return out.str();
+}
+
+} // namespace bongo
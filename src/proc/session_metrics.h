@@ -0,0 +1,64 @@
+/**********************************************
+   File:   session_metrics.h
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#pragma once
+#include "utils/latency_histogram.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace bongo {
+
+// Counters of one session. They are written by whichever thread owns the
+// session at the moment, reactor or worker, and read by anyone.
+struct SessionCounters {
+    std::atomic<uint64_t> bytesIn = 0;
+    std::atomic<uint64_t> bytesOut = 0;
+    std::atomic<uint64_t> requests = 0;
+    std::atomic<uint64_t> responses = 0;
+    std::atomic<uint64_t> rejected = 0; // requests refused by load shedding
+
+    // A single writer needs no read-modify-write.
+    static void add(std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    void clear();
+};
+
+/*******************************************************************************
+ *   SessionMetrics sums up the sessions of a listener: bytes, requests taken
+ *   off the wire and responses made by workers, and where the time went.
+ *   Queue time runs from a complete request to a worker taking it, process
+ *   time is the worker's processRequest(). All of it is updated and read
+ *   without locks.
+ */
+struct SessionMetrics {
+    std::atomic<uint64_t> bytesIn = 0;
+    std::atomic<uint64_t> bytesOut = 0;
+    std::atomic<uint64_t> requests = 0;
+    std::atomic<uint64_t> responses = 0;
+    std::atomic<uint64_t> rejected = 0;
+    LatencyHistogram queueTime;   // ns
+    LatencyHistogram processTime; // ns
+
+    // One line: the counters, then p50/p99/p999 of both histograms in us.
+    std::string report() const;
+};
+
+} // namespace bongo
@@ -0,0 +1,77 @@
+/**********************************************
+   File:   sessions_queue.h
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+#pragma once
+#include "utils/thread_queue.h"
+#include "utils/mpmc_queue.h"
+#include <chrono>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace bongo {
+
+class SessionBase;
+
+/*******************************************************************************
+ *   SessionsQueue hands sessions from the reactors to the workers. Reactors
+ *   and sessions only see this interface, ThreadPool picks the queue under
+ *   it: ThreadQueue with one mutex, or the lock-free MpmcQueue.
+ */
+class SessionsQueue {
+public:
+    virtual ~SessionsQueue() = default;
+
+    virtual void push(SessionBase* session) = 0;
+    virtual void push_bulk(std::vector<SessionBase*>& sessions) = 0;
+    virtual std::optional<SessionBase*> pop() = 0;
+    virtual bool pop_bulk(std::vector<SessionBase*>& out, size_t max) = 0;
+    virtual void shutdown() = 0;
+
+    // Read without the lock, for admission decisions.
+    virtual size_t size() const = 0;
+    virtual std::chrono::nanoseconds headWait() const = 0;
+
+    // Shedding by wait time turns this on, pushes skip the clock without it.
+    virtual void trackWait() = 0;
+};
+
+template <typename Queue>
+class SessionsQueueOf : public SessionsQueue {
+public:
+    template <typename... Args>
+    SessionsQueueOf(Args&&... args) : _queue(std::forward<Args>(args)...) {}
+
+    void push(SessionBase* session) override { _queue.push(session); }
+    void push_bulk(std::vector<SessionBase*>& sessions) override { _queue.push_bulk(sessions); }
+    std::optional<SessionBase*> pop() override { return _queue.pop(); }
+    bool pop_bulk(std::vector<SessionBase*>& out, size_t max) override { return _queue.pop_bulk(out, max); }
+    void shutdown() override { _queue.shutdown(); }
+    size_t size() const override { return _queue.size(); }
+    std::chrono::nanoseconds headWait() const override { return _queue.headWait(); }
+    void trackWait() override { _queue.trackWait(); }
+
+    Queue& queue() { return _queue; }
+
+private:
+    Queue _queue;
+};
+
+using LockedSessionsQueue = SessionsQueueOf<ThreadQueue<SessionBase*>>;
+using LockFreeSessionsQueue = SessionsQueueOf<MpmcQueue<SessionBase*>>;
+
+} // namespace bongo
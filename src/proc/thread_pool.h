@@ -23,7 +23,9 @@
 
 namespace bongo {
 
-template <typename ProcessorType, size_t Size = 0>
+// Queue is the one behind sessionsQueue(): ThreadQueue, or MpmcQueue when
+// many workers and reactors contend for one mutex.
+template <typename ProcessorType, size_t Size = 0, typename Queue = ThreadQueue<SessionBase*>>
 class ThreadPool {
 public:
     ThreadPool(size_t size = Size) : _size(size) {
@@ -61,7 +63,7 @@ public:
 private:
     size_t _size;
     std::vector<std::thread> _threads;
-    SessionsQueue _sessionsQueue;
+    SessionsQueueOf<Queue> _sessionsQueue;
     ProcessorStats _stats;
 };
 
@@ -22,6 +22,9 @@
 #include <experimental/scope>
 #include "gtest/gtest.h"
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 using namespace bongo;
 
@@ -40,7 +43,7 @@ TEST(SESSION, HttpBasic) {
     SessionsQueue* sessionsQueue = pool.sessionsQueue();
 
     session = new HttpSession;
-    session->setPipe(pipeQueue.getWriteFd());
+    session->setNotificationQueue(&pipeQueue);
     ASSERT_EQ(SessionState::Released, session->state());
 
     const std::vector<std::string> inputs = {
@@ -52,7 +55,11 @@ TEST(SESSION, HttpBasic) {
 
     for (const auto& inputStr: inputs) {
         NotificationBase* msg = nullptr;
-        auto cleanupMsg = std::experimental::scope_exit([&]() { delete msg; });
+        auto cleanupMsg = std::experimental::scope_exit([&]() {
+            if (msg) {
+                msg->taken();
+            }
+        });
 
         Buffer readBuffer = session->getReadBuffer(inputStr.length());
         memcpy(readBuffer.ptr, inputStr.data(), inputStr.length());
@@ -61,14 +68,16 @@ TEST(SESSION, HttpBasic) {
         session->onRead(sessionsQueue);
         ASSERT_EQ(SessionState::InProcessing, session->state());
 
-        msg = pipeQueue.next();
+        msg = pipeQueue.wait(-1);
         ASSERT_NE(nullptr, msg);
         ASSERT_EQ(NotificationType::SessionReleased, msg->type());
         ASSERT_EQ(session, msg->session());
 
         session->setState(SessionState::Released);
+        session->takePushed(true);
 
-        Buffer writeBuffer = session->getDataForWriting();
+        std::string written = session->output().toString();
+        Buffer writeBuffer { .ptr = written.data(), .size = written.size() };
         ASSERT_EQ(output.length(), writeBuffer.size);
         ASSERT_EQ(0, memcmp(output.data(), writeBuffer.ptr, writeBuffer.size));
         session->completedWriting(writeBuffer.size);
@@ -78,8 +87,8 @@ TEST(SESSION, HttpBasic) {
 TEST(SESSION, HttpMultiRequest) {
     TempLogLevel tll{"DEBUG"};
 
+    // The node belongs to the session, nothing to free.
     NotificationBase* msg = nullptr;
-    auto cleanupMsg = std::experimental::scope_exit([&]() { delete msg; });
     HttpSession* session = nullptr;
     auto cleanupSession = std::experimental::scope_exit([&]() { delete session; });
 
@@ -92,7 +101,7 @@ TEST(SESSION, HttpMultiRequest) {
     SessionsQueue* sessionsQueue = pool.sessionsQueue();
 
     session = new HttpSession;
-    session->setPipe(pipeQueue.getWriteFd());
+    session->setNotificationQueue(&pipeQueue);
     ASSERT_EQ(SessionState::Released, session->state());
 
     const std::vector<std::string> inputs = {
@@ -111,14 +120,16 @@ TEST(SESSION, HttpMultiRequest) {
     session->onRead(sessionsQueue);
     ASSERT_EQ(SessionState::InProcessing, session->state());
 
-    msg = pipeQueue.next();
+    msg = pipeQueue.wait(-1);
     ASSERT_NE(nullptr, msg);
     ASSERT_EQ(NotificationType::SessionReleased, msg->type());
     ASSERT_EQ(session, msg->session());
 
     session->setState(SessionState::Released);
+    session->takePushed(true);
 
-    Buffer writeBuffer = session->getDataForWriting();
+    std::string written = session->output().toString();
+    Buffer writeBuffer { .ptr = written.data(), .size = written.size() };
     ASSERT_EQ(2 * output.length(), writeBuffer.size);
 
     size_t offset = 0;
@@ -129,3 +140,127 @@ TEST(SESSION, HttpMultiRequest) {
 
     session->completedWriting(writeBuffer.size);
 }
+
+TEST(SESSION, HttpLoadShedding) {
+    LockedSessionsQueue sessionsQueue;
+    sessionsQueue.trackWait();
+    const LoadShedding shedding{ .maxWaitMs = 5 };
+
+    HttpSession session;
+    session.setLoadShedding(&shedding);
+
+    const std::string input = "GET /index.html HTTP/1.1\r\n\r\n";
+    auto feed = [&]() {
+        Buffer readBuffer = session.getReadBuffer(input.length());
+        memcpy(readBuffer.ptr, input.data(), input.length());
+        session.updateReadBuffer(input.length());
+    };
+
+    // A short queue is fine while it moves.
+    HttpSession other;
+    sessionsQueue.push(&other);
+    feed();
+    session.onRead(&sessionsQueue);
+    ASSERT_EQ(SessionState::InProcessing, session.state());
+    ASSERT_EQ(2, sessionsQueue.size());
+    ASSERT_EQ(&other, sessionsQueue.pop().value());
+    ASSERT_EQ(&session, sessionsQueue.pop().value());
+    delete session.getRequest().value();
+    session.setState(SessionState::Released);
+
+    // The head of the queue has waited too long, the reactor answers 503.
+    sessionsQueue.push(&other);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    feed();
+    session.onRead(&sessionsQueue);
+    ASSERT_EQ(SessionState::Released, session.state());
+    ASSERT_EQ(1, sessionsQueue.size());
+    ASSERT_EQ(HttpSession::getOverloadedResponse(), session.output().toString());
+    ASSERT_EQ(1, session.counters().rejected.load());
+}
+
+TEST(SESSION, HttpFile) {
+    TempLogLevel tll{"ERROR"};
+
+    char dirName[] = "/tmp/utest_http_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(dirName));
+    const std::string dir = dirName;
+    const std::string fileName = dir + "/index.html";
+    auto cleanupDir = std::experimental::scope_exit([&]() { unlink(fileName.c_str()); rmdir(dirName); });
+
+    const std::string content = "<html>Hello from a file!</html>";
+    FILE* f = fopen(fileName.c_str(), "w");
+    ASSERT_NE(nullptr, f);
+    fwrite(content.data(), 1, content.length(), f);
+    fclose(f);
+
+    auto cache = std::make_shared<HttpFileCache>();
+    ASSERT_EQ(0, cache->init(dir));
+    ASSERT_EQ(1u, cache->size());
+    ASSERT_NE(nullptr, cache->find("/index.html"));
+    ASSERT_EQ(nullptr, cache->find("/missing.html"));
+
+    HttpFileSession* session = nullptr;
+    auto cleanupSession = std::experimental::scope_exit([&]() { delete session; });
+
+    NotificationQueue pipeQueue;
+    auto pipeQueueRet = pipeQueue.init();
+    ASSERT_EQ(0, pipeQueueRet.first);
+
+    HttpFileSingleThreadPool pool;
+    pool.start();
+    SessionsQueue* sessionsQueue = pool.sessionsQueue();
+
+    session = new HttpFileSession(cache);
+    session->setNotificationQueue(&pipeQueue);
+
+    const std::string header = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(content.length())
+                             + "\r\nContent-Type: text/html\r\n\r\n";
+
+    const std::vector<std::pair<std::string, std::string>> cases = {
+        { "GET /index.html HTTP/1.1\r\n\r\n", header + content },
+        { "GET /missing.html HTTP/1.1\r\n\r\n", HttpFileSession::getNotFoundResponse() },
+    };
+
+    for (const auto& [input, expected]: cases) {
+        NotificationBase* msg = nullptr;
+        auto cleanupMsg = std::experimental::scope_exit([&]() {
+            if (msg) {
+                msg->taken();
+            }
+        });
+
+        Buffer readBuffer = session->getReadBuffer(input.length());
+        memcpy(readBuffer.ptr, input.data(), input.length());
+        session->updateReadBuffer(input.length());
+
+        session->onRead(sessionsQueue);
+        msg = pipeQueue.wait(-1);
+        ASSERT_NE(nullptr, msg);
+        ASSERT_EQ(NotificationType::SessionReleased, msg->type());
+        session->setState(SessionState::Released);
+        session->takePushed(true);
+
+        ASSERT_EQ(expected, session->output().toString());
+        session->completedWriting(expected.length());
+        ASSERT_TRUE(session->output().empty());
+    }
+
+    // The header comes from the cache, the body is left to sendfile().
+    Buffer readBuffer = session->getReadBuffer(cases[0].first.length());
+    memcpy(readBuffer.ptr, cases[0].first.data(), cases[0].first.length());
+    session->updateReadBuffer(cases[0].first.length());
+    session->onRead(sessionsQueue);
+    pipeQueue.wait(-1)->taken();
+    session->setState(SessionState::Released);
+    session->takePushed(true);
+
+    OutputChain& output = session->output();
+    ASSERT_EQ(2u, output.segmentsCount());
+    ASSERT_FALSE(output.frontFile());
+    output.used(header.length());
+    auto slice = output.frontFile();
+    ASSERT_TRUE(slice);
+    ASSERT_EQ(content.length(), slice->size);
+    output.used(content.length());
+}
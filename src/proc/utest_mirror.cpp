@@ -40,7 +40,7 @@ TEST(SESSION, MirrorBasic) {
     SessionsQueue* sessionsQueue = pool.sessionsQueue();
 
     session = new MirrorSession;
-    session->setPipe(pipeQueue.getWriteFd());
+    session->setNotificationQueue(&pipeQueue);
     ASSERT_EQ(SessionState::Released, session->state());
 
     std::vector<std::string> inputs = {
@@ -50,7 +50,11 @@ TEST(SESSION, MirrorBasic) {
 
     for (const auto& inputStr: inputs) {
         NotificationBase* msg = nullptr;
-        auto cleanupMsg = std::experimental::scope_exit([&]() { delete msg; });
+        auto cleanupMsg = std::experimental::scope_exit([&]() {
+            if (msg) {
+                msg->taken();
+            }
+        });
 
         const uint32_t len = inputStr.length();
         const size_t dataSize = sizeof(uint32_t) + len;
@@ -62,14 +66,16 @@ TEST(SESSION, MirrorBasic) {
         session->onRead(sessionsQueue);
         ASSERT_EQ(SessionState::InProcessing, session->state());
 
-        msg = pipeQueue.next();
+        msg = pipeQueue.wait(-1);
         ASSERT_NE(nullptr, msg);
         ASSERT_EQ(NotificationType::SessionReleased, msg->type());
         ASSERT_EQ(session, msg->session());
 
         session->setState(SessionState::Released);
+        session->takePushed(true);
 
-        Buffer writeBuffer = session->getDataForWriting();
+        std::string written = session->output().toString();
+        Buffer writeBuffer { .ptr = written.data(), .size = written.size() };
         uint32_t checkLength = 0;
         memcpy(&checkLength, writeBuffer.ptr, sizeof(checkLength));
         std::string outputStr(writeBuffer.ptr + sizeof(checkLength), writeBuffer.size - sizeof(checkLength));
@@ -82,8 +88,8 @@ TEST(SESSION, MirrorBasic) {
 TEST(SESSION, MirrorMultiRequest) {
     TempLogLevel tll{"DEBUG"};
 
+    // The node belongs to the session, nothing to free.
     NotificationBase* msg = nullptr;
-    auto cleanupMsg = std::experimental::scope_exit([&]() { delete msg; });
     MirrorSession* session = nullptr;
     auto cleanupSession = std::experimental::scope_exit([&]() { delete session; });
 
@@ -96,7 +102,7 @@ TEST(SESSION, MirrorMultiRequest) {
     SessionsQueue* sessionsQueue = pool.sessionsQueue();
 
     session = new MirrorSession;
-    session->setPipe(pipeQueue.getWriteFd());
+    session->setNotificationQueue(&pipeQueue);
     ASSERT_EQ(SessionState::Released, session->state());
 
     std::vector<std::string> inputs = {
@@ -116,14 +122,16 @@ TEST(SESSION, MirrorMultiRequest) {
     session->onRead(sessionsQueue);
     ASSERT_EQ(SessionState::InProcessing, session->state());
 
-    msg = pipeQueue.next();
+    msg = pipeQueue.wait(-1);
     ASSERT_NE(nullptr, msg);
     ASSERT_EQ(NotificationType::SessionReleased, msg->type());
     ASSERT_EQ(session, msg->session());
 
     session->setState(SessionState::Released);
+    session->takePushed(true);
 
-    Buffer writeBuffer = session->getDataForWriting();
+    std::string written = session->output().toString();
+    Buffer writeBuffer { .ptr = written.data(), .size = written.size() };
     size_t offset = 0;
     for (const auto& inputStr: inputs) {
         const uint32_t len = inputStr.length();
@@ -156,7 +164,7 @@ TEST(SESSION, MirrorVarHeaderSize) {
     MirrorSession* session = new MirrorSession;
     auto cleanupSession = std::experimental::scope_exit([&]() { delete session; });
     session->setHeaderDelimiter();
-    session->setPipe(pipeQueue.getWriteFd());
+    session->setNotificationQueue(&pipeQueue);
     ASSERT_EQ(SessionState::Released, session->state());
 
     std::vector<std::string> inputs = {
@@ -166,7 +174,11 @@ TEST(SESSION, MirrorVarHeaderSize) {
 
     for (const auto& inputStr: inputs) {
         NotificationBase* msg = nullptr;
-        auto cleanupMsg = std::experimental::scope_exit([&]() { delete msg; });
+        auto cleanupMsg = std::experimental::scope_exit([&]() {
+            if (msg) {
+                msg->taken();
+            }
+        });
 
         const std::string requestStr = MirrorSession::makeMirrorPacketWithVarHeader(inputStr);
         Buffer readBuffer = session->getReadBuffer(requestStr.length());
@@ -176,14 +188,16 @@ TEST(SESSION, MirrorVarHeaderSize) {
         session->onRead(sessionsQueue);
         ASSERT_EQ(SessionState::InProcessing, session->state());
 
-        msg = pipeQueue.next();
+        msg = pipeQueue.wait(-1);
         ASSERT_NE(nullptr, msg);
         ASSERT_EQ(NotificationType::SessionReleased, msg->type());
         ASSERT_EQ(session, msg->session());
 
         session->setState(SessionState::Released);
+        session->takePushed(true);
 
-        Buffer writeBuffer = session->getDataForWriting();
+        std::string written = session->output().toString();
+        Buffer writeBuffer { .ptr = written.data(), .size = written.size() };
         size_t outputSize = 0;
         std::string outputStr = MirrorSession::parseOutput(writeBuffer, outputSize);
         ASSERT_EQ(inputStr, outputStr);
@@ -191,3 +205,88 @@ TEST(SESSION, MirrorVarHeaderSize) {
         session->completedWriting(writeBuffer.size);
     }
 }
+
+TEST(SESSION, MirrorLoadShedding) {
+    LockedSessionsQueue sessionsQueue;
+    const LoadShedding shedding{ .maxQueued = 1 };
+
+    MirrorSession session;
+    session.setLoadShedding(&shedding);
+
+    auto feed = [&](const std::string& inputStr) {
+        const uint32_t len = inputStr.length();
+        const size_t dataSize = sizeof(uint32_t) + len;
+        Buffer readBuffer = session.getReadBuffer(dataSize);
+        memcpy(readBuffer.ptr, &len, sizeof(len));
+        memcpy(readBuffer.ptr + sizeof(len), inputStr.data(), len);
+        session.updateReadBuffer(dataSize);
+    };
+
+    // Another session waits for a worker already: both requests are refused.
+    MirrorSession other;
+    sessionsQueue.push(&other);
+    feed("Hello");
+    feed("world!");
+
+    int ret = session.onRead(&sessionsQueue);
+    ASSERT_EQ(0, ret);
+    ASSERT_EQ(SessionState::Released, session.state());
+    ASSERT_EQ(1, sessionsQueue.size());
+    ASSERT_EQ(2, session.counters().rejected.load());
+    ASSERT_EQ(session.makeErrorFrame() + session.makeErrorFrame(), session.output().toString());
+    session.completedWriting(session.output().size());
+
+    // The queue is empty again, requests go to workers.
+    auto queued = sessionsQueue.pop();
+    ASSERT_EQ(&other, queued.value());
+    feed("Hello");
+
+    ret = session.onRead(&sessionsQueue);
+    ASSERT_EQ(0, ret);
+    ASSERT_EQ(SessionState::InProcessing, session.state());
+    ASSERT_EQ(1, sessionsQueue.size());
+    ASSERT_EQ(&session, sessionsQueue.pop().value());
+    ASSERT_TRUE(session.output().empty());
+}
+
+TEST(SESSION, MirrorBadSessionInBatch) {
+    TempLogLevel tll{"CRITICAL"};
+
+    NotificationQueue pipeQueue;
+    auto pipeQueueRet = pipeQueue.init();
+    ASSERT_EQ(0, pipeQueueRet.first);
+
+    LockedSessionsQueue sessionsQueue;
+    MirrorProcessor processor(&sessionsQueue);
+
+    MirrorSession first;
+    MirrorSession second;
+    for (MirrorSession* session: {&first, &second}) {
+        session->setNotificationQueue(&pipeQueue);
+        session->setState(SessionState::InProcessing);
+
+        const std::string inputStr = "Hello, world!";
+        const uint32_t len = inputStr.length();
+        Buffer readBuffer = session->getReadBuffer(sizeof(len) + len);
+        memcpy(readBuffer.ptr, &len, sizeof(len));
+        memcpy(readBuffer.ptr + sizeof(len), inputStr.data(), len);
+        session->updateReadBuffer(sizeof(len) + len);
+        session->onRead(&sessionsQueue);
+    }
+
+    // A bad entry doesn't strand the sessions after it, run() returns once
+    // the batch is done.
+    std::vector<SessionBase*> batch = {&first, nullptr, &second};
+    sessionsQueue.push_bulk(batch);
+    processor.run();
+
+    for (MirrorSession* session: {&first, &second}) {
+        NotificationBase* msg = pipeQueue.next();
+        ASSERT_NE(nullptr, msg);
+        ASSERT_EQ(NotificationType::SessionReleased, msg->type());
+        ASSERT_EQ(session, msg->session());
+        msg->taken();
+        session->takePushed(true);
+        ASSERT_FALSE(session->output().empty());
+    }
+}
@@ -0,0 +1,145 @@
+/**********************************************
+   File:   utest_session.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+#include "session_base.h"
+#include "notification_base.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace bongo;
+
+namespace {
+
+// Stands for a session going back and forth between a reactor and workers.
+class StressSession : public SessionBase {
+public:
+    std::atomic<bool> inProcessing = false;
+};
+
+} // namespace
+
+TEST(SESSION, NotificationCoalesced) {
+    NotificationQueue queue;
+    ASSERT_EQ(0, queue.init().first);
+
+    SessionBase session;
+    ASSERT_NE(0, session.notify(NotificationType::MoreData));
+    session.setNotificationQueue(&queue);
+
+    // Posted once until the consumer takes it.
+    ASSERT_EQ(0, session.notify(NotificationType::MoreData));
+    ASSERT_EQ(0, session.notify(NotificationType::MoreData));
+    ASSERT_EQ(0, session.notify(NotificationType::SessionReleased));
+
+    NotificationBase* msg = queue.next();
+    ASSERT_NE(nullptr, msg);
+    ASSERT_EQ(NotificationType::MoreData, msg->type());
+    ASSERT_EQ(&session, msg->session());
+    ASSERT_TRUE(msg->queued());
+    msg->taken();
+
+    msg = queue.next();
+    ASSERT_NE(nullptr, msg);
+    ASSERT_EQ(NotificationType::SessionReleased, msg->type());
+    msg->taken();
+    ASSERT_EQ(nullptr, queue.next());
+
+    // Taken: the same node goes again.
+    ASSERT_EQ(0, session.notify(NotificationType::MoreData));
+    msg = queue.next();
+    ASSERT_NE(nullptr, msg);
+    ASSERT_EQ(NotificationType::MoreData, msg->type());
+    msg->taken();
+    ASSERT_EQ(nullptr, queue.next());
+    ASSERT_EQ(0, queue.overflowsCount());
+}
+
+TEST(SESSION, NotificationReleaseStress) {
+    const size_t WORKERS = 4;
+    const size_t SESSIONS = 1024; // per worker
+    const size_t RELEASES = 500000; // per worker
+
+    NotificationQueue queue;
+    ASSERT_EQ(0, queue.init().first);
+
+    std::vector<std::unique_ptr<StressSession>> sessions;
+    for (size_t i = 0; i < WORKERS * SESSIONS; i++) {
+        sessions.emplace_back(std::make_unique<StressSession>());
+        sessions.back()->setNotificationQueue(&queue);
+    }
+
+    // A worker releases a session only after the consumer took the previous
+    // release of it, and pokes its neighbour's sessions with MoreData.
+    std::atomic<size_t> moreDataPosted = 0;
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < WORKERS; w++) {
+        workers.emplace_back([&, w]() {
+            for (size_t i = 0; i < RELEASES; i++) {
+                StressSession* session = sessions[w * SESSIONS + i % SESSIONS].get();
+                while (session->inProcessing.load()) {
+                    std::this_thread::yield();
+                }
+                session->inProcessing.store(true);
+                session->notify(NotificationType::SessionReleased);
+
+                if (i % 16 == 0) {
+                    sessions[((w + 1) % WORKERS) * SESSIONS + i % SESSIONS]->notify(NotificationType::MoreData);
+                    moreDataPosted++;
+                }
+            }
+        });
+    }
+
+    size_t released = 0;
+    size_t moreData = 0;
+    while (released < WORKERS * RELEASES) {
+        NotificationBase* msg = queue.wait(5000);
+        ASSERT_NE(nullptr, msg);
+        ASSERT_TRUE(msg->queued());
+        msg->taken();
+
+        StressSession* session = static_cast<StressSession*>(msg->session());
+        if (msg->type() == NotificationType::SessionReleased) {
+            ASSERT_TRUE(session->inProcessing.load());
+            session->inProcessing.store(false);
+            released++;
+        } else {
+            ASSERT_EQ(NotificationType::MoreData, msg->type());
+            moreData++;
+        }
+    }
+
+    for (auto& t: workers) {
+        t.join();
+    }
+
+    while (NotificationBase* msg = queue.next()) {
+        ASSERT_EQ(NotificationType::MoreData, msg->type());
+        msg->taken();
+        moreData++;
+    }
+
+    ASSERT_EQ(WORKERS * RELEASES, released);
+    ASSERT_GT(moreData, 0);
+    ASSERT_LE(moreData, moreDataPosted.load());
+    for (auto& session: sessions) {
+        ASSERT_FALSE(session->inProcessing.load());
+    }
+}
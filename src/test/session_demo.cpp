@@ -40,10 +40,7 @@ int EchoNetSession::onRead(SessionsQueue*) {
 
     LOG_TRACE << "EchoNetSession::onRead data size " << src.size;
 
-    Buffer dest = _writeBuf.getAvailable(src.size);
-    memcpy(dest.ptr, src.ptr, src.size);
-
-    _writeBuf.update(src.size);
+    _output.append(src.ptr, src.size);
     _readBuf.used(src.size);
 
     _conn->writeData();
@@ -51,27 +48,52 @@ int EchoNetSession::onRead(SessionsQueue*) {
     return 0;
 }
 
+/*******************************************************************************
+ *   SplitEcho
+ */
+int SplitEchoNetSession::onRead(SessionsQueue*) {
+    for (;;) {
+        Buffer src = _readBuf.getData();
+        uint32_t size;
+        if (src.size < sizeof(size)) {
+            break;
+        }
+
+        memcpy(&size, src.ptr, sizeof(size));
+        if (src.size < sizeof(size) + size) {
+            break;
+        }
+
+        _output.append(src.ptr, sizeof(size));
+        _conn->writeData();
+        _output.append(src.ptr + sizeof(size), size);
+        _conn->writeData();
+        _readBuf.used(sizeof(size) + size);
+    }
+
+    return 0;
+}
+
 /*******************************************************************************
  *   BigWriter
  */
 int BigWriterNetSession::init() {
     const size_t target_buf_size = sizeof(size_t) + BIG_SIZE;
-    Buffer buf = _writeBuf.getAvailable(target_buf_size);
+    auto data = std::make_shared<std::string>(target_buf_size, '\0');
+    char* ptr = data->data();
 
-    memcpy(buf.ptr, &BIG_SIZE, sizeof(size_t));
+    memcpy(ptr, &BIG_SIZE, sizeof(size_t));
 
     char ch = 'A';
     for (size_t i = sizeof(size_t); i < target_buf_size; i++, ch++) {
         if (ch > 'Z') {
             ch = 'A';
         }
-        buf.ptr[i] = ch;
+        ptr[i] = ch;
     }
 
-    _writeBuf.update(target_buf_size);
-
-    buf = _writeBuf.getData();
-    if (buf.size != target_buf_size) {
+    _output.append(std::move(data));
+    if (_output.size() != target_buf_size) {
         LOG_ERROR << "BigWriterNetSession::init: failed to set a write buffer";
         return -1;
     }
@@ -98,6 +120,54 @@ int BigWriterNetSession::onRead(SessionsQueue*) {
     return -1;
 }
 
+/*******************************************************************************
+ *   FileWriter
+ */
+int FileWriterNetSession::init() {
+    const size_t size = _file->size();
+    _output.append((const char*)&size, sizeof(size));
+    _output.appendFile(_file, 0, size);
+    return 0;
+}
+
+int FileWriterNetSession::onRead(SessionsQueue*) {
+    Buffer src = _readBuf.getData();
+    if (src.size < sizeof(size_t)) {
+        LOG_TRACE << "FileWriterNetSession::onRead not enough data";
+        return 0;
+    }
+
+    size_t val;
+    memcpy(&val, src.ptr, sizeof(val));
+
+    if (val != _file->size()) {
+        LOG_ERROR << "FileWriterNetSession::onRead invalid feedback";
+    }
+
+    LOG_TRACE << "FileWriterNetSession::onRead: finished ok";
+    return -1;
+}
+
+/*******************************************************************************
+ *   Ticker
+ */
+int TickerNetSession::init() {
+    _timer.setCallback([this]() { onTick(); });
+    armTimer(&_timer, _intervalMs);
+    return 0;
+}
+
+void TickerNetSession::onTick() {
+    _output.append((const char*)&_ticks, sizeof(_ticks));
+    _ticks++;
+
+    if (_ticks < _count) {
+        armTimer(&_timer, _intervalMs);
+    }
+
+    _conn->writeData();
+}
+
 /*******************************************************************************
  *   ReqRespSession
  */
@@ -123,25 +193,22 @@ std::optional<RequestBase*> ReqRespSession::parseMessage(const InputMessagePtr&
 ProcessingStatus ReqRespSession::sendResponse(const ResponseBase& response) {
     const ResponseDemo& resp = dynamic_cast<const ResponseDemo&>(response);
 
-    size_t serializedSize = sizeof(uint32_t) + resp.data.size();
-    Buffer dest = _writeBuf.getAvailable(serializedSize);
-
+    OutputChain& output = pushBuffer();
     uint32_t size = resp.data.size();
-    memcpy(dest.ptr, &size, sizeof(size));
-    memcpy(dest.ptr + sizeof(size), resp.data.data(), size);
-
-    _writeBuf.update(serializedSize);
-
-    _conn->writeData();
-
-    if (_writeBuf.size() > 0) {
-        LOG_TRACE << "ReqRespSession::sendResponse: more data";
-        return ProcessingStatus::IncompleteDataSend;
-    }
+    output.append((const char*)&size, sizeof(size));
+    output.append(resp.data.data(), size);
 
+    // Pipelined requests are answered together: the last response goes to
+    // the reactor with the release of the session.
     return ProcessingStatus::Ok;
 }
 
+bool ReqRespSession::rejectRequest() {
+    const uint32_t size = RejectedSize;
+    _output.append((const char*)&size, sizeof(size));
+    return true;
+}
+
 size_t ReqRespSession::parseMessageSize(Buffer header) {
     assert(header.size >= sizeof(uint32_t));
     uint32_t size;
@@ -149,4 +216,19 @@ size_t ReqRespSession::parseMessageSize(Buffer header) {
     return size;
 }
 
+/*******************************************************************************
+ *   EchoDatagramSession
+ */
+std::optional<RequestBase*> EchoDatagramSession::parseMessage(const InputMessagePtr& msg) {
+    RequestDemo* req = new RequestDemo;
+    req->command.assign(msg->body.data(), msg->body.size());
+    return req;
+}
+
+ProcessingStatus EchoDatagramSession::sendResponse(const ResponseBase& response) {
+    const ResponseDemo& resp = dynamic_cast<const ResponseDemo&>(response);
+    reply(resp.data.data(), resp.data.size());
+    return ProcessingStatus::Ok;
+}
+
 } // namespace bongo
@@ -19,6 +19,7 @@
 #pragma once
 #include "net/net_session.h"
 #include "net/nonblock_conn.h"
+#include "net/datagram.h"
 #include <mutex>
 #include <list>
 #include <optional>
@@ -46,6 +47,7 @@ class EchoNetSession : public NetSession {
 public:
     EchoNetSession(NonBlockConnection* conn) : NetSession(conn) { }
     int onRead(SessionsQueue*) override;
+    bool recycle() override { reset(); return true; }
 };
     
 class EchoNetSessionFactory : public NetSessionFactory {
@@ -54,6 +56,23 @@ public:
     NetSession* makeSession(NonBlockConnection* conn) override { return new EchoNetSession(conn); }
 };
 
+/*******************************************************************************
+ *   SplitEcho
+ *
+ *   Echoes every length-prefixed frame with two writes, the header and then
+ *   the body.
+ */
+class SplitEchoNetSession : public NetSession {
+public:
+    SplitEchoNetSession(NonBlockConnection* conn) : NetSession(conn) { }
+    int onRead(SessionsQueue*) override;
+};
+
+class SplitEchoNetSessionFactory : public NetSessionFactory {
+public:
+    NetSession* makeSession(NonBlockConnection* conn) override { return new SplitEchoNetSession(conn); }
+};
+
 /*******************************************************************************
  *   BigWriter
  */
@@ -72,6 +91,62 @@ public:
     NetSession* makeSession(NonBlockConnection* conn) override { return new BigWriterNetSession(conn); }
 };
 
+/*******************************************************************************
+ *   FileWriter
+ *
+ *   Sends the size of a file followed by its content, taken from the file
+ *   with sendfile(). Expects the size back and closes the connection.
+ */
+class FileWriterNetSession : public NetSession {
+public:
+    FileWriterNetSession(NonBlockConnection* conn, std::shared_ptr<const OutputFile> file)
+      : NetSession(conn), _file(file) {}
+    int init() override;
+    int onRead(SessionsQueue*) override;
+
+private:
+    std::shared_ptr<const OutputFile> _file;
+};
+
+class FileWriterNetSessionFactory : public NetSessionFactory {
+public:
+    FileWriterNetSessionFactory(std::shared_ptr<const OutputFile> file) : _file(file) {}
+    NetSession* makeSession(NonBlockConnection* conn) override { return new FileWriterNetSession(conn, _file); }
+
+private:
+    std::shared_ptr<const OutputFile> _file;
+};
+
+/*******************************************************************************
+ *   Ticker
+ *
+ *   Sends a counter from a session timer every interval, count times.
+ */
+class TickerNetSession : public NetSession {
+public:
+    TickerNetSession(NonBlockConnection* conn, uint64_t intervalMs, uint64_t count)
+      : NetSession(conn), _intervalMs(intervalMs), _count(count) {}
+    int init() override;
+
+private:
+    Timer _timer;
+    const uint64_t _intervalMs;
+    const uint64_t _count;
+    uint64_t _ticks = 0;
+
+    void onTick();
+};
+
+class TickerNetSessionFactory : public NetSessionFactory {
+public:
+    TickerNetSessionFactory(uint64_t intervalMs, uint64_t count) : _intervalMs(intervalMs), _count(count) {}
+    NetSession* makeSession(NonBlockConnection* conn) override { return new TickerNetSession(conn, _intervalMs, _count); }
+
+private:
+    const uint64_t _intervalMs;
+    const uint64_t _count;
+};
+
 /*******************************************************************************
  *   ReqRespSession
  * 
@@ -99,10 +174,15 @@ public:
     }
 
     ProcessingStatus sendResponse(const ResponseBase& resp) override;
+    bool recycle() override { reset(); return true; }
+
+    // A shed request is answered with this size and no body.
+    static constexpr uint32_t RejectedSize = UINT32_MAX;
 
 protected:
     size_t parseMessageSize(Buffer header) override;
     std::optional<RequestBase*> parseMessage(const InputMessagePtr& msg) override;
+    bool rejectRequest() override;
 };
     
 class ReqRespSessionFactory : public NetSessionFactory {
@@ -112,5 +192,27 @@ public:
     }
 };
 
+/*******************************************************************************
+ *   Request/Response over UDP: a datagram is the command, the reply is the
+ *   response data.
+ */
+class EchoDatagramSession : public DatagramSession {
+public:
+    EchoDatagramSession(NonBlockDatagram* socket, const DatagramPeer& peer)
+     : DatagramSession(socket, peer) {}
+
+    ProcessingStatus sendResponse(const ResponseBase& resp) override;
+
+protected:
+    std::optional<RequestBase*> parseMessage(const InputMessagePtr& msg) override;
+};
+
+class EchoDatagramSessionFactory : public DatagramSessionFactory {
+public:
+    DatagramSession* makeDatagramSession(NonBlockDatagram* socket, const DatagramPeer& peer) override {
+        return new EchoDatagramSession(socket, peer);
+    }
+};
+
 
 } // namespace bongo
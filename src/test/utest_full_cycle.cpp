@@ -20,9 +20,11 @@
 #include "proc/thread_pool.h"
 #include "session_demo.h"
 #include "net/block_conn.h"
+#include "net/upstream_pool.h"
 #include "utils/log.h"
 #include "gtest/gtest.h"
 #include <atomic>
+#include <arpa/inet.h>
 #include <chrono>
 #include <iostream>
 
@@ -46,11 +48,29 @@ protected:
     }
 };
 
+// Holds every request until the gate opens.
+std::atomic<bool> gateOpen = false;
+std::atomic<size_t> gateWaiting = 0;
+
+class GatedProcessor : public Processor {
+public:
+    GatedProcessor(SessionsQueue* queue, ProcessorStats* stats = nullptr) : Processor(queue, stats) {}
+
+protected:
+    ProcessingStatus processRequest(SessionBase* session, RequestBase* request) override {
+        gateWaiting++;
+        while (!gateOpen.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return Processor::processRequest(session, request);
+    }
+};
+
 TEST(FULL_CYCLE, ProcessorsControl) {
     // TempLogLevel tll{"DEBUG"};
 
     const size_t COUNT = 4;
-    SessionsQueue sessionsQueue;
+    LockedSessionsQueue sessionsQueue;
 
     auto processorFunc = [](SessionsQueue* sessionsQueue) {
         Processor processor(sessionsQueue);
@@ -139,10 +159,738 @@ TEST(FULL_CYCLE, RequestResponse) {
     }
 
     ASSERT_EQ(REQUEST_COUNT, pool.stats().processedCount.load());
+    ASSERT_EQ(REQUEST_COUNT, net.stats().requestsCount);
+    pool.stop();
+
+    net.stop();
+    t.join();
+}
+
+class SlowProcessor : public Processor {
+public:
+    SlowProcessor(SessionsQueue* queue, ProcessorStats* stats = nullptr) : Processor(queue, stats) {}
+
+protected:
+    ProcessingStatus processRequest(SessionBase* session, RequestBase* request) override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        return Processor::processRequest(session, request);
+    }
+};
+
+TEST(FULL_CYCLE, Backpressure) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const size_t REQUEST_COUNT = 100;
+
+    ThreadPool<SlowProcessor> pool(1);
+
+    NonBlockNet net;
+    int ret = net.init();
+    ASSERT_EQ(0, ret);
+    net.setSessionsQueue(pool.sessionsQueue());
+
+    auto factory = std::make_shared<ReqRespSessionFactory>();
+    factory->setWatermarks(NetWatermarks{ .inputHigh = 4, .inputLow = 1 });
+    NetOperation op { .name = "Backpressure", .ip = IP, .port = PORT, .factory = factory };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+    pool.start();
+
+    BlockConnector connector(IP, PORT);
+    ret = connector.init(); ASSERT_EQ(0, ret);
+    auto conn_info = connector.make_connection(); ASSERT_TRUE(conn_info);
+    BlockConnection conn(conn_info->fd);
+
+    // Requests go out one by one, much faster than the worker takes them.
+    std::thread writer([&]() {
+        for (uint32_t i = 0; i < REQUEST_COUNT; i++) {
+            const std::string command = std::to_string(i);
+            char buf[16];
+            const uint32_t size = command.size();
+            memcpy(buf, &size, sizeof(size));
+            memcpy(buf + sizeof(size), command.data(), size);
+            int ret = conn.writeAll(buf, sizeof(size) + size);
+            ASSERT_EQ(sizeof(size) + size, ret);
+        }
+    });
+
+    for (uint32_t i = 0; i < REQUEST_COUNT; i++) {
+        const std::string command = std::to_string(i);
+        char buf[16];
+        uint32_t size = 0;
+        ret = conn.readAll((char*)&size, sizeof(size));
+        ASSERT_EQ(sizeof(size), ret);
+        ASSERT_EQ(command.size(), size);
+        ret = conn.readAll(buf, size);
+        ASSERT_EQ(size, ret);
+        ASSERT_EQ(command, std::string(buf, size));
+    }
+    writer.join();
+
+    pool.stop();
+    net.stop();
+    t.join();
+
+    auto s = net.stats();
+    ASSERT_GT(s.inputHighHitsCount, 0);
+    ASSERT_GT(s.readResumesCount, 0);
+    ASSERT_EQ(0, s.readPausedCount);
+}
+
+// A burst already in the socket is not read in one go: the watermarks are
+// checked while reading, and reading stops once they pause it.
+TEST(FULL_CYCLE, BackpressureBurst) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const size_t REQUEST_COUNT = 8192;
+
+    // Never started, the requests stay queued.
+    ThreadPool<Processor> pool(1);
+
+    NonBlockNet net;
+    int ret = net.init();
+    ASSERT_EQ(0, ret);
+    net.setSessionsQueue(pool.sessionsQueue());
+
+    auto factory = std::make_shared<ReqRespSessionFactory>();
+    factory->setWatermarks(NetWatermarks{ .inputHigh = 4, .inputLow = 1 });
+    NetOperation op { .name = "Backpressure", .ip = IP, .port = PORT, .factory = factory };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    BlockConnector connector(IP, PORT);
+    ret = connector.init(); ASSERT_EQ(0, ret);
+    auto conn_info = connector.make_connection(); ASSERT_TRUE(conn_info);
+    BlockConnection conn(conn_info->fd);
+
+    std::string burst;
+    for (size_t i = 0; i < REQUEST_COUNT; i++) {
+        const uint32_t size = 4;
+        burst.append((const char*)&size, sizeof(size));
+        burst.append("ping");
+    }
+    ret = conn.writeAll(burst.data(), burst.size());
+    ASSERT_EQ(burst.size(), ret);
+
+    for (int i = 0; i < 10 && net.stats().readPausedCount == 0; i++) {
+        ASSERT_EQ(0, net.step(10));
+    }
+
+    auto s = net.stats();
+    ASSERT_EQ(1, s.readPausedCount);
+    ASSERT_GT(s.inputHighHitsCount, 0);
+    ASSERT_GT(s.requestsCount, 0);
+    ASSERT_LT(s.requestsCount, REQUEST_COUNT);
+}
+
+// Strict request/response through a worker, with the reactor spinning.
+TEST(FULL_CYCLE, BusyPoll) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const size_t ROUND_TRIPS = 2000;
+
+    ThreadPool<Processor> pool(1);
+
+    NonBlockNet net;
+    int ret = net.init();
+    ASSERT_EQ(0, ret);
+    net.setSessionsQueue(pool.sessionsQueue());
+    net.setBusyPoll(NetBusyPoll{ .spinUs = 1000, .socketUs = 50 });
+
+    NetOperation op { .name = "BusyPoll", .ip = IP, .port = PORT, .factory = std::make_shared<ReqRespSessionFactory>() };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+    pool.start();
+
+    BlockConnector connector(IP, PORT);
+    ret = connector.init(); ASSERT_EQ(0, ret);
+    auto conn_info = connector.make_connection(); ASSERT_TRUE(conn_info);
+    BlockConnection conn(conn_info->fd);
+
+    for (uint32_t i = 0; i < ROUND_TRIPS; i++) {
+        const std::string command = std::to_string(i);
+        char buf[16];
+        uint32_t size = command.size();
+        memcpy(buf, &size, sizeof(size));
+        memcpy(buf + sizeof(size), command.data(), size);
+        ret = conn.writeAll(buf, sizeof(size) + size);
+        ASSERT_EQ(sizeof(size) + size, ret);
+
+        ret = conn.readAll((char*)&size, sizeof(size));
+        ASSERT_EQ(sizeof(size), ret);
+        ASSERT_EQ(command.size(), size);
+        ret = conn.readAll(buf, size);
+        ASSERT_EQ(size, ret);
+        ASSERT_EQ(command, std::string(buf, size));
+    }
+
     pool.stop();
+    net.stop();
+    t.join();
+
+    // SO_BUSY_POLL may be refused without CAP_NET_ADMIN, the spinning is ours.
+    auto s = net.stats();
+    ASSERT_GT(s.spinWaitsCount, 0);
+    ASSERT_LE(s.busyPollFailedCount, 1);
+}
+
+TEST(FULL_CYCLE, SessionMetrics) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const size_t ROUND_TRIPS = 500;
+
+    ThreadPool<Processor> pool(2);
+
+    NonBlockNet net;
+    int ret = net.init();
+    ASSERT_EQ(0, ret);
+    net.setSessionsQueue(pool.sessionsQueue());
+
+    auto factory = std::make_shared<ReqRespSessionFactory>();
+    SessionMetrics* metrics = factory->enableMetrics();
+    NetOperation op { .name = "Metrics", .ip = IP, .port = PORT, .factory = factory };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+    pool.start();
+
+    BlockConnector connector(IP, PORT);
+    ret = connector.init(); ASSERT_EQ(0, ret);
+    auto conn_info = connector.make_connection(); ASSERT_TRUE(conn_info);
+    BlockConnection conn(conn_info->fd);
+
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < ROUND_TRIPS; i++) {
+        const std::string command = std::to_string(i);
+        char buf[16];
+        uint32_t size = command.size();
+        memcpy(buf, &size, sizeof(size));
+        memcpy(buf + sizeof(size), command.data(), size);
+        ret = conn.writeAll(buf, sizeof(size) + size);
+        ASSERT_EQ(sizeof(size) + size, ret);
+        bytes += sizeof(size) + size;
+
+        ret = conn.readAll((char*)&size, sizeof(size));
+        ASSERT_EQ(sizeof(size), ret);
+        ret = conn.readAll(buf, size);
+        ASSERT_EQ(size, ret);
 
+        // Readable while the sessions are running.
+        if (i == ROUND_TRIPS / 2) {
+            ASSERT_GT(metrics->queueTime.snapshot().count, 0);
+            ASSERT_FALSE(metrics->report().empty());
+        }
+    }
+
+    pool.stop();
     net.stop();
     t.join();
+
+    ASSERT_EQ(ROUND_TRIPS, metrics->requests.load());
+    ASSERT_EQ(ROUND_TRIPS, metrics->responses.load());
+    ASSERT_EQ(bytes, metrics->bytesIn.load());
+    ASSERT_EQ(bytes, metrics->bytesOut.load());
+
+    auto queueTime = metrics->queueTime.snapshot();
+    auto processTime = metrics->processTime.snapshot();
+    ASSERT_EQ(ROUND_TRIPS, queueTime.count);
+    ASSERT_EQ(ROUND_TRIPS, processTime.count);
+    ASSERT_GT(processTime.percentile(0.5), 0);
+    ASSERT_LE(processTime.percentile(0.5), processTime.percentile(0.99));
+}
+
+TEST(FULL_CYCLE, LoadShedding) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+
+    gateOpen = false;
+    gateWaiting = 0;
+    ThreadPool<GatedProcessor> pool(1);
+
+    NonBlockNet net;
+    int ret = net.init();
+    ASSERT_EQ(0, ret);
+    net.setSessionsQueue(pool.sessionsQueue());
+
+    auto factory = std::make_shared<ReqRespSessionFactory>();
+    factory->setAdmission(NetAdmission{ .shedding = { .maxQueued = 1 } });
+    SessionMetrics* metrics = factory->enableMetrics();
+    NetOperation op { .name = "Shedding", .ip = IP, .port = PORT, .factory = factory };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+    pool.start();
+
+    std::vector<std::unique_ptr<BlockConnection>> conns;
+    for (size_t i = 0; i < 3; i++) {
+        BlockConnector connector(IP, PORT);
+        ret = connector.init(); ASSERT_EQ(0, ret);
+        auto conn_info = connector.make_connection(); ASSERT_TRUE(conn_info);
+        conns.emplace_back(std::make_unique<BlockConnection>(conn_info->fd));
+    }
+
+    auto send = [&](size_t i) {
+        const std::string command = std::to_string(i);
+        char buf[16];
+        uint32_t size = command.size();
+        memcpy(buf, &size, sizeof(size));
+        memcpy(buf + sizeof(size), command.data(), size);
+        return conns[i]->writeAll(buf, sizeof(size) + size) == (int)(sizeof(size) + size);
+    };
+
+    // The worker is stuck with the first request, the second one waits in
+    // the queue, the third one finds the queue full.
+    ASSERT_TRUE(send(0));
+    while (gateWaiting.load() == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    ASSERT_TRUE(send(1));
+    while (pool.sessionsQueue()->size() == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    ASSERT_TRUE(send(2));
+    uint32_t size = 0;
+    ret = conns[2]->readAll((char*)&size, sizeof(size));
+    ASSERT_EQ(sizeof(size), ret);
+    ASSERT_EQ(ReqRespSession::RejectedSize, size);
+
+    gateOpen = true;
+    for (size_t i = 0; i < 2; i++) {
+        char buf[16];
+        ret = conns[i]->readAll((char*)&size, sizeof(size));
+        ASSERT_EQ(sizeof(size), ret);
+        ret = conns[i]->readAll(buf, size);
+        ASSERT_EQ(size, ret);
+        ASSERT_EQ(std::to_string(i), std::string(buf, size));
+    }
+
+    pool.stop();
+    net.stop();
+    t.join();
+
+    ASSERT_EQ(3, metrics->requests.load());
+    ASSERT_EQ(2, metrics->responses.load());
+    ASSERT_EQ(1, metrics->rejected.load());
+}
+
+// Answers a request with as many frames as it says, each pushed to the
+// reactor on its own while the session is still in processing.
+class StreamingProcessor : public ProcessorBase {
+public:
+    StreamingProcessor(SessionsQueue* queue, ProcessorStats* stats = nullptr) : ProcessorBase(queue, stats) {}
+
+protected:
+    ProcessingStatus processRequest(SessionBase* session, RequestBase* request) override {
+        RequestDemo* req = dynamic_cast<RequestDemo*>(request);
+        assert(req);
+
+        const size_t count = std::stoul(req->command);
+        for (size_t i = 0; i < count; i++) {
+            ResponseDemo resp;
+            resp.data = std::to_string(i);
+            ProcessingStatus status = session->sendResponse(resp);
+            if (status != ProcessingStatus::Ok) {
+                return status;
+            }
+            session->pushData();
+        }
+        return ProcessingStatus::Ok;
+    }
+};
+
+TEST(FULL_CYCLE, PushData) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const size_t CONNECTIONS = 8;
+    const size_t REQUEST_COUNT = 20;
+    const size_t FRAMES = 50;
+
+    ThreadPool<StreamingProcessor> pool(4);
+
+    NonBlockNet net;
+    int ret = net.init();
+    ASSERT_EQ(0, ret);
+    net.setSessionsQueue(pool.sessionsQueue());
+
+    NetOperation op { .name = "PushData", .ip = IP, .port = PORT, .factory = std::make_shared<ReqRespSessionFactory>() };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+    pool.start();
+
+    // Every connection pipelines its requests, the frames come back in order.
+    std::atomic<size_t> framesCount = 0;
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < CONNECTIONS; c++) {
+        clients.emplace_back([&]() {
+            BlockConnector connector(IP, PORT);
+            ASSERT_EQ(0, connector.init());
+            auto conn_info = connector.make_connection();
+            ASSERT_TRUE(conn_info);
+            BlockConnection conn(conn_info->fd);
+
+            const std::string command = std::to_string(FRAMES);
+            char buf[16];
+            const uint32_t size = command.size();
+            memcpy(buf, &size, sizeof(size));
+            memcpy(buf + sizeof(size), command.data(), size);
+            for (size_t i = 0; i < REQUEST_COUNT; i++) {
+                ASSERT_EQ(sizeof(size) + size, conn.writeAll(buf, sizeof(size) + size));
+            }
+
+            for (size_t i = 0; i < REQUEST_COUNT * FRAMES; i++) {
+                const std::string expected = std::to_string(i % FRAMES);
+                uint32_t frameSize = 0;
+                ASSERT_EQ(sizeof(frameSize), conn.readAll((char*)&frameSize, sizeof(frameSize)));
+                ASSERT_EQ(expected.size(), frameSize);
+                ASSERT_EQ(frameSize, conn.readAll(buf, frameSize));
+                ASSERT_EQ(expected, std::string(buf, frameSize));
+                framesCount++;
+            }
+        });
+    }
+
+    for (auto& client: clients) {
+        client.join();
+    }
+
+    pool.stop();
+    net.stop();
+    t.join();
+
+    ASSERT_EQ(CONNECTIONS * REQUEST_COUNT * FRAMES, framesCount.load());
+    ASSERT_EQ(CONNECTIONS * REQUEST_COUNT, pool.stats().processedCount.load());
+    ASSERT_GT(net.stats().pushDataCount, 0);
+}
+
+// Tries writeData() from the worker before answering. Off the reactor
+// thread it's refused, output() stays the reactor's.
+class WriteDataProcessor : public StreamingProcessor {
+public:
+    WriteDataProcessor(SessionsQueue* queue, ProcessorStats* stats = nullptr) : StreamingProcessor(queue, stats) {}
+
+    static inline std::atomic<size_t> refusedCount = 0;
+
+protected:
+    ProcessingStatus processRequest(SessionBase* session, RequestBase* request) override {
+        NetSession* netSession = dynamic_cast<NetSession*>(session);
+        assert(netSession);
+        if (netSession->connection()->writeData() != 0) {
+            refusedCount++;
+        }
+        return StreamingProcessor::processRequest(session, request);
+    }
+};
+
+TEST(FULL_CYCLE, WriteDataFromWorkers) {
+    TempLogLevel tll{"CRITICAL"};
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const size_t CONNECTIONS = 8;
+    const size_t REQUEST_COUNT = 20;
+    const size_t FRAMES = 10;
+
+    ThreadPool<WriteDataProcessor> pool(4);
+    WriteDataProcessor::refusedCount = 0;
+
+    NonBlockNet net;
+    int ret = net.init();
+    ASSERT_EQ(0, ret);
+    net.setSessionsQueue(pool.sessionsQueue());
+
+    NetOperation op { .name = "WriteData", .ip = IP, .port = PORT, .factory = std::make_shared<ReqRespSessionFactory>() };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+    pool.start();
+
+    // The reactor fills the input queues and writes while the workers run,
+    // every frame still comes back whole and in order.
+    std::atomic<size_t> framesCount = 0;
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < CONNECTIONS; c++) {
+        clients.emplace_back([&]() {
+            BlockConnector connector(IP, PORT);
+            ASSERT_EQ(0, connector.init());
+            auto conn_info = connector.make_connection();
+            ASSERT_TRUE(conn_info);
+            BlockConnection conn(conn_info->fd);
+
+            const std::string command = std::to_string(FRAMES);
+            char buf[16];
+            const uint32_t size = command.size();
+            memcpy(buf, &size, sizeof(size));
+            memcpy(buf + sizeof(size), command.data(), size);
+            for (size_t i = 0; i < REQUEST_COUNT; i++) {
+                ASSERT_EQ(sizeof(size) + size, conn.writeAll(buf, sizeof(size) + size));
+            }
+
+            for (size_t i = 0; i < REQUEST_COUNT * FRAMES; i++) {
+                const std::string expected = std::to_string(i % FRAMES);
+                uint32_t frameSize = 0;
+                ASSERT_EQ(sizeof(frameSize), conn.readAll((char*)&frameSize, sizeof(frameSize)));
+                ASSERT_EQ(expected.size(), frameSize);
+                ASSERT_EQ(frameSize, conn.readAll(buf, frameSize));
+                ASSERT_EQ(expected, std::string(buf, frameSize));
+                framesCount++;
+            }
+        });
+    }
+
+    for (auto& client: clients) {
+        client.join();
+    }
+
+    pool.stop();
+    net.stop();
+    t.join();
+
+    ASSERT_EQ(CONNECTIONS * REQUEST_COUNT * FRAMES, framesCount.load());
+    ASSERT_EQ(CONNECTIONS * REQUEST_COUNT, WriteDataProcessor::refusedCount.load());
+}
+
+TEST(FULL_CYCLE, LockFreeQueue) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const size_t CONNECTIONS = 8;
+    const size_t REQUEST_COUNT = 200;
+    const size_t PIPELINE = 8;
+
+    ThreadPool<Processor, 0, MpmcQueue<SessionBase*>> pool(4);
+
+    NonBlockNet net;
+    int ret = net.init();
+    ASSERT_EQ(0, ret);
+    net.setSessionsQueue(pool.sessionsQueue());
+
+    NetOperation op { .name = "LockFree", .ip = IP, .port = PORT, .factory = std::make_shared<ReqRespSessionFactory>() };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+    pool.start();
+
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < CONNECTIONS; c++) {
+        clients.emplace_back([&, c]() {
+            BlockConnector connector(IP, PORT);
+            ASSERT_EQ(0, connector.init());
+            auto conn_info = connector.make_connection();
+            ASSERT_TRUE(conn_info);
+            BlockConnection conn(conn_info->fd);
+
+            const std::string command = "conn" + std::to_string(c);
+            const uint32_t size = command.size();
+            std::vector<char> frames;
+            for (size_t i = 0; i < PIPELINE; i++) {
+                frames.insert(frames.end(), (const char*)&size, (const char*)&size + sizeof(size));
+                frames.insert(frames.end(), command.begin(), command.end());
+            }
+
+            for (size_t i = 0; i < REQUEST_COUNT; i += PIPELINE) {
+                ASSERT_EQ(frames.size(), conn.writeAll(frames.data(), frames.size()));
+                std::vector<char> echo(frames.size());
+                ASSERT_EQ(frames.size(), conn.readAll(echo.data(), echo.size()));
+                ASSERT_EQ(frames, echo);
+            }
+        });
+    }
+
+    for (auto& client: clients) {
+        client.join();
+    }
+
+    pool.stop();
+    net.stop();
+    t.join();
+
+    ASSERT_EQ(CONNECTIONS * REQUEST_COUNT, pool.stats().processedCount.load());
+}
+
+TEST(FULL_CYCLE, UpstreamPool) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const size_t CONNECTIONS = 3;
+    const size_t CALL_COUNT = 300;
+
+    // The upstream echoes length-prefixed messages.
+    ThreadPool<Processor> backendPool(2);
+    NonBlockNet backend;
+    int ret = backend.init();
+    ASSERT_EQ(0, ret);
+    backend.setSessionsQueue(backendPool.sessionsQueue());
+
+    NetOperation op { .name = "Upstream", .ip = IP, .port = PORT, .factory = std::make_shared<ReqRespSessionFactory>() };
+    ret = backend.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread backendThread([&]() { backend.run(100); });
+    backend.waitListenerReady();
+    backendPool.start();
+
+    ThreadPool<Processor> workers(2);
+    NonBlockNet net;
+    ret = net.init();
+    ASSERT_EQ(0, ret);
+    net.setSessionsQueue(workers.sessionsQueue());
+
+    UpstreamPool upstream(net, UpstreamTarget{ .name = "Upstream", .ip = IP, .port = PORT, .connections = CONNECTIONS });
+    ret = upstream.start();
+    ASSERT_EQ(0, ret);
+
+    std::thread::id reactorId;
+    std::thread t([&]() {
+        reactorId = std::this_thread::get_id();
+        net.run(100);
+    });
+    workers.start();
+
+    for (size_t i = 0; i < 100 && upstream.stats().connections < CONNECTIONS; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(CONNECTIONS, upstream.stats().connections);
+
+    std::atomic<size_t> matched = 0;
+    std::atomic<size_t> onReactor = 0;
+    std::atomic<size_t> done = 0;
+    for (size_t i = 0; i < CALL_COUNT; i++) {
+        std::string request = "call " + std::to_string(i);
+        ret = upstream.submit(request, [&, request](int status, std::string&& reply) {
+            if (status == 0 && reply == request) {
+                matched++;
+            }
+            if (std::this_thread::get_id() == reactorId) {
+                onReactor++;
+            }
+            done++;
+        });
+        ASSERT_EQ(0, ret);
+    }
+
+    for (size_t i = 0; i < 500 && done.load() < CALL_COUNT; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    workers.stop();
+    net.stop();
+    t.join();
+
+    backendPool.stop();
+    backend.stop();
+    backendThread.join();
+
+    ASSERT_EQ(CALL_COUNT, matched.load());
+    ASSERT_EQ(0, onReactor.load());
+
+    auto s = upstream.stats();
+    ASSERT_EQ(CALL_COUNT, s.submitted);
+    ASSERT_EQ(CALL_COUNT, s.completed);
+    ASSERT_EQ(0, s.failed);
+    ASSERT_EQ(0, s.reconnects);
+
+    // The calls were pipelined over the pre-warmed connections only.
+    ASSERT_EQ(CONNECTIONS, backend.stats().connectionsCount);
+}
+
+TEST(FULL_CYCLE, Datagrams) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const size_t PEERS = 3;
+    const size_t COUNT = 200;
+    const size_t WINDOW = 20;
+
+    for (NetBackend backend: {NetBackend::Epoll, NetBackend::Uring}) {
+        ThreadPool<Processor> pool(2);
+
+        NonBlockNet net;
+        int ret = net.init(1024, backend);
+        ASSERT_EQ(0, ret);
+        net.setSessionsQueue(pool.sessionsQueue());
+
+        auto factory = std::make_shared<EchoDatagramSessionFactory>();
+        factory->setTimeouts(NetTimeouts{ .idleMs = 50 });
+        NetOperation op { .name = "Datagrams", .ip = IP, .port = PORT, .factory = factory };
+        ret = net.startDatagram(op);
+        ASSERT_EQ(0, ret);
+        ASSERT_EQ(1, net.stats().datagramsCount);
+
+        std::thread t([&]() { net.run(100); });
+        pool.start();
+
+        sockaddr_in server = {};
+        server.sin_family = AF_INET;
+        server.sin_port = htons(PORT);
+        server.sin_addr.s_addr = inet_addr(IP.c_str());
+
+        std::vector<int> peers;
+        for (size_t i = 0; i < PEERS; i++) {
+            int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+            ASSERT_GE(fd, 0);
+            timeval tv { .tv_sec = 2, .tv_usec = 0 };
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            ret = connect(fd, (sockaddr*)&server, sizeof(server));
+            ASSERT_EQ(0, ret);
+            peers.push_back(fd);
+        }
+
+        // The peers' datagrams interleave, each one gets its replies in order.
+        // Windows are small enough for the default socket buffers.
+        for (size_t first = 0; first < COUNT; first += WINDOW) {
+            for (size_t n = first; n < first + WINDOW; n++) {
+                for (size_t i = 0; i < PEERS; i++) {
+                    const std::string command = std::to_string(i) + ":" + std::to_string(n);
+                    ret = send(peers[i], command.data(), command.size(), 0);
+                    ASSERT_EQ((int)command.size(), ret);
+                }
+            }
+
+            for (size_t i = 0; i < PEERS; i++) {
+                for (size_t n = first; n < first + WINDOW; n++) {
+                    char buf[64];
+                    ret = recv(peers[i], buf, sizeof(buf), 0);
+                    ASSERT_GT(ret, 0) << strerror(errno);
+                    ASSERT_EQ(std::to_string(i) + ":" + std::to_string(n), std::string(buf, ret));
+                }
+            }
+        }
+
+        for (int fd: peers) {
+            close(fd);
+        }
+
+        // Quiet peers go away with their sessions.
+        for (size_t i = 0; i < 100 && net.stats().idleTimeoutsCount < PEERS; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        pool.stop();
+        net.stop();
+        t.join();
+
+        auto s = net.stats();
+        ASSERT_EQ(PEERS * COUNT, s.datagramsReceivedCount);
+        ASSERT_EQ(PEERS * COUNT, s.datagramsSentCount);
+        ASSERT_EQ(0, s.datagramsDroppedCount);
+        ASSERT_EQ(PEERS, s.idleTimeoutsCount);
+        ASSERT_LE(s.sendmmsgCount, s.datagramsSentCount);
+    }
 }
 
 // using namespace bongo;
@@ -18,24 +18,51 @@
 
 #include "session_demo.h"
 #include "net/nonblock_conn.h"
+#include "net/nonblock_group.h"
 #include "net/block_conn.h"
+#include "net/splice_proxy.h"
 #include "utils/log.h"
 #include "gtest/gtest.h"
 
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <filesystem>
+#include <functional>
 #include <thread>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
 
 using namespace bongo;
 
-TEST(NONBLOCK_CONN, ListenerBlockConnect) {
+// The scenarios below run against every NonBlockNet backend.
+class NONBLOCK_BACKEND : public ::testing::TestWithParam<NetBackend> {};
+
+INSTANTIATE_TEST_SUITE_P(Backends, NONBLOCK_BACKEND,
+    ::testing::Values(NetBackend::Epoll, NetBackend::Uring),
+    [](const ::testing::TestParamInfo<NetBackend>& info) {
+        return info.param == NetBackend::Epoll ? std::string("Epoll") : std::string("Uring");
+    });
+
+TEST_P(NONBLOCK_BACKEND, ListenerBlockConnect) {
     // TempLogLevel tll{"DEBUG"};
 
     const std::string IP = "127.0.0.1";
     const int PORT = 8888;
 
     NonBlockNet net;
-    int ret = net.init();
+    int ret = net.init(1024, GetParam());
+    if (net.backend() != GetParam()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
 
     std::thread t([&]() {
         NetOperation op { .name = "ListenTest", .ip = IP, .port = PORT, .factory = std::make_shared<EchoNetSessionFactory>() };
@@ -97,26 +124,29 @@ TEST(NONBLOCK_CONN, ListenerBlockConnect) {
     }
 
     for (int i=0; i < 10; i++) {
-        if (net.stats().connectionsCount > 0) {
+        if (net.stats().acceptedCount > 0) {
             break;
         }
 
         std::this_thread::sleep_for(std::chrono::milliseconds(50));
     }
-    ASSERT_GT(net.stats().connectionsCount, 0);
+    ASSERT_GT(net.stats().acceptedCount, 0);
 
     net.stop();
     t.join();
 }
 
-TEST(NONBLOCK_CONN, ListenerBlockConnectBig) {
+TEST_P(NONBLOCK_BACKEND, ListenerBlockConnectBig) {
     // TempLogLevel tll{"DEBUG"};
 
     const std::string IP = "127.0.0.1";
     const int PORT = 8888;
 
     NonBlockNet net;
-    int ret = net.init();
+    int ret = net.init(1024, GetParam());
+    if (net.backend() != GetParam()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
 
     std::thread t([&]() {
         //const size_t SIZE = 8 * 1024 * 1024;
@@ -181,26 +211,29 @@ TEST(NONBLOCK_CONN, ListenerBlockConnectBig) {
     }
 
     for (int i=0; i < 10; i++) {
-        if (net.stats().connectionsCount > 0) {
+        if (net.stats().acceptedCount > 0) {
             break;
         }
 
         std::this_thread::sleep_for(std::chrono::milliseconds(50));
     }
-    ASSERT_GT(net.stats().connectionsCount, 0);
+    ASSERT_GT(net.stats().acceptedCount, 0);
 
     net.stop();
     t.join();
 }
 
-TEST(NONBLOCK_CONN, ConnectBlockListener) {
+TEST_P(NONBLOCK_BACKEND, ConnectBlockListener) {
     // TempLogLevel tll{"DEBUG"};
 
     const std::string IP = "127.0.0.1";
     const int PORT = 8888;
 
     NonBlockNet net;
-    int ret = net.init();
+    int ret = net.init(1024, GetParam());
+    if (net.backend() != GetParam()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
     ASSERT_EQ(0, ret);
 
     std::thread block_thread([&]() {
@@ -269,3 +302,1485 @@ TEST(NONBLOCK_CONN, ConnectBlockListener) {
     net.stop();
     t.join();
 }
+
+TEST_P(NONBLOCK_BACKEND, FileWriterBlockConnect) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+
+    // A file larger than the socket buffers, so sendfile() hits EAGAIN.
+    char path[] = "/tmp/utest_session_demo_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    std::vector<uint64_t> data(4 * 1024 * 1024);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = i;
+    }
+    const size_t dataSize = data.size() * sizeof(data[0]);
+    ASSERT_EQ((ssize_t)dataSize, write(fd, data.data(), dataSize));
+    close(fd);
+
+    auto file = OutputFile::open(path);
+    unlink(path);
+    ASSERT_TRUE(file);
+
+    NonBlockNet net;
+    int ret = net.init(1024, GetParam());
+    if (net.backend() != GetParam()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+    ASSERT_EQ(0, ret);
+
+    NetOperation op { .name = "FileTest", .ip = IP, .port = PORT, .factory = std::make_shared<FileWriterNetSessionFactory>(file) };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+
+    BlockConnector connector(IP, PORT);
+    ret = connector.init();
+    ASSERT_EQ(0, ret);
+    auto conn_info = connector.make_connection();
+    ASSERT_TRUE(conn_info);
+    BlockConnection conn(conn_info->fd);
+
+    size_t size = 0;
+    ret = conn.readAll((char*)&size, sizeof(size));
+    ASSERT_EQ(sizeof(size), ret);
+    ASSERT_EQ(dataSize, size);
+
+    std::vector<uint64_t> check(data.size());
+    ret = conn.readAll((char*)check.data(), size);
+    ASSERT_EQ(size, ret);
+    ASSERT_EQ(data, check);
+
+    ret = conn.writeAll((char*)&size, sizeof(size));
+    ASSERT_EQ(sizeof(size), ret);
+
+    net.stop();
+    t.join();
+}
+
+namespace {
+
+// Runs reset on the reactor thread when the request comes, then answers
+// with the file: the write finds a socket the peer has already reset.
+class ResetFileSession : public NetSession {
+public:
+    ResetFileSession(NonBlockConnection* conn, std::shared_ptr<const OutputFile> file, std::function<void()>& reset)
+      : NetSession(conn), _file(file), _reset(reset) {}
+
+    int onRead(SessionsQueue*) override {
+        _readBuf.used(_readBuf.getData().size);
+        if (_reset) {
+            _reset();
+            _reset = nullptr;
+            _output.appendFile(_file, 0, _file->size());
+            _conn->writeData();
+        }
+        return 0;
+    }
+
+private:
+    std::shared_ptr<const OutputFile> _file;
+    std::function<void()>& _reset;
+};
+
+class ResetFileSessionFactory : public NetSessionFactory {
+public:
+    ResetFileSessionFactory(std::shared_ptr<const OutputFile> file) : _file(file) {}
+    NetSession* makeSession(NonBlockConnection* conn) override { return new ResetFileSession(conn, _file, reset); }
+
+    std::function<void()> reset;
+
+private:
+    std::shared_ptr<const OutputFile> _file;
+};
+
+} // namespace
+
+TEST_P(NONBLOCK_BACKEND, FileWriterPeerReset) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+
+    char path[] = "/tmp/utest_session_demo_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    std::vector<char> data(1024 * 1024, 'x');
+    ASSERT_EQ((ssize_t)data.size(), write(fd, data.data(), data.size()));
+    close(fd);
+
+    auto file = OutputFile::open(path);
+    unlink(path);
+    ASSERT_TRUE(file);
+
+    // The default disposition kills the process on SIGPIPE, init() must
+    // take care of it.
+    signal(SIGPIPE, SIG_DFL);
+
+    NonBlockNet net;
+    int ret = net.init(1024, GetParam());
+    if (net.backend() != GetParam()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+    ASSERT_EQ(0, ret);
+
+    auto factory = std::make_shared<ResetFileSessionFactory>(file);
+    NetOperation op { .name = "FileTest", .ip = IP, .port = PORT, .factory = factory };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    BlockConnector connector(IP, PORT);
+    ret = connector.init();
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+
+    auto conn_info = connector.make_connection();
+    ASSERT_TRUE(conn_info);
+    const int clientFd = conn_info->fd;
+
+    // Half-closed, then reset: the server side is in CLOSE_WAIT when the
+    // RST comes, the next write to it fails with EPIPE.
+    factory->reset = [clientFd]() {
+        shutdown(clientFd, SHUT_WR);
+        linger lin { .l_onoff = 1, .l_linger = 0 };
+        setsockopt(clientFd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+        close(clientFd);
+    };
+
+    char request = 'r';
+    ASSERT_EQ(1, write(clientFd, &request, 1));
+
+    for (int i = 0; i < 200 && (net.stats().acceptedCount == 0 || net.stats().connectionsCount > 0); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(1, net.stats().acceptedCount);
+    ASSERT_EQ(0, net.stats().connectionsCount);
+
+    net.stop();
+    t.join();
+}
+
+TEST_P(NONBLOCK_BACKEND, ReadTimeouts) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const int SLOW_PORT = 8889;
+
+    NonBlockNet net;
+    int ret = net.init(1024, GetParam());
+    if (net.backend() != GetParam()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+
+    auto echoFactory = std::make_shared<EchoNetSessionFactory>();
+    echoFactory->setTimeouts(NetTimeouts{ .idleMs = 200 });
+    NetOperation op { .name = "IdleTest", .ip = IP, .port = PORT, .factory = echoFactory };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    auto reqRespFactory = std::make_shared<ReqRespSessionFactory>();
+    reqRespFactory->setTimeouts(NetTimeouts{ .headerMs = 300 });
+    NetOperation slowOp { .name = "HeaderTest", .ip = IP, .port = SLOW_PORT, .factory = reqRespFactory };
+    ret = net.startListen(slowOp);
+    ASSERT_EQ(0, ret);
+
+    // Longer than the timeouts: the reactor must wake up for the deadlines.
+    std::thread t([&]() { net.run(1000); });
+
+    using Clock = std::chrono::steady_clock;
+
+    // Idle: one echo, then silence.
+    {
+        BlockConnector connector(IP, PORT);
+        ret = connector.init();
+        ASSERT_EQ(0, ret);
+        auto conn_info = connector.make_connection();
+        ASSERT_TRUE(conn_info);
+        BlockConnection conn(conn_info->fd);
+
+        uint64_t val = 42;
+        ret = conn.writeAll((char*)&val, sizeof(val));
+        ASSERT_EQ(sizeof(val), ret);
+        ret = conn.readAll((char*)&val, sizeof(val));
+        ASSERT_EQ(sizeof(val), ret);
+
+        const auto start = Clock::now();
+        ret = conn.readSome((char*)&val, sizeof(val));
+        ASSERT_EQ(0, ret);
+        ASSERT_LT(Clock::now() - start, std::chrono::milliseconds(800));
+    }
+
+    // Header: a request dribbling in byte by byte doesn't extend the timeout.
+    {
+        BlockConnector connector(IP, SLOW_PORT);
+        ret = connector.init();
+        ASSERT_EQ(0, ret);
+        auto conn_info = connector.make_connection();
+        ASSERT_TRUE(conn_info);
+        BlockConnection conn(conn_info->fd);
+
+        const uint32_t size = 100;
+        const auto start = Clock::now();
+        for (size_t i = 0; i < sizeof(size); i++) {
+            send(conn_info->fd, (const char*)&size + i, 1, MSG_NOSIGNAL);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        char ch = 0;
+        while (send(conn_info->fd, &ch, 1, MSG_NOSIGNAL) == 1 && Clock::now() - start < std::chrono::seconds(5)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        ASSERT_LT(Clock::now() - start, std::chrono::seconds(5));
+    }
+
+    for (int i = 0; i < 20 && net.stats().connectionsCount > 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    auto s = net.stats();
+    ASSERT_EQ(0, s.connectionsCount);
+    ASSERT_EQ(1, s.idleTimeoutsCount);
+    ASSERT_EQ(1, s.headerTimeoutsCount);
+
+    net.stop();
+    t.join();
+}
+
+TEST_P(NONBLOCK_BACKEND, WriteStallTimeout) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+
+    NonBlockNet net;
+    int ret = net.init(1024, GetParam());
+    if (net.backend() != GetParam()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+
+    // BigWriter sends 100MB to a peer that reads nothing.
+    auto factory = std::make_shared<BigWriterNetSessionFactory>();
+    factory->setTimeouts(NetTimeouts{ .writeStallMs = 200 });
+    NetOperation op { .name = "StallTest", .ip = IP, .port = PORT, .factory = factory };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(1000); });
+
+    BlockConnector connector(IP, PORT);
+    ret = connector.init();
+    ASSERT_EQ(0, ret);
+    auto conn_info = connector.make_connection();
+    ASSERT_TRUE(conn_info);
+    BlockConnection conn(conn_info->fd);
+
+    for (int i = 0; i < 40 && net.stats().writeTimeoutsCount == 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    auto s = net.stats();
+    ASSERT_EQ(1, s.writeTimeoutsCount);
+    ASSERT_EQ(0, s.connectionsCount);
+
+    net.stop();
+    t.join();
+}
+
+TEST_P(NONBLOCK_BACKEND, SessionTimer) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+
+    NonBlockNet net;
+    int ret = net.init(1024, GetParam());
+    if (net.backend() != GetParam()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+
+    const uint64_t TICKS = 5;
+    NetOperation op { .name = "TickerTest", .ip = IP, .port = PORT, .factory = std::make_shared<TickerNetSessionFactory>(20, TICKS) };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(1000); });
+
+    BlockConnector connector(IP, PORT);
+    ret = connector.init();
+    ASSERT_EQ(0, ret);
+    auto conn_info = connector.make_connection();
+    ASSERT_TRUE(conn_info);
+    BlockConnection conn(conn_info->fd);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < TICKS; i++) {
+        uint64_t tick = 0;
+        ret = conn.readAll((char*)&tick, sizeof(tick));
+        ASSERT_EQ(sizeof(tick), ret);
+        ASSERT_EQ(i, tick);
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_GE(elapsed, std::chrono::milliseconds(20 * TICKS - 20));
+    ASSERT_LT(elapsed, std::chrono::milliseconds(800));
+
+    net.stop();
+    t.join();
+}
+
+namespace {
+
+class CountingEchoFactory : public EchoNetSessionFactory {
+public:
+    NetSession* makeSession(NonBlockConnection* conn) override {
+        _made++;
+        return EchoNetSessionFactory::makeSession(conn);
+    }
+
+    size_t made() const { return _made; }
+
+private:
+    size_t _made = 0;
+};
+
+} // namespace
+
+TEST_P(NONBLOCK_BACKEND, RecycleConnections) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+
+    NonBlockNet net;
+    int ret = net.init(1024, GetParam());
+    ASSERT_EQ(0, ret);
+    if (net.backend() != GetParam()) {
+        GTEST_SKIP();
+    }
+
+    auto factory = std::make_shared<CountingEchoFactory>();
+    NetOperation op { .name = "ListenTest", .ip = IP, .port = PORT, .factory = factory };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(1000); });
+    net.waitListenerReady();
+
+    // Sequential short connections: each one is closed by the peer before the
+    // next one starts, so the same connection and session get reused.
+    const size_t CONNECTIONS = 50;
+    for (uint64_t val = 0; val < CONNECTIONS; val++) {
+        BlockConnector connector(IP, PORT);
+        ret = connector.init();
+        ASSERT_EQ(0, ret);
+        auto conn_info = connector.make_connection();
+        ASSERT_TRUE(conn_info);
+        BlockConnection conn(conn_info->fd);
+
+        ret = conn.writeAll((char*)&val, sizeof(val));
+        ASSERT_EQ(sizeof(val), ret);
+
+        uint64_t num = 0;
+        ret = conn.readAll((char*)&num, sizeof(num));
+        ASSERT_EQ(sizeof(num), ret);
+        ASSERT_EQ(val, num);
+    }
+
+    for (int i = 0; i < 20 && net.stats().connectionsCount > 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    net.stop();
+    t.join();
+
+    auto s = net.stats();
+    ASSERT_EQ(CONNECTIONS, s.acceptedCount);
+    ASSERT_EQ(0, s.connectionsCount);
+    ASSERT_LT(factory->made(), CONNECTIONS / 5);
+    ASSERT_GT(net.freeConnectionsCount(), 0);
+}
+
+TEST_P(NONBLOCK_BACKEND, DeferredFlush) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const uint32_t FRAMES = 50;
+
+    NonBlockNet net;
+    int ret = net.init(1024, GetParam());
+    ASSERT_EQ(0, ret);
+    if (net.backend() != GetParam()) {
+        GTEST_SKIP();
+    }
+
+    NetOperation op { .name = "ListenTest", .ip = IP, .port = PORT, .factory = std::make_shared<SplitEchoNetSessionFactory>() };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(1000); });
+    net.waitListenerReady();
+
+    BlockConnector connector(IP, PORT);
+    ret = connector.init();
+    ASSERT_EQ(0, ret);
+    auto conn_info = connector.make_connection();
+    ASSERT_TRUE(conn_info);
+    BlockConnection conn(conn_info->fd);
+
+    // Pipelined frames in one write, two writeData() calls each.
+    std::string frames;
+    for (uint32_t i = 0; i < FRAMES; i++) {
+        const std::string body = "frame " + std::to_string(i);
+        const uint32_t size = body.size();
+        frames.append((const char*)&size, sizeof(size));
+        frames.append(body);
+    }
+
+    ret = conn.writeAll(frames.data(), frames.size());
+    ASSERT_EQ(frames.size(), ret);
+
+    std::string echo(frames.size(), '\0');
+    ret = conn.readAll(echo.data(), echo.size());
+    ASSERT_EQ(echo.size(), ret);
+    ASSERT_EQ(frames, echo);
+
+    net.stop();
+    t.join();
+
+    // The responses of a step go out with one write.
+    auto s = net.stats();
+    ASSERT_EQ(2 * FRAMES, s.writesDeferredCount);
+    ASSERT_GE(s.deferredFlushesCount, 1);
+    ASSERT_LT(s.deferredFlushesCount, FRAMES / 5);
+}
+
+TEST_P(NONBLOCK_BACKEND, ConnectionCap) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const size_t CAP = 2;
+
+    NonBlockNet net;
+    int ret = net.init(1024, GetParam());
+    ASSERT_EQ(0, ret);
+    if (net.backend() != GetParam()) {
+        GTEST_SKIP();
+    }
+
+    auto factory = std::make_shared<EchoNetSessionFactory>();
+    factory->setAdmission(NetAdmission{ .maxConnections = CAP });
+    NetOperation op { .name = "ListenTest", .ip = IP, .port = PORT, .factory = factory };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+
+    auto connect = [&]() {
+        BlockConnector connector(IP, PORT);
+        EXPECT_EQ(0, connector.init());
+        auto conn_info = connector.make_connection();
+        EXPECT_TRUE(conn_info);
+        return std::make_unique<BlockConnection>(conn_info ? conn_info->fd : -1);
+    };
+
+    auto echo = [](BlockConnection& conn, uint64_t val) {
+        uint64_t num = 0;
+        return conn.writeAll((char*)&val, sizeof(val)) == sizeof(val) &&
+               conn.readAll((char*)&num, sizeof(num)) == sizeof(num) && num == val;
+    };
+
+    std::vector<std::unique_ptr<BlockConnection>> conns;
+    for (uint64_t val = 0; val < CAP; val++) {
+        conns.push_back(connect());
+        ASSERT_TRUE(echo(*conns.back(), val));
+    }
+    ASSERT_EQ(CAP, factory->connectionsCount());
+
+    // One too many: reset right after accept.
+    auto extra = connect();
+    uint64_t num = 0;
+    ret = extra->readSome((char*)&num, sizeof(num));
+    ASSERT_LE(ret, 0);
+
+    // A closed connection makes room.
+    conns.front().reset();
+    for (int i = 0; i < 20 && factory->connectionsCount() == CAP; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    conns.front() = connect();
+    ASSERT_TRUE(echo(*conns.front(), 42));
+
+    net.stop();
+    t.join();
+
+    auto s = net.stats();
+    ASSERT_EQ(1, s.connectionsRejectedCount);
+    ASSERT_EQ(CAP + 1, s.acceptedCount);
+}
+
+TEST_P(NONBLOCK_BACKEND, GroupListenerBlockConnect) {
+    // TempLogLevel tll{"DEBUG"};
+
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const size_t REACTORS_COUNT = 2;
+    // SO_REUSEPORT hashes the connections over the reactors: with this many
+    // the chance of one reactor getting none is 2^-63.
+    const size_t CONNECTIONS_COUNT = 64;
+
+    NonBlockNetGroup group(REACTORS_COUNT);
+    int ret = group.init(1024, GetParam());
+    ASSERT_EQ(0, ret);
+    if (group.reactor(0).backend() != GetParam()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+
+    NetOperation op { .name = "GroupTest", .ip = IP, .port = PORT, .factory = std::make_shared<EchoNetSessionFactory>() };
+    ret = group.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    ret = group.start(100);
+    ASSERT_EQ(0, ret);
+    ASSERT_EQ(REACTORS_COUNT, group.stats().listenersCount);
+
+    auto foo = [&]() {
+        BlockConnector connector(IP, PORT);
+        int ret = connector.init();
+        ASSERT_EQ(0, ret);
+        auto conn_info = connector.make_connection();
+        ASSERT_TRUE(conn_info);
+
+        BlockConnection conn(conn_info->fd);
+        for (uint64_t val = 0; val < 128; val++) {
+            ret = conn.writeAll((char*)&val, sizeof(val));
+            ASSERT_EQ(sizeof(val), ret);
+
+            uint64_t num = 0;
+            ret = conn.readAll((char*)&num, sizeof(num));
+            ASSERT_EQ(sizeof(num), ret);
+            ASSERT_EQ(val, num);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t j = 0; j < CONNECTIONS_COUNT; j++) {
+        workers.emplace_back(std::thread(foo));
+    }
+
+    for (auto& w: workers) {
+        w.join();
+    }
+
+    ASSERT_EQ(CONNECTIONS_COUNT, group.stats().acceptedCount);
+    for (size_t i = 0; i < REACTORS_COUNT; i++) {
+        ASSERT_GT(group.reactor(i).stats().acceptedCount, 0);
+    }
+
+    group.stop();
+}
+
+namespace {
+
+// Echoes, and records whether the accepted socket has TCP_NODELAY.
+class NoDelayEchoSessionFactory : public NetSessionFactory {
+public:
+    NetSession* makeSession(NonBlockConnection* conn) override {
+        int flag = 0;
+        socklen_t len = sizeof(flag);
+        if (getsockopt(conn->fd(), IPPROTO_TCP, TCP_NODELAY, &flag, &len) == 0 && flag != 0) {
+            noDelayCount++;
+        }
+        return new EchoNetSession(conn);
+    }
+
+    std::atomic<size_t> noDelayCount = 0;
+};
+
+} // namespace
+
+TEST_P(NONBLOCK_BACKEND, GroupListenerNoDelay) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+
+    NonBlockNetGroup group(2);
+    int ret = group.init(1024, GetParam());
+    ASSERT_EQ(0, ret);
+    if (group.reactor(0).backend() != GetParam()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+
+    // The reactors listen with a copy of the operation, options included.
+    auto factory = std::make_shared<NoDelayEchoSessionFactory>();
+    NetOperation op { .name = "GroupTest", .ip = IP, .port = PORT, .factory = factory, .noDelay = true };
+    ret = group.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    ret = group.start(100);
+    ASSERT_EQ(0, ret);
+
+    BlockConnector connector(IP, PORT);
+    ret = connector.init();
+    ASSERT_EQ(0, ret);
+    auto conn_info = connector.make_connection();
+    ASSERT_TRUE(conn_info);
+
+    BlockConnection conn(conn_info->fd);
+    uint64_t val = 42;
+    ret = conn.writeAll((char*)&val, sizeof(val));
+    ASSERT_EQ(sizeof(val), ret);
+    uint64_t num = 0;
+    ret = conn.readAll((char*)&num, sizeof(num));
+    ASSERT_EQ(sizeof(num), ret);
+    ASSERT_EQ(val, num);
+
+    ASSERT_EQ(1, group.stats().acceptedCount);
+    ASSERT_EQ(1, factory->noDelayCount);
+
+    group.stop();
+}
+
+TEST_P(NONBLOCK_BACKEND, UnixListenerBlockConnect) {
+    // A socket file and an abstract name.
+    const std::string paths[] = {
+        "/tmp/bongo_utest_" + std::to_string(getpid()) + ".sock",
+        "@bongo_utest_" + std::to_string(getpid()),
+    };
+
+    for (const auto& path: paths) {
+        NonBlockNet net;
+        int ret = net.init(1024, GetParam());
+        if (net.backend() != GetParam()) {
+            GTEST_SKIP() << "io_uring is not available";
+        }
+        ASSERT_EQ(0, ret);
+
+        NetOperation op { .name = "UnixListenTest", .factory = std::make_shared<EchoNetSessionFactory>(), .path = path };
+        ret = net.startListen(op);
+        ASSERT_EQ(0, ret);
+
+        std::thread t([&]() { net.run(100); });
+        net.waitListenerReady();
+
+        BlockConnector connector(UnixPath{path});
+        ret = connector.init();
+        ASSERT_EQ(0, ret);
+        auto conn_info = connector.make_connection();
+        ASSERT_TRUE(conn_info);
+        BlockConnection conn(conn_info->fd);
+
+        for (uint64_t val = 0; val < 100; val++) {
+            ret = conn.writeAll((char*)&val, sizeof(val));
+            ASSERT_EQ(sizeof(val), ret);
+
+            uint64_t echo = 0;
+            ret = conn.readAll((char*)&echo, sizeof(echo));
+            ASSERT_EQ(sizeof(echo), ret);
+            ASSERT_EQ(val, echo);
+        }
+
+        net.stop();
+        t.join();
+        ASSERT_EQ(1, net.stats().acceptedCount);
+        unlink(path.c_str());
+    }
+}
+
+TEST_P(NONBLOCK_BACKEND, UnixConnectBlockListener) {
+    const std::string PATH = "@bongo_utest_connect_" + std::to_string(getpid());
+
+    NonBlockNet net;
+    int ret = net.init(1024, GetParam());
+    if (net.backend() != GetParam()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+    ASSERT_EQ(0, ret);
+
+    BlockListener listener(UnixPath{PATH});
+    ret = listener.init();
+    ASSERT_EQ(0, ret);
+
+    NetOperation op { .name = "UnixConnectTest", .factory = std::make_shared<EchoNetSessionFactory>(), .path = PATH };
+    ret = net.startConnect(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(100); });
+
+    auto conn_info = listener.accept_connection();
+    ASSERT_TRUE(conn_info);
+    BlockConnection conn(conn_info->fd);
+
+    char data[] = "unix echo";
+    ret = conn.writeAll(data, sizeof(data));
+    ASSERT_EQ(sizeof(data), ret);
+
+    char echo[sizeof(data)];
+    ret = conn.readAll(echo, sizeof(echo));
+    ASSERT_EQ(sizeof(echo), ret);
+    ASSERT_STREQ(data, echo);
+
+    net.stop();
+    t.join();
+}
+
+TEST(NONBLOCK_EPOLL, CtlOncePerConnection) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+
+    NonBlockNet net;
+    int ret = net.init();
+    ASSERT_EQ(0, ret);
+
+    NetOperation op { .name = "ListenTest", .ip = IP, .port = PORT, .factory = std::make_shared<EchoNetSessionFactory>() };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+
+    BlockConnector connector(IP, PORT);
+    ret = connector.init();
+    ASSERT_EQ(0, ret);
+    auto conn_info = connector.make_connection();
+    ASSERT_TRUE(conn_info);
+
+    BlockConnection conn(conn_info->fd);
+
+    // Request/response traffic must not re-arm the connection.
+    const size_t ROUNDS = 1000;
+    for (uint64_t val = 0; val < ROUNDS; val++) {
+        ret = conn.writeAll((char*)&val, sizeof(val));
+        ASSERT_EQ(sizeof(val), ret);
+
+        uint64_t num = 0;
+        ret = conn.readAll((char*)&num, sizeof(num));
+        ASSERT_EQ(sizeof(num), ret);
+        ASSERT_EQ(val, num);
+    }
+
+    auto s = net.stats();
+    ASSERT_EQ(3, s.epollCtlCount); // the pipe, the listener and the connection
+    ASSERT_LT((double)s.epollCtlCount / ROUNDS, 0.01);
+
+    net.stop();
+    t.join();
+}
+
+TEST(NONBLOCK_EPOLL, EofWithLastData) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+
+    // Stepped from this thread: the bytes and the FIN are both in the socket
+    // when it's accepted, one edge reports them together.
+    NonBlockNet net;
+    int ret = net.init();
+    ASSERT_EQ(0, ret);
+
+    NetOperation op { .name = "ListenTest", .ip = IP, .port = PORT, .factory = std::make_shared<EchoNetSessionFactory>() };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    BlockConnector connector(IP, PORT);
+    ret = connector.init();
+    ASSERT_EQ(0, ret);
+    auto conn_info = connector.make_connection();
+    ASSERT_TRUE(conn_info);
+    BlockConnection conn(conn_info->fd);
+
+    std::string data = "last words";
+    ASSERT_EQ(data.size(), conn.writeAll(data.data(), data.size()));
+    shutdown(conn_info->fd, SHUT_WR);
+
+    for (int i = 0; i < 10 && (net.stats().acceptedCount == 0 || net.stats().connectionsCount > 0); i++) {
+        ASSERT_EQ(0, net.step(10));
+    }
+
+    // The short read isn't the end, the EOF behind it closes the connection.
+    auto s = net.stats();
+    ASSERT_EQ(1, s.acceptedCount);
+    ASSERT_EQ(0, s.connectionsCount);
+
+    std::string echoed(data.size(), '\0');
+    ASSERT_EQ(data.size(), conn.readAll(echoed.data(), echoed.size()));
+    ASSERT_EQ(data, echoed);
+    char ch;
+    ASSERT_EQ(0, read(conn_info->fd, &ch, 1));
+}
+
+TEST(NONBLOCK_EPOLL, AcceptBudget) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+
+    NonBlockNet net;
+    int ret = net.init();
+    ASSERT_EQ(0, ret);
+    net.setAcceptBudget(1);
+
+    NetOperation op { .name = "ListenTest", .ip = IP, .port = PORT, .factory = std::make_shared<EchoNetSessionFactory>() };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    // The connections wait in the listen queue until the reactor starts.
+    const size_t CONNECTIONS = 8;
+    std::vector<std::unique_ptr<BlockConnection>> conns;
+    for (size_t i = 0; i < CONNECTIONS; i++) {
+        BlockConnector connector(IP, PORT);
+        ret = connector.init();
+        ASSERT_EQ(0, ret);
+        auto conn_info = connector.make_connection();
+        ASSERT_TRUE(conn_info);
+        conns.emplace_back(std::make_unique<BlockConnection>(conn_info->fd));
+    }
+
+    std::thread t([&]() { net.run(100); });
+
+    for (uint64_t val = 0; val < CONNECTIONS; val++) {
+        ret = conns[val]->writeAll((char*)&val, sizeof(val));
+        ASSERT_EQ(sizeof(val), ret);
+
+        uint64_t num = 0;
+        ret = conns[val]->readAll((char*)&num, sizeof(num));
+        ASSERT_EQ(sizeof(num), ret);
+        ASSERT_EQ(val, num);
+    }
+
+    auto s = net.stats();
+    ASSERT_EQ(CONNECTIONS, s.acceptedCount);
+    ASSERT_GE(s.acceptCapHitsCount, CONNECTIONS - 1);
+
+    net.stop();
+    t.join();
+}
+
+TEST(NONBLOCK_EPOLL, DeferAccepts) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+
+    NonBlockNet net;
+    int ret = net.init();
+    ASSERT_EQ(0, ret);
+
+    auto factory = std::make_shared<EchoNetSessionFactory>();
+    factory->setAdmission(NetAdmission{ .maxConnections = 1, .deferAccepts = true });
+    NetOperation op { .name = "ListenTest", .ip = IP, .port = PORT, .factory = factory };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+
+    std::vector<ConnectionInfo> infos;
+    std::vector<std::unique_ptr<BlockConnection>> conns;
+    for (size_t i = 0; i < 2; i++) {
+        BlockConnector connector(IP, PORT);
+        ret = connector.init();
+        ASSERT_EQ(0, ret);
+        auto conn_info = connector.make_connection();
+        ASSERT_TRUE(conn_info);
+        infos.push_back(*conn_info);
+        conns.emplace_back(std::make_unique<BlockConnection>(conn_info->fd));
+    }
+
+    for (uint64_t val = 0; val < 2; val++) {
+        ret = conns[val]->writeAll((char*)&val, sizeof(val));
+        ASSERT_EQ(sizeof(val), ret);
+    }
+
+    uint64_t num = 0;
+    ret = conns[0]->readAll((char*)&num, sizeof(num));
+    ASSERT_EQ(sizeof(num), ret);
+    ASSERT_EQ(0, num);
+
+    // The second connection waits in the listen queue.
+    pollfd pfd{ .fd = infos[1].fd, .events = POLLIN, .revents = 0 };
+    ret = poll(&pfd, 1, 200);
+    ASSERT_EQ(0, ret);
+    ASSERT_EQ(1, net.stats().acceptedCount);
+
+    conns[0].reset();
+    ret = conns[1]->readAll((char*)&num, sizeof(num));
+    ASSERT_EQ(sizeof(num), ret);
+    ASSERT_EQ(1, num);
+
+    net.stop();
+    t.join();
+
+    auto s = net.stats();
+    ASSERT_EQ(2, s.acceptedCount);
+    ASSERT_GE(s.acceptDeferredCount, 1);
+    ASSERT_EQ(0, s.connectionsRejectedCount);
+}
+
+TEST(NONBLOCK_EPOLL, ZeroCopyBigWriter) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+
+    NonBlockNet net;
+    int ret = net.init();
+    ASSERT_EQ(0, ret);
+    net.setZeroCopyThreshold(64 * 1024);
+
+    std::thread block_thread([&]() {
+        BlockListener listener(IP, PORT);
+        int ret = listener.init();
+        ASSERT_EQ(0, ret);
+
+        auto conn_info = listener.accept_connection();
+        ASSERT_TRUE(conn_info);
+        BlockConnection conn(conn_info->fd);
+
+        size_t size = 0;
+        ret = conn.readAll((char*)&size, sizeof(size));
+        ASSERT_EQ(sizeof(size), ret);
+
+        std::vector<char> buffer(16 * 1024 * 1024);
+        char ch = 'A';
+        for (size_t received_size = 0; received_size < size; ) {
+            size_t sz = std::min(buffer.size(), size - received_size);
+            int ret = conn.readAll(buffer.data(), sz);
+            ASSERT_EQ(ret, sz);
+
+            // Memory referenced by zero-copy sends must not be reused too early.
+            for (size_t i = 0; i < sz; i++, ch++) {
+                if (ch > 'Z') {
+                    ch = 'A';
+                }
+                ASSERT_EQ(ch, buffer[i]);
+            }
+
+            received_size += ret;
+        }
+
+        ret = conn.writeAll((char*)&size, sizeof(size));
+        ASSERT_EQ(sizeof(size), ret);
+    });
+
+    // Let accept() start on the block_thread.
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::thread t([&]() {
+        NetOperation op { .name = "ConnectTest", .ip = IP, .port = PORT, .factory = std::make_shared<BigWriterNetSessionFactory>() };
+        ret = net.startConnect(op);
+        ASSERT_EQ(0, ret);
+        net.run(100);
+    });
+
+    block_thread.join();
+    net.stop();
+    t.join();
+
+    auto s = net.stats();
+    ASSERT_GT(s.zeroCopySendsCount, 0);
+    ASSERT_GT(s.zeroCopyCompletedCount, 0);
+    ASSERT_LE(s.zeroCopyCompletedCount, s.zeroCopySendsCount);
+}
+
+namespace {
+
+// A blocking OpenSSL client over a connected socket.
+class TlsClient {
+public:
+    TlsClient(int fd, const std::string& caPem) {
+        _ctx = SSL_CTX_new(TLS_client_method());
+        BIO* bio = BIO_new_mem_buf(caPem.data(), caPem.size());
+        X509* ca = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr);
+        X509_STORE_add_cert(SSL_CTX_get_cert_store(_ctx), ca);
+        X509_free(ca);
+        BIO_free(bio);
+        SSL_CTX_set_verify(_ctx, SSL_VERIFY_PEER, nullptr);
+
+        _ssl = SSL_new(_ctx);
+        SSL_set_fd(_ssl, fd);
+    }
+
+    ~TlsClient() {
+        SSL_free(_ssl);
+        SSL_CTX_free(_ctx);
+    }
+
+    bool connect() { return SSL_connect(_ssl) == 1; }
+
+    size_t writeAll(const char* data, size_t size) {
+        size_t written = 0;
+        while (written < size) {
+            int ret = SSL_write(_ssl, data + written, size - written);
+            if (ret <= 0) {
+                break;
+            }
+            written += ret;
+        }
+        return written;
+    }
+
+    size_t readAll(char* data, size_t size) {
+        size_t received = 0;
+        while (received < size) {
+            int ret = SSL_read(_ssl, data + received, size - received);
+            if (ret <= 0) {
+                break;
+            }
+            received += ret;
+        }
+        return received;
+    }
+
+    void shutdown() { SSL_shutdown(_ssl); }
+
+private:
+    SSL_CTX* _ctx = nullptr;
+    SSL* _ssl = nullptr;
+};
+
+TlsContextPtr makeServerTls(bool kernelOffload, std::string& caPem) {
+    TlsConfig config;
+    if (TlsContext::makeSelfSigned("localhost", config.certPem, config.keyPem) != 0) {
+        return nullptr;
+    }
+    config.kernelOffload = kernelOffload;
+    caPem = config.certPem;
+
+    auto tls = std::make_shared<TlsContext>(TlsMode::Server, config);
+    return tls->init() == 0 ? tls : nullptr;
+}
+
+} // namespace
+
+// kTLS, when the kernel has it, or the user-space fallback otherwise.
+class NONBLOCK_TLS : public ::testing::TestWithParam<bool> {};
+
+INSTANTIATE_TEST_SUITE_P(Offload, NONBLOCK_TLS, ::testing::Values(false, true),
+    [](const ::testing::TestParamInfo<bool>& info) {
+        return info.param ? std::string("Kernel") : std::string("User");
+    });
+
+TEST_P(NONBLOCK_TLS, Echo) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+
+    NonBlockNet net;
+    int ret = net.init();
+    ASSERT_EQ(0, ret);
+
+    std::string caPem;
+    auto factory = std::make_shared<EchoNetSessionFactory>();
+    factory->setTls(makeServerTls(GetParam(), caPem));
+    ASSERT_TRUE(factory->tls());
+
+    NetOperation op { .name = "TlsTest", .ip = IP, .port = PORT, .factory = factory };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+
+    BlockConnector connector(IP, PORT);
+    ret = connector.init();
+    ASSERT_EQ(0, ret);
+    auto conn_info = connector.make_connection();
+    ASSERT_TRUE(conn_info);
+    BlockConnection conn(conn_info->fd);
+
+    TlsClient client(conn_info->fd, caPem);
+    ASSERT_TRUE(client.connect());
+
+    // Small messages, then more than a record at once.
+    for (size_t size: {5, 1000, 100 * 1024}) {
+        std::string data(size, 'x');
+        for (size_t i = 0; i < size; i++) {
+            data[i] = 'a' + i % 26;
+        }
+        ASSERT_EQ(size, client.writeAll(data.data(), size));
+
+        std::string echo(size, '\0');
+        ASSERT_EQ(size, client.readAll(echo.data(), size));
+        ASSERT_EQ(data, echo);
+    }
+
+    client.shutdown();
+    net.stop();
+    t.join();
+
+    auto s = net.stats();
+    ASSERT_EQ(1, s.tlsHandshakesCount);
+    ASSERT_EQ(GetParam() && TlsContext::kernelTlsAvailable() ? 1 : 0, s.tlsOffloadedCount);
+}
+
+TEST_P(NONBLOCK_TLS, FileWriter) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+
+    // Read and encrypted in user space, or sendfile()d through kTLS.
+    char path[] = "/tmp/utest_session_demo_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    std::vector<uint64_t> data(1024 * 1024);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = i;
+    }
+    const size_t dataSize = data.size() * sizeof(data[0]);
+    ASSERT_EQ((ssize_t)dataSize, write(fd, data.data(), dataSize));
+    close(fd);
+
+    auto file = OutputFile::open(path);
+    unlink(path);
+    ASSERT_TRUE(file);
+
+    NonBlockNet net;
+    int ret = net.init();
+    ASSERT_EQ(0, ret);
+
+    std::string caPem;
+    auto factory = std::make_shared<FileWriterNetSessionFactory>(file);
+    factory->setTls(makeServerTls(GetParam(), caPem));
+    ASSERT_TRUE(factory->tls());
+
+    NetOperation op { .name = "TlsFileTest", .ip = IP, .port = PORT, .factory = factory };
+    ret = net.startListen(op);
+    ASSERT_EQ(0, ret);
+
+    std::thread t([&]() { net.run(100); });
+    net.waitListenerReady();
+
+    BlockConnector connector(IP, PORT);
+    ret = connector.init();
+    ASSERT_EQ(0, ret);
+    auto conn_info = connector.make_connection();
+    ASSERT_TRUE(conn_info);
+    BlockConnection conn(conn_info->fd);
+
+    TlsClient client(conn_info->fd, caPem);
+    ASSERT_TRUE(client.connect());
+
+    size_t size = 0;
+    ASSERT_EQ(sizeof(size), client.readAll((char*)&size, sizeof(size)));
+    ASSERT_EQ(dataSize, size);
+
+    std::vector<uint64_t> check(data.size());
+    ASSERT_EQ(size, client.readAll((char*)check.data(), size));
+    ASSERT_EQ(data, check);
+
+    ASSERT_EQ(sizeof(size), client.writeAll((char*)&size, sizeof(size)));
+
+    net.stop();
+    t.join();
+}
+
+TEST(NONBLOCK_TLS_URING, Refused) {
+    NonBlockNet net;
+    int ret = net.init(1024, NetBackend::Uring);
+    ASSERT_EQ(0, ret);
+    if (net.backend() != NetBackend::Uring) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+
+    std::string caPem;
+    auto factory = std::make_shared<EchoNetSessionFactory>();
+    factory->setTls(makeServerTls(false, caPem));
+
+    NonBlockConnection connection(&net, std::make_shared<const std::string>("TlsUring"), -1);
+    ASSERT_EQ(-1, connection.setSession(factory));
+}
+
+TEST(NONBLOCK_TLS_CONFIG, ClientVerifyRequired) {
+    TempLogLevel tll{"CRITICAL"};
+    std::string certPem, keyPem;
+    ASSERT_EQ(0, TlsContext::makeSelfSigned("localhost", certPem, keyPem));
+
+    // Verifying the server takes a CA and a name, skipping it must be asked for.
+    ASSERT_EQ(-1, TlsContext(TlsMode::Client, TlsConfig{}).init());
+    ASSERT_EQ(-1, TlsContext(TlsMode::Client, TlsConfig{ .caPem = certPem }).init());
+    ASSERT_EQ(0, TlsContext(TlsMode::Client, TlsConfig{ .caPem = certPem, .serverName = "localhost" }).init());
+    ASSERT_EQ(0, TlsContext(TlsMode::Client, TlsConfig{ .insecure = true }).init());
+}
+
+class NONBLOCK_TLS_CLIENT : public ::testing::TestWithParam<bool> {};
+
+INSTANTIATE_TEST_SUITE_P(ServerName, NONBLOCK_TLS_CLIENT, ::testing::Values(true, false),
+    [](const ::testing::TestParamInfo<bool>& info) {
+        return info.param ? std::string("Match") : std::string("Mismatch");
+    });
+
+TEST_P(NONBLOCK_TLS_CLIENT, Handshake) {
+    TempLogLevel tll{"CRITICAL"};
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+
+    NonBlockNet server;
+    int ret = server.init();
+    ASSERT_EQ(0, ret);
+
+    std::string caPem;
+    auto serverFactory = std::make_shared<EchoNetSessionFactory>();
+    serverFactory->setTls(makeServerTls(false, caPem));
+    ASSERT_TRUE(serverFactory->tls());
+
+    NetOperation serverOp { .name = "TlsServer", .ip = IP, .port = PORT, .factory = serverFactory };
+    ret = server.startListen(serverOp);
+    ASSERT_EQ(0, ret);
+
+    std::thread serverThread([&]() { server.run(100); });
+    server.waitListenerReady();
+
+    // The certificate is for localhost.
+    TlsConfig config { .caPem = caPem, .serverName = GetParam() ? "localhost" : "elsewhere" };
+    auto tls = std::make_shared<TlsContext>(TlsMode::Client, config);
+    ASSERT_EQ(0, tls->init());
+    auto clientFactory = std::make_shared<EchoNetSessionFactory>();
+    clientFactory->setTls(tls);
+
+    NonBlockNet client;
+    ret = client.init();
+    ASSERT_EQ(0, ret);
+    NetOperation clientOp { .name = "TlsClient", .ip = IP, .port = PORT, .factory = clientFactory };
+    ret = client.startConnect(clientOp);
+    ASSERT_EQ(0, ret);
+
+    std::thread clientThread([&]() { client.run(100); });
+    for (int i = 0; i < 200; i++) {
+        auto s = client.stats();
+        if (s.connectedCount > 0 && (s.tlsHandshakesCount > 0 || s.connectionsCount == 0)) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    client.stop();
+    clientThread.join();
+    server.stop();
+    serverThread.join();
+
+    auto s = client.stats();
+    ASSERT_EQ(1, s.connectedCount);
+    ASSERT_EQ(GetParam() ? 1 : 0, s.tlsHandshakesCount);
+    ASSERT_EQ(GetParam() ? 1 : 0, s.connectionsCount);
+}
+
+// Spliced, and copied through user space for comparison. Small pipes, so
+// both directions run into backpressure.
+class NONBLOCK_PROXY : public ::testing::TestWithParam<bool> {};
+
+INSTANTIATE_TEST_SUITE_P(Relay, NONBLOCK_PROXY, ::testing::Values(false, true),
+    [](const ::testing::TestParamInfo<bool>& info) {
+        return info.param ? std::string("Copy") : std::string("Splice");
+    });
+
+TEST_P(NONBLOCK_PROXY, EchoThrough) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const int PROXY_PORT = 8889;
+    const size_t SIZE = 8 * 1024 * 1024;
+
+    NonBlockNet echo;
+    int ret = echo.init();
+    ASSERT_EQ(0, ret);
+    NetOperation echoOp { .name = "Echo", .ip = IP, .port = PORT, .factory = std::make_shared<EchoNetSessionFactory>() };
+    ret = echo.startListen(echoOp);
+    ASSERT_EQ(0, ret);
+
+    NonBlockNet proxy;
+    ret = proxy.init();
+    ASSERT_EQ(0, ret);
+    ProxyTarget target { .name = "Upstream", .ip = IP, .port = PORT, .pipeSize = 4096, .copy = GetParam() };
+    NetOperation proxyOp { .name = "Proxy", .ip = IP, .port = PROXY_PORT, .factory = std::make_shared<ProxySessionFactory>(target) };
+    ret = proxy.startListen(proxyOp);
+    ASSERT_EQ(0, ret);
+
+    std::thread echoThread([&]() { echo.run(100); });
+    std::thread proxyThread([&]() { proxy.run(100); });
+    echo.waitListenerReady();
+    proxy.waitListenerReady();
+
+    BlockConnector connector(IP, PROXY_PORT);
+    ret = connector.init();
+    ASSERT_EQ(0, ret);
+    auto conn_info = connector.make_connection();
+    ASSERT_TRUE(conn_info);
+    BlockConnection conn(conn_info->fd);
+
+    std::string data(SIZE, '\0');
+    for (size_t i = 0; i < SIZE; i++) {
+        data[i] = 'a' + i % 23;
+    }
+
+    // The echo comes back while the rest is still being sent.
+    std::thread writer([&]() {
+        ASSERT_EQ(SIZE, conn.writeAll(data.data(), SIZE));
+        shutdown(conn_info->fd, SHUT_WR);
+    });
+
+    std::string echoed(SIZE, '\0');
+    ret = conn.readAll(echoed.data(), SIZE);
+    writer.join();
+    ASSERT_EQ(SIZE, ret);
+    ASSERT_EQ(data, echoed);
+
+    // The EOF goes to the echo server, which closes, and back.
+    char ch;
+    ASSERT_EQ(0, read(conn_info->fd, &ch, 1));
+
+    for (int i = 0; i < 100 && proxy.stats().connectionsCount > 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    proxy.stop();
+    proxyThread.join();
+    echo.stop();
+    echoThread.join();
+
+    auto s = proxy.stats();
+    ASSERT_EQ(1, s.relayPairsCount);
+    ASSERT_EQ(2 * SIZE, s.relayedBytesCount);
+    ASSERT_EQ(0, s.connectionsCount);
+}
+
+TEST_P(NONBLOCK_PROXY, UpstreamReset) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const int PROXY_PORT = 8889;
+
+    BlockListener listener(IP, PORT);
+    int ret = listener.init();
+    ASSERT_EQ(0, ret);
+
+    // The default disposition kills the process on SIGPIPE, init() must
+    // take care of it.
+    signal(SIGPIPE, SIG_DFL);
+
+    // Stepped from this thread: the events pile up while the test sets the
+    // sockets up, and come in the order they happened.
+    NonBlockNet proxy;
+    ret = proxy.init();
+    ASSERT_EQ(0, ret);
+    ProxyTarget target { .name = "Upstream", .ip = IP, .port = PORT, .copy = GetParam() };
+    NetOperation proxyOp { .name = "Proxy", .ip = IP, .port = PROXY_PORT, .factory = std::make_shared<ProxySessionFactory>(target) };
+    ret = proxy.startListen(proxyOp);
+    ASSERT_EQ(0, ret);
+
+    BlockConnector connector(IP, PROXY_PORT);
+    ret = connector.init();
+    ASSERT_EQ(0, ret);
+    auto client_info = connector.make_connection();
+    ASSERT_TRUE(client_info);
+    BlockConnection client(client_info->fd);
+
+    char ch = 'a';
+    ASSERT_EQ(1, client.writeAll(&ch, 1));
+    for (int i = 0; i < 10 && proxy.stats().relayedBytesCount == 0; i++) {
+        ASSERT_EQ(0, proxy.step(10));
+    }
+
+    auto upstream_info = listener.accept_connection();
+    ASSERT_TRUE(upstream_info);
+    const int upstreamFd = upstream_info->fd;
+    ASSERT_EQ(1, read(upstreamFd, &ch, 1));
+
+    // The upstream is in CLOSE_WAIT on the proxy when the RST comes. The
+    // byte the client sent before it waits in the pipe, its event comes
+    // first and the splice to the upstream fails with EPIPE.
+    shutdown(upstreamFd, SHUT_WR);
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(0, proxy.step(10));
+    }
+
+    ch = 'b';
+    ASSERT_EQ(1, client.writeAll(&ch, 1));
+    linger lin { .l_onoff = 1, .l_linger = 0 };
+    setsockopt(upstreamFd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+    close(upstreamFd);
+
+    for (int i = 0; i < 10 && proxy.stats().connectionsCount > 0; i++) {
+        ASSERT_EQ(0, proxy.step(10));
+    }
+
+    auto s = proxy.stats();
+    ASSERT_EQ(1, s.relayPairsCount);
+    ASSERT_EQ(1, s.relayedBytesCount);
+    ASSERT_EQ(0, s.connectionsCount);
+}
+
+static size_t openFdsCount() {
+    return std::distance(std::filesystem::directory_iterator("/proc/self/fd"), std::filesystem::directory_iterator());
+}
+
+TEST(NONBLOCK_PROXY_RECYCLING, OffLeaksNothing) {
+    const std::string IP = "127.0.0.1";
+    const int PORT = 8888;
+    const int PROXY_PORT = 8889;
+    const size_t COUNT = 5;
+
+    NonBlockNet echo;
+    int ret = echo.init();
+    ASSERT_EQ(0, ret);
+    NetOperation echoOp { .name = "Echo", .ip = IP, .port = PORT, .factory = std::make_shared<EchoNetSessionFactory>() };
+    ret = echo.startListen(echoOp);
+    ASSERT_EQ(0, ret);
+
+    // Deleted connections take their splice pipes with them.
+    NonBlockNet proxy;
+    proxy.setRecycling(false);
+    ret = proxy.init();
+    ASSERT_EQ(0, ret);
+    ProxyTarget target { .name = "Upstream", .ip = IP, .port = PORT };
+    NetOperation proxyOp { .name = "Proxy", .ip = IP, .port = PROXY_PORT, .factory = std::make_shared<ProxySessionFactory>(target) };
+    ret = proxy.startListen(proxyOp);
+    ASSERT_EQ(0, ret);
+
+    std::thread echoThread([&]() { echo.run(100); });
+    std::thread proxyThread([&]() { proxy.run(100); });
+    echo.waitListenerReady();
+    proxy.waitListenerReady();
+
+    const size_t fds = openFdsCount();
+    for (size_t i = 0; i < COUNT; i++) {
+        BlockConnector connector(IP, PROXY_PORT);
+        ret = connector.init();
+        ASSERT_EQ(0, ret);
+        auto conn_info = connector.make_connection();
+        ASSERT_TRUE(conn_info);
+        BlockConnection conn(conn_info->fd);
+
+        char data[] = "through";
+        ASSERT_EQ(sizeof(data), conn.writeAll(data, sizeof(data)));
+        char echoed[sizeof(data)];
+        ASSERT_EQ(sizeof(echoed), conn.readAll(echoed, sizeof(echoed)));
+        ASSERT_STREQ(data, echoed);
+    }
+
+    for (int i = 0; i < 200 && (proxy.stats().connectionsCount > 0 || echo.stats().connectionsCount > 0); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(0, proxy.stats().connectionsCount);
+    ASSERT_EQ(COUNT, proxy.stats().relayPairsCount);
+    ASSERT_EQ(fds, openFdsCount());
+
+    proxy.stop();
+    proxyThread.join();
+    echo.stop();
+    echoThread.join();
+}
+
+TEST(NONBLOCK_PROXY_UPSTREAM, Refused) {
+    const std::string IP = "127.0.0.1";
+    const int PROXY_PORT = 8889;
+
+    NonBlockNet proxy;
+    int ret = proxy.init();
+    ASSERT_EQ(0, ret);
+    ProxyTarget target { .name = "Upstream", .ip = IP, .port = 8888 };
+    NetOperation proxyOp { .name = "Proxy", .ip = IP, .port = PROXY_PORT, .factory = std::make_shared<ProxySessionFactory>(target) };
+    ret = proxy.startListen(proxyOp);
+    ASSERT_EQ(0, ret);
+
+    std::thread proxyThread([&]() { proxy.run(100); });
+    proxy.waitListenerReady();
+
+    BlockConnector connector(IP, PROXY_PORT);
+    ret = connector.init();
+    ASSERT_EQ(0, ret);
+    auto conn_info = connector.make_connection();
+    ASSERT_TRUE(conn_info);
+
+    // Nothing listens upstream, the client is closed.
+    char ch;
+    ASSERT_LE(read(conn_info->fd, &ch, 1), 0);
+    close(conn_info->fd);
+
+    proxy.stop();
+    proxyThread.join();
+    ASSERT_EQ(0, proxy.stats().connectionsCount);
+}
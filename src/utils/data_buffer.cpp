@@ -20,6 +20,7 @@
 #include <assert.h>
 #include <string.h>
 #include <iostream>
+#include <utility>
 
 Buffer DataBuffer::getData() {
     return Buffer {
@@ -64,6 +65,12 @@ void DataBuffer::release() {
     _offset = 0;
 }
 
+void DataBuffer::swap(DataBuffer& buffer) {
+    _data.swap(buffer._data);
+    std::swap(_offset, buffer._offset);
+    std::swap(_size, buffer._size);
+}
+
 void DataBuffer::append(DataBuffer& buffer) {
     Buffer src = buffer.getData();
     if (src.size == 0) {
@@ -17,6 +17,7 @@
  **********************************************/
 
 #pragma once
+#include <cstddef>
 #include <vector>
 
 struct Buffer {
@@ -32,7 +33,8 @@ public:
     void update(size_t increment_size);
     void used(size_t used_size);
     void release();
-    void swap(DataBuffer& buffer) { _data.swap(buffer._data); }
+    void clear() { _offset = _size = 0; }
+    void swap(DataBuffer& buffer);
     void append(DataBuffer& buffer);
     size_t size() const { return _size - _offset; }
 
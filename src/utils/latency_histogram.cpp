@@ -0,0 +1,90 @@
+/**********************************************
+   File:   latency_histogram.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "latency_histogram.h"
+#include <chrono>
+
+/*******************************************************************************
+ *   LatencyHistogram
+ */
+uint64_t LatencyHistogram::bucketLow(size_t index) {
+    if (index < SubBuckets) {
+        return index;
+    }
+
+    const unsigned shift = (index >> SubBucketBits) - 1;
+    return (SubBuckets + (index & (SubBuckets - 1))) << shift;
+}
+
+uint64_t LatencyHistogram::bucketHigh(size_t index) {
+    if (index < SubBuckets) {
+        return index;
+    }
+
+    const unsigned shift = (index >> SubBucketBits) - 1;
+    return bucketLow(index) + (1ull << shift) - 1;
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    Snapshot result;
+    result.counts.resize(BucketsCount);
+    for (size_t i = 0; i < BucketsCount; i++) {
+        result.counts[i] = _counts[i].load(std::memory_order_relaxed);
+        result.count += result.counts[i];
+    }
+    result.sum = _sum.load(std::memory_order_relaxed);
+    return result;
+}
+
+void LatencyHistogram::reset() {
+    for (auto& count: _counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    _sum.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Snapshot::percentile(double fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+
+    const uint64_t rank = std::max<uint64_t>(1, (uint64_t)(fraction * count + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return bucketHigh(i);
+        }
+    }
+
+    return bucketHigh(counts.size() - 1);
+}
+
+void LatencyHistogram::Snapshot::merge(const Snapshot& other) {
+    counts.resize(std::max(counts.size(), other.counts.size()));
+    for (size_t i = 0; i < other.counts.size(); i++) {
+        counts[i] += other.counts[i];
+    }
+    count += other.count;
+    sum += other.sum;
+}
+
+uint64_t monotonicNs() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
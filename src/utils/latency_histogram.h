@@ -0,0 +1,81 @@
+/**********************************************
+   File:   latency_histogram.h
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*******************************************************************************
+ *   LatencyHistogram counts values in log-linear buckets, HDR-style: every
+ *   power of two is split into SubBuckets equal buckets, so a value is known
+ *   within 1/SubBuckets of itself. Recording is two relaxed atomic additions,
+ *   any thread may record and read at the same time without locks. Values
+ *   from 2^MaxBits up land in the last bucket.
+ */
+class LatencyHistogram {
+public:
+    static constexpr unsigned SubBucketBits = 4;
+    static constexpr unsigned SubBuckets = 1 << SubBucketBits;
+    static constexpr unsigned MaxBits = 40; // about 18 minutes in nanoseconds
+    static constexpr size_t BucketsCount = (MaxBits - SubBucketBits + 1) << SubBucketBits;
+
+    void record(uint64_t value) {
+        _counts[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    // A copy of the counters. Taken while others record, it may be off by the
+    // values recorded during the copy.
+    struct Snapshot {
+        std::vector<uint64_t> counts;
+        uint64_t count = 0;
+        uint64_t sum = 0;
+
+        // The highest value of the bucket holding the given fraction, 0..1.
+        uint64_t percentile(double fraction) const;
+        double mean() const { return count ? (double)sum / count : 0.0; }
+        void merge(const Snapshot& other);
+    };
+
+    Snapshot snapshot() const;
+    void reset();
+
+    static size_t bucket(uint64_t value) {
+        if (value >= (1ull << MaxBits)) {
+            return BucketsCount - 1;
+        }
+        if (value < SubBuckets) {
+            return value;
+        }
+
+        const unsigned shift = 63 - __builtin_clzll(value) - SubBucketBits;
+        return ((shift + 1) << SubBucketBits) + ((value >> shift) & (SubBuckets - 1));
+    }
+    static uint64_t bucketLow(size_t index);
+    static uint64_t bucketHigh(size_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, BucketsCount> _counts{};
+    std::atomic<uint64_t> _sum = 0;
+};
+
+// Nanoseconds of the monotonic clock.
+uint64_t monotonicNs();
@@ -0,0 +1,39 @@
+/**********************************************
+   File:   mpmc_queue.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "mpmc_queue.h"
+#include "log.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+void futexWait(std::atomic<uint32_t>* word, uint32_t expected) {
+    long ret = syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+    if (ret < 0 && errno != EAGAIN && errno != EINTR) {
+        LOG_ERROR << "futexWait: failed futex(): " << strerror(errno);
+    }
+}
+
+void futexWake(std::atomic<uint32_t>* word, int count) {
+    long ret = syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+    if (ret < 0) {
+        LOG_ERROR << "futexWake: failed futex(): " << strerror(errno);
+    }
+}
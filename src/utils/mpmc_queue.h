@@ -0,0 +1,308 @@
+/**********************************************
+   File:   mpmc_queue.h
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// Blocks while *word == expected, up to a wakeup. Spurious returns are fine.
+void futexWait(std::atomic<uint32_t>* word, uint32_t expected);
+void futexWake(std::atomic<uint32_t>* word, int count);
+
+/*******************************************************************************
+ *   MpmcQueue is a bounded lock-free queue between any number of producers
+ *   and consumers, a drop-in for ThreadQueue. Each cell carries a sequence
+ *   number telling whose turn it is; producers claim cells with a CAS on the
+ *   tail, consumers with a CAS on the head.
+ *
+ *   Idle consumers park on a futex. A push wakes exactly as many of them as
+ *   it has values, and costs no syscall while nobody sleeps. A full ring
+ *   spills into an overflow list under a mutex, so push() never fails; the
+ *   FIFO order doesn't hold for the spilled values.
+ */
+template <typename T>
+class MpmcQueue {
+public:
+    MpmcQueue(size_t capacity = DefaultCapacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        _mask = size - 1;
+        _cells = std::make_unique<Cell[]>(size);
+        for (size_t i = 0; i < size; i++) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    void push(T value) {
+        size_t retries = FullRetries;
+        if (!tryStore(value, stampNs(), retries)) {
+            spill(&value, &value + 1);
+        }
+        wake(1);
+    }
+
+    // The values are moved out, the vector is left empty. Once one of them
+    // spills, so does the rest, keeping the batch in order.
+    void push_bulk(std::vector<T>& values) {
+        const int64_t now = stampNs();
+        size_t retries = FullRetries;
+        size_t stored = 0;
+        while (stored < values.size() && tryStore(values[stored], now, retries)) {
+            stored++;
+        }
+        if (stored < values.size()) {
+            spill(values.data() + stored, values.data() + values.size());
+        }
+        wake(values.size());
+        values.clear();
+    }
+
+    std::optional<T> pop() {
+        T value{};
+        if (!take(value)) {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+    // Replaces the content of out with up to max values, waiting for the
+    // first one. Leaves a share of the queue to the parked consumers.
+    // false once the queue is shut down and empty.
+    bool pop_bulk(std::vector<T>& out, size_t max) {
+        out.clear();
+        T value{};
+        if (!take(value)) {
+            return false;
+        }
+        out.push_back(std::move(value));
+
+        const size_t sleepers = _sleepers.load(std::memory_order_relaxed);
+        const size_t share = (size() + 1 + sleepers) / (sleepers + 1);
+        const size_t count = std::min(std::max<size_t>(max, 1), share);
+        while (out.size() < count && tryTake(value)) {
+            out.push_back(std::move(value));
+        }
+        return true;
+    }
+
+    // The consumers drain what's left, then pop() returns nothing.
+    void shutdown() {
+        _done.store(true, std::memory_order_seq_cst);
+        _epoch.fetch_add(1, std::memory_order_seq_cst);
+        futexWake(&_epoch, INT32_MAX);
+    }
+
+    // Both read without synchronization, for admission decisions. The values
+    // may be a moment old.
+    size_t size() const {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        const size_t head = _head.load(std::memory_order_relaxed);
+        return (tail > head ? tail - head : 0) + _overflowSize.load(std::memory_order_relaxed);
+    }
+
+    // Pushes read the clock only after this, headWait() is 0 until then.
+    void trackWait() {
+        if (!_trackWait.load(std::memory_order_relaxed)) {
+            _trackWait.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    // How long the oldest value of the ring has been waiting, 0 when empty.
+    std::chrono::nanoseconds headWait() const {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        const Cell& cell = _cells[head & _mask];
+        if (cell.sequence.load(std::memory_order_acquire) != head + 1) {
+            return std::chrono::nanoseconds(0);
+        }
+        const int64_t since = cell.since.load(std::memory_order_relaxed);
+        return std::chrono::nanoseconds(since == 0 ? 0 : std::max<int64_t>(0, clockNs() - since));
+    }
+
+    size_t capacity() const { return _mask + 1; }
+    size_t parksCount() const { return _parks.load(std::memory_order_relaxed); }
+    size_t wakeupsCount() const { return _wakeups.load(std::memory_order_relaxed); }
+    size_t overflowsCount() const { return _overflows.load(std::memory_order_relaxed); }
+
+    static constexpr size_t DefaultCapacity = 4096;
+    static constexpr size_t FullRetries = 16;
+    static constexpr size_t SpinRounds = 4;   // yields before parking
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        std::atomic<int64_t> since = 0;
+        T value{};
+    };
+
+    void spill(T* first, T* last) {
+        std::lock_guard lock(_overflowMutex);
+        for (T* value = first; value != last; value++) {
+            _overflow.push_back(std::move(*value));
+        }
+        _overflowSize.store(_overflow.size(), std::memory_order_release);
+        _overflows.fetch_add(last - first, std::memory_order_relaxed);
+    }
+
+    // A full ring is given a few chances to drain before spilling. The
+    // retries are shared by the values of one push, not given to each.
+    bool tryStore(T& value, int64_t now, size_t& retries) {
+        size_t pos = _tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = _cells[pos & _mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.since.store(now, std::memory_order_relaxed);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // A lap behind: full.
+                if (retries == 0) {
+                    return false;
+                }
+                retries--;
+                std::this_thread::yield();
+                pos = _tail.load(std::memory_order_relaxed);
+            } else {
+                pos = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryTake(T& value) {
+        size_t pos = _head.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = _cells[pos & _mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(pos + _mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // Empty, or the producer of the cell isn't done yet.
+                break;
+            } else {
+                pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+
+        if (_overflowSize.load(std::memory_order_acquire) == 0) {
+            return false;
+        }
+
+        std::lock_guard lock(_overflowMutex);
+        if (_overflow.empty()) {
+            return false;
+        }
+        value = std::move(_overflow.front());
+        _overflow.pop_front();
+        _overflowSize.store(_overflow.size(), std::memory_order_release);
+        return true;
+    }
+
+    // Blocks until a value is taken, false once shut down and empty.
+    bool take(T& value) {
+        for (size_t i = 0; i < SpinRounds; i++) {
+            if (tryTake(value)) {
+                return true;
+            }
+            std::this_thread::yield();
+        }
+
+        for (;;) {
+            const uint32_t epoch = _epoch.load(std::memory_order_acquire);
+            // Pairs with the fence in wake(): either this thread sees the
+            // value, or the producer sees it sleeping and moves the epoch.
+            _sleepers.fetch_add(1, std::memory_order_seq_cst);
+            if (tryTake(value)) {
+                _sleepers.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+            if (_done.load(std::memory_order_seq_cst)) {
+                _sleepers.fetch_sub(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            _parks.fetch_add(1, std::memory_order_relaxed);
+            futexWait(&_epoch, epoch);
+            _sleepers.fetch_sub(1, std::memory_order_relaxed);
+            if (tryTake(value)) {
+                return true;
+            }
+        }
+    }
+
+    void wake(size_t count) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const size_t sleepers = _sleepers.load(std::memory_order_relaxed);
+        if (sleepers == 0 || count == 0) {
+            return;
+        }
+
+        _epoch.fetch_add(1, std::memory_order_release);
+        futexWake(&_epoch, (int)std::min<size_t>(count, INT32_MAX));
+        _wakeups.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    int64_t stampNs() const {
+        return _trackWait.load(std::memory_order_relaxed) ? clockNs() : 0;
+    }
+
+    static int64_t clockNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    std::unique_ptr<Cell[]> _cells;
+    size_t _mask = 0;
+    std::atomic<bool> _trackWait = false;
+
+    // Producers, consumers and the parking on separate cache lines.
+    alignas(64) std::atomic<size_t> _tail = 0;
+    alignas(64) std::atomic<size_t> _head = 0;
+    alignas(64) std::atomic<uint32_t> _epoch = 0;
+    std::atomic<size_t> _sleepers = 0;
+    std::atomic<bool> _done = false;
+    alignas(64) std::atomic<size_t> _overflowSize = 0;
+    std::mutex _overflowMutex;
+    std::deque<T> _overflow;
+    std::atomic<size_t> _parks = 0;
+    std::atomic<size_t> _wakeups = 0;
+    std::atomic<size_t> _overflows = 0;
+};
@@ -0,0 +1,70 @@
+/**********************************************
+   File:   mpsc_ring.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "mpsc_ring.h"
+#include "log.h"
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+PipeResult initEventFd(int* fd) {
+    *fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (*fd < 0) {
+        LOG_ERROR << "initEventFd: failed eventfd(): " << strerror(errno);
+        return PipeResult{ -1, errno };
+    }
+
+    return PipeResult{ 0, 0 };
+}
+
+void closeEventFd(int fd) {
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+void raiseEventFd(int fd) {
+    uint64_t value = 1;
+    if (::write(fd, &value, sizeof(value)) != sizeof(value)) {
+        LOG_ERROR << "raiseEventFd: failed write(): " << strerror(errno);
+    }
+}
+
+void clearEventFd(int fd) {
+    uint64_t value = 0;
+    if (::read(fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        LOG_ERROR << "clearEventFd: failed read(): " << strerror(errno);
+    }
+}
+
+int waitEventFd(int fd, int time_ms) {
+    pollfd pfd { .fd = fd, .events = POLLIN, .revents = 0 };
+    for (;;) {
+        int ret = poll(&pfd, 1, time_ms);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (ret < 0) {
+            LOG_ERROR << "waitEventFd: failed poll(): " << strerror(errno);
+        }
+        return ret;
+    }
+}
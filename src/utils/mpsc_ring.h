@@ -0,0 +1,227 @@
+/**********************************************
+   File:   mpsc_ring.h
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#pragma once
+#include "pipe_queue.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+PipeResult initEventFd(int* fd);
+void closeEventFd(int fd);
+void raiseEventFd(int fd);
+void clearEventFd(int fd);
+int waitEventFd(int fd, int time_ms);
+
+/*******************************************************************************
+ *   MpscRing is a bounded lock-free queue of pointers from any number of
+ *   threads to one consumer. Each slot carries a sequence number telling
+ *   whose turn it is, producers claim slots with a CAS on the tail.
+ *
+ *   The consumer is woken through an eventfd, and only when it's going to
+ *   block: arm() before waiting, disarm() after. Pushes meanwhile cost no
+ *   syscall. A full ring spills into an overflow list under a mutex, so
+ *   nothing is lost, and the items of one producer keep their order.
+ */
+template <typename T>
+class MpscRing {
+public:
+    MpscRing(size_t capacity = DefaultCapacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        _mask = size - 1;
+        _slots = std::make_unique<Slot[]>(size);
+        for (size_t i = 0; i < size; i++) {
+            _slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MpscRing() {
+        closeEventFd(_eventFd);
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    PipeResult init() {
+        return initEventFd(&_eventFd);
+    }
+
+    // Any thread.
+    void push(T* item) {
+        if (_spilling.load(std::memory_order_acquire) || !tryPush(item, FullRetries)) {
+            std::lock_guard lock(_overflowMutex);
+            _overflow.push_back(item);
+            _spilling.store(true, std::memory_order_release);
+            _overflows.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Pairs with the fence in arm(): either the consumer sees the item,
+        // or this thread sees it armed.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_armed.load(std::memory_order_relaxed) && _armed.exchange(false)) {
+            raiseEventFd(_eventFd);
+            _wakeups.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Consumer. nullptr when nothing is ready.
+    T* next() {
+        if (_spilledPos < _spilled.size()) {
+            return _spilled[_spilledPos++];
+        }
+
+        if (T* item = pop()) {
+            return item;
+        }
+
+        // The spilled items come after everything claimed in the ring.
+        if (!_spilling.load(std::memory_order_acquire) || _tail.load(std::memory_order_acquire) != _head) {
+            return nullptr;
+        }
+
+        _spilled.clear();
+        _spilledPos = 0;
+        {
+            std::lock_guard lock(_overflowMutex);
+            _spilled.swap(_overflow);
+            _spilling.store(false, std::memory_order_release);
+        }
+
+        return _spilled.empty() ? nullptr : _spilled[_spilledPos++];
+    }
+
+    // Consumer. Blocks until an item is ready, nullptr on timeout.
+    T* wait(int time_ms) {
+        for (;;) {
+            if (T* item = next()) {
+                return item;
+            }
+
+            if (!arm()) {
+                continue;
+            }
+
+            const int ret = waitEventFd(_eventFd, time_ms);
+            disarm();
+            if (ret <= 0) {
+                return next();
+            }
+            clearWakeup();
+        }
+    }
+
+    // Consumer. Items claimed or spilled, maybe not published yet.
+    bool empty() const {
+        return _spilledPos == _spilled.size() && _tail.load(std::memory_order_acquire) == _head &&
+               !_spilling.load(std::memory_order_acquire);
+    }
+
+    // Consumer, before blocking on getReadFd(). False when there are items
+    // already: don't block then.
+    bool arm() {
+        _armed.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!empty()) {
+            _armed.store(false, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    void disarm() { _armed.store(false, std::memory_order_relaxed); }
+
+    // Consumer, once the eventfd fired.
+    void clearWakeup() { clearEventFd(_eventFd); }
+
+    int getReadFd() const { return _eventFd; }
+    size_t capacity() const { return _mask + 1; }
+    size_t wakeupsCount() const { return _wakeups.load(std::memory_order_relaxed); }
+    size_t overflowsCount() const { return _overflows.load(std::memory_order_relaxed); }
+
+    static constexpr size_t DefaultCapacity = 4096;
+    static constexpr size_t FullRetries = 16;
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T* item = nullptr;
+    };
+
+    // A full ring is given a few chances to drain before spilling: once one
+    // item spills, everything after it does too until the consumer catches up.
+    bool tryPush(T* item, size_t retries) {
+        size_t pos = _tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = _slots[pos & _mask];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.item = item;
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // A lap behind: full.
+                if (retries-- == 0) {
+                    return false;
+                }
+                std::this_thread::yield();
+                pos = _tail.load(std::memory_order_relaxed);
+            } else {
+                pos = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    T* pop() {
+        Slot& slot = _slots[_head & _mask];
+        if (slot.sequence.load(std::memory_order_acquire) != _head + 1) {
+            return nullptr;
+        }
+
+        T* item = slot.item;
+        slot.sequence.store(_head + _mask + 1, std::memory_order_release);
+        _head++;
+        return item;
+    }
+
+    std::unique_ptr<Slot[]> _slots;
+    size_t _mask = 0;
+
+    // Producers and the consumer on separate cache lines.
+    alignas(64) std::atomic<size_t> _tail = 0;
+    alignas(64) size_t _head = 0;
+    std::vector<T*> _spilled;
+    size_t _spilledPos = 0;
+    alignas(64) std::atomic<bool> _armed = false;
+    std::atomic<bool> _spilling = false;
+    std::mutex _overflowMutex;
+    std::vector<T*> _overflow;
+    std::atomic<size_t> _wakeups = 0;
+    std::atomic<size_t> _overflows = 0;
+    int _eventFd = -1;
+};
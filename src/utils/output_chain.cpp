@@ -0,0 +1,227 @@
+/**********************************************
+   File:   output_chain.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "output_chain.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*******************************************************************************
+ *   OutputFile
+ */
+OutputFile::~OutputFile() {
+    close(_fd);
+}
+
+std::shared_ptr<const OutputFile> OutputFile::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return nullptr;
+    }
+
+    return std::make_shared<const OutputFile>(fd, (size_t)st.st_size);
+}
+
+/*******************************************************************************
+ *   OutputChain
+ */
+
+void OutputChain::push(Owner owner, const char* ptr, size_t size) {
+    _segments.push_back(Segment{ .owner = std::move(owner), .ptr = ptr, .size = size });
+    _size += size;
+}
+
+void OutputChain::append(const char* ptr, size_t size) {
+    if (size == 0) {
+        return;
+    }
+
+    // Large pieces get a segment of their own: one copy, no chunk waste.
+    if (size > MaxCopySize) {
+        append(std::make_shared<const std::string>(ptr, size));
+        return;
+    }
+
+    if (!_chunk || _chunkUsed + size > _chunk->size()) {
+        _chunk = std::make_shared<Chunk>(ChunkSize);
+        _chunkUsed = 0;
+    }
+
+    char* dest = _chunk->data() + _chunkUsed;
+    memcpy(dest, ptr, size);
+    _chunkUsed += size;
+
+    // Extend the last segment, if it ends right where this piece starts.
+    if (!_segments.empty()) {
+        Segment& last = _segments.back();
+        if (last.owner.get() == _chunk.get() && last.ptr + last.size == dest) {
+            last.size += size;
+            _size += size;
+            return;
+        }
+    }
+
+    push(_chunk, dest, size);
+}
+
+void OutputChain::append(std::shared_ptr<const std::string> data) {
+    if (!data || data->empty()) {
+        return;
+    }
+
+    const char* ptr = data->data();
+    const size_t size = data->size();
+    push(std::move(data), ptr, size);
+}
+
+void OutputChain::append(Owner owner, const char* ptr, size_t size) {
+    if (size == 0) {
+        return;
+    }
+
+    push(std::move(owner), ptr, size);
+}
+
+void OutputChain::appendStatic(const char* ptr, size_t size) {
+    if (size == 0) {
+        return;
+    }
+
+    push(nullptr, ptr, size);
+}
+
+void OutputChain::appendFile(std::shared_ptr<const OutputFile> file, off_t offset, size_t size) {
+    if (!file || size == 0) {
+        return;
+    }
+
+    const int fd = file->fd();
+    push(std::move(file), nullptr, size);
+    _segments.back().fd = fd;
+    _segments.back().offset = offset;
+}
+
+void OutputChain::splice(OutputChain& other) {
+    for (auto& segment: other._segments) {
+        _segments.push_back(std::move(segment));
+    }
+    _size += other._size;
+
+    other._segments.clear();
+    other._size = 0;
+}
+
+size_t OutputChain::fill(iovec* iov, size_t maxCount) const {
+    size_t count = 0;
+    for (const auto& segment: _segments) {
+        if (count == maxCount || segment.fd != -1) {
+            break;
+        }
+
+        iov[count].iov_base = const_cast<char*>(segment.ptr);
+        iov[count].iov_len = segment.size;
+        count++;
+    }
+
+    return count;
+}
+
+std::optional<OutputChain::FileSlice> OutputChain::frontFile() const {
+    if (_segments.empty() || _segments.front().fd == -1) {
+        return {};
+    }
+
+    const Segment& first = _segments.front();
+    return FileSlice{ .fd = first.fd, .offset = first.offset, .size = first.size };
+}
+
+size_t OutputChain::describe(Slice* slices, size_t maxCount) const {
+    size_t count = 0;
+    for (const auto& segment: _segments) {
+        if (count == maxCount) {
+            break;
+        }
+
+        slices[count++] = Slice{ .ptr = segment.ptr, .size = segment.size, .fd = segment.fd, .offset = segment.offset };
+    }
+
+    return count;
+}
+
+void OutputChain::used(size_t size, std::vector<Owner>* owners) {
+    assert(size <= _size);
+    _size -= size;
+
+    while (size > 0) {
+        Segment& first = _segments.front();
+        if (owners != nullptr && first.owner && (owners->empty() || owners->back() != first.owner)) {
+            owners->push_back(first.owner);
+        }
+
+        if (size < first.size) {
+            if (first.fd != -1) {
+                first.offset += size;
+            } else {
+                first.ptr += size;
+            }
+            first.size -= size;
+            break;
+        }
+
+        size -= first.size;
+        _segments.pop_front();
+    }
+
+    // Nobody else refers to the chunk any more, start filling it from the beginning.
+    if (_segments.empty() && _chunk && _chunk.use_count() == 1) {
+        _chunkUsed = 0;
+    }
+}
+
+void OutputChain::clear() {
+    _segments.clear();
+    _size = 0;
+    _chunk.reset();
+    _chunkUsed = 0;
+}
+
+std::string OutputChain::toString() const {
+    std::string result;
+    result.reserve(_size);
+    for (const auto& segment: _segments) {
+        if (segment.fd == -1) {
+            result.append(segment.ptr, segment.size);
+            continue;
+        }
+
+        const size_t pos = result.size();
+        result.resize(pos + segment.size);
+        ssize_t ret = pread(segment.fd, result.data() + pos, segment.size, segment.offset);
+        result.resize(pos + (ret > 0 ? ret : 0));
+    }
+
+    return result;
+}
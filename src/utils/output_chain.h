@@ -0,0 +1,139 @@
+/**********************************************
+   File:   output_chain.h
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <optional>
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/*******************************************************************************
+ *   OutputFile is an open read-only file shared by output segments. The file
+ *   is closed with the last reference.
+ */
+class OutputFile {
+public:
+    OutputFile(int fd, size_t size) : _fd(fd), _size(size) {}
+    ~OutputFile();
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    int fd() const { return _fd; }
+    size_t size() const { return _size; }
+
+    // Returns nullptr if the file can't be opened or is not a regular file.
+    static std::shared_ptr<const OutputFile> open(const std::string& path);
+
+private:
+    const int _fd;
+    const size_t _size;
+};
+
+/*******************************************************************************
+ *   OutputChain is a queue of data segments waiting to be written to a socket.
+ *   A segment references memory owned by a refcounted object, or static memory,
+ *   so large bodies and canned responses are queued without copying and sent
+ *   with one writev/sendmsg. Small pieces (headers, lengths) are copied and
+ *   packed together into shared chunks. A file segment is a range of an open
+ *   file, sent with sendfile() and never read into user space.
+ */
+class OutputChain {
+public:
+    // Copies data. Pieces up to MaxCopySize share chunks of ChunkSize bytes.
+    void append(const char* ptr, size_t size);
+
+    using Owner = std::shared_ptr<const void>;
+
+    // References data without copying. The chain keeps the owner alive.
+    void append(std::shared_ptr<const std::string> data);
+    void append(Owner owner, const char* ptr, size_t size);
+
+    // References data living until the end of the program.
+    void appendStatic(const char* ptr, size_t size);
+
+    // Moves the segments of other to the end of this chain. other keeps its
+    // chunk and goes on filling it, the memory taken away stays as it is.
+    void splice(OutputChain& other);
+
+    // Queues size bytes of the file starting at offset.
+    void appendFile(std::shared_ptr<const OutputFile> file, off_t offset, size_t size);
+
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    size_t segmentsCount() const { return _segments.size(); }
+
+    // Describes up to maxCount leading memory segments, stops at a file segment.
+    // Returns the number of entries filled.
+    size_t fill(iovec* iov, size_t maxCount) const;
+
+    struct FileSlice {
+        int fd;
+        off_t offset;
+        size_t size;
+    };
+
+    // The leading segment, when it is a file one.
+    std::optional<FileSlice> frontFile() const;
+
+    struct Slice {
+        const char* ptr;  // memory segments
+        size_t size;
+        int fd;           // file segments, -1 for memory ones
+        off_t offset;
+    };
+
+    // Describes up to maxCount leading segments, memory and file ones alike.
+    // Returns the number of entries filled.
+    size_t describe(Slice* slices, size_t maxCount) const;
+
+    // Drops size bytes from the front of the chain. When owners is given, it
+    // receives references to the memory of those bytes, e.g. to keep it alive
+    // until a zero-copy send completes.
+    void used(size_t size, std::vector<Owner>* owners = nullptr);
+    void clear();
+
+    // Copy of the whole content. For testing purposes.
+    std::string toString() const;
+
+    static constexpr size_t ChunkSize = 16 * 1024;
+    static constexpr size_t MaxCopySize = ChunkSize / 4;
+
+private:
+    struct Segment {
+        Owner owner;
+        const char* ptr;
+        size_t size;
+        int fd = -1;      // file segments only
+        off_t offset = 0;
+    };
+
+    std::deque<Segment> _segments;
+    size_t _size = 0;
+
+    using Chunk = std::vector<char>;
+    std::shared_ptr<Chunk> _chunk;
+    size_t _chunkUsed = 0;
+
+private:
+    void push(Owner owner, const char* ptr, size_t size);
+};
@@ -16,12 +16,16 @@
    limitations under the License.
  **********************************************/
 #pragma once
+#include <algorithm>
 #include <iostream>
 #include <queue>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <optional>
+#include <vector>
 
 template<typename T>
 class ThreadQueue {
@@ -29,32 +33,135 @@ public:
     ThreadQueue() : _done(false) {}
 
     void push(T value) {
+        const int64_t now = stampNs();
         std::unique_lock<std::mutex> lock(_mtx);
-        _queue.push(std::move(value));
+        if (_queue.empty()) {
+            _headSince.store(now, std::memory_order_relaxed);
+        }
+        _queue.push(Entry{ std::move(value), now });
+        _size.store(_queue.size(), std::memory_order_relaxed);
         _cv.notify_one();
     }
 
+    // Takes the lock and signals the waiters once for the whole batch. The
+    // values are moved out, the vector is left empty.
+    void push_bulk(std::vector<T>& values) {
+        if (values.empty()) {
+            return;
+        }
+
+        const int64_t now = stampNs();
+        std::unique_lock<std::mutex> lock(_mtx);
+        if (_queue.empty()) {
+            _headSince.store(now, std::memory_order_relaxed);
+        }
+        for (auto& value: values) {
+            _queue.push(Entry{ std::move(value), now });
+        }
+        _size.store(_queue.size(), std::memory_order_relaxed);
+
+        // Nobody to wake beyond the sleeping consumers.
+        const size_t wake = std::min(values.size(), _waiting);
+        if (wake == _waiting) {
+            _cv.notify_all();
+        } else {
+            for (size_t i = 0; i < wake; i++) {
+                _cv.notify_one();
+            }
+        }
+        lock.unlock();
+        values.clear();
+    }
+
     std::optional<T> pop() {
         std::unique_lock<std::mutex> lock(_mtx);
-        _cv.wait(lock, [&] { return !_queue.empty() || _done; });
+        wait(lock);
 
         if (_queue.empty())
             return std::nullopt;
 
-        T value = std::move(_queue.front());
+        T value = std::move(_queue.front().value);
         _queue.pop();
+        _size.store(_queue.size(), std::memory_order_relaxed);
+        _headSince.store(_queue.empty() ? 0 : _queue.front().since, std::memory_order_relaxed);
         return value;
     }
 
+    // Replaces the content of out with up to max values, waiting for the
+    // first one. Leaves a share of the queue to the other sleeping consumers,
+    // so one wakeup doesn't drain the whole batch into a single thread.
+    // false once the queue is shut down and empty.
+    bool pop_bulk(std::vector<T>& out, size_t max) {
+        out.clear();
+        std::unique_lock<std::mutex> lock(_mtx);
+        wait(lock);
+
+        if (_queue.empty())
+            return false;
+
+        const size_t share = (_queue.size() + _waiting) / (_waiting + 1);
+        const size_t count = std::min(std::max<size_t>(max, 1), share);
+        for (size_t i = 0; i < count; i++) {
+            out.push_back(std::move(_queue.front().value));
+            _queue.pop();
+        }
+        _size.store(_queue.size(), std::memory_order_relaxed);
+        _headSince.store(_queue.empty() ? 0 : _queue.front().since, std::memory_order_relaxed);
+        return true;
+    }
+
     void shutdown() {
         std::unique_lock<std::mutex> lock(_mtx);
         _done = true;
         _cv.notify_all();
     }
 
+    // Both read without the lock, for admission decisions. The values may be
+    // a moment old.
+    size_t size() const { return _size.load(std::memory_order_relaxed); }
+
+    // Pushes read the clock only after this, headWait() is 0 until then.
+    // Values already queued stay unstamped.
+    void trackWait() {
+        if (!_trackWait.load(std::memory_order_relaxed)) {
+            _trackWait.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    // How long the oldest element has been waiting, 0 for an empty queue.
+    std::chrono::nanoseconds headWait() const {
+        const int64_t since = _headSince.load(std::memory_order_relaxed);
+        return std::chrono::nanoseconds(since == 0 ? 0 : clockNs() - since);
+    }
+
+private:
+    struct Entry {
+        T value;
+        int64_t since;
+    };
+
+    void wait(std::unique_lock<std::mutex>& lock) {
+        _waiting++;
+        _cv.wait(lock, [&] { return !_queue.empty() || _done; });
+        _waiting--;
+    }
+
+    int64_t stampNs() const {
+        return _trackWait.load(std::memory_order_relaxed) ? clockNs() : 0;
+    }
+
+    static int64_t clockNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
 private:
-    std::queue<T> _queue;
+    std::queue<Entry> _queue;
     std::mutex _mtx;
     std::condition_variable _cv;
     bool _done;
+    size_t _waiting = 0;  // consumers blocked in pop(), under the lock
+    std::atomic<size_t> _size = 0;
+    std::atomic<int64_t> _headSince = 0;
+    std::atomic<bool> _trackWait = false;
 };
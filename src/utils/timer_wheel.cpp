@@ -0,0 +1,199 @@
+/**********************************************
+   File:   timer_wheel.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "timer_wheel.h"
+#include <assert.h>
+#include <chrono>
+
+/*******************************************************************************
+ *   Timer
+ */
+void Timer::cancel() {
+    if (_wheel != nullptr) {
+        _wheel->_size--;
+        unlink();
+    }
+}
+
+void Timer::unlink() {
+    _prev->_next = _next;
+    _next->_prev = _prev;
+    _prev = nullptr;
+    _next = nullptr;
+    _wheel = nullptr;
+}
+
+/*******************************************************************************
+ *   TimerWheel
+ */
+TimerWheel::TimerWheel(uint64_t now) : _now(now) {
+    for (auto& level: _slots) {
+        for (auto& head: level) {
+            head._prev = &head;
+            head._next = &head;
+        }
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    for (auto& level: _slots) {
+        for (auto& head: level) {
+            while (head._next != &head) {
+                head._next->unlink();
+            }
+        }
+    }
+}
+
+uint64_t TimerWheel::clock() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+}
+
+void TimerWheel::link(Timer* head, Timer* timer) {
+    timer->_prev = head->_prev;
+    timer->_next = head;
+    head->_prev->_next = timer;
+    head->_prev = timer;
+}
+
+void TimerWheel::arm(Timer* timer, uint64_t deadline) {
+    timer->cancel();
+    timer->_deadline = deadline;
+    timer->_wheel = this;
+    _size++;
+    place(timer);
+}
+
+void TimerWheel::place(Timer* timer) {
+    // The current tick has been fired already.
+    const uint64_t deadline = timer->_deadline > _now ? timer->_deadline : _now + 1;
+    const uint64_t delta = deadline - _now;
+
+    for (unsigned level = 0; level < Levels; level++) {
+        const unsigned shift = level * SlotBits;
+        if (delta < ((uint64_t)Slots << shift)) {
+            link(&_slots[level][(deadline >> shift) & (Slots - 1)], timer);
+            return;
+        }
+    }
+
+    // Too far. Park in the top level slot that cascades last.
+    const unsigned shift = (Levels - 1) * SlotBits;
+    link(&_slots[Levels - 1][((_now >> shift) - 1) & (Slots - 1)], timer);
+}
+
+void TimerWheel::cascade(unsigned level) {
+    const unsigned shift = level * SlotBits;
+    Timer* head = &_slots[level][(_now >> shift) & (Slots - 1)];
+
+    while (head->_next != head) {
+        Timer* timer = head->_next;
+        timer->_prev->_next = timer->_next;
+        timer->_next->_prev = timer->_prev;
+
+        // Due at this very tick, which is about to fire.
+        if (timer->_deadline <= _now) {
+            link(&_slots[0][_now & (Slots - 1)], timer);
+        } else {
+            place(timer);
+        }
+    }
+}
+
+size_t TimerWheel::advance(uint64_t now) {
+    size_t fired = 0;
+
+    while (_now < now) {
+        if (_size == 0) {
+            _now = now;
+            break;
+        }
+
+        _now++;
+
+        // Upper levels first: they may drop timers into a lower level slot
+        // which cascades at the same tick.
+        unsigned top = 0;
+        while (top + 1 < Levels && (_now & (((uint64_t)1 << ((top + 1) * SlotBits)) - 1)) == 0) {
+            top++;
+        }
+
+        for (unsigned level = top; level > 0; level--) {
+            cascade(level);
+        }
+
+        // Detach the slot first, callbacks may re-arm into the wheel.
+        Timer* head = &_slots[0][_now & (Slots - 1)];
+        if (head->_next == head) {
+            continue;
+        }
+
+        Timer expired;
+        expired._next = head->_next;
+        expired._prev = head->_prev;
+        expired._next->_prev = &expired;
+        expired._prev->_next = &expired;
+        head->_next = head;
+        head->_prev = head;
+
+        while (expired._next != &expired) {
+            Timer* timer = expired._next;
+            assert(timer->_deadline <= _now);
+            _size--;
+            timer->unlink();
+            fired++;
+
+            // The callback may delete the timer's owner.
+            if (timer->_callback) {
+                timer->_callback();
+            }
+        }
+    }
+
+    return fired;
+}
+
+int64_t TimerWheel::nextTimeout(uint64_t now) const {
+    if (_size == 0) {
+        return -1;
+    }
+
+    const int64_t behind = now > _now ? (int64_t)(now - _now) : 0;
+    int64_t best = -1;
+
+    for (unsigned level = 0; level < Levels; level++) {
+        const unsigned shift = level * SlotBits;
+        const uint64_t slot = _now >> shift;
+
+        // Level 0 fires the slot of the tick, upper levels cascade it at the
+        // start of the slot, so look from the next one.
+        for (unsigned i = 1; i <= Slots; i++) {
+            const Timer* head = &_slots[level][(slot + i) & (Slots - 1)];
+            if (head->_next != head) {
+                const int64_t timeout = (int64_t)(((slot + i) << shift) - _now);
+                if (best < 0 || timeout < best) {
+                    best = timeout;
+                }
+                break;
+            }
+        }
+    }
+
+    return best > behind ? best - behind : 0;
+}
@@ -0,0 +1,110 @@
+/**********************************************
+   File:   timer_wheel.h
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+class TimerWheel;
+
+/*******************************************************************************
+ *   Timer is a node of a TimerWheel. It's owned by the user and linked into a
+ *   slot of the wheel while armed, so arming and cancelling are O(1) with no
+ *   allocation. A destroyed timer cancels itself.
+ */
+class Timer {
+    friend class TimerWheel;
+public:
+    using Callback = std::function<void()>;
+
+    Timer() = default;
+    explicit Timer(Callback callback) : _callback(std::move(callback)) {}
+    ~Timer() { cancel(); }
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    void setCallback(Callback callback) { _callback = std::move(callback); }
+
+    bool armed() const { return _wheel != nullptr; }
+    uint64_t deadline() const { return _deadline; }
+    void cancel();
+
+private:
+    Timer* _prev = nullptr;
+    Timer* _next = nullptr;
+    TimerWheel* _wheel = nullptr;
+    uint64_t _deadline = 0;
+    Callback _callback;
+
+    void unlink();
+};
+
+/*******************************************************************************
+ *   TimerWheel is a hierarchical timing wheel with a millisecond tick. Level 0
+ *   has one slot per tick, every next level has slots Slots times wider. Timers
+ *   of the upper levels cascade down when the lower level wraps around.
+ *   Deadlines beyond the top level wait in its farthest slot and get placed
+ *   again when it cascades. The wheel is not thread-safe.
+ */
+class TimerWheel {
+public:
+    TimerWheel(uint64_t now = 0);
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Re-arms the timer if it's armed already. Deadlines in the past fire with
+    // the next tick.
+    void arm(Timer* timer, uint64_t deadline);
+    void armAfter(Timer* timer, uint64_t delay) { arm(timer, _now + delay); }
+    void cancel(Timer* timer) { timer->cancel(); }
+
+    // Moves the time forward and fires expired timers. Callbacks may arm and
+    // cancel timers, including the one being fired. Returns the fired count.
+    size_t advance(uint64_t now);
+
+    // Milliseconds from now to the next slot with timers, -1 if there are
+    // none. It may come earlier than the deadline, when an upper level slot
+    // cascades.
+    int64_t nextTimeout(uint64_t now) const;
+
+    uint64_t now() const { return _now; }
+    size_t size() const { return _size; }
+
+    // Milliseconds of the monotonic clock.
+    static uint64_t clock();
+
+    static constexpr unsigned SlotBits = 6;
+    static constexpr unsigned Slots = 1 << SlotBits;
+    static constexpr unsigned Levels = 4;
+
+private:
+    friend class Timer;
+
+    // Slots are circular lists with a sentinel head.
+    Timer _slots[Levels][Slots];
+    uint64_t _now = 0;
+    size_t _size = 0;
+
+    void place(Timer* timer);
+    void cascade(unsigned level);
+    static void link(Timer* head, Timer* timer);
+};
@@ -0,0 +1,103 @@
+/**********************************************
+   File:   utest_latency_histogram.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "latency_histogram.h"
+#include "gtest/gtest.h"
+#include <random>
+#include <thread>
+#include <vector>
+
+TEST(LATENCY_HISTOGRAM, Buckets) {
+    // Small values are exact, larger ones share a bucket with their neighbours.
+    for (uint64_t v = 0; v < LatencyHistogram::SubBuckets; v++) {
+        ASSERT_EQ(v, LatencyHistogram::bucket(v));
+    }
+
+    size_t last = 0;
+    for (uint64_t v = 1; v < (1u << 20); v++) {
+        const size_t index = LatencyHistogram::bucket(v);
+        ASSERT_TRUE(index == last || index == last + 1) << v;
+        ASSERT_LE(LatencyHistogram::bucketLow(index), v);
+        ASSERT_GE(LatencyHistogram::bucketHigh(index), v);
+        last = index;
+    }
+
+    // Relative error is bounded by 1/SubBuckets.
+    for (uint64_t v: { 1000ull, 123456ull, 987654321ull }) {
+        const size_t index = LatencyHistogram::bucket(v);
+        const uint64_t width = LatencyHistogram::bucketHigh(index) - LatencyHistogram::bucketLow(index) + 1;
+        ASSERT_LE(width * LatencyHistogram::SubBuckets, v);
+    }
+
+    ASSERT_EQ(LatencyHistogram::BucketsCount - 1, LatencyHistogram::bucket(~0ull));
+}
+
+TEST(LATENCY_HISTOGRAM, Percentiles) {
+    LatencyHistogram histogram;
+    for (uint64_t v = 1; v <= 10000; v++) {
+        histogram.record(v * 1000);
+    }
+
+    auto s = histogram.snapshot();
+    ASSERT_EQ(10000, s.count);
+    ASSERT_NEAR(5000500.0, s.mean(), 1.0);
+
+    for (double p: { 0.5, 0.9, 0.99, 0.999 }) {
+        const double expected = p * 10000 * 1000;
+        ASSERT_GE(s.percentile(p), expected);
+        ASSERT_LE(s.percentile(p), expected * (1.0 + 1.0 / LatencyHistogram::SubBuckets));
+    }
+
+    histogram.reset();
+    ASSERT_EQ(0, histogram.snapshot().count);
+    ASSERT_EQ(0, histogram.snapshot().percentile(0.99));
+}
+
+TEST(LATENCY_HISTOGRAM, Concurrent) {
+    const size_t THREADS = 4;
+    const size_t COUNT = 100000;
+
+    LatencyHistogram histogram;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < THREADS; t++) {
+        threads.emplace_back([&histogram, t]() {
+            std::mt19937_64 rng(t);
+            for (size_t i = 0; i < COUNT; i++) {
+                histogram.record(rng() % 1000000);
+            }
+        });
+    }
+
+    // Readers see a consistent enough picture while the writers go on.
+    for (size_t i = 0; i < 10; i++) {
+        ASSERT_LE(histogram.snapshot().count, THREADS * COUNT);
+    }
+
+    for (auto& t: threads) {
+        t.join();
+    }
+
+    auto s = histogram.snapshot();
+    ASSERT_EQ(THREADS * COUNT, s.count);
+
+    LatencyHistogram::Snapshot merged;
+    merged.merge(s);
+    merged.merge(s);
+    ASSERT_EQ(2 * s.count, merged.count);
+    ASSERT_EQ(s.percentile(0.5), merged.percentile(0.5));
+}
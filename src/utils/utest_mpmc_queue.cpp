@@ -0,0 +1,167 @@
+/**********************************************
+   File:   utest_mpmc_queue.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "mpmc_queue.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST(UTILS, MpmcQueueBasic) {
+    MpmcQueue<size_t> queue(8);
+    ASSERT_EQ(8, queue.capacity());
+    ASSERT_EQ(0, queue.size());
+    ASSERT_EQ(0, queue.headWait().count());
+
+    for (size_t k = 0; k < 3; k++) {
+        for (size_t i = 0; i < 8; i++) {
+            queue.push(i);
+        }
+        ASSERT_EQ(8, queue.size());
+        for (size_t i = 0; i < 8; i++) {
+            ASSERT_EQ(i, queue.pop().value());
+        }
+        ASSERT_EQ(0, queue.size());
+    }
+
+    // Past the capacity the rest of the batch spills, nothing is lost and
+    // the batch keeps its order.
+    std::vector<size_t> values;
+    for (size_t i = 0; i < 20; i++) {
+        values.push_back(i);
+    }
+    queue.push_bulk(values);
+    ASSERT_TRUE(values.empty());
+    ASSERT_EQ(20, queue.size());
+    ASSERT_EQ(12, queue.overflowsCount());
+
+    size_t next = 0;
+    std::vector<size_t> out;
+    while (queue.size() > 0) {
+        ASSERT_TRUE(queue.pop_bulk(out, 6));
+        ASSERT_LE(out.size(), 6);
+        for (size_t value: out) {
+            ASSERT_EQ(next++, value);
+        }
+    }
+    ASSERT_EQ(20, next);
+
+    queue.push(7);
+    queue.shutdown();
+    ASSERT_EQ(7, queue.pop().value());
+    ASSERT_FALSE(queue.pop());
+    ASSERT_FALSE(queue.pop_bulk(out, 4));
+    ASSERT_EQ(0, queue.parksCount());
+}
+
+TEST(UTILS, MpmcQueueParking) {
+    MpmcQueue<size_t> queue;
+    std::atomic<size_t> got = 0;
+    std::thread consumer([&]() { got = queue.pop().value_or(0); });
+
+    while (queue.parksCount() == 0) {
+        std::this_thread::yield();
+    }
+    queue.push(5);
+    consumer.join();
+    ASSERT_EQ(5, got.load());
+    ASSERT_EQ(1, queue.wakeupsCount());
+
+    // Nobody parked: the pushes make no syscall.
+    queue.push(6);
+    queue.push(7);
+    ASSERT_EQ(1, queue.wakeupsCount());
+
+    std::thread waiter([&]() {
+        std::vector<size_t> out;
+        while (queue.pop_bulk(out, 4)) {
+        }
+    });
+    queue.shutdown();
+    waiter.join();
+    ASSERT_EQ(0, queue.size());
+}
+
+TEST(UTILS, MpmcQueueContention) {
+    constexpr size_t ProducersCount = 4;
+    constexpr size_t ConsumersCount = 4;
+    constexpr size_t ValuesCount = 100000;
+
+    // Small enough to spill now and then.
+    MpmcQueue<size_t> queue(64);
+    std::atomic<size_t> sum = 0;
+    std::atomic<size_t> taken = 0;
+    std::vector<std::thread> consumers;
+    for (size_t i = 0; i < ConsumersCount; i++) {
+        consumers.emplace_back([&, i]() {
+            std::vector<size_t> out;
+            if (i % 2 == 0) {
+                while (auto value = queue.pop()) {
+                    sum += value.value();
+                    taken++;
+                }
+                return;
+            }
+
+            while (queue.pop_bulk(out, 8)) {
+                for (size_t value: out) {
+                    sum += value;
+                }
+                taken += out.size();
+            }
+        });
+    }
+
+    std::vector<std::thread> producers;
+    for (size_t p = 0; p < ProducersCount; p++) {
+        producers.emplace_back([&, p]() {
+            std::vector<size_t> values;
+            for (size_t i = 0; i < ValuesCount; i++) {
+                const size_t value = p * ValuesCount + i + 1;
+                if (p % 2 == 0) {
+                    queue.push(value);
+                    continue;
+                }
+
+                values.push_back(value);
+                if (values.size() == 16) {
+                    queue.push_bulk(values);
+                }
+            }
+            queue.push_bulk(values);
+        });
+    }
+
+    for (auto& t: producers) {
+        t.join();
+    }
+
+    const size_t total = ProducersCount * ValuesCount;
+    while (taken.load() < total) {
+        std::this_thread::yield();
+    }
+    queue.shutdown();
+    for (auto& t: consumers) {
+        t.join();
+    }
+
+    ASSERT_EQ(total * (total + 1) / 2, sum.load());
+    ASSERT_EQ(total, taken.load());
+    ASSERT_EQ(0, queue.size());
+}
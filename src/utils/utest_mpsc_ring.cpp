@@ -0,0 +1,128 @@
+/**********************************************
+   File:   utest_mpsc_ring.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+#include "mpsc_ring.h"
+#include "gtest/gtest.h"
+
+#include <poll.h>
+#include <thread>
+#include <vector>
+
+struct RingItem {
+    size_t producer;
+    size_t index;
+};
+
+using TestRing = MpscRing<RingItem>;
+
+TEST(UTILS, MpscRingBasic) {
+    TestRing ring(8);
+    ASSERT_EQ(0, ring.init().first);
+    ASSERT_EQ(8, ring.capacity());
+    ASSERT_TRUE(ring.empty());
+    ASSERT_EQ(nullptr, ring.next());
+
+    std::vector<RingItem> items(20);
+    for (size_t k = 0; k < 3; k++) {
+        for (auto& item: items) {
+            ring.push(&item);
+        }
+
+        // Past the capacity they spill, the order holds.
+        for (auto& item: items) {
+            ASSERT_EQ(&item, ring.next());
+        }
+        ASSERT_EQ(nullptr, ring.next());
+        ASSERT_TRUE(ring.empty());
+    }
+
+    ASSERT_EQ(3 * (items.size() - 8), ring.overflowsCount());
+    ASSERT_EQ(0, ring.wakeupsCount());
+}
+
+TEST(UTILS, MpscRingWakeup) {
+    TestRing ring;
+    ASSERT_EQ(0, ring.init().first);
+
+    RingItem item { .producer = 0, .index = 0 };
+    pollfd pfd { .fd = ring.getReadFd(), .events = POLLIN, .revents = 0 };
+
+    // Not armed: no syscall, nothing to read on the fd.
+    ring.push(&item);
+    ASSERT_EQ(0, poll(&pfd, 1, 0));
+    ASSERT_FALSE(ring.arm());
+    ASSERT_EQ(&item, ring.next());
+
+    // Armed: one wakeup, the following pushes are free again.
+    ASSERT_TRUE(ring.arm());
+    ring.push(&item);
+    ring.push(&item);
+    ASSERT_EQ(1, poll(&pfd, 1, 0));
+    ASSERT_EQ(1, ring.wakeupsCount());
+
+    ring.disarm();
+    ring.clearWakeup();
+    ASSERT_EQ(0, poll(&pfd, 1, 0));
+    ASSERT_EQ(&item, ring.next());
+    ASSERT_EQ(&item, ring.next());
+    ASSERT_EQ(nullptr, ring.next());
+}
+
+TEST(UTILS, MpscRingProducers) {
+    const size_t PRODUCERS = 4;
+    const size_t COUNT = 200000;
+
+    // Small, so the producers run into a full ring.
+    TestRing ring(256);
+    ASSERT_EQ(0, ring.init().first);
+
+    std::vector<std::vector<RingItem>> items(PRODUCERS, std::vector<RingItem>(COUNT));
+    std::vector<std::thread> producers;
+    for (size_t p = 0; p < PRODUCERS; p++) {
+        producers.emplace_back([&, p]() {
+            for (size_t i = 0; i < COUNT; i++) {
+                items[p][i] = RingItem { .producer = p, .index = i };
+                ring.push(&items[p][i]);
+            }
+        });
+    }
+
+    // The consumer sleeps like a reactor does, no wakeup may get lost.
+    std::vector<size_t> expected(PRODUCERS, 0);
+    size_t received = 0;
+    while (received < PRODUCERS * COUNT) {
+        if (ring.arm()) {
+            pollfd pfd { .fd = ring.getReadFd(), .events = POLLIN, .revents = 0 };
+            ASSERT_EQ(1, poll(&pfd, 1, 5000));
+            ring.clearWakeup();
+        }
+        ring.disarm();
+
+        while (RingItem* item = ring.next()) {
+            ASSERT_EQ(expected[item->producer], item->index);
+            expected[item->producer]++;
+            received++;
+        }
+    }
+
+    for (auto& t: producers) {
+        t.join();
+    }
+
+    ASSERT_EQ(nullptr, ring.next());
+    ASSERT_LT(ring.wakeupsCount(), PRODUCERS * COUNT);
+}
@@ -0,0 +1,196 @@
+/**********************************************
+   File:   utest_output_chain.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "output_chain.h"
+#include "gtest/gtest.h"
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+TEST(OUTPUT_CHAIN, Basics) {
+    OutputChain chain;
+    ASSERT_TRUE(chain.empty());
+
+    // Small copies are packed into one segment.
+    chain.append("Hello", 5);
+    chain.append(", ", 2);
+    ASSERT_EQ(1, chain.segmentsCount());
+
+    // Referenced data keeps its own segment and its address.
+    auto body = std::make_shared<const std::string>("world");
+    chain.append(body);
+    static const char tail[] = "!";
+    chain.appendStatic(tail, 1);
+    ASSERT_EQ(3, chain.segmentsCount());
+    ASSERT_EQ(13, chain.size());
+    ASSERT_EQ("Hello, world!", chain.toString());
+
+    iovec iov[8];
+    ASSERT_EQ(2, chain.fill(iov, 2));
+    ASSERT_EQ(3, chain.fill(iov, 8));
+    ASSERT_EQ(body->data(), iov[1].iov_base);
+    ASSERT_EQ(tail, iov[2].iov_base);
+
+    // Consume across a segment boundary.
+    chain.used(9);
+    ASSERT_EQ(2, chain.segmentsCount());
+    ASSERT_EQ("rld!", chain.toString());
+
+    chain.used(4);
+    ASSERT_TRUE(chain.empty());
+    ASSERT_EQ(0, chain.segmentsCount());
+}
+
+TEST(OUTPUT_CHAIN, LargeAndReuse) {
+    OutputChain chain;
+
+    std::string big(OutputChain::MaxCopySize + 1, 'A');
+    chain.append(big.data(), big.size());
+    chain.append("B", 1);
+    ASSERT_EQ(2, chain.segmentsCount());
+    ASSERT_EQ(big + "B", chain.toString());
+
+    iovec iov[2];
+    chain.fill(iov, 2);
+    const void* chunkData = iov[1].iov_base;
+
+    // A drained chain fills its chunk from the beginning again.
+    chain.used(chain.size());
+    chain.append("C", 1);
+    chain.fill(iov, 1);
+    ASSERT_EQ(chunkData, iov[0].iov_base);
+
+    // Many small pieces spill over into new chunks.
+    chain.clear();
+    const size_t COUNT = 3 * OutputChain::ChunkSize / 8;
+    for (uint64_t i = 0; i < COUNT; i++) {
+        chain.append((const char*)&i, sizeof(i));
+    }
+    ASSERT_EQ(COUNT * sizeof(uint64_t), chain.size());
+    ASSERT_EQ(3, chain.segmentsCount());
+
+    std::string str = chain.toString();
+    for (uint64_t i = 0; i < COUNT; i++) {
+        uint64_t val = 0;
+        memcpy(&val, str.data() + i * sizeof(val), sizeof(val));
+        ASSERT_EQ(i, val);
+    }
+}
+
+TEST(OUTPUT_CHAIN, Splice) {
+    OutputChain output;
+    output.append("head", 4);
+
+    OutputChain pushed;
+    pushed.append("1", 1);
+    pushed.append(std::make_shared<const std::string>("22"));
+    output.splice(pushed);
+    ASSERT_TRUE(pushed.empty());
+    ASSERT_EQ(0, pushed.segmentsCount());
+    ASSERT_EQ("head122", output.toString());
+
+    // The spliced chain packs on into the chunk it has, past the bytes moved away.
+    pushed.append("3", 1);
+    output.splice(pushed);
+    ASSERT_EQ("head1223", output.toString());
+    ASSERT_EQ(4, output.segmentsCount());
+
+    output.used(6);
+    ASSERT_EQ("23", output.toString());
+}
+
+TEST(OUTPUT_CHAIN, KeepOwners) {
+    OutputChain chain;
+
+    auto body = std::make_shared<const std::string>(OutputChain::MaxCopySize * 2, 'B');
+    chain.append("H", 1);
+    chain.append(body);
+    chain.append(body);
+    chain.append("T", 1);
+
+    // The chunk and the body are referenced once each, however many segments use them.
+    std::vector<OutputChain::Owner> owners;
+    chain.used(1 + body->size() + 1, &owners);
+    ASSERT_EQ(2, owners.size());
+    ASSERT_EQ(3, body.use_count());
+
+    // The chunk is still held, so new data can't overwrite the sent bytes.
+    iovec iov[2];
+    chain.used(chain.size() - 1);
+    chain.fill(iov, 1);
+    const char* t = (const char*)iov[0].iov_base;
+    chain.used(1);
+    chain.append("X", 1);
+    chain.fill(iov, 1);
+    ASSERT_NE(t - 1, iov[0].iov_base);
+    ASSERT_EQ('H', *(t - 1));
+}
+
+TEST(OUTPUT_CHAIN, FileSegments) {
+    char path[] = "/tmp/output_chain_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    const std::string content = "0123456789";
+    ASSERT_EQ((ssize_t)content.size(), write(fd, content.data(), content.size()));
+    close(fd);
+
+    auto file = OutputFile::open(path);
+    unlink(path);
+    ASSERT_TRUE(file);
+    ASSERT_EQ(content.size(), file->size());
+    ASSERT_FALSE(OutputFile::open("/tmp"));
+
+    OutputChain chain;
+    chain.append("<", 1);
+    chain.appendFile(file, 2, 5);
+    chain.append(">", 1);
+    ASSERT_EQ(7, chain.size());
+    ASSERT_EQ("<23456>", chain.toString());
+
+    // Memory segments are described up to the file segment.
+    iovec iov[4];
+    ASSERT_EQ(1, chain.fill(iov, 4));
+    ASSERT_FALSE(chain.frontFile());
+
+    // describe() goes past it.
+    OutputChain::Slice slices[4];
+    ASSERT_EQ(3, chain.describe(slices, 4));
+    ASSERT_EQ(-1, slices[0].fd);
+    ASSERT_EQ(1, slices[0].size);
+    ASSERT_EQ(file->fd(), slices[1].fd);
+    ASSERT_EQ(2, slices[1].offset);
+    ASSERT_EQ(5, slices[1].size);
+    ASSERT_EQ(">", std::string(slices[2].ptr, slices[2].size));
+    ASSERT_EQ(2, chain.describe(slices, 2));
+    chain.used(1);
+
+    auto slice = chain.frontFile();
+    ASSERT_TRUE(slice);
+    ASSERT_EQ(file->fd(), slice->fd);
+    ASSERT_EQ(2, slice->offset);
+    ASSERT_EQ(5, slice->size);
+    ASSERT_EQ(0, chain.fill(iov, 4));
+
+    chain.used(3);
+    slice = chain.frontFile();
+    ASSERT_EQ(5, slice->offset);
+    ASSERT_EQ(2, slice->size);
+
+    chain.used(2);
+    ASSERT_EQ(">", chain.toString());
+}
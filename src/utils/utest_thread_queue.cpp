@@ -0,0 +1,109 @@
+/**********************************************
+   File:   utest_thread_queue.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+
+#include "thread_queue.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST(UTILS, ThreadQueueBulk) {
+    ThreadQueue<size_t> queue;
+    std::vector<size_t> values = { 1, 2, 3, 4, 5 };
+    queue.push_bulk(values);
+    ASSERT_TRUE(values.empty());
+    ASSERT_EQ(5, queue.size());
+
+    queue.push(6);
+    std::vector<size_t> out;
+    ASSERT_TRUE(queue.pop_bulk(out, 4));
+    ASSERT_EQ((std::vector<size_t>{ 1, 2, 3, 4 }), out);
+    ASSERT_TRUE(queue.pop_bulk(out, 4));
+    ASSERT_EQ((std::vector<size_t>{ 5, 6 }), out);
+    ASSERT_EQ(0, queue.size());
+    ASSERT_EQ(0, queue.headWait().count());
+
+    queue.push(7);
+    queue.shutdown();
+    ASSERT_TRUE(queue.pop_bulk(out, 4));
+    ASSERT_EQ((std::vector<size_t>{ 7 }), out);
+    ASSERT_FALSE(queue.pop_bulk(out, 4));
+    ASSERT_TRUE(out.empty());
+}
+
+TEST(UTILS, ThreadQueueTrackWait) {
+    ThreadQueue<size_t> queue;
+    queue.push(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    ASSERT_EQ(0, queue.headWait().count());
+
+    // The untracked head keeps 0 until it leaves.
+    queue.trackWait();
+    queue.push(2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    ASSERT_EQ(0, queue.headWait().count());
+    ASSERT_EQ(1, queue.pop().value());
+    ASSERT_GE(queue.headWait(), std::chrono::milliseconds(2));
+    ASSERT_EQ(2, queue.pop().value());
+    ASSERT_EQ(0, queue.headWait().count());
+}
+
+TEST(UTILS, ThreadQueueBulkConsumers) {
+    constexpr size_t ConsumersCount = 4;
+    constexpr size_t BatchesCount = 2000;
+    constexpr size_t BatchSize = 32;
+
+    ThreadQueue<size_t> queue;
+    std::atomic<size_t> sum = 0;
+    std::atomic<size_t> taken = 0;
+    std::vector<std::thread> consumers;
+    for (size_t i = 0; i < ConsumersCount; i++) {
+        consumers.emplace_back([&]() {
+            std::vector<size_t> out;
+            while (queue.pop_bulk(out, 8)) {
+                ASSERT_LE(out.size(), 8);
+                for (size_t value: out) {
+                    sum += value;
+                }
+                taken += out.size();
+            }
+        });
+    }
+
+    size_t expected = 0;
+    std::vector<size_t> values;
+    for (size_t k = 0; k < BatchesCount; k++) {
+        for (size_t i = 0; i < BatchSize; i++) {
+            values.push_back(k * BatchSize + i);
+            expected += values.back();
+        }
+        queue.push_bulk(values);
+    }
+
+    while (taken.load() < BatchesCount * BatchSize) {
+        std::this_thread::yield();
+    }
+    queue.shutdown();
+    for (auto& t: consumers) {
+        t.join();
+    }
+
+    ASSERT_EQ(expected, sum.load());
+    ASSERT_EQ(0, queue.size());
+}
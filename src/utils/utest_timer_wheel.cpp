@@ -0,0 +1,152 @@
+/**********************************************
+   File:   utest_timer_wheel.cpp
+
+   Copyright 2025 Michael Popov
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ **********************************************/
+#include "timer_wheel.h"
+#include "gtest/gtest.h"
+#include <memory>
+#include <random>
+#include <vector>
+
+TEST(TIMER_WHEEL, Basics) {
+    TimerWheel wheel(1000);
+    ASSERT_EQ(-1, wheel.nextTimeout(1000));
+
+    std::vector<int> fired;
+    Timer a([&]() { fired.push_back(1); });
+    Timer b([&]() { fired.push_back(2); });
+    Timer c([&]() { fired.push_back(3); });
+
+    wheel.armAfter(&a, 10);
+    wheel.armAfter(&b, 5);
+    wheel.armAfter(&c, 20);
+    ASSERT_EQ(3, wheel.size());
+    ASSERT_EQ(5, wheel.nextTimeout(1000));
+    ASSERT_EQ(2, wheel.nextTimeout(1003));
+
+    // A cancelled timer never fires, a re-armed one moves.
+    c.cancel();
+    ASSERT_FALSE(c.armed());
+    wheel.arm(&b, 1015);
+    ASSERT_EQ(2, wheel.size());
+
+    ASSERT_EQ(0, wheel.advance(1009));
+    ASSERT_EQ(1, wheel.advance(1010));
+    ASSERT_EQ(std::vector<int>({1}), fired);
+    ASSERT_FALSE(a.armed());
+
+    ASSERT_EQ(1, wheel.advance(1100));
+    ASSERT_EQ(std::vector<int>({1, 2}), fired);
+    ASSERT_EQ(0, wheel.size());
+
+    // Deadlines in the past fire with the next tick.
+    wheel.arm(&a, 50);
+    ASSERT_EQ(1, wheel.nextTimeout(1100));
+    ASSERT_EQ(1, wheel.advance(1101));
+}
+
+TEST(TIMER_WHEEL, Cascade) {
+    TimerWheel wheel(7);
+
+    // Every level, and beyond the top level.
+    const std::vector<uint64_t> delays = { 1, 63, 64, 65, 100, 4095, 4096, 5000, 262143, 262144,
+                                           300001, 16777215, 16777216, 20000000, 40000000 };
+
+    std::vector<std::unique_ptr<Timer>> timers;
+    std::vector<uint64_t> firedAt(delays.size(), 0);
+    for (size_t i = 0; i < delays.size(); i++) {
+        timers.emplace_back(std::make_unique<Timer>([&, i]() { firedAt[i] = wheel.now(); }));
+        wheel.armAfter(timers.back().get(), delays[i]);
+    }
+
+    // Jump from deadline to deadline the way a reactor does.
+    uint64_t now = wheel.now();
+    while (wheel.size() > 0) {
+        const int64_t timeout = wheel.nextTimeout(now);
+        ASSERT_GE(timeout, 0);
+        now += timeout;
+        wheel.advance(now);
+    }
+
+    for (size_t i = 0; i < delays.size(); i++) {
+        ASSERT_EQ(7 + delays[i], firedAt[i]) << "delay " << delays[i];
+    }
+}
+
+TEST(TIMER_WHEEL, CallbacksRearmAndCancel) {
+    TimerWheel wheel;
+
+    // A periodic timer re-arms itself and cancels its peer at the end.
+    size_t ticks = 0;
+    Timer other([]() { FAIL(); });
+    Timer periodic;
+    periodic.setCallback([&]() {
+        if (++ticks < 10) {
+            wheel.armAfter(&periodic, 100);
+        } else {
+            other.cancel();
+        }
+    });
+
+    wheel.armAfter(&periodic, 100);
+    wheel.armAfter(&other, 2000);
+
+    // Two timers of the same tick, the first one deletes the second.
+    auto victim = std::make_unique<Timer>([]() { FAIL(); });
+    Timer killer([&]() { victim.reset(); });
+    wheel.armAfter(&killer, 50);
+    wheel.armAfter(victim.get(), 50);
+
+    ASSERT_EQ(11, wheel.advance(1000));
+    ASSERT_EQ(10, ticks);
+    ASSERT_EQ(nullptr, victim);
+    ASSERT_EQ(0, wheel.size());
+}
+
+TEST(TIMER_WHEEL, Random) {
+    TimerWheel wheel(123456);
+    std::mt19937 rng(1);
+
+    const size_t COUNT = 10000;
+    std::vector<std::unique_ptr<Timer>> timers;
+    std::vector<uint64_t> deadlines(COUNT);
+    size_t late = 0;
+    size_t fired = 0;
+
+    for (size_t i = 0; i < COUNT; i++) {
+        timers.emplace_back(std::make_unique<Timer>([&, i]() {
+            fired++;
+            late += wheel.now() != deadlines[i];
+        }));
+
+        deadlines[i] = wheel.now() + 1 + rng() % 500000;
+        wheel.arm(timers.back().get(), deadlines[i]);
+    }
+
+    // Cancel every third one.
+    for (size_t i = 0; i < COUNT; i += 3) {
+        timers[i]->cancel();
+    }
+
+    uint64_t now = wheel.now();
+    while (wheel.size() > 0) {
+        now += 1 + rng() % 1000;
+        wheel.advance(now);
+    }
+
+    ASSERT_EQ(COUNT - (COUNT + 2) / 3, fired);
+    ASSERT_EQ(0, late);
+}